@@ -0,0 +1,489 @@
+#include "build_cache.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "code_converter.h"
+#include "file_utils/file_utils.h"
+#include "md5/md5.h"
+#include "stb/stb_ds.h"
+#include "string/sds.h"
+#include "string_utils.h"
+
+#define MD5_HEX_SIZE 33
+
+struct cache_entry {
+    sds path;
+    uint64_t size;
+    struct timespec last_use;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static sds cache_dir              = NULL;
+static sds compiler_version       = NULL;
+static uint64_t cache_size_limit  = (uint64_t) BUILD_CACHE_DEFAULT_SIZE_MB * 1024 * 1024;
+static unsigned int cache_hits    = 0;
+static unsigned int cache_misses  = 0;
+static unsigned int result_hits   = 0;
+static unsigned int result_misses = 0;
+
+static void key_to_hex(const uint8_t key[16], char hex[MD5_HEX_SIZE]) {
+    for(int i = 0; i < 16; i++) {
+        sprintf(hex + 2 * i, "%02x", key[i]);
+    }
+}
+
+static bool create_dir_recursive(const char *path) {
+
+    sds partial = sdsempty();
+    bool ok     = true;
+
+    for(const char *c = path; *c && ok; c++) {
+        partial = sdscatlen(partial, c, 1);
+        if(c[1] == '/' || c[1] == '\0') {
+            if(mkdir(partial, 0755) == -1 && errno != EEXIST) {
+                ok = false;
+            }
+        }
+    }
+
+    sdsfree(partial);
+    return ok;
+}
+
+// Must be called with cache_lock held. Returns NULL when the directory can not be created
+static const char *resolve_cache_dir(void) {
+
+    if(cache_dir == NULL) {
+        const char *xdg_cache = getenv("XDG_CACHE_HOME");
+
+        if(xdg_cache && *xdg_cache) {
+            cache_dir = sdscatfmt(sdsempty(), "%s/%s", xdg_cache, BUILD_CACHE_DIR_NAME);
+        } else {
+            cache_dir = sdscatfmt(sdsempty(), "%s/.cache/%s", get_home_dir(), BUILD_CACHE_DIR_NAME);
+        }
+    }
+
+    if(!create_dir_recursive(cache_dir)) {
+        return NULL;
+    }
+
+    return cache_dir;
+}
+
+// Must be called with cache_lock held. Returns NULL when the cache is disabled
+static const char *get_cache_dir(void) {
+
+    if(cache_size_limit == 0) {
+        return NULL;
+    }
+
+    return resolve_cache_dir();
+}
+
+// Must be called with cache_lock held
+static const char *get_compiler_version(const char *compiler) {
+
+    if(compiler_version == NULL) {
+        compiler_version = sdsempty();
+
+        sds command = sdscatfmt(sdsempty(), "%s -dumpfullversion -dumpversion 2>/dev/null", compiler);
+        FILE *fp    = popen(command, "r");
+
+        if(fp) {
+            char line[256];
+            while(fgets(line, sizeof(line), fp) != NULL) {
+                compiler_version = sdscat(compiler_version, line);
+            }
+            pclose(fp);
+        }
+
+        sdsfree(command);
+    }
+
+    return compiler_version;
+}
+
+static void md5_update_string(MD5Context *ctx, const char *str) {
+    //the terminator separates the fields, so "ab" + "c" and "a" + "bc" give different keys
+    md5Update(ctx, (uint8_t *) str, strlen(str) + 1);
+}
+
+bool get_build_cache_key(const char *source_file, const char *compiler, const char *flags, uint8_t key[16]) {
+
+    FILE *fp = fopen(source_file, "rb");
+
+    if(!fp) {
+        return false;
+    }
+
+    MD5Context ctx;
+    md5Init(&ctx);
+
+    uint8_t buffer[8192];
+    size_t n;
+
+    while((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        md5Update(&ctx, buffer, n);
+    }
+
+    fclose(fp);
+
+    pthread_mutex_lock(&cache_lock);
+    const char *version = get_compiler_version(compiler);
+    md5_update_string(&ctx, "\n");
+    md5_update_string(&ctx, compiler);
+    md5_update_string(&ctx, version);
+    md5_update_string(&ctx, flags);
+    md5_update_string(&ctx, BUILD_CACHE_VERSION);
+    pthread_mutex_unlock(&cache_lock);
+
+    md5Finalize(&ctx);
+    memcpy(key, ctx.digest, 16);
+
+    return true;
+}
+
+static sds get_entry_path(const char *dir, const uint8_t key[16], const char *suffix) {
+    char hex[MD5_HEX_SIZE];
+    key_to_hex(key, hex);
+    return sdscatfmt(sdsempty(), "%s/%s%s", dir, hex, suffix);
+}
+
+// Must be called with cache_lock held
+static bool copy_from_cache(const char *entry, const char *to, mode_t mode) {
+
+    if(!file_exists(entry)) {
+        return false;
+    }
+
+    //a running solver can still be using the old file, so it is replaced instead of overwritten
+    unlink(to);
+
+    if(cp_file(to, entry, true) != 0 || chmod(to, mode) != 0) {
+        return false;
+    }
+
+    //the modification time of an entry is its last use
+    utimensat(AT_FDCWD, entry, NULL, 0);
+
+    return true;
+}
+
+// Must be called with cache_lock held. The file is written under a temporary name and renamed, so other shells sharing
+// the cache never see a partial entry
+static bool copy_to_cache(const char *from, const char *entry, mode_t mode) {
+
+    sds tmp_entry = sdscatfmt(sdsempty(), "%s.XXXXXX", entry);
+    bool copied   = false;
+
+    int fd = mkstemp(tmp_entry);
+
+    if(fd != -1) {
+        close(fd);
+
+        copied = cp_file(tmp_entry, from, true) == 0 && chmod(tmp_entry, mode) == 0 && rename(tmp_entry, entry) == 0;
+
+        if(!copied) {
+            unlink(tmp_entry);
+        }
+    }
+
+    sdsfree(tmp_entry);
+
+    return copied;
+}
+
+// Copies the cached executable for key to executable. Returns false on a miss
+bool fetch_from_build_cache(const uint8_t key[16], const char *executable) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = get_cache_dir();
+
+    if(!dir) {
+        pthread_mutex_unlock(&cache_lock);
+        return false;
+    }
+
+    sds entry = get_entry_path(dir, key, "");
+    bool hit  = copy_from_cache(entry, executable, 0755);
+
+    if(hit) {
+        cache_hits++;
+    } else {
+        cache_misses++;
+    }
+
+    sdsfree(entry);
+    pthread_mutex_unlock(&cache_lock);
+
+    return hit;
+}
+
+// Entries are named after their key, followed by a suffix for solve results. Temporary files are skipped
+static bool is_cache_entry_name(const char *name) {
+
+    for(int i = 0; i < MD5_HEX_SIZE - 1; i++) {
+        if(!isxdigit((unsigned char) name[i])) return false;
+    }
+
+    const char *suffix = name + MD5_HEX_SIZE - 1;
+
+    return STR_EQUALS(suffix, "") || STR_EQUALS(suffix, RESULT_CACHE_SUFFIX) || STR_EQUALS(suffix, RESULT_CACHE_SUFFIX RUN_STATS_FILE_SUFFIX);
+}
+
+static struct cache_entry *read_cache_entries(const char *dir, uint64_t *total_size) {
+
+    struct cache_entry *entries = NULL;
+    *total_size                 = 0;
+
+    DIR *d = opendir(dir);
+
+    if(!d) {
+        return NULL;
+    }
+
+    struct dirent *de;
+
+    while((de = readdir(d)) != NULL) {
+
+        if(!is_cache_entry_name(de->d_name)) {
+            continue;
+        }
+
+        sds path = sdscatfmt(sdsempty(), "%s/%s", dir, de->d_name);
+        struct stat st;
+
+        if(stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+            sdsfree(path);
+            continue;
+        }
+
+        struct cache_entry entry = {.path = path, .size = (uint64_t) st.st_size, .last_use = st.st_mtim};
+        arrput(entries, entry);
+        *total_size += entry.size;
+    }
+
+    closedir(d);
+
+    return entries;
+}
+
+static void free_cache_entries(struct cache_entry *entries) {
+    for(int i = 0; i < arrlen(entries); i++) {
+        sdsfree(entries[i].path);
+    }
+    arrfree(entries);
+}
+
+static int compare_entries_by_last_use(const void *a, const void *b) {
+
+    const struct timespec *ta = &((const struct cache_entry *) a)->last_use;
+    const struct timespec *tb = &((const struct cache_entry *) b)->last_use;
+
+    if(ta->tv_sec != tb->tv_sec) return ta->tv_sec < tb->tv_sec ? -1 : 1;
+    if(ta->tv_nsec != tb->tv_nsec) return ta->tv_nsec < tb->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Must be called with cache_lock held. The most recently used entry is always kept
+static void evict_least_recently_used(const char *dir) {
+
+    uint64_t total_size;
+    struct cache_entry *entries = read_cache_entries(dir, &total_size);
+    int n_entries               = (int) arrlen(entries);
+
+    if(total_size > cache_size_limit) {
+        qsort(entries, n_entries, sizeof(struct cache_entry), compare_entries_by_last_use);
+
+        for(int i = 0; i < n_entries - 1 && total_size > cache_size_limit; i++) {
+            if(unlink(entries[i].path) == 0) {
+                total_size -= entries[i].size;
+            }
+        }
+    }
+
+    free_cache_entries(entries);
+}
+
+void store_in_build_cache(const uint8_t key[16], const char *executable) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = get_cache_dir();
+
+    if(dir) {
+        sds entry = get_entry_path(dir, key, "");
+
+        if(copy_to_cache(executable, entry, 0755)) {
+            evict_least_recently_used(dir);
+        }
+
+        sdsfree(entry);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// The key of a solve result is the key of the executable plus everything else that was passed to it (e.g., the final time)
+void get_result_cache_key(const uint8_t build_key[16], const char *options, uint8_t key[16]) {
+
+    MD5Context ctx;
+    md5Init(&ctx);
+
+    md5_update_string(&ctx, "result");
+    md5Update(&ctx, (uint8_t *) build_key, 16);
+    md5_update_string(&ctx, options);
+
+    md5Finalize(&ctx);
+    memcpy(key, ctx.digest, 16);
+}
+
+// Copies a cached solve result (the output and its statistics sidecar) to output_file. Returns false on a miss
+bool fetch_result_from_cache(const uint8_t key[16], const char *output_file) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = get_cache_dir();
+
+    if(!dir) {
+        pthread_mutex_unlock(&cache_lock);
+        return false;
+    }
+
+    sds entry       = get_entry_path(dir, key, RESULT_CACHE_SUFFIX);
+    sds stats_entry = get_entry_path(dir, key, RESULT_CACHE_SUFFIX RUN_STATS_FILE_SUFFIX);
+    sds stats_file  = sdscatfmt(sdsempty(), "%s%s", output_file, RUN_STATS_FILE_SUFFIX);
+
+    //both parts are needed, as the LRU eviction can remove one of them
+    bool hit = file_exists(entry) && file_exists(stats_entry) && copy_from_cache(entry, output_file, 0644) &&
+               copy_from_cache(stats_entry, stats_file, 0644);
+
+    if(hit) {
+        result_hits++;
+    } else {
+        result_misses++;
+    }
+
+    sdsfree(entry);
+    sdsfree(stats_entry);
+    sdsfree(stats_file);
+    pthread_mutex_unlock(&cache_lock);
+
+    return hit;
+}
+
+// Results bigger than a quarter of the cache are not stored, so one long run does not evict everything else
+void store_result_in_cache(const uint8_t key[16], const char *output_file) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = get_cache_dir();
+    struct stat st;
+
+    if(dir && stat(output_file, &st) == 0 && (uint64_t) st.st_size <= cache_size_limit / 4) {
+
+        sds entry       = get_entry_path(dir, key, RESULT_CACHE_SUFFIX);
+        sds stats_entry = get_entry_path(dir, key, RESULT_CACHE_SUFFIX RUN_STATS_FILE_SUFFIX);
+        sds stats_file  = sdscatfmt(sdsempty(), "%s%s", output_file, RUN_STATS_FILE_SUFFIX);
+
+        if(copy_to_cache(stats_file, stats_entry, 0644) && copy_to_cache(output_file, entry, 0644)) {
+            evict_least_recently_used(dir);
+        }
+
+        sdsfree(entry);
+        sdsfree(stats_entry);
+        sdsfree(stats_file);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+bool is_build_cache_enabled(void) {
+    pthread_mutex_lock(&cache_lock);
+    bool enabled = cache_size_limit > 0;
+    pthread_mutex_unlock(&cache_lock);
+    return enabled;
+}
+
+void set_build_cache_size_limit(uint64_t size_limit) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    cache_size_limit = size_limit;
+
+    const char *dir = get_cache_dir();
+    if(dir) {
+        evict_least_recently_used(dir);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// Returns false when the cache is disabled. The directory in info is owned by the cache
+bool get_build_cache_info(struct build_cache_info *info) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = get_cache_dir();
+
+    info->dir        = dir;
+    info->size_limit = cache_size_limit;
+    info->hits       = cache_hits;
+    info->misses     = cache_misses;
+    info->result_hits   = result_hits;
+    info->result_misses = result_misses;
+    info->n_entries  = 0;
+    info->size       = 0;
+
+    if(dir) {
+        struct cache_entry *entries = read_cache_entries(dir, &info->size);
+
+        //a result and its statistics sidecar are one entry
+        for(int i = 0; i < arrlen(entries); i++) {
+            size_t len = sdslen(entries[i].path);
+            if(len < strlen(RUN_STATS_FILE_SUFFIX) || !STR_EQUALS(entries[i].path + len - strlen(RUN_STATS_FILE_SUFFIX), RUN_STATS_FILE_SUFFIX)) {
+                info->n_entries++;
+            }
+        }
+        free_cache_entries(entries);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return dir != NULL;
+}
+
+// Returns the number of removed entries or -1 when the cache directory can not be accessed
+int clear_build_cache(void) {
+
+    pthread_mutex_lock(&cache_lock);
+
+    const char *dir = resolve_cache_dir();
+    int removed     = -1;
+
+    if(dir) {
+        uint64_t total_size;
+        struct cache_entry *entries = read_cache_entries(dir, &total_size);
+
+        removed = 0;
+        for(int i = 0; i < arrlen(entries); i++) {
+            if(unlink(entries[i].path) == 0) removed++;
+        }
+
+        free_cache_entries(entries);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return removed;
+}
@@ -0,0 +1,43 @@
+#ifndef __BUILD_CACHE_H
+#define __BUILD_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Compiled models are kept in $XDG_CACHE_HOME/odecompiler (~/.cache/odecompiler by default), one executable per entry.
+// Entries are named after the md5 of the generated C source, the compiler, its version, the flags and BUILD_CACHE_VERSION,
+// so a model is only compiled again when any of them changes. The least recently used entries are removed when the
+// cache grows past its size limit. A limit of 0 disables the cache.
+// Solve results are kept in the same directory as RESULT_CACHE_SUFFIX entries (plus their statistics sidecar), keyed by the
+// executable key and the options the solver was run with.
+#define BUILD_CACHE_DIR_NAME "odecompiler"
+#define RESULT_CACHE_SUFFIX ".out"
+#define BUILD_CACHE_VERSION "1"
+#define BUILD_CACHE_DEFAULT_SIZE_MB 256
+
+struct build_cache_info {
+    const char *dir;
+    unsigned int n_entries;
+    uint64_t size;
+    uint64_t size_limit;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int result_hits;
+    unsigned int result_misses;
+};
+
+bool get_build_cache_key(const char *source_file, const char *compiler, const char *flags, uint8_t key[16]);
+bool fetch_from_build_cache(const uint8_t key[16], const char *executable);
+void store_in_build_cache(const uint8_t key[16], const char *executable);
+
+void get_result_cache_key(const uint8_t build_key[16], const char *options, uint8_t key[16]);
+bool fetch_result_from_cache(const uint8_t key[16], const char *output_file);
+void store_result_in_cache(const uint8_t key[16], const char *output_file);
+
+bool is_build_cache_enabled(void);
+void set_build_cache_size_limit(uint64_t size_limit);
+bool get_build_cache_info(struct build_cache_info *info);
+int clear_build_cache(void);
+
+#endif /* __BUILD_CACHE_H */
@@ -1,5 +1,6 @@
 #include "code_converter.h"
 #include "stb/stb_ds.h"
+#include "string_utils.h"
 #include <assert.h>
 #include <sys/types.h>
 
@@ -9,12 +10,14 @@
                         "#include <stdio.h>\n"   \
                         "#include <stdlib.h>\n"  \
                         "#include <float.h>\n"   \
-                        "#include <string.h>\n"
+                        "#include <string.h>\n" \
+                        "#include <pthread.h>\n"\
+                        "#include <signal.h>\n"\
+                        "#include <sys/time.h>\n"\
+                        "#include <time.h>\n"
 
 #define WRITE_NEQ fprintf(file, "#define NEQ %d\n", (int) arrlen(initial));
-
-struct var_declared_entry_t *var_declared = NULL;
-struct var_declared_entry_t *ode_position = NULL;
+#define WRITE_NREC fprintf(file, "#define NREC %d\n#define NSTATS (NEQ + NREC)\n", (int) arrlen(solver_config->recorded_vars));
 
 static sds ast_to_c(ast *a, solver_config *solver_config);
 
@@ -74,7 +77,7 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
             buf     = sdscatfmt(buf, "%s%s = %s", indent_spaces[indentation_level], a->assignment_stmt.name->identifier.value, tmp);
             sdsfree(tmp);
         } else {
-            int declared        = shgeti(var_declared, a->assignment_stmt.name->identifier.value) != -1;
+            int declared        = hmgeti(solver_config->var_declared, a->assignment_stmt.name->identifier.symbol) != -1;
             bool has_ode_symbol = (a->assignment_stmt.name->identifier.value[strlen(a->assignment_stmt.name->identifier.value) - 1] == '\'');
 
             if(has_ode_symbol) {
@@ -96,7 +99,7 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
                     if(a->assignment_stmt.unit != NULL) {
                         buf = sdscatfmt(buf, " //%s", a->assignment_stmt.unit);
                     }
-                    shput(var_declared, a->assignment_stmt.name->identifier.value, 1);
+                    hmput(solver_config->var_declared, a->assignment_stmt.name->identifier.symbol, 1);
                     sdsfree(tmp);
                 } else {
                     sds tmp = ast_to_c(a->assignment_stmt.value, solver_config);
@@ -115,6 +118,7 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
         if(n == 1) {
 
             char *id_name  = variables[0]->identifier.value;
+            symbol_id id   = variables[0]->identifier.symbol;
             ast *call_expr = a->grouped_assignment_stmt.call_expr;
 
             int global     = variables[0]->identifier.global;
@@ -124,7 +128,7 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
                 buf     = sdscatfmt(buf, "%s%s = %s;\n", indent_spaces[indentation_level], id_name, tmp);
                 sdsfree(tmp);
             } else {
-                int declared = shgeti(var_declared, id_name) != -1;
+                int declared = hmgeti(solver_config->var_declared, id) != -1;
 
                 if(!declared) {
                     sds tmp = ast_to_c(call_expr, solver_config);
@@ -133,7 +137,7 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
                         tmp = sdscatfmt(tmp, " //%s", a->assignment_stmt.unit);
                     }
 
-                    shput(var_declared, id_name, 1);
+                    hmput(solver_config->var_declared, id, 1);
                     sdsfree(tmp);
                 } else {
                     sds tmp = ast_to_c(call_expr, solver_config);
@@ -150,11 +154,11 @@ static sds assignment_stmt_to_c(ast *a, solver_config *solver_config) {
 
                 if(!global) {
 
-                    int declared = shgeti(var_declared, id->identifier.value) != -1;
+                    int declared = hmgeti(solver_config->var_declared, id->identifier.symbol) != -1;
 
                     if(!declared) {
                         buf = sdscatfmt(buf, "%s%s %s;\n", indent_spaces[indentation_level], var_type, id->identifier.value);
-                        shput(var_declared, id->identifier.value, 1);
+                        hmput(solver_config->var_declared, id->identifier.symbol, 1);
                     }
                 }
             }
@@ -361,7 +365,8 @@ static sds call_expr_to_c(ast *a, solver_config *solver_config) {
         if(is_export_fn) {
             sds ode_name = sdsdup(tmp);
             ode_name     = sdscat(ode_name, "'");
-            int position = shget(ode_position, ode_name);
+            //a name that was never interned is not an ODE of the model
+            int position = hmget(solver_config->ode_position, find_symbol(ode_name, sdslen(ode_name)));
             sdsfree(ode_name);
             buf = sdscatfmt(buf, "%i", position - 1);
         } else {
@@ -580,6 +585,460 @@ static void create_export_functions(FILE *f) {
     fprintf(f, "}\n\n");
 }
 
+// Name shown for a top-level statement of the RHS in the profile of the solver
+static sds get_profile_statement_label(ast *a) {
+
+    switch(a->tag) {
+        case ast_ode_stmt:
+        case ast_assignment_stmt:
+            return sdsnew(a->assignment_stmt.name->identifier.value);
+        case ast_grouped_assignment_stmt: {
+            sds label = sdsempty();
+            for(int i = 0; i < arrlen(a->grouped_assignment_stmt.names); i++) {
+                label = sdscatfmt(label, "%s%s", i ? "," : "", a->grouped_assignment_stmt.names[i]->identifier.value);
+            }
+            return label;
+        }
+        case ast_if_expr:
+            return sdsnew("if");
+        case ast_while_stmt:
+            return sdsnew("while");
+        case ast_expression_stmt:
+            if(a->expr_stmt != NULL && a->expr_stmt->tag == ast_call_expression) {
+                return sdscatfmt(sdsempty(), "%s()", a->expr_stmt->call_expr.function_identifier->identifier.value);
+            }
+            return sdsnew("expression");
+        default:
+            return sdsnew("statement");
+    }
+}
+
+// Counters of the integration, written after the statistics of the variables (see RUN_STATS_FILE_SUFFIX). The time
+// spent in each region of the solver is sampled with a timer, so the RHS only pays for a store to __solver_region__.
+// The timer only runs in the profiling builds or with SAMPLE_REGIONS_FLAG
+static void create_solver_stats_functions(FILE *f, program main_body, solver_config *solver_config) {
+
+    bool profile = solver_config->profile_statements;
+
+    fprintf(f, "#define __REGION_SOLVER__ 0\n"
+               "#define __REGION_RHS__ 1\n"
+               "#define __REGION_OUTPUT__ 2\n\n");
+
+    fprintf(f, "typedef struct __solver_stats__t {\n"
+               "    uint64_t rhs_evals;\n"
+               "    uint64_t accepted_steps;\n"
+               "    uint64_t rejected_steps;\n"
+               "    uint64_t lin_solv_setups;\n"
+               "    real min_dt;\n"
+               "    real max_dt;\n"
+               "    real sum_dt;\n"
+               "    double start_time;\n"
+               "    uint64_t samples[3];\n"
+               "} __solver_stats__;\n\n");
+
+    fprintf(f, "static __solver_stats__ __solver_stats_values__ = {.min_dt = DBL_MAX};\n"
+               "static volatile sig_atomic_t __solver_region__ = __REGION_SOLVER__;\n"
+               "static bool __sample_regions__ = %s;\n\n", profile ? "true" : "false");
+
+    if(profile) {
+        int n_stmt = arrlen(main_body);
+
+        fprintf(f, "#define __N_PROFILE_STMTS__ %d\n", n_stmt > 0 ? n_stmt : 1);
+        fprintf(f, "static volatile sig_atomic_t __profile_stmt__ = 0;\n"
+                   "static uint64_t __profile_samples__[__N_PROFILE_STMTS__];\n");
+
+        fprintf(f, "static const int __profile_stmt_lines__[__N_PROFILE_STMTS__] = {");
+        for(int i = 0; i < n_stmt; i++) {
+            fprintf(f, "%s%u", i ? ", " : "", main_body[i]->token.line_number);
+        }
+        fprintf(f, "%s};\n", n_stmt ? "" : "0");
+
+        fprintf(f, "static const char *__profile_stmt_names__[__N_PROFILE_STMTS__] = {");
+        for(int i = 0; i < n_stmt; i++) {
+            sds label = get_profile_statement_label(main_body[i]);
+            fprintf(f, "%s\"%s\"", i ? ", " : "", label);
+            sdsfree(label);
+        }
+        fprintf(f, "%s};\n\n", n_stmt ? "" : "\"\"");
+    }
+
+    fprintf(f, "static void __sample_solver_region__(int sig) {\n"
+               "    (void) sig;\n"
+               "    __solver_stats_values__.samples[__solver_region__]++;\n"
+               "%s"
+               "}\n\n",
+            profile ? "    if(__solver_region__ == __REGION_RHS__) __profile_samples__[__profile_stmt__]++;\n" : "");
+
+    fprintf(f, "static void __start_solver_stats__(void) {\n"
+               "    __solver_stats_values__.start_time = __wall_time__();\n"
+               "    if(!__sample_regions__) return;\n"
+               "    struct sigaction sa;\n"
+               "    memset(&sa, 0, sizeof(sa));\n"
+               "    sa.sa_handler = __sample_solver_region__;\n"
+               "    sa.sa_flags = SA_RESTART;\n"
+               "    sigemptyset(&sa.sa_mask);\n"
+               "    sigaction(SIGALRM, &sa, NULL);\n"
+               "    struct itimerval timer = {{0, %d}, {0, %d}};\n"
+               "    setitimer(ITIMER_REAL, &timer, NULL);\n"
+               "}\n\n",
+            profile ? PROFILE_SAMPLING_INTERVAL_US : SOLVER_SAMPLING_INTERVAL_US, profile ? PROFILE_SAMPLING_INTERVAL_US : SOLVER_SAMPLING_INTERVAL_US);
+
+    fprintf(f, "static inline void __count_step_size__(real dt) {\n"
+               "    if(dt < __solver_stats_values__.min_dt) __solver_stats_values__.min_dt = dt;\n"
+               "    if(dt > __solver_stats_values__.max_dt) __solver_stats_values__.max_dt = dt;\n"
+               "}\n\n");
+
+    fprintf(f, "static void __write_solver_stats__(FILE *stats_file) {\n"
+               "    if(__sample_regions__) {\n"
+               "        struct itimerval timer = {{0, 0}, {0, 0}};\n"
+               "        setitimer(ITIMER_REAL, &timer, NULL);\n"
+               "    }\n"
+               "    __solver_stats__ *s = &__solver_stats_values__;\n"
+               "    double total_time = __wall_time__() - s->start_time;\n"
+               "    uint64_t n_samples = s->samples[__REGION_SOLVER__] + s->samples[__REGION_RHS__] + s->samples[__REGION_OUTPUT__];\n"
+               "    double time_per_sample = n_samples > 0 ? total_time / n_samples : 0.0;\n"
+               "    uint32_t solver_type = %d;\n"
+               "    double record[%d] = {s->rhs_evals, s->accepted_steps, s->rejected_steps,\n"
+               "                         s->accepted_steps > 0 ? s->min_dt : 0.0, s->accepted_steps > 0 ? s->sum_dt / s->accepted_steps : 0.0, s->max_dt,\n"
+               "                         s->samples[__REGION_RHS__] * time_per_sample, s->samples[__REGION_OUTPUT__] * time_per_sample, total_time,\n"
+               "                         s->lin_solv_setups, n_samples};\n"
+               "    fwrite(&solver_type, sizeof(uint32_t), 1, stats_file);\n"
+               "    fwrite(record, sizeof(double), %d, stats_file);\n"
+               "}\n\n",
+            solver_config->solver_type, RUN_SOLVER_STATS_N_FIELDS, RUN_SOLVER_STATS_N_FIELDS);
+
+    if(profile) {
+        fprintf(f, "static void __write_profile__(const char *file_name) {\n"
+                   "    char *profile_file_name = malloc(strlen(file_name) + strlen(\"%s\") + 1);\n"
+                   "    sprintf(profile_file_name, \"%%s%s\", file_name);\n"
+                   "    FILE *profile_file = fopen(profile_file_name, \"w\");\n"
+                   "    free(profile_file_name);\n"
+                   "    if(profile_file == NULL) {\n"
+                   "        fprintf(stderr, \"Error writing the profile for %%s\\n\", file_name);\n"
+                   "        return;\n"
+                   "    }\n"
+                   "    fprintf(profile_file, \"%%llu %%d\\n\", (unsigned long long) __solver_stats_values__.samples[__REGION_RHS__], __N_PROFILE_STMTS__);\n"
+                   "    for(int i = 0; i < __N_PROFILE_STMTS__; i++) {\n"
+                   "        fprintf(profile_file, \"%%d %%llu %%s\\n\", __profile_stmt_lines__[i], (unsigned long long) __profile_samples__[i], __profile_stmt_names__[i]);\n"
+                   "    }\n"
+                   "    fclose(profile_file);\n"
+                   "}\n\n",
+                RUN_PROFILE_FILE_SUFFIX, RUN_PROFILE_FILE_SUFFIX);
+    }
+}
+
+static void create_run_stats_functions(FILE *f, solver_config *solver_config) {
+
+    fprintf(f, "//Streaming statistics of each variable. They are written to <output_file>%s\n", RUN_STATS_FILE_SUFFIX);
+    fprintf(f, "typedef struct __run_stats__t {\n"
+               "    real min;\n"
+               "    real min_time;\n"
+               "    real max;\n"
+               "    real max_time;\n"
+               "    real mean;\n"
+               "    real m2;\n"
+               "    real integral;\n"
+               "} __run_stats__;\n\n");
+
+    fprintf(f, "static __run_stats__ __run_stats_values__[NSTATS];\n"
+               "static real __run_stats_last_values__[NSTATS];\n"
+               "static real __run_stats_last_time__ = 0.0;\n"
+               "static uint64_t __run_stats_samples__ = 0;\n\n");
+
+    fprintf(f, "static void __update_run_stats__(real time, const real *values, const real *recorded) {\n"
+               "    __run_stats_samples__++;\n"
+               "    for(int i = 0; i < NSTATS; i++) {\n"
+               "        __run_stats__ *s = &__run_stats_values__[i];\n"
+               "        real v = i < NEQ ? values[i] : recorded[i - NEQ];\n"
+               "        if(__run_stats_samples__ == 1) {\n"
+               "            s->min = s->max = v;\n"
+               "            s->min_time = s->max_time = time;\n"
+               "        } else {\n"
+               "            if(v < s->min) { s->min = v; s->min_time = time; }\n"
+               "            if(v > s->max) { s->max = v; s->max_time = time; }\n"
+               "            s->integral += 0.5 * (v + __run_stats_last_values__[i]) * (time - __run_stats_last_time__);\n"
+               "        }\n"
+               "        //Welford's online mean and variance\n"
+               "        real delta = v - s->mean;\n"
+               "        s->mean += delta / __run_stats_samples__;\n"
+               "        s->m2 += delta * (v - s->mean);\n"
+               "        __run_stats_last_values__[i] = v;\n"
+               "    }\n"
+               "    __run_stats_last_time__ = time;\n"
+               "}\n\n");
+
+    fprintf(f, "static void __write_run_stats__(const char *file_name) {\n"
+               "    char *stats_file_name = malloc(strlen(file_name) + strlen(\"%s\") + 1);\n"
+               "    sprintf(stats_file_name, \"%%s%s\", file_name);\n"
+               "    FILE *stats_file = fopen(stats_file_name, \"wb\");\n"
+               "    free(stats_file_name);\n"
+               "    if(stats_file == NULL) {\n"
+               "        fprintf(stderr, \"Error writing the statistics for %%s\\n\", file_name);\n"
+               "        return;\n"
+               "    }\n"
+               "    uint32_t version = %d;\n"
+               "    uint32_t n_vars = NSTATS;\n"
+               "    double final_time = __run_stats_last_time__;\n"
+               "    fwrite(\"%s\", 1, 8, stats_file);\n"
+               "    fwrite(&version, sizeof(uint32_t), 1, stats_file);\n"
+               "    fwrite(&n_vars, sizeof(uint32_t), 1, stats_file);\n"
+               "    fwrite(&__run_stats_samples__, sizeof(uint64_t), 1, stats_file);\n"
+               "    fwrite(&final_time, sizeof(double), 1, stats_file);\n"
+               "    for(int i = 0; i < NSTATS; i++) {\n"
+               "        __run_stats__ *s = &__run_stats_values__[i];\n"
+               "        double record[%d] = {s->min, s->min_time, s->max, s->max_time, s->mean,\n"
+               "                             __run_stats_samples__ > 0 ? s->m2 / __run_stats_samples__ : 0.0, s->integral};\n"
+               "        fwrite(record, sizeof(double), %d, stats_file);\n"
+               "    }\n"
+               "    __write_solver_stats__(stats_file);\n"
+               "    fclose(stats_file);\n"
+               "%s"
+               "}\n\n",
+            RUN_STATS_FILE_SUFFIX, RUN_STATS_FILE_SUFFIX, RUN_STATS_VERSION, RUN_STATS_MAGIC, RUN_STATS_N_FIELDS, RUN_STATS_N_FIELDS,
+            solver_config->profile_statements ? "    __write_profile__(file_name);\n" : "");
+}
+
+// The solvers copy each output row to a buffer and a writer thread formats and writes it, so the integration
+// does not wait on fprintf. Two fixed size buffers are used: the solver fills one while the writer drains the other.
+// When the writer is still busy with the previous buffer the solver blocks, which bounds the memory used.
+static void create_output_writer_functions(FILE *f) {
+
+    fprintf(f, "#define __OUT_ROW_SIZE__ (NSTATS + 1)\n"
+               "#define __OUT_BUFFER_ROWS__ (%d / (sizeof(real) * __OUT_ROW_SIZE__) + 1)\n\n", OUTPUT_BUFFER_SIZE);
+
+    fprintf(f, "typedef struct __output_writer__t {\n"
+               "    FILE *file;\n"
+               "    real *buffers[2];\n"
+               "    int n_rows[2];\n"
+               "    int filling;\n"
+               "    int pending;\n"
+               "    bool done;\n"
+               "    bool threaded;\n"
+               "    pthread_t thread;\n"
+               "    pthread_mutex_t lock;\n"
+               "    pthread_cond_t cond;\n"
+               "    uint64_t rows_written;\n"
+               "    uint64_t buffers_written;\n"
+               "    uint64_t times_blocked;\n"
+               "    double blocked_time;\n"
+               "    double write_time;\n"
+               "    double start_time;\n"
+               "} __output_writer__;\n\n");
+
+    fprintf(f, "static __output_writer__ __writer__;\n\n");
+
+    fprintf(f, "static double __wall_time__(void) {\n"
+               "    struct timespec ts;\n"
+               "    clock_gettime(CLOCK_MONOTONIC, &ts);\n"
+               "    return ts.tv_sec + ts.tv_nsec * 1e-9;\n"
+               "}\n\n");
+
+    fprintf(f, "static void __write_rows__(FILE *f, const real *rows, int n_rows) {\n"
+               "    for(int r = 0; r < n_rows; r++) {\n"
+               "        const real *row = rows + r * __OUT_ROW_SIZE__;\n"
+               "        for(int i = 0; i < __OUT_ROW_SIZE__; i++) {\n"
+               "            fprintf(f, \"%%lf \", row[i]);\n"
+               "        }\n"
+               "        fprintf(f, \"\\n\");\n"
+               "    }\n"
+               "}\n\n");
+
+    fprintf(f, "static void *__output_writer_thread__(void *arg) {\n"
+               "    __output_writer__ *w = (__output_writer__ *) arg;\n"
+               "    pthread_mutex_lock(&w->lock);\n"
+               "    while(1) {\n"
+               "        while(w->pending == -1 && !w->done) {\n"
+               "            pthread_cond_wait(&w->cond, &w->lock);\n"
+               "        }\n"
+               "        if(w->pending == -1) break;\n"
+               "        int b = w->pending;\n"
+               "        pthread_mutex_unlock(&w->lock);\n"
+               "        double start = __wall_time__();\n"
+               "        __write_rows__(w->file, w->buffers[b], w->n_rows[b]);\n"
+               "        pthread_mutex_lock(&w->lock);\n"
+               "        w->write_time += __wall_time__() - start;\n"
+               "        w->n_rows[b] = 0;\n"
+               "        w->pending = -1;\n"
+               "        pthread_cond_broadcast(&w->cond);\n"
+               "    }\n"
+               "    pthread_mutex_unlock(&w->lock);\n"
+               "    return NULL;\n"
+               "}\n\n");
+
+    fprintf(f, "static void __output_writer_start__(FILE *f) {\n"
+               "    __output_writer__ *w = &__writer__;\n"
+               "    memset(w, 0, sizeof(__output_writer__));\n"
+               "    w->file = f;\n"
+               "    w->pending = -1;\n"
+               "    w->buffers[0] = (real *) malloc(sizeof(real) * __OUT_ROW_SIZE__ * __OUT_BUFFER_ROWS__);\n"
+               "    w->buffers[1] = (real *) malloc(sizeof(real) * __OUT_ROW_SIZE__ * __OUT_BUFFER_ROWS__);\n"
+               "    w->start_time = __wall_time__();\n"
+               "    pthread_mutex_init(&w->lock, NULL);\n"
+               "    pthread_cond_init(&w->cond, NULL);\n"
+               "    //the regions of the solver are sampled in its own thread (see __start_solver_stats__)\n"
+               "    sigset_t alarm_set, old_set;\n"
+               "    sigemptyset(&alarm_set);\n"
+               "    sigaddset(&alarm_set, SIGALRM);\n"
+               "    pthread_sigmask(SIG_BLOCK, &alarm_set, &old_set);\n"
+               "    //if the thread can't be created the rows are written by the solver\n"
+               "    w->threaded = pthread_create(&w->thread, NULL, __output_writer_thread__, w) == 0;\n"
+               "    pthread_sigmask(SIG_SETMASK, &old_set, NULL);\n"
+               "}\n\n");
+
+    fprintf(f, "static void __output_flush__(void) {\n"
+               "    __output_writer__ *w = &__writer__;\n"
+               "    int b = w->filling;\n"
+               "    if(w->n_rows[b] == 0) return;\n"
+               "    w->rows_written += w->n_rows[b];\n"
+               "    w->buffers_written++;\n"
+               "    if(!w->threaded) {\n"
+               "        double start = __wall_time__();\n"
+               "        __write_rows__(w->file, w->buffers[b], w->n_rows[b]);\n"
+               "        w->blocked_time += __wall_time__() - start;\n"
+               "        w->write_time = w->blocked_time;\n"
+               "        w->n_rows[b] = 0;\n"
+               "        return;\n"
+               "    }\n"
+               "    pthread_mutex_lock(&w->lock);\n"
+               "    if(w->pending != -1) {\n"
+               "        double start = __wall_time__();\n"
+               "        while(w->pending != -1) {\n"
+               "            pthread_cond_wait(&w->cond, &w->lock);\n"
+               "        }\n"
+               "        w->blocked_time += __wall_time__() - start;\n"
+               "        w->times_blocked++;\n"
+               "    }\n"
+               "    w->pending = b;\n"
+               "    w->filling = 1 - b;\n"
+               "    pthread_cond_broadcast(&w->cond);\n"
+               "    pthread_mutex_unlock(&w->lock);\n"
+               "}\n\n");
+
+    fprintf(f, "static void __output_push_row__(real time, const real *values, const real *recorded) {\n"
+               "    __output_writer__ *w = &__writer__;\n"
+               "    real *row = w->buffers[w->filling] + w->n_rows[w->filling] * __OUT_ROW_SIZE__;\n"
+               "    row[0] = time;\n"
+               "    for(int i = 0; i < NEQ; i++) {\n"
+               "        row[i + 1] = values[i];\n"
+               "    }\n"
+               "    for(int i = 0; i < NREC; i++) {\n"
+               "        row[NEQ + 1 + i] = recorded[i];\n"
+               "    }\n"
+               "    if(++w->n_rows[w->filling] == (int) __OUT_BUFFER_ROWS__) {\n"
+               "        __output_flush__();\n"
+               "    }\n"
+               "}\n\n");
+
+    fprintf(f, "static void __output_writer_finish__(bool report_io) {\n"
+               "    __output_writer__ *w = &__writer__;\n"
+               "    __output_flush__();\n"
+               "    if(w->threaded) {\n"
+               "        pthread_mutex_lock(&w->lock);\n"
+               "        w->done = true;\n"
+               "        pthread_cond_broadcast(&w->cond);\n"
+               "        pthread_mutex_unlock(&w->lock);\n"
+               "        pthread_join(w->thread, NULL);\n"
+               "    }\n"
+               "    fflush(w->file);\n"
+               "    if(report_io) {\n"
+               "        double total_time = __wall_time__() - w->start_time;\n"
+               "        printf(\"I/O report: %%llu rows in %%llu buffers of %%d rows (%%s writer).\\n\", (unsigned long long) w->rows_written,\n"
+               "               (unsigned long long) w->buffers_written, (int) __OUT_BUFFER_ROWS__, w->threaded ? \"threaded\" : \"inline\");\n"
+               "        printf(\"I/O report: solver blocked on output %%llu times for %%lf s (%%.1lf%%%% of %%lf s). Writer busy for %%lf s.\\n\",\n"
+               "               (unsigned long long) w->times_blocked, w->blocked_time, total_time > 0 ? 100.0 * w->blocked_time / total_time : 0.0,\n"
+               "               total_time, w->write_time);\n"
+               "    }\n"
+               "    pthread_mutex_destroy(&w->lock);\n"
+               "    pthread_cond_destroy(&w->cond);\n"
+               "    free(w->buffers[0]);\n"
+               "    free(w->buffers[1]);\n"
+               "}\n\n");
+}
+
+// Parameters passed as name=value when running the solver. Only emitted when the model is compiled for a sweep, so the
+// regular models don't pay for the checks in the RHS
+static void create_runtime_params_functions(FILE *f, solver_config *solver_config) {
+
+    int n = arrlen(solver_config->runtime_params);
+
+    if(n == 0) return;
+
+    fprintf(f, "#define NPARAMS %d\n", n);
+    fprintf(f, "static const char *__runtime_param_names__[NPARAMS] = {");
+    for(int i = 0; i < n; i++) {
+        fprintf(f, "%s\"%s\"", i ? ", " : "", solver_config->runtime_params[i]);
+    }
+    fprintf(f, "};\n");
+    fprintf(f, "static real __runtime_params__[NPARAMS];\n"
+               "static bool __runtime_param_set__[NPARAMS];\n\n");
+
+    fprintf(f, "static bool __set_runtime_param__(const char *arg) {\n"
+               "    const char *value = strchr(arg, '=');\n"
+               "    if(value == NULL) return false;\n"
+               "    for(int i = 0; i < NPARAMS; i++) {\n"
+               "        if(strlen(__runtime_param_names__[i]) == (size_t) (value - arg) && strncmp(arg, __runtime_param_names__[i], value - arg) == 0) {\n"
+               "            char *end;\n"
+               "            __runtime_params__[i] = strtod(value + 1, &end);\n"
+               "            __runtime_param_set__[i] = *end == '\\0' && end != value + 1;\n"
+               "            return __runtime_param_set__[i];\n"
+               "        }\n"
+               "    }\n"
+               "    return false;\n"
+               "}\n\n");
+}
+
+// Progress lines for the shell and a clean stop on SIGINT/SIGTERM: the solver loop ends at the next output point and the
+// output and statistics computed so far are kept
+static void create_progress_functions(FILE *f, int n_runtime_params) {
+
+    fprintf(f, "static volatile sig_atomic_t __stop_requested__ = 0;\n"
+               "static bool __progress_enabled__ = false;\n"
+               "static real __progress_final_time__ = 0.0;\n"
+               "static double __progress_last_report__ = 0.0;\n\n");
+
+    fprintf(f, "static void __stop_handler__(int sig) {\n"
+               "    (void) sig;\n"
+               "    __stop_requested__ = 1;\n"
+               "}\n\n");
+
+    fprintf(f, "static void __report_progress__(real time) {\n"
+               "    double now = __wall_time__();\n"
+               "    if(now - __progress_last_report__ >= %g) {\n"
+               "        __progress_last_report__ = now;\n"
+               "        printf(\"%s %%lf %%lf %%d\\n\", time, __progress_final_time__, __ode_last_iteration__);\n"
+               "        fflush(stdout);\n"
+               "    }\n"
+               "}\n\n", PROGRESS_INTERVAL, PROGRESS_PREFIX);
+
+    fprintf(f, "static void __parse_solver_options__(int argc, char **argv, bool *report_io) {\n"
+               "    __progress_final_time__ = strtod(argv[1], NULL);\n"
+               "    for(int i = 3; i < argc; i++) {\n"
+               "        if(strcmp(argv[i], \"%s\") == 0) {\n"
+               "            *report_io = true;\n"
+               "        } else if(strcmp(argv[i], \"%s\") == 0) {\n"
+               "            __progress_enabled__ = true;\n"
+               "        } else if(strcmp(argv[i], \"%s\") == 0) {\n"
+               "            __sample_regions__ = true;\n"
+               "        }%s\n"
+               "    }\n"
+               "    signal(SIGINT, __stop_handler__);\n"
+               "    signal(SIGTERM, __stop_handler__);\n"
+               "}\n\n", REPORT_IO_FLAG, PROGRESS_FLAG, SAMPLE_REGIONS_FLAG,
+            n_runtime_params ? " else if(!__set_runtime_param__(argv[i])) {\n"
+                               "            fprintf(stderr, \"Invalid option or parameter %s\\n\", argv[i]);\n"
+                               "            exit(EXIT_FAILURE);\n"
+                               "        }"
+                             : "");
+
+    fprintf(f, "static int __solver_exit_code__(real time) {\n"
+               "    if(__stop_requested__) {\n"
+               "        printf(\"Solver interrupted at t = %%lf\\n\", time);\n"
+               "        return %d;\n"
+               "    }\n"
+               "    return 0;\n"
+               "}\n\n", SOLVER_INTERRUPTED_EXIT_CODE);
+}
+
 static sds generate_exposed_ode_values_for_loop(enum solver_type_t solver) {
 
     sds code = sdsempty();
@@ -647,7 +1106,7 @@ void write_odes_old_values(program p, FILE *file, solver_config *solver_config)
     }
 }
 
-sds out_file_header(program p) {
+sds out_file_header(program p, char **recorded_vars) {
 
     sds ret    = sdsempty();
 
@@ -662,21 +1121,45 @@ sds out_file_header(program p) {
         ret = sdscatprintf(ret, ", %.*s", (int) strlen(a->assignment_stmt.name->identifier.value) - 1, a->assignment_stmt.name->identifier.value);
     }
 
+    for(int i = 0; i < arrlen(recorded_vars); i++) {
+        ret = sdscatprintf(ret, ", %s", recorded_vars[i]);
+    }
+
     ret = sdscat(ret, "\\n\"");
 
     return ret;
 }
 
-void write_variables_or_body(program p, FILE *file, solver_config *solver_config) {
+static int get_runtime_param_index(ast *a, solver_config *solver_config) {
+
+    if(a->assignment_stmt.name->identifier.global || hmgeti(solver_config->var_declared, a->assignment_stmt.name->identifier.symbol) != -1) {
+        return -1;
+    }
+
+    int n = arrlen(solver_config->runtime_params);
+
+    for(int i = 0; i < n; i++) {
+        if(STR_EQUALS(solver_config->runtime_params[i], a->assignment_stmt.name->identifier.value)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void write_variables_or_body(program p, FILE *file, bool profile_statements, solver_config *solver_config) {
     int n_stmt = arrlen(p);
     for(int i = 0; i < n_stmt; i++) {
         ast *a = p[i];
+        if(profile_statements) {
+            //the barrier keeps the compiler from moving the work of a statement across the marker
+            fprintf(file, "    __asm__ __volatile__(\"\" ::: \"memory\");\n"
+                          "    __profile_stmt__ = %d;\n", i);
+        }
         if(a->tag == ast_ode_stmt) {
             uint32_t position = a->assignment_stmt.declaration_position;
             sds tmp           = ast_to_c(a->assignment_stmt.value, solver_config);
-            sds name          = ast_to_c(a->assignment_stmt.name, solver_config);
-            shput(ode_position, name, position);
-            sdsfree(name);
+            hmput(solver_config->ode_position, a->assignment_stmt.name->identifier.symbol, position);
 
             if(solver_config->solver_type == CVODE_SOLVER) {
                 fprintf(file, "    NV_Ith_S(rDY, %d) = %s;\n", position - 1, tmp);
@@ -684,6 +1167,13 @@ void write_variables_or_body(program p, FILE *file, solver_config *solver_config
                 fprintf(file, "    rDY[%d] = %s;\n", position - 1, tmp);
             }
 
+            sdsfree(tmp);
+        } else if(a->tag == ast_assignment_stmt && get_runtime_param_index(a, solver_config) != -1) {
+            //the value given when running the solver replaces the one in the model
+            int index = get_runtime_param_index(a, solver_config);
+            sds tmp   = ast_to_c(a->assignment_stmt.value, solver_config);
+            fprintf(file, "    real %s = __runtime_param_set__[%d] ? __runtime_params__[%d] : %s;\n", a->assignment_stmt.name->identifier.value, index, index, tmp);
+            hmput(solver_config->var_declared, a->assignment_stmt.name->identifier.symbol, 1);
             sdsfree(tmp);
         } else {
             sds buf = ast_to_c(a, solver_config);
@@ -788,6 +1278,123 @@ static sds generate_end_functions(program functions) {
     return result;
 }
 
+// Copies the recorded intermediates to __rec__ at the end of the RHS. The solvers only pass __rec__ when writing an output point
+static void write_recorded_vars_copy(FILE *file, solver_config *solver_config) {
+
+    int n = arrlen(solver_config->recorded_vars);
+
+    if(n == 0) return;
+
+    if(solver_config->solver_type == CVODE_SOLVER) {
+        fprintf(file, "\n    real *__rec__ = (real *) f_data;\n");
+    }
+
+    fprintf(file, "\n    if(__rec__ != NULL) {\n");
+    for(int i = 0; i < n; i++) {
+        fprintf(file, "        __rec__[%d] = %s;\n", i, solver_config->recorded_vars[i]);
+    }
+    fprintf(file, "    }\n");
+}
+
+static sds generate_recorded_vars_declarations(solver_config *solver_config, const char *state_vector) {
+
+    sds code = sdsempty();
+
+    if(arrlen(solver_config->recorded_vars) == 0) return code;
+
+    code = sdscat(code, "    real __rec__[NREC];\n");
+
+    if(solver_config->solver_type == CVODE_SOLVER) {
+        code = sdscatfmt(code, "    N_Vector __rec_rhs__ = N_VClone(%s);\n", state_vector);
+    } else {
+        code = sdscat(code, "    real __rec_rhs__[NEQ];\n");
+    }
+
+    return code;
+}
+
+// Re-evaluates the RHS at an output point to get the recorded intermediates. When write_values is set they are also
+// written after the state variables (the rows of the integration loop are written by the output writer instead)
+static sds generate_recorded_vars_output(solver_config *solver_config, const char *indent, const char *time, const char *state_vector, bool write_values) {
+
+    sds code = sdsempty();
+
+    if(arrlen(solver_config->recorded_vars) == 0) return code;
+
+    code = sdscatfmt(code, "%ssolve_model(%s, %s, __rec_rhs__, __rec__);\n", indent, time, state_vector);
+
+    if(write_values) {
+        code = sdscatfmt(code, "%sfor(int i = 0; i < NREC; i++) {\n", indent);
+        code = sdscatfmt(code, "%s    fprintf(f, \"%%lf \", __rec__[i]);\n", indent);
+        code = sdscatfmt(code, "%s}\n", indent);
+    }
+
+    return code;
+}
+
+// Top-level real assignments can be given at run time. Variables assigned by a function call with multiple returns can't
+bool is_runtime_param_assignment(const ast *a) {
+    ast *value = a->assignment_stmt.value;
+    return value->tag != ast_boolean_literal && value->tag != ast_if_expr && value->tag != ast_string_literal &&
+           !a->assignment_stmt.name->identifier.global;
+}
+
+bool is_runtime_param(program p, const char *param_name) {
+
+    int n_stmt = arrlen(p);
+
+    for(int i = 0; i < n_stmt; i++) {
+        ast *a = p[i];
+
+        if(a->tag == ast_assignment_stmt && STR_EQUALS(a->assignment_stmt.name->identifier.value, param_name)) {
+            return is_runtime_param_assignment(a);
+        }
+    }
+
+    return false;
+}
+
+bool has_end_functions(program p) {
+
+    int n_stmt = arrlen(p);
+
+    for(int i = 0; i < n_stmt; i++) {
+        if(p[i]->tag == ast_function_statement && p[i]->function_stmt.is_end_fn) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool is_recordable_var(program p, const char *var_name) {
+
+    int n_stmt = arrlen(p);
+
+    for(int i = 0; i < n_stmt; i++) {
+        ast *a = p[i];
+
+        if(a->tag == ast_assignment_stmt) {
+            ast *value = a->assignment_stmt.value;
+            bool is_real = value->tag != ast_boolean_literal && value->tag != ast_if_expr && value->tag != ast_string_literal;
+
+            if(is_real && !a->assignment_stmt.name->identifier.global && STR_EQUALS(a->assignment_stmt.name->identifier.value, var_name)) {
+                return true;
+            }
+        } else if(a->tag == ast_grouped_assignment_stmt) {
+            int n = arrlen(a->grouped_assignment_stmt.names);
+            for(int j = 0; j < n; j++) {
+                ast *id = a->grouped_assignment_stmt.names[j];
+                if(!id->identifier.global && STR_EQUALS(id->identifier.value, var_name)) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
 static bool write_cvode_solver(FILE *file, program initial, program globals, program functions, program main_body, sds out_header, solver_config *solver_config) {
 
     unsigned int *indentation_level = &solver_config->indentation_level;
@@ -803,12 +1410,18 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
 
 
     WRITE_NEQ
+    WRITE_NREC
     fprintf(file, "typedef realtype real;\n");
 
     create_dynamic_array_headers(file);
     create_export_functions(file);
+    create_output_writer_functions(file);
+    create_solver_stats_functions(file, main_body, solver_config);
+    create_run_stats_functions(file, solver_config);
+    create_runtime_params_functions(file, solver_config);
+    create_progress_functions(file, arrlen(solver_config->runtime_params));
 
-    write_variables_or_body(globals, file, solver_config);
+    write_variables_or_body(globals, file, false, solver_config);
     fprintf(file, "\n");
 
     write_functions(functions, file, false, solver_config);
@@ -819,6 +1432,9 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
 
     // RHS CPU
     fprintf(file, "static int solve_model(realtype time, N_Vector sv, N_Vector rDY, void *f_data) {\n\n");
+    fprintf(file, "    //the evaluations that record the intermediate variables (f_data != NULL) are part of the output\n"
+                  "    int __previous_region__ = __solver_region__;\n"
+                  "    if(f_data == NULL) __solver_region__ = __REGION_RHS__;\n\n");
 
     fprintf(file, "    //State variables\n");
     write_odes_old_values(main_body, file, solver_config);
@@ -827,12 +1443,18 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
     fprintf(file, "    //Parameters\n");
 
     (*indentation_level)++;
-    write_variables_or_body(main_body, file, solver_config);
+    write_variables_or_body(main_body, file, solver_config->profile_statements, solver_config);
     (*indentation_level)--;
 
+    write_recorded_vars_copy(file, solver_config);
+    fprintf(file, "    __solver_region__ = __previous_region__;\n");
+
     fprintf(file, "\n    return 0;  \n\n}\n\n");
 
-    sds export_code = generate_exposed_ode_values_for_loop(solver_config->solver_type);
+    sds export_code  = generate_exposed_ode_values_for_loop(solver_config->solver_type);
+    sds rec_decl     = generate_recorded_vars_declarations(solver_config, "y");
+    sds rec_output   = generate_recorded_vars_output(solver_config, "            ", "t", "y", false);
+    const char *rec  = arrlen(solver_config->recorded_vars) ? "__rec__" : "NULL";
 
     fprintf(file, "static int check_flag(void *flagvalue, const char *funcname, int opt) {\n"
                   "\n"
@@ -903,20 +1525,27 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
                   "    realtype tout = dt;\n"
                   "    int retval;\n"
                   "    realtype t;\n"
-                  "\n");
+                  "%s"
+                  "\n", rec_decl);
 
-    fprintf(file, "    while(tout < final_t) {\n"
+    fprintf(file, "    while(tout < final_t && !__stop_requested__) {\n"
                   "\n"
                   "        retval = CVode(cvode_mem, tout, y, &t, CV_NORMAL);\n"
                   "\n"
                   "        if(retval == CV_SUCCESS) {\n"
-                  "            fprintf(f, \"%%lf \", t);\n"
+                  "            realtype last_dt;\n"
+                  "            CVodeGetLastStep(cvode_mem, &last_dt);\n"
+                  "            __count_step_size__(last_dt);\n"
+                  "            __solver_region__ = __REGION_OUTPUT__;\n"
                   "            for(int i = 0; i < NEQ; i++) {\n"
-                  "                fprintf(f, \"%%lf \", NV_Ith_S(y,i));\n"
                   "                %s\n"
                   "            }\n"
+                  "%s"
                   "\n"
-                  "            fprintf(f, \"\\n\");\n"
+                  "            __output_push_row__(t, N_VGetArrayPointer(y), %s);\n"
+                  "            __update_run_stats__(t, N_VGetArrayPointer(y), %s);\n"
+                  "            if(__progress_enabled__) __report_progress__(t);\n"
+                  "            __solver_region__ = __REGION_SOLVER__;\n"
                   "\n"
                   "            tout+=dt;\n"
                   "            __ode_last_iteration__+=1;\n"
@@ -924,19 +1553,42 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
                   "\n"
                   "    }\n"
                   "\n"
+                  "    long int n_steps = 0, n_rhs_evals = 0, n_err_test_fails = 0, n_conv_fails = 0, n_lin_setups = 0;\n"
+                  "    realtype time_reached = 0.0;\n"
+                  "    CVodeGetNumSteps(cvode_mem, &n_steps);\n"
+                  "    CVodeGetNumRhsEvals(cvode_mem, &n_rhs_evals);\n"
+                  "    CVodeGetNumErrTestFails(cvode_mem, &n_err_test_fails);\n"
+                  "    CVodeGetNumNonlinSolvConvFails(cvode_mem, &n_conv_fails);\n"
+                  "    CVodeGetNumLinSolvSetups(cvode_mem, &n_lin_setups);\n"
+                  "    CVodeGetCurrentTime(cvode_mem, &time_reached);\n"
+                  "    __solver_stats_values__.rhs_evals = n_rhs_evals;\n"
+                  "    __solver_stats_values__.accepted_steps = n_steps;\n"
+                  "    __solver_stats_values__.rejected_steps = n_err_test_fails + n_conv_fails;\n"
+                  "    __solver_stats_values__.lin_solv_setups = n_lin_setups;\n"
+                  "    //the step sizes are only sampled at the output points, the mean is over all the steps\n"
+                  "    __solver_stats_values__.sum_dt = time_reached;\n"
+                  "    __write_run_stats__(file_name);\n"
+                  "\n"
                   "    // Free the linear solver memory\n"
                   "    SUNLinSolFree(LS);\n"
                   "    SUNMatDestroy(A);\n"
                   "    CVodeFree(&cvode_mem);\n"
+                  "%s"
                   "}\n",
-            export_code);
+            export_code, rec_output, rec, rec, arrlen(solver_config->recorded_vars) ? "    N_VDestroy(__rec_rhs__);\n" : "");
 
     sdsfree(export_code);
+    sdsfree(rec_decl);
+    sdsfree(rec_output);
     write_functions(functions, file, true, solver_config);
 
     bool error;
 
+    //the runtime parameters are set before the initial conditions and the first output row are computed
     fprintf(file, "\nint main(int argc, char **argv) {\n"
+                  "    bool report_io = false;\n"
+                  "    __parse_solver_options__(argc, argv, &report_io);\n"
+                  "\n"
                   "    SUNContext sunctx;\n"
                   "    SUNContext_Create(NULL, &sunctx);\n"
                   "    N_Vector x0 = N_VNew_Serial(NEQ, sunctx);\n"
@@ -944,22 +1596,35 @@ static bool write_cvode_solver(FILE *file, program initial, program globals, pro
     error             = generate_initial_conditions_values(initial, file, solver_config);
 
     sds end_functions = generate_end_functions(functions);
+    rec_decl          = generate_recorded_vars_declarations(solver_config, "x0");
+    rec_output        = generate_recorded_vars_output(solver_config, "    ", "0.0", "x0", true);
+
     fprintf(file, "    set_initial_conditions(x0, values);\n"
+                  "%s"
                   "    FILE *f = fopen(argv[2], \"w\");\n"
                   "    fprintf(f, %s);\n"
                   "    fprintf(f, \"0.0 \");\n"
                   "    for(int i = 0; i < NEQ; i++) {\n"
                   "        fprintf(f, \"%%lf \", NV_Ith_S(x0, i));\n"
                   "    }\n"
+                  "%s"
                   "    fprintf(f, \"\\n\");\n"
+                  "    __update_run_stats__(0.0, N_VGetArrayPointer(x0), %s);\n"
                   "\n\n",
-            out_header);
+            rec_decl, out_header, rec_output, rec);
+
+    sdsfree(rec_decl);
+    sdsfree(rec_output);
 
-    fprintf(file, "    solve_ode(x0, strtod(argv[1], NULL), f, argv[2], sunctx);\n"
+    fprintf(file, "    __output_writer_start__(f);\n"
+                  "    __start_solver_stats__();\n"
+                  "    solve_ode(x0, strtod(argv[1], NULL), f, argv[2], sunctx);\n"
+                  "    __output_writer_finish__(report_io);\n"
+                  "    fclose(f);\n"
                   "\n"
                   "    free(x0);\n"
                   "    %s\n"
-                  "    return (0);\n"
+                  "    return __solver_exit_code__(__run_stats_last_time__);\n"
                   "}",
             end_functions);
 
@@ -974,12 +1639,18 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
     fprintf(file, COMMON_INCLUDES " \n\n");
 
     WRITE_NEQ
+    WRITE_NREC
     fprintf(file, "typedef double real;\n");
 
     create_dynamic_array_headers(file);
     create_export_functions(file);
+    create_output_writer_functions(file);
+    create_solver_stats_functions(file, main_body, solver_config);
+    create_run_stats_functions(file, solver_config);
+    create_runtime_params_functions(file, solver_config);
+    create_progress_functions(file, arrlen(solver_config->runtime_params));
 
-    write_variables_or_body(globals, file, solver_config);
+    write_variables_or_body(globals, file, false, solver_config);
     fprintf(file, "\n");
 
     write_functions(functions, file, false, solver_config);
@@ -989,7 +1660,13 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
     fprintf(file, "\n}\n\n");
 
     // RHS CPU
-    fprintf(file, "static int solve_model(real time, real *sv, real *rDY) {\n\n");
+    fprintf(file, "static int solve_model(real time, real *sv, real *rDY, real *__rec__) {\n\n");
+    fprintf(file, "    //the evaluations that record the intermediate variables (__rec__ != NULL) are part of the output\n"
+                  "    int __previous_region__ = __solver_region__;\n"
+                  "    if(__rec__ == NULL) {\n"
+                  "        __solver_region__ = __REGION_RHS__;\n"
+                  "        __solver_stats_values__.rhs_evals++;\n"
+                  "    }\n\n");
 
     fprintf(file, "    //State variables\n");
     write_odes_old_values(main_body, file, solver_config);
@@ -998,10 +1675,16 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
     fprintf(file, "    //Parameters\n");
 
     (*indentation_level)++;
-    write_variables_or_body(main_body, file, solver_config);
+    write_variables_or_body(main_body, file, solver_config->profile_statements, solver_config);
     (*indentation_level)--;
 
+    write_recorded_vars_copy(file, solver_config);
+    fprintf(file, "    __solver_region__ = __previous_region__;\n");
+
     sds export_code = generate_exposed_ode_values_for_loop(solver_config->solver_type);
+    sds rec_decl    = generate_recorded_vars_declarations(solver_config, "sv");
+    sds rec_output  = generate_recorded_vars_output(solver_config, "            ", "time_new", "sv", false);
+    const char *rec = arrlen(solver_config->recorded_vars) ? "__rec__" : "NULL";
 
     fprintf(file, "\n    return 0;  \n\n}\n\n");
 
@@ -1027,26 +1710,21 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
                   "    const real _beta_safety_ = 0.8;\n"
                   "\n"
                   "    const real __tiny_ = pow(abstol, 2.0f);\n"
+                  "%s"
                   "\n"
                   "    if(time_new + dt > final_time) {\n"
                   "       dt = final_time - time_new;\n"
                   "    }\n"
                   "\n"
-                  "    solve_model(time_new, sv, rDY);\n"
+                  "    solve_model(time_new, sv, rDY, NULL);\n"
                   "    time_new += dt;\n"
                   "\n"
                   "    for(int i = 0; i < NEQ; i++){\n"
                   "        _k1__[i] = rDY[i];\n"
                   "    }\n"
-                  "\n");
+                  "\n", rec_decl);
 
-    fprintf(file, "    real min[NEQ];\n"
-                  "    real max[NEQ];\n\n"
-                  "    for(int i = 0; i < NEQ; i++) {\n"
-                  "       min[i] = DBL_MAX;\n"
-                  "       max[i] = DBL_MIN;\n"
-                  "    }\n\n"
-                  "    while(1) {\n"
+    fprintf(file, "    while(!__stop_requested__) {\n"
                   "\n"
                   "        for(int i = 0; i < NEQ; i++) {\n"
                   "            //stores the old variables in a vector\n"
@@ -1058,7 +1736,7 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
                   "        }\n"
                   "\n"
                   "        time_new += dt;\n"
-                  "        solve_model(time_new, sv, rDY);\n"
+                  "        solve_model(time_new, sv, rDY, NULL);\n"
                   "        time_new -= dt;//step back\n"
                   "\n"
                   "        double greatestError = 0.0, auxError = 0.0;\n"
@@ -1085,6 +1763,7 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
                   "\n"
                   "        //it doesn't accept the solution\n"
                   "        if ((greatestError >= 1.0f) && dt > 0.00000001) {\n"
+                  "            __solver_stats_values__.rejected_steps++;\n"
                   "            //restore the old values to do it again\n"
                   "            for(int i = 0;  i < NEQ; i++) {\n"
                   "                sv[i] = edos_old_aux_[i];\n"
@@ -1104,17 +1783,21 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
                   "            for(int i = 0; i < NEQ; i++){\n"
                   "                sv[i] = edos_new_euler_[i];\n"
                   "            }\n"
+                  "            __solver_stats_values__.accepted_steps++;\n"
+                  "            __solver_stats_values__.sum_dt += previous_dt;\n"
+                  "            __count_step_size__(previous_dt);\n"
+                  "            __solver_region__ = __REGION_OUTPUT__;\n"
 
-                  "            fprintf(f, \"%%lf \", time_new);\n"
                   "            for(int i = 0; i < NEQ; i++) {\n"
-                  "                fprintf(f, \"%%lf \", sv[i]);\n"
-                  "                if(sv[i] < min[i]) min[i] = sv[i];\n"
-                  "                if(sv[i] > max[i]) max[i] = sv[i];\n"
                   "                %s\n"
                   "            }\n"
+                  "%s"
                   "\n"
                   "            __ode_last_iteration__ += 1;\n"
-                  "            fprintf(f, \"\\n\");\n"
+                  "            __output_push_row__(time_new, sv, %s);\n"
+                  "            __update_run_stats__(time_new, sv, %s);\n"
+                  "            if(__progress_enabled__) __report_progress__(time_new);\n"
+                  "            __solver_region__ = __REGION_SOLVER__;\n"
 
                   "\n"
                   "            if(time_new + previous_dt >= final_time) {\n"
@@ -1132,26 +1815,23 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
                   "        }\n"
                   "    }\n"
                   "\n"
-                  "    char *min_max = malloc(strlen(file_name) + 9);\n"
-
-                  "    sprintf(min_max, \"%%s_min_max\", file_name);\n"
-                  "    FILE* min_max_file = fopen(min_max, \"w\");\n"
-                  "    for(int i = 0; i < NEQ; i++) {\n"
-                  "        fprintf(min_max_file, \"%%e;%%e\\n\", min[i], max[i]);\n"
-                  "    }\n"
-                  "    fclose(min_max_file);\n"
-                  "    free(min_max);\n"
-                  "    \n"
+                  "    __write_run_stats__(file_name);\n"
+                  "\n"
                   "    free(_k1__);\n"
                   "    free(_k2__);\n"
                   "}\n\n",
-            export_code);
+            export_code, rec_output, rec, rec);
 
     sdsfree(export_code);
+    sdsfree(rec_decl);
+    sdsfree(rec_output);
 
     write_functions(functions, file, true, solver_config);
 
+    //the runtime parameters are set before the initial conditions and the first output row are computed
     fprintf(file, "\nint main(int argc, char **argv) {\n"
+                  "    bool report_io = false;\n"
+                  "    __parse_solver_options__(argc, argv, &report_io);\n"
                   "\n"
                   "    real *x0 = (real*) malloc(sizeof(real)*NEQ);\n"
                   "\n");
@@ -1159,22 +1839,35 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
     bool error        = generate_initial_conditions_values(initial, file, solver_config);
 
     sds end_functions = generate_end_functions(functions);
+    rec_decl          = generate_recorded_vars_declarations(solver_config, "x0");
+    rec_output        = generate_recorded_vars_output(solver_config, "    ", "0.0", "x0", true);
+
     fprintf(file,
             "    set_initial_conditions(x0, values);\n"
+            "%s"
             "    FILE *f = fopen(argv[2], \"w\");\n"
             "    fprintf(f, %s);\n"
             "    fprintf(f, \"0.0 \");\n"
             "    for(int i = 0; i < NEQ; i++) {\n"
             "        fprintf(f, \"%%lf \", x0[i]);\n"
             "    }\n"
+            "%s"
             "    fprintf(f, \"\\n\");\n"
+            "    __update_run_stats__(0.0, x0, %s);\n"
             "\n\n",
-            out_header);
+            rec_decl, out_header, rec_output, rec);
+
+    sdsfree(rec_decl);
+    sdsfree(rec_output);
     fprintf(file,
+            "    __output_writer_start__(f);\n"
+            "    __start_solver_stats__();\n"
             "    solve_ode(x0, strtod(argv[1], NULL), f, argv[2]);\n"
+            "    __output_writer_finish__(report_io);\n"
+            "    fclose(f);\n"
             "    free(x0);\n"
             "    %s\n"
-            "    return (0);\n"
+            "    return __solver_exit_code__(__run_stats_last_time__);\n"
             "}",
             end_functions);
 
@@ -1185,8 +1878,14 @@ static bool write_adpt_euler_solver(FILE *file, program initial, program globals
 }
 
 bool convert_to_c(program prog, FILE *file, solver_type solver) {
+    solver_config config = {0};
+    config.solver_type   = solver;
+    return convert_to_c_with_config(prog, file, &config);
+}
 
-    solver_config solver_config = {0, solver};
+bool convert_to_c_with_config(program prog, FILE *file, solver_config *solver_config) {
+
+    solver_config->indentation_level = 0;
 
     program main_body           = NULL;
     program functions           = NULL;
@@ -1218,17 +1917,39 @@ bool convert_to_c(program prog, FILE *file, solver_type solver) {
         }
     }
 
-    sh_new_arena(var_declared);
-    sh_new_arena(ode_position);
+    int n_rec = arrlen(solver_config->recorded_vars);
+    for(int i = 0; i < n_rec; i++) {
+        if(!is_recordable_var(main_body, solver_config->recorded_vars[i])) {
+            fprintf(stderr, "Error: %s is not a top-level variable of the model and cannot be recorded!\n", solver_config->recorded_vars[i]);
+            error = true;
+        }
+    }
+
+    int n_params = arrlen(solver_config->runtime_params);
+    for(int i = 0; i < n_params; i++) {
+        if(!is_runtime_param(main_body, solver_config->runtime_params[i])) {
+            fprintf(stderr, "Error: %s is not a parameter of the model!\n", solver_config->runtime_params[i]);
+            error = true;
+        }
+    }
+
+    if(error) {
+        arrfree(main_body);
+        arrfree(functions);
+        arrfree(initial);
+        arrfree(globals);
+        arrfree(imports);
+        return error;
+    }
 
-    sds out_header = out_file_header(main_body);
+    sds out_header = out_file_header(main_body, solver_config->recorded_vars);
 
-    switch(solver) {
+    switch(solver_config->solver_type) {
         case CVODE_SOLVER:
-            error = write_cvode_solver(file, initial, globals, functions, main_body, out_header, &solver_config);
+            error = write_cvode_solver(file, initial, globals, functions, main_body, out_header, solver_config);
             break;
         case EULER_ADPT_SOLVER:
-            error = write_adpt_euler_solver(file, initial, globals, functions, main_body, out_header, &solver_config);
+            error = write_adpt_euler_solver(file, initial, globals, functions, main_body, out_header, solver_config);
             break;
         default:
             fprintf(stderr, "Error: invalid solver type!\n");
@@ -1236,8 +1957,8 @@ bool convert_to_c(program prog, FILE *file, solver_type solver) {
 
     sdsfree(out_header);
 
-    shfree(var_declared);
-    shfree(ode_position);
+    hmfree(solver_config->var_declared);
+    hmfree(solver_config->ode_position);
     arrfree(main_body);
     arrfree(functions);
     arrfree(initial);
@@ -6,8 +6,41 @@
 
 #define EXPOSED_ODE_VALUES_NAME "__exposed_odes_values__"
 
+// Binary sidecar written by the generated solvers next to the output file.
+// Layout: magic[8], uint32 version, uint32 n_vars, uint64 n_samples, double final_time,
+// followed by RUN_STATS_N_FIELDS doubles per variable (min, min_time, max, max_time, mean, variance, integral)
+// and the solver block: uint32 solver type and RUN_SOLVER_STATS_N_FIELDS doubles (rhs evaluations, accepted steps,
+// rejected steps, min dt, mean dt, max dt, rhs time, output time, total time, linear solver setups, time samples)
+#define RUN_STATS_FILE_SUFFIX "_stats"
+#define RUN_STATS_MAGIC "ODESTATS"
+#define RUN_STATS_VERSION 2
+#define RUN_STATS_N_FIELDS 7
+#define RUN_SOLVER_STATS_N_FIELDS 11
+
+// The time spent in the RHS and in the output is estimated by sampling: a SIGALRM every SOLVER_SAMPLING_INTERVAL_US
+// microseconds of wall time counts the region the solver is in, so the counters cost a store per RHS call. The timer
+// only runs when SAMPLE_REGIONS_FLAG is passed after the output file (the shell passes it with setreportio). Solvers
+// compiled with profile_statements always sample, also count the top-level statement of the RHS being run and write
+// "line samples name" lines, after a "total_rhs_samples n_statements" line, to <output_file>RUN_PROFILE_FILE_SUFFIX
+#define SOLVER_SAMPLING_INTERVAL_US 1000
+#define SAMPLE_REGIONS_FLAG "--sample-regions"
+#define PROFILE_SAMPLING_INTERVAL_US 100
+#define RUN_PROFILE_FILE_SUFFIX "_profile"
+
+// The generated solvers write the output through a writer thread with two buffers of OUTPUT_BUFFER_SIZE bytes.
+// Passing REPORT_IO_FLAG after the output file makes them print how long the solver waited on the writer
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define REPORT_IO_FLAG "--report-io"
+
+// With PROGRESS_FLAG the solvers print "PROGRESS_PREFIX time final_time steps" lines to stdout every PROGRESS_INTERVAL
+// seconds. On SIGINT or SIGTERM they stop integrating, write what was computed so far and exit with SOLVER_INTERRUPTED_EXIT_CODE
+#define PROGRESS_FLAG "--progress"
+#define PROGRESS_PREFIX "__progress__"
+#define PROGRESS_INTERVAL 0.2
+#define SOLVER_INTERRUPTED_EXIT_CODE 3
+
 struct var_declared_entry_t {
-    char *key;
+    symbol_id key;
     int value;
 };
 
@@ -19,8 +52,20 @@ typedef enum solver_type_t {
 typedef struct solver_config_t {
     unsigned int indentation_level;
     solver_type solver_type;
+    char **recorded_vars; //stb array of intermediate variables written as extra output columns
+    char **runtime_params; //stb array of parameters that can be set when running the solver (name=value arguments)
+    bool profile_statements; //attribute the RHS samples to its statements (see RUN_PROFILE_FILE_SUFFIX)
+    //state of the conversion, kept here so different programs can be converted at the same time from different threads
+    struct var_declared_entry_t *var_declared;
+    struct var_declared_entry_t *ode_position;
 } solver_config;
 
 bool convert_to_c(program p, FILE *out, solver_type solver);
+bool convert_to_c_with_config(program p, FILE *out, solver_config *config);
+bool is_recordable_var(program p, const char *var_name);
+bool is_runtime_param_assignment(const ast *a);
+bool is_runtime_param(program p, const char *param_name);
+// The endfn functions run when the solver ends, so their side effects (prints, files) only happen if the solver runs
+bool has_end_functions(program p);
 
 #endif /* __C_CONVERTER_H */
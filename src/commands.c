@@ -1,19 +1,26 @@
 #include "commands.h"
+#include "build_cache.h"
 #include "code_converter.h"
+#include "compiler/import_cache.h"
 #include "compiler/token.h"
 #include "file_utils/file_utils.h"
 #include "gnuplot_utils.h"
 #include "md5/md5.h"
 #include "model_config.h"
 #include "ode_shell.h"
+#include "pipe_utils.h"
+#include "session.h"
 #include "stb/stb_ds.h"
+#include "timing.h"
 #include "to_latex.h"
 
 #ifdef __linux__
 #include <linux/limits.h>
 #endif
 
+#include <fcntl.h>
 #include <math.h>
+#include <sys/ioctl.h>
 #include <readline/history.h>
 #include <readline/readline.h>
 #include <unistd.h>
@@ -113,13 +120,6 @@ static struct model_config *load_model_config_or_print_error(struct shell_variab
     }
 }
 
-static void check_and_print_execution_output(FILE *fp) {
-    char msg[PATH_MAX];
-    while(fgets(msg, PATH_MAX, fp) != NULL) {
-        printf("%s", msg);
-    }
-}
-
 static char *autocomplete_command(const char *text, int state) {
 
     rl_attempted_completion_over = 1;
@@ -179,7 +179,12 @@ static bool should_complete_model(const char *c) {
             "unload",
             "vars",
             "plotvars",
-            "replotvars"};
+            "replotvars",
+            "recordvar",
+            "sweep",
+            "sweeplhs",
+            "profile",
+            "meminfo"};
 
     size_t len = sizeof(autocompletable_commands) / sizeof(autocompletable_commands[0]);
     for(size_t i = 0; i < len; i++) {
@@ -200,7 +205,10 @@ static bool should_complete_model_and_var(const char *c) {
             "setplotx",
             "setploty",
             "plotvar",
-            "replotvar"};
+            "replotvar",
+            "windowstats",
+            "crossings",
+            "peaks"};
 
     size_t len = sizeof(autocompletable_commands) / sizeof(autocompletable_commands[0]);
     for(size_t i = 0; i < len; i++) {
@@ -268,7 +276,7 @@ static char *autocomplete_command_params(const char *text, int state) {
         c = commands[index];
     }
 
-    if(!c.key || STR_EQUALS(c.key, "list") || STR_EQUALS(c.key, "pwd") || STR_EQUALS(c.key, "quit") || STR_EQUALS(c.key, "setglobalreload")) {
+    if(!c.key || STR_EQUALS(c.key, "list") || STR_EQUALS(c.key, "pwd") || STR_EQUALS(c.key, "quit") || STR_EQUALS(c.key, "setglobalreload") || STR_EQUALS(c.key, "setreportio") || STR_EQUALS(c.key, "cacheinfo") || STR_EQUALS(c.key, "clearcache") || STR_EQUALS(c.key, "setcachesize") || STR_EQUALS(c.key, "setmemoize")) {
         //Do nothing
     } else if(should_complete_model(c.key)) {
         if(count <= 2) {
@@ -350,1552 +358,3962 @@ static struct model_config *get_model_and_n_runs_for_plot_cmds(struct shell_vari
     return model_config;
 }
 
-static bool load_model(struct shell_variables *shell_state, const char *model_file, struct model_config *model_config) {
-
-    bool error     = false;
-    bool new_model = (model_config == NULL);
-
-    if(new_model) {
+// Creates the model of an ode file: it is parsed, checked and compiled. The shell state is not touched, so several
+// models can be created at the same time from different threads. Returns NULL on errors
+static struct model_config *new_model_from_file(const char *current_dir, const char *model_file) {
 
-        const char *ext = get_filename_ext(model_file);
+    const char *ext = get_filename_ext(model_file);
 
-        sds new_file    = sdsnew(model_file);
+    sds new_file    = sdsnew(model_file);
 
-        if(ext == NULL) {
-            //we try to add .ode and find the file again
-            new_file = sdscat(new_file, ".ode");
-        }
+    if(ext == NULL) {
+        //we try to add .ode and find the file again
+        new_file = sdscat(new_file, ".ode");
+    }
 
-        model_config = calloc(1, sizeof(struct model_config));
+    struct model_config *model_config = new_model_config();
 
-        if(model_config == NULL) {
-            fprintf(stderr, "%s - Error allocating memory fot the model config!\n", __FUNCTION__);
-            return true;
-        }
+    if(model_config == NULL) {
+        fprintf(stderr, "%s - Error allocating memory fot the model config!\n", __FUNCTION__);
+        sdsfree(new_file);
+        return NULL;
+    }
 
-        model_config->should_reload = true;
-        model_config->auto_reload   = false;
+    model_config->should_reload = true;
+    model_config->auto_reload   = false;
 
-        model_config->model_name    = get_filename_without_ext(model_file);
+    model_config->model_name    = get_filename_without_ext(model_file);
 
-        int model_index             = shgeti(shell_state->loaded_models, model_config->model_name);
+    sds full_model_file_path;
 
-        if(model_index != -1) {
-            printf("Model %s is alread loaded!\n", model_config->model_name);
-            free_model_config(model_config);
-            sdsfree(new_file);
-            return true;
-        }
+    if(model_file[0] != '/') {
+        full_model_file_path = sdsnew(current_dir);
+    } else {
+        full_model_file_path = sdsempty();
+    }
 
-        sds full_model_file_path;
+    full_model_file_path     = sdscatfmt(full_model_file_path, "%s", new_file);
+    model_config->model_file = strdup(full_model_file_path);
 
-        if(model_file[0] != '/') {
-            full_model_file_path = sdsnew(shell_state->current_dir);
-        } else {
-            full_model_file_path = sdsempty();
-        }
+    sdsfree(full_model_file_path);
+    sdsfree(new_file);
 
-        full_model_file_path     = sdscatfmt(full_model_file_path, "%s", new_file);
-        model_config->model_file = strdup(full_model_file_path);
+    bool error = generate_model_program(model_config);
 
-        sdsfree(full_model_file_path);
-        sdsfree(new_file);
+    if(error) {
+        free_model_config(model_config);
+        return NULL;
+    }
 
-        error = generate_model_program(model_config);
+    model_config->plot_config.xindex = 1;
+    model_config->plot_config.yindex = 2;
 
-        if(error) {
-            free_model_config(model_config);
-            return true;
-        }
+    if(!model_config->plot_config.xlabel) {
+        model_config->plot_config.xlabel = strdup(get_var_name(model_config, 1));
+    }
 
-        model_config->plot_config.xindex = 1;
-        model_config->plot_config.yindex = 2;
+    if(!model_config->plot_config.ylabel) {
+        model_config->plot_config.ylabel = strdup(get_var_name(model_config, 2));
+    }
 
-        if(!model_config->plot_config.xlabel) {
-            model_config->plot_config.xlabel = strdup(get_var_name(model_config, 1));
-        }
+    if(!model_config->plot_config.title) {
+        const char *title = get_var_name(model_config, 2);
+        if(title)
+            model_config->plot_config.title = strdup(title);
+        else
+            model_config->plot_config.title = strdup("notitle");
+    }
 
-        if(!model_config->plot_config.ylabel) {
-            model_config->plot_config.ylabel = strdup(get_var_name(model_config, 2));
-        }
+    model_config->is_derived = false;
 
-        if(!model_config->plot_config.title) {
-            const char *title = get_var_name(model_config, 2);
-            if(title)
-                model_config->plot_config.title = strdup(title);
-            else
-                model_config->plot_config.title = strdup("notitle");
-        }
+    if(compile_model(model_config)) {
+        free_model_config(model_config);
+        return NULL;
     }
 
-    model_config->is_derived = !new_model;
+    return model_config;
+}
 
-    error                    = compile_model(model_config);
+// Adds a compiled model to the shell and makes it the current model
+static void add_loaded_model(struct shell_variables *shell_state, struct model_config *model_config) {
 
-    if(!error) {
-        shput(shell_state->loaded_models, model_config->model_name, model_config);
-        shell_state->current_model = model_config;
+    shput(shell_state->loaded_models, model_config->model_name, model_config);
+    shell_state->current_model = model_config;
 
-        if(new_model) {
-            char *tmp = get_dir_from_path(model_config->model_file);
+    if(!model_config->is_derived) {
+        char *tmp = get_dir_from_path(model_config->model_file);
 #ifdef __linux__
-            add_file_watch(shell_state, tmp);
+        add_file_watch(shell_state, tmp);
 #endif
-            free(tmp);
-        }
-    } else {
-        free_model_config(model_config);
+        free(tmp);
     }
 
-    if(!error) {
-        printf("Model %s successfully loaded\n", model_config->model_name);
+    printf("Model %s successfully loaded\n", model_config->model_name);
+}
+
+static bool is_model_loaded(struct shell_variables *shell_state, const char *model_file) {
+
+    char *model_name = get_filename_without_ext(model_file);
+    bool loaded      = shgeti(shell_state->loaded_models, model_name) != -1;
+
+    if(loaded) {
+        printf("Model %s is alread loaded!\n", model_name);
     }
 
-    return !error;
-}
+    free(model_name);
 
-COMMAND_FUNCTION(load) {
-    (void) num_args;
-    return load_model(shell_state, tokens[1], NULL);
+    return loaded;
 }
 
-static void load_min_max_data(const char *filename, struct model_config *model_config) {
+static bool load_model(struct shell_variables *shell_state, const char *model_file, struct model_config *model_config) {
 
-    size_t len = 0;
+    if(model_config == NULL) {
 
-    FILE *fp;
+        if(is_model_loaded(shell_state, model_file)) {
+            return false;
+        }
 
-    fp = fopen(filename, "r");
+        model_config = new_model_from_file(shell_state->current_dir, model_file);
 
-    if(fp == NULL) {
-        fprintf(stderr, "Error reading file %s\n", filename);
-        return;
+        if(model_config == NULL) {
+            return false;
+        }
+
+    } else {
+        model_config->is_derived = true;
+
+        if(compile_model(model_config)) {
+            free_model_config(model_config);
+            return false;
+        }
     }
 
-    char *line                                                    = NULL;
+    add_loaded_model(shell_state, model_config);
+
+    return true;
+}
+
+struct model_load_queue {
+    const char *current_dir;
+    const char **model_files;
+    struct model_config **model_configs;
+    int n_models;
+    int next;
+    pthread_mutex_t lock;
+};
 
-    int n                                                         = shlen(model_config->var_indexes) - 1;
+static void *model_load_worker(void *arg) {
 
-    model_config->runs[model_config->num_runs - 1].vars_max_value = (double *) malloc(sizeof(double) * n);
-    model_config->runs[model_config->num_runs - 1].vars_min_value = (double *) malloc(sizeof(double) * n);
+    struct model_load_queue *queue = (struct model_load_queue *) arg;
 
-    int count                                                     = 0;
-    while((getline(&line, &len, fp)) != -1) {
-        if(line) {
-            char *end;
-            double min                                                           = strtod(line, &end);
-            double max                                                           = strtod(end + 1, NULL);
-            model_config->runs[model_config->num_runs - 1].vars_max_value[count] = max;
-            model_config->runs[model_config->num_runs - 1].vars_min_value[count] = min;
-            count++;
-        }
+    while(true) {
+        pthread_mutex_lock(&queue->lock);
+        int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if(i >= queue->n_models) break;
+
+        queue->model_configs[i] = new_model_from_file(queue->current_dir, queue->model_files[i]);
     }
 
-    free(line);
-    fclose(fp);
+    return NULL;
 }
 
-COMMAND_FUNCTION(solve) {
+// Several models are parsed and compiled in parallel, one thread per core. They are added to the shell in the order
+// they were given, so the last one becomes the current model
+static bool load_models(struct shell_variables *shell_state, sds *model_files, int n_files) {
 
-    double simulation_steps          = 0;
+    struct model_load_queue queue = {0};
+    queue.current_dir             = shell_state->current_dir;
+    pthread_mutex_init(&queue.lock, NULL);
 
-    const char *simulation_steps_str = tokens[num_args];
+    for(int i = 0; i < n_files; i++) {
 
-    simulation_steps                 = string_to_double(simulation_steps_str);
+        bool repeated = false;
+        for(int j = 0; j < queue.n_models && !repeated; j++) {
+            char *a  = get_filename_without_ext(queue.model_files[j]);
+            char *b  = get_filename_without_ext(model_files[i]);
+            repeated = STR_EQUALS(a, b);
+            free(a);
+            free(b);
+        }
 
-    if(isnan(simulation_steps) || simulation_steps == 0) {
-        printf("Error parsing command %s. Invalid number: %s\n", tokens[0], simulation_steps_str);
-        return false;
+        if(repeated) {
+            printf("Model %s is given more than once!\n", model_files[i]);
+        } else if(!is_model_loaded(shell_state, model_files[i])) {
+            arrput(queue.model_files, model_files[i]);
+            queue.n_models++;
+        }
     }
 
-    struct model_config *model_config = NULL;
+    queue.model_configs = calloc(queue.n_models, sizeof(struct model_config *));
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
+    int *cpus     = get_usable_cpus();
+    int n_threads = arrlen(cpus);
+    arrfree(cpus);
+    if(n_threads > queue.n_models) n_threads = queue.n_models;
 
-    model_config->num_runs++;
+    pthread_t *threads = malloc(sizeof(pthread_t) * n_threads);
 
-    struct run_info params = {0};
-    params.time            = simulation_steps;
-    params.vars_max_value  = NULL;
-    params.vars_min_value  = NULL;
+    for(int t = 0; t < n_threads; t++) {
+        pthread_create(&threads[t], NULL, model_load_worker, &queue);
+    }
 
-    arrput(model_config->runs, params);
+    for(int t = 0; t < n_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
 
-    sds output_file   = get_model_output_file(model_config, model_config->num_runs);
+    bool success = queue.n_models == n_files;
 
-    sds model_command = sdscat(sdsempty(), model_config->model_command);
+    for(int i = 0; i < queue.n_models; i++) {
+        if(queue.model_configs[i]) {
+            add_loaded_model(shell_state, queue.model_configs[i]);
+        } else {
+            printf("Error loading model %s\n", queue.model_files[i]);
+            success = false;
+        }
+    }
+
+    free(threads);
+    free(queue.model_configs);
+    arrfree(queue.model_files);
+    pthread_mutex_destroy(&queue.lock);
+
+    return success;
+}
+
+COMMAND_FUNCTION(load) {
+    if(num_args == 1) {
+        return load_model(shell_state, tokens[1], NULL);
+    }
+    return load_models(shell_state, tokens + 1, num_args);
+}
 
-    model_command     = sdscatprintf(model_command, " %lf %s", simulation_steps, output_file);
+// Loads the statistics written by the solver. The time reached by the solver is returned in final_time_reached
+static bool load_run_stats(const char *filename, struct run_info *run_info, uint32_t expected_n_vars, double *final_time_reached) {
 
-    FILE *fp          = popen(model_command, "r");
-    check_and_print_execution_output(fp);
+    FILE *fp = fopen(filename, "rb");
 
-    int st = pclose(fp);
-    bool error = WEXITSTATUS(st) != 0;
+    if(fp == NULL) {
+        fprintf(stderr, "Error reading file %s\n", filename);
+        return false;
+    }
 
-    if(!error) {
-        printf("Model %s solved for %lf steps.\n", model_config->model_name, simulation_steps);
-        sds min_max_filename = sdsempty();
-        min_max_filename     = sdscatfmt(min_max_filename, "%s_min_max", output_file);
+    char magic[8];
+    uint32_t version, n_vars;
+    uint64_t n_samples;
+    double final_time;
+
+    bool valid = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) && memcmp(magic, RUN_STATS_MAGIC, sizeof(magic)) == 0 &&
+                 fread(&version, sizeof(uint32_t), 1, fp) == 1 && version == RUN_STATS_VERSION &&
+                 fread(&n_vars, sizeof(uint32_t), 1, fp) == 1 && n_vars == expected_n_vars &&
+                 fread(&n_samples, sizeof(uint64_t), 1, fp) == 1 &&
+                 fread(&final_time, sizeof(double), 1, fp) == 1;
+
+    struct var_stats *stats = NULL;
+
+    if(valid) {
+        stats = (struct var_stats *) malloc(sizeof(struct var_stats) * n_vars);
+        for(uint32_t i = 0; i < n_vars && valid; i++) {
+            double record[RUN_STATS_N_FIELDS];
+            valid = fread(record, sizeof(double), RUN_STATS_N_FIELDS, fp) == RUN_STATS_N_FIELDS;
+            stats[i] = (struct var_stats){record[0], record[1], record[2], record[3], record[4], record[5], record[6]};
+        }
+    }
 
-        load_min_max_data(min_max_filename, model_config);
-        sdsfree(min_max_filename);
+    struct solver_stats *solver_stats = NULL;
+    uint32_t solver_type;
+    double record[RUN_SOLVER_STATS_N_FIELDS];
+
+    //the counters of the solver come after the statistics of the variables
+    if(valid && fread(&solver_type, sizeof(uint32_t), 1, fp) == 1 && fread(record, sizeof(double), RUN_SOLVER_STATS_N_FIELDS, fp) == RUN_SOLVER_STATS_N_FIELDS) {
+        solver_stats  = (struct solver_stats *) malloc(sizeof(struct solver_stats));
+        *solver_stats = (struct solver_stats){solver_type, record[0], record[1], record[2], record[9], record[10], record[3], record[4], record[5], record[6], record[7], record[8]};
     } else {
-        model_config->num_runs--;
-        (void) arrpop(model_config->runs);
+        valid = false;
     }
 
-    sdsfree(model_command);
-    sdsfree(output_file);
+    fclose(fp);
+
+    if(!valid) {
+        fprintf(stderr, "Error reading file %s. Invalid statistics file\n", filename);
+        free(stats);
+        return false;
+    }
+
+    free(run_info->vars_stats);
+    free(run_info->solver_stats);
+    run_info->vars_stats   = stats;
+    run_info->solver_stats = solver_stats;
+    run_info->num_samples = n_samples;
+    *final_time_reached   = final_time;
 
     return true;
 }
 
-static bool plot_helper(struct shell_variables *shell_state, const char *command, command_type c_type, const char *model_name, unsigned int run_number, sds custom_gnuplot_cmd) {
+// Stores the results of a finished job in its run. Interrupted runs keep the partial output.
+// When verbose is false only the output of failed jobs is printed
+static void finish_solve_job(struct solve_job *job, bool verbose) {
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+    struct model_config *model_config = job->model_config;
+    unsigned int run_number           = job->run_number;
 
-    if(!model_config) return false;
+    sds prefix = job->id > 0 ? sdscatfmt(sdsempty(), "[%i] ", job->id) : sdsempty();
 
-    if(shell_state->gnuplot_handle == NULL) {
+    add_stage_time(STAGE_SOLVE, job->start_time, job->start_time + job->elapsed_time);
+
+    if(job->background && sdslen(job->output) > 0 && (verbose || job->status == JOB_FAILED)) {
+        printf("%s", job->output);
+    }
 
-        if(c_type == CMD_REPLOT || c_type == CMD_CUSTOM_REPLOT) {
+    if(job->status == JOB_DONE || job->status == JOB_CANCELLED) {
 
-            printf("Error executing command %s. No previous plot. plot the model first using \"plot modelname\" or list loaded models using \"list\"\n", command);
-            return false;
+        struct run_info *run_info = &model_config->runs[run_number - 1];
+        double final_time_reached = job->current_time;
+
+        sds stats_filename = get_model_stats_file(model_config, run_number);
+        load_run_stats(stats_filename, run_info, shlen(model_config->var_indexes) - 1, &final_time_reached);
+        sdsfree(stats_filename);
+
+        if(job->status == JOB_CANCELLED) {
+            run_info->time = final_time_reached;
+        } else if(job->store_result) {
+            sds output_file = get_model_output_file(model_config, run_number);
+            store_result_in_cache(job->result_key, output_file);
+            sdsfree(output_file);
         }
 
-        shell_state->gnuplot_handle = (struct popen2 *) malloc(sizeof(struct popen2));
-        if(shell_state->gnuplot_handle == NULL) {
-            fprintf(stderr, "%s - error allocating memory for gnuplot handle\n", __FUNCTION__);
-            return false;
+        if(!verbose) {
+            //nothing to print
+        } else if(job->status == JOB_DONE) {
+            printf("%sModel %s solved for %lf steps.\n", prefix, model_config->model_name, job->final_time);
+        } else {
+            printf("%sModel %s was interrupted at t = %lf. The partial output was kept as run %u.\n", prefix, model_config->model_name,
+                   final_time_reached, run_number);
         }
 
-        popen2("gnuplot", shell_state->gnuplot_handle);
-        if(strcmp(shell_state->default_gnuplot_term, "sixel") == 0) {
-            gnuplot_cmd(shell_state->gnuplot_handle, "set term sixel");
+    } else {
+        if(job->background && verbose) {
+            printf("%sError solving model %s. Run %u has no results.\n", prefix, model_config->model_name, run_number);
         }
 
-        gnuplot_cmd(shell_state->gnuplot_handle, "set term push");
+        if(run_number == model_config->num_runs) {
+            model_config->num_runs--;
+            (void) arrpop(model_config->runs);
+        }
     }
 
-    command = "plot";
-
-    if(c_type == CMD_PLOT_TERM || c_type == CMD_REPLOT_TERM) {
-        gnuplot_cmd(shell_state->gnuplot_handle, "set term dumb");
-    }
+    model_config->running_jobs--;
+    sdsfree(prefix);
+}
 
-    if(c_type == CMD_REPLOT || c_type == CMD_REPLOT_TERM) {
-        command = "replot";
-    }
+// Reports and removes the background jobs and reloads that finished. When called from the prompt a new line is printed first
+bool report_finished_jobs(struct shell_variables *shell_state, bool at_prompt) {
 
-    gnuplot_cmd(shell_state->gnuplot_handle, "set xlabel \"%s\"", model_config->plot_config.xlabel);
+    bool reported = false;
 
-    if(c_type == CMD_REPLOT) {
-        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"Variables\"");
-    } else if(c_type == CMD_PLOT) {
-        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"%s\"", model_config->plot_config.ylabel);
-    }
+    for(int i = 0; i < arrlen(shell_state->jobs); i++) {
 
-    sds output_file = get_model_output_file(model_config, run_number);
+        struct solve_job *job = shell_state->jobs[i];
 
-    if((c_type == CMD_CUSTOM_PLOT || c_type == CMD_CUSTOM_REPLOT) && custom_gnuplot_cmd != NULL && sdslen(custom_gnuplot_cmd) > 0) {
+        if(!is_solve_job_finished(job)) continue;
 
-        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"Variables\"");
-        gnuplot_cmd(shell_state->gnuplot_handle, custom_gnuplot_cmd);
+        if(at_prompt && !reported) printf("\n");
 
-    } else {
-        gnuplot_cmd(shell_state->gnuplot_handle, "%s '%s' u %d:%d title \"%s\" w lines lw 2",
-                    command, output_file, model_config->plot_config.xindex,
-                    model_config->plot_config.yindex, model_config->plot_config.title);
-    }
-    if(strcmp(shell_state->default_gnuplot_term, "sixel") == 0) {
-        printf("\n");
-    }
+        join_solve_job(job);
+        finish_solve_job(job, true);
+        free_solve_job(job);
 
-    sdsfree(output_file);
+        arrdel(shell_state->jobs, i);
+        i--;
 
-    if(c_type == CMD_PLOT_TERM || c_type == CMD_REPLOT_TERM) {
-        reset_terminal(shell_state->gnuplot_handle);
+        reported = true;
     }
 
-    return true;
-}
+    for(int i = 0; i < arrlen(shell_state->reload_messages); i++) {
 
-COMMAND_FUNCTION(plot) {
+        if(at_prompt && !reported) printf("\n");
 
-    char *model_name        = NULL;
-    unsigned int run_number = 0;
+        printf("%s\n", shell_state->reload_messages[i]);
+        sdsfree(shell_state->reload_messages[i]);
 
-    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
-        return false;
+        reported = true;
     }
-    return plot_helper(shell_state, tokens[0], CMD_PLOT, model_name, run_number, NULL);
+
+    arrsetlen(shell_state->reload_messages, 0);
+
+    return reported;
 }
 
-COMMAND_FUNCTION(replot) {
+// A run with the same executable and final time as a previous one (in this or in another session) reuses its output.
+// Returns false when the result is not cached
+static bool load_cached_solve_result(struct model_config *model_config, double final_time, const char *output_file, uint8_t result_key[16]) {
 
-    char *model_name        = NULL;
-    unsigned int run_number = 0;
+    //the final time is formatted as it is passed to the solver
+    char options[64];
+    snprintf(options, sizeof(options), "%lf", final_time);
 
-    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
-        return false;
-    }
-    return plot_helper(shell_state, tokens[0], CMD_REPLOT, model_name, run_number, NULL);
-}
+    get_result_cache_key(model_config->build_key, options, result_key);
 
-COMMAND_FUNCTION(plottoterm) {
+    struct run_info *run_info = &model_config->runs[model_config->num_runs - 1];
 
-    char *model_name        = NULL;
-    unsigned int run_number = 0;
+    //the cached output replaces the one the columns were built from
+    sds cols_file = sdscat(sdsnew(output_file), RUN_COLUMNS_FILE_SUFFIX);
+    unlink(cols_file);
+    sdsfree(cols_file);
 
-    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+    if(!fetch_result_from_cache(result_key, output_file)) {
+        run_info->cache_status = RUN_CACHE_MISS;
         return false;
     }
 
-    return plot_helper(shell_state, tokens[0], CMD_PLOT_TERM, model_name, run_number, NULL);
+    run_info->cache_status = RUN_CACHE_HIT;
+
+    double final_time_reached = final_time;
+    sds stats_filename        = get_model_stats_file(model_config, model_config->num_runs);
+    load_run_stats(stats_filename, run_info, shlen(model_config->var_indexes) - 1, &final_time_reached);
+    sdsfree(stats_filename);
+
+    return true;
 }
 
-COMMAND_FUNCTION(replottoterm) {
-    char *model_name        = NULL;
-    unsigned int run_number = 0;
+COMMAND_FUNCTION(solve) {
 
-    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+    double simulation_steps          = 0;
+
+    const char *simulation_steps_str = tokens[num_args];
+
+    simulation_steps                 = string_to_double(simulation_steps_str);
+
+    if(isnan(simulation_steps) || simulation_steps == 0) {
+        printf("Error parsing command %s. Invalid number: %s\n", tokens[0], simulation_steps_str);
         return false;
     }
 
-    return plot_helper(shell_state, tokens[0], CMD_REPLOT_TERM, model_name, run_number, NULL);
-}
+    struct model_config *model_config = NULL;
 
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
 
-static bool plot_file_helper(struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+    bool background = shell_state->run_in_background;
 
-    const char *command = tokens[0];
-    char *model_name;
-    char *file_name = NULL;
-    unsigned int run_number;
+    //detached solves are waited for by the caller, without the shell lock (see server.h and loadcmds -j)
+    bool detached = shell_state->detach_solves && !background;
 
-    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &file_name);
+    model_config->num_runs++;
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+    struct run_info params = {0};
+    params.time            = simulation_steps;
 
-    if(!model_config) return false;
+    arrput(model_config->runs, params);
 
-    if(shell_state->gnuplot_handle == NULL) {
-        if(c_type == CMD_REPLOT_FILE) {
-            printf("Error executing command %s. No previous plot. plot the model first using \"plot modelname\" or list loaded models using \"list\"\n", command);
-            return false;
-        }
+    sds output_file = get_model_output_file(model_config, model_config->num_runs);
 
-        shell_state->gnuplot_handle = (struct popen2 *) malloc(sizeof(struct popen2));
-        if(shell_state->gnuplot_handle == NULL) {
-            fprintf(stderr, "%s - error allocating memory for gnuplot handle\n", __FUNCTION__);
-            return false;
-        }
-        popen2("gnuplot", shell_state->gnuplot_handle);
+    //with setreportio the user wants to measure the solver, so it always runs. The same for models with endfn functions,
+    //as a cached result would skip what they print or write
+    bool memoize = shell_state->memoize_solves && !shell_state->report_io && model_config->has_build_key && is_build_cache_enabled() &&
+                   !has_end_functions(model_config->program);
+    uint8_t result_key[16];
 
-        if(strcmp(shell_state->default_gnuplot_term, "sixel") == 0) {
-            gnuplot_cmd(shell_state->gnuplot_handle, "set term sixel");
-        }
+    double start = begin_stage();
 
-        gnuplot_cmd(shell_state->gnuplot_handle, "set term push");
+    if(memoize && load_cached_solve_result(model_config, simulation_steps, output_file, result_key)) {
+        end_stage(STAGE_SOLVE, start);
+        printf("Model %s solved for %lf steps (cached result, run %u).\n", model_config->model_name, simulation_steps, model_config->num_runs);
+        sdsfree(output_file);
+        return true;
     }
 
-    if(c_type == CMD_PLOT_FILE) {
-        command = "plot";
-    } else {
-        command = "replot";
-    }
+    struct solve_job *job = start_solve_job(model_config->model_command, simulation_steps, output_file, NULL, -1, shell_state->report_io, background || detached);
 
-    if(file_name == NULL) {
-        //This should not happen
-        printf("Error executing command %s. Invalid model file_name!\n", command);
+    sdsfree(output_file);
+
+    if(!job) {
+        model_config->num_runs--;
+        (void) arrpop(model_config->runs);
         return false;
     }
 
-    const char *ext = get_filename_ext(file_name);
+    job->model_config = model_config;
+    job->run_number   = model_config->num_runs;
+    job->store_result = memoize;
+    memcpy(job->result_key, result_key, sizeof(result_key));
+    model_config->running_jobs++;
 
-    if(!FILE_HAS_EXTENSION(ext, "pdf") && !FILE_HAS_EXTENSION(ext, "png")) {
-        printf("Error executing command %s. Only .pdf and .png outputs are supported\n", command);
-        return false;
+    if(background) {
+        job->id = ++shell_state->next_job_id;
+        arrput(shell_state->jobs, job);
+        printf("[%d] Solving model %s for %lf steps in the background (run %u).\n", job->id, model_config->model_name, simulation_steps, job->run_number);
     }
 
-    gnuplot_cmd(shell_state->gnuplot_handle, "set terminal %s", ext);
-    gnuplot_cmd(shell_state->gnuplot_handle, "set output \"%s", file_name);
-    gnuplot_cmd(shell_state->gnuplot_handle, "set xlabel \"%s\"", model_config->plot_config.xlabel);
-    gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"%s\"", model_config->plot_config.ylabel);
+    run_solve_job(job);
 
-    sds output_file = get_model_output_file(model_config, run_number);
+    if(background) {
+        return true;
+    }
 
-    gnuplot_cmd(shell_state->gnuplot_handle, "%s '%s' u %d:%d title \"%s\" w lines lw 2",
-                command, output_file, model_config->plot_config.xindex,
-                model_config->plot_config.yindex, model_config->plot_config.title);
+    if(detached) {
+        shell_state->detached_job = job;
+        return true;
+    }
 
-    sdsfree(output_file);
+    finish_solve_job(job, true);
 
-    reset_terminal(shell_state->gnuplot_handle);
+    bool success = job->status != JOB_FAILED;
+    free_solve_job(job);
 
-    return true;
+    return success;
 }
 
-COMMAND_FUNCTION(plottofile) {
-    return plot_file_helper(shell_state, tokens, CMD_PLOT_FILE, num_args);
-}
+// Reports a detached solve once join_solve_job returned
+bool report_detached_job(struct solve_job *job) {
 
-COMMAND_FUNCTION(replottofile) {
-    return plot_file_helper(shell_state, tokens, CMD_REPLOT_FILE, num_args);
-}
+    finish_solve_job(job, true);
 
-static bool setplot_helper(struct shell_variables *shell_state, const sds *tokens, command_type c_type, int num_args, bool quiet) {
+    bool success = job->status != JOB_FAILED;
+    free_solve_job(job);
 
-    const char *command               = tokens[0];
+    return success;
+}
 
-    struct model_config *model_config = NULL;
+#define MAX_PROFILE_ROWS 20
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
+struct statement_profile {
+    int line;
+    uint64_t samples;
+    char name[256];
+};
 
-    const char *cmd_param = tokens[num_args];
+static int compare_statements_by_samples(const void *a, const void *b) {
 
-    if(c_type == CMD_SET_PLOT_X || c_type == CMD_SET_PLOT_Y) {
+    uint64_t sa = ((const struct statement_profile *) a)->samples;
+    uint64_t sb = ((const struct statement_profile *) b)->samples;
 
-        bool index_as_str;
-        int index      = (int) string_to_long(cmd_param, &index_as_str);
-        char *var_name = NULL;
+    if(sa != sb) return sa > sb ? -1 : 1;
+    return ((const struct statement_profile *) a)->line - ((const struct statement_profile *) b)->line;
+}
 
-        if(index_as_str) {
-            //string was passed, try to get the index from the var_indexes on model_config
-            index = shget(model_config->var_indexes, cmd_param);
+// Prints the statements of the RHS where the solver spent more time, from the profile written by a profiling build
+static bool print_statement_profile(const char *filename, const struct run_info *run_info) {
 
-            if(index == -1) {
-                printf("Error parsing command %s. Invalid variable name: %s. You can list model variable name using vars %s\n", command, cmd_param, model_config->model_name);
-                return false;
-            }
-        } else {
-            var_name = get_var_name(model_config, index);
+    FILE *fp = fopen(filename, "r");
 
-            if(!var_name) {
-                printf("Error parsing command %s. Invalid index: %d. You can list model variable name using vars %s\n", command, index, model_config->model_name);
-                return false;
-            }
-        }
+    if(fp == NULL) {
+        printf("Error reading file %s\n", filename);
+        return false;
+    }
 
-        CREATE_TABLE(table);
-        if(c_type == CMD_SET_PLOT_X) {
-            model_config->plot_config.xindex = index;
-            if(!quiet) {
+    unsigned long long rhs_samples;
+    int n_statements;
+    struct statement_profile *statements = NULL;
 
-                free(model_config->plot_config.xlabel);
+    bool valid = fscanf(fp, "%llu %d", &rhs_samples, &n_statements) == 2 && n_statements >= 0;
 
-                if(index_as_str) {
-                    model_config->plot_config.xlabel = strdup(cmd_param);
-                    ft_printf_ln(table, "\'%s\' variable will be plotted along the X axis", cmd_param);
-                } else {
-                    model_config->plot_config.xlabel = strdup(var_name);
-                    ft_printf_ln(table, "\'%s\' variable will be plotted along the X axis", var_name);
-                }
-            }
-        } else {
+    for(int i = 0; i < n_statements && valid; i++) {
+        struct statement_profile statement;
+        unsigned long long samples;
+        valid             = fscanf(fp, "%d %llu %255s", &statement.line, &samples, statement.name) == 3;
+        statement.samples = samples;
+        arrput(statements, statement);
+    }
 
-            model_config->plot_config.yindex = index;
+    fclose(fp);
 
-            free(model_config->plot_config.ylabel);
+    if(!valid) {
+        printf("Error reading file %s. Invalid profile file\n", filename);
+        arrfree(statements);
+        return false;
+    }
 
-            if(index_as_str) {
-                model_config->plot_config.ylabel = strdup(cmd_param);
-                model_config->plot_config.title  = strdup(cmd_param);
-            } else {
-                model_config->plot_config.ylabel = strdup(var_name);
-                model_config->plot_config.title  = strdup(var_name);
-            }
+    if(rhs_samples == 0) {
+        printf("The run was too short to sample the RHS. Use a longer final time\n");
+        arrfree(statements);
+        return true;
+    }
 
-            if(!quiet) {
-                ft_printf_ln(table, "\'%s\' variable will be plotted along the Y axis", model_config->plot_config.ylabel);
-            }
-        }
+    qsort(statements, n_statements, sizeof(struct statement_profile), compare_statements_by_samples);
 
-        PRINT_AND_FREE_TABLE(table);
+    double rhs_time = run_info->solver_stats ? run_info->solver_stats->rhs_time : 0.0;
 
-    } else if(c_type == CMD_SET_PLOT_X_LABEL || c_type == CMD_SET_PLOT_Y_LABEL) {
+    printf("Time spent in the RHS by statement (%llu samples)\n", rhs_samples);
 
-        if(c_type == CMD_SET_PLOT_X_LABEL) {
-            free(model_config->plot_config.xlabel);
-            model_config->plot_config.xlabel = strdup(cmd_param);
-        } else {
-            free(model_config->plot_config.ylabel);
-            model_config->plot_config.ylabel = strdup(cmd_param);
-        }
-    } else if(c_type == CMD_SET_PLOT_TITLE) {
-        free(model_config->plot_config.title);
-        model_config->plot_config.title = strdup(cmd_param);
+    CREATE_TABLE(table);
+    ft_printf_ln(table, "Line|Statement|Samples|Time|RHS time");
+
+    for(int i = 0; i < n_statements && i < MAX_PROFILE_ROWS && statements[i].samples > 0; i++) {
+        double fraction = (double) statements[i].samples / rhs_samples;
+        ft_printf_ln(table, "%d|%s|%lu|%.3lf s|%.1lf%%", statements[i].line, statements[i].name, (unsigned long) statements[i].samples,
+                     rhs_time * fraction, 100.0 * fraction);
     }
 
+    PRINT_AND_FREE_TABLE(table);
+
+    arrfree(statements);
+
     return true;
 }
 
-COMMAND_FUNCTION(setplotx) {
-    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_X, num_args, false);
-}
+COMMAND_FUNCTION(profile) {
 
-COMMAND_FUNCTION(setploty) {
-    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, num_args, false);
-}
+    double final_time = string_to_double(tokens[num_args]);
 
-COMMAND_FUNCTION(setplotxlabel) {
-    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_X_LABEL, num_args, false);
-}
+    if(isnan(final_time) || final_time <= 0) {
+        printf("Error executing command %s. Invalid final time: %s\n", tokens[0], tokens[num_args]);
+        return false;
+    }
 
-COMMAND_FUNCTION(setplotylabel) {
-    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y_LABEL, num_args, false);
-}
+    struct model_config *model_config = NULL;
 
-COMMAND_FUNCTION(setplotlegend) {
-    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_TITLE, num_args, false);
-}
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
 
-static bool get_plotvar_command(sds *plot_command, struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+    printf("Compiling model %s for profiling\n", model_config->model_name);
+    sds executable = compile_model_for_profiling(model_config);
 
-    if(plot_command == NULL || *plot_command == NULL) {
+    if(!executable) {
+        printf("Error compiling model %s for profiling\n", model_config->model_name);
         return false;
     }
 
-    unsigned int run_number;
-    char *model_name = NULL;
-    char *tmp;
+    model_config->num_runs++;
 
-    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &tmp);
+    struct run_info run_info = {0};
+    run_info.time            = final_time;
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+    arrput(model_config->runs, run_info);
 
-    if(!model_config) return false;
+    sds output_file       = get_model_output_file(model_config, model_config->num_runs);
+    sds profile_file      = sdscat(sdsdup(output_file), RUN_PROFILE_FILE_SUFFIX);
+    struct solve_job *job = start_solve_job(executable, final_time, output_file, NULL, -1, false, false);
 
-    bool ret = true;
+    sdsfree(output_file);
 
-    if(num_args == 1) {
-        ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 1, true);
-    } else if(num_args == 2) {
+    bool success = job != NULL;
 
-        bool error;
-        string_to_long(tokens[2], &error);
+    if(job) {
+        job->model_config = model_config;
+        job->run_number   = model_config->num_runs;
+        model_config->running_jobs++;
 
-        if(!error) {
-            ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 1, true);
-        } else {
-            ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 2, true);
+        run_solve_job(job);
+        finish_solve_job(job, true);
+
+        //an interrupted run still has the profile of what was solved
+        success = job->status != JOB_FAILED;
+        free_solve_job(job);
+
+        if(success) {
+            success = print_statement_profile(profile_file, &model_config->runs[model_config->num_runs - 1]);
         }
-    } else if(num_args == 3) {
-        ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 2, true);
+    } else {
+        model_config->num_runs--;
+        (void) arrpop(model_config->runs);
     }
 
-    if(ret == false) {
-        return false;
+    unlink(profile_file);
+    sdsfree(profile_file);
+    unlink(executable);
+    sdsfree(executable);
+
+    return success;
+}
+
+// Runs are still being written by the jobs, so their model can't be unloaded or reset
+static bool has_running_jobs_print_error(const char *command, struct model_config *model_config) {
+    if(model_config->running_jobs > 0) {
+        printf("Error executing command %s. Model %s has running jobs. Wait for them or kill them first\n", command, model_config->model_name);
+        return true;
     }
+    return false;
+}
 
-    sds output_file = get_model_output_file(model_config, run_number);
+static struct solve_job *get_job_or_print_error(struct shell_variables *shell_state, const char *command, const char *id_str) {
 
-    char *first     = "plot";
+    bool error;
+    int id = (int) string_to_long(id_str, &error);
 
-    if(c_type == CMD_REPLOT) {
-        first = "replot";
+    for(int i = 0; i < arrlen(shell_state->jobs) && !error; i++) {
+        if(shell_state->jobs[i]->id == id) {
+            return shell_state->jobs[i];
+        }
     }
 
-    if(sdslen(*plot_command) > 0) first = ", ";
+    printf("Error executing command %s. There is no running job with id %s\n", command, id_str);
+    return NULL;
+}
 
-    char *title   = get_var_name(model_config, model_config->plot_config.yindex);
+COMMAND_FUNCTION(jobs) {
 
-    *plot_command = sdscatfmt(*plot_command, "%s '%s' u %i:%i title '%s' w lines lw 2",
-                              first, output_file, model_config->plot_config.xindex,
-                              model_config->plot_config.yindex, title);
+    (void) tokens;
+    (void) num_args;
 
-    sdsfree(output_file);
+    report_finished_jobs(shell_state, false);
+
+    int n_jobs = arrlen(shell_state->jobs);
+
+    if(n_jobs == 0) {
+        printf("No running jobs\n");
+        return true;
+    }
+
+    CREATE_TABLE(table);
+
+    ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER);
+    ft_write_ln(table, "Job", "Model", "Run", "Status", "Time", "Progress", "Steps/s", "Elapsed (s)");
+
+    for(int i = 0; i < n_jobs; i++) {
+        struct solve_job *job = shell_state->jobs[i];
+
+        pthread_mutex_lock(&job->lock);
+        const char *status = job->cancel_requested && !job->finished ? "Stopping" : get_solve_job_status_name(job->status);
+        double elapsed     = job->finished ? job->elapsed_time : get_wall_time() - job->start_time;
+
+        ft_printf_ln(table, "%d|%s|%u|%s|%lf / %lf|%.1lf%%|%.0lf|%.2lf", job->id, job->model_config->model_name, job->run_number, status,
+                     job->current_time, job->final_time, 100.0 * job->current_time / job->final_time, job->steps_per_second, elapsed);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    PRINT_AND_FREE_TABLE(table);
 
     return true;
 }
 
-static bool plot_or_replot_var_helper(struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+// Blocks until the given job (or all jobs) finish. Ctrl+C stops waiting but keeps the jobs running
+COMMAND_FUNCTION(waitjobs) {
 
-    int varcount      = 0;
-    sds *vars_to_plot = NULL;
-    int split_index;
+    struct solve_job *job = NULL;
 
     if(num_args == 1) {
-        vars_to_plot = sdssplit(tokens[1], " ", &varcount);
-        split_index  = 1;
-    } else if(num_args == 2) {
-        bool dont_have_run_number;
-        string_to_long(tokens[2], &dont_have_run_number);
+        job = get_job_or_print_error(shell_state, tokens[0], tokens[1]);
+        if(!job) return false;
+    }
 
-        if(dont_have_run_number) {
-            vars_to_plot = sdssplit(tokens[2], " ", &varcount);
-            split_index  = 2;
+    set_waiting_for_jobs(true);
+
+    struct timespec interval = {0, 50000000};
+
+    while(!was_job_wait_interrupted()) {
+
+        bool finished = true;
+
+        if(job) {
+            finished = is_solve_job_finished(job);
         } else {
-            vars_to_plot = sdssplit(tokens[1], " ", &varcount);
-            split_index  = 1;
+            for(int i = 0; i < arrlen(shell_state->jobs) && finished; i++) {
+                finished = is_solve_job_finished(shell_state->jobs[i]);
+            }
         }
-    } else if(num_args == 3) {
-        vars_to_plot = sdssplit(tokens[2], " ", &varcount);
-        split_index  = 2;
-    }
 
-    bool ret = true;
-
-    char *new_tokens[num_args + 1];
+        if(finished) break;
 
-    for(int i = 0; i < num_args + 1; i++) {
-        new_tokens[i] = tokens[i];
+        nanosleep(&interval, NULL);
     }
 
-    unsigned int run_number;
-    char *model_name = NULL;
-    char *tmp;
+    bool interrupted = was_job_wait_interrupted();
+    set_waiting_for_jobs(false);
 
-    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &tmp);
+    report_finished_jobs(shell_state, false);
 
-    const struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
-    if(!model_config) {
-        sdsfreesplitres(vars_to_plot, varcount);
-        return false;
+    if(interrupted) {
+        printf("\nStopped waiting. The jobs are still running in the background.\n");
     }
 
-    sds gnuplot_cmd = sdsempty();
+    return !interrupted;
+}
 
-    for(int i = 0; i < varcount; i++) {
-        new_tokens[split_index] = vars_to_plot[i];
-        bool success            = get_plotvar_command(&gnuplot_cmd, shell_state, new_tokens, c_type, num_args);
+COMMAND_FUNCTION(killjob) {
 
-        if(!success) {
-            sdsfree(gnuplot_cmd);
-            sdsfreesplitres(vars_to_plot, varcount);
-            return false;
-        }
-    }
+    (void) num_args;
 
-    command_type ct = CMD_CUSTOM_PLOT;
+    struct solve_job *job = get_job_or_print_error(shell_state, tokens[0], tokens[1]);
 
-    if(c_type == CMD_REPLOT) ct = CMD_CUSTOM_REPLOT;
+    if(!job) return false;
 
-    ret = plot_helper(shell_state, tokens[0], ct, model_name, run_number, gnuplot_cmd);
-    sdsfree(gnuplot_cmd);
-    sdsfreesplitres(vars_to_plot, varcount);
-    return ret;
-}
+    cancel_solve_job(job);
 
-COMMAND_FUNCTION(plotvar) {
-    return plot_or_replot_var_helper(shell_state, tokens, CMD_PLOT, num_args);
+    return true;
 }
 
-COMMAND_FUNCTION(replotvar) {
-    return plot_or_replot_var_helper(shell_state, tokens, CMD_REPLOT, num_args);
+#define MAX_SWEEP_POINTS 10000
+
+struct sweep_param {
+    char *name;
+    double start;
+    double end;
+};
+
+// Full factorial design: every combination of n_values[p] evenly spaced values of each parameter. The last parameter varies fastest
+static double *build_full_factorial_design(const struct sweep_param *params, const int *n_values, int n_params, int n_points) {
+
+    double *design = malloc(sizeof(double) * n_points * n_params);
+
+    for(int i = 0; i < n_points; i++) {
+        int rest = i;
+        for(int p = n_params - 1; p >= 0; p--) {
+            int k    = rest % n_values[p];
+            rest     = rest / n_values[p];
+            double h = n_values[p] > 1 ? (params[p].end - params[p].start) / (n_values[p] - 1) : 0.0;
+            design[i * n_params + p] = params[p].start + k * h;
+        }
+    }
+
+    return design;
 }
 
-COMMAND_FUNCTION(plotvars) {
+// Latin hypercube design: each parameter range is split into n_points strata and every stratum is sampled once.
+// A fixed seed is used so the same command gives the same points
+static double *build_latin_hypercube_design(const struct sweep_param *params, int n_params, int n_points) {
 
-    unsigned int run_number;
-    char *model_name;
+    double *design           = malloc(sizeof(double) * n_points * n_params);
+    int *strata              = malloc(sizeof(int) * n_points);
+    unsigned short state[3] = {0x330E, 0xABCD, 0x1234};
 
-    get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number);
+    for(int p = 0; p < n_params; p++) {
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+        for(int i = 0; i < n_points; i++) {
+            strata[i] = i;
+        }
 
-    if(!model_config) return false;
+        //Fisher-Yates shuffle
+        for(int i = n_points - 1; i > 0; i--) {
+            int j     = (int) (erand48(state) * (i + 1));
+            int tmp   = strata[i];
+            strata[i] = strata[j];
+            strata[j] = tmp;
+        }
 
-    int old_xindex   = model_config->plot_config.xindex;
-    int old_yindex   = model_config->plot_config.yindex;
+        for(int i = 0; i < n_points; i++) {
+            double u                 = (strata[i] + erand48(state)) / n_points;
+            design[i * n_params + p] = params[p].start + u * (params[p].end - params[p].start);
+        }
+    }
 
-    char *old_xlabel = strdup(model_config->plot_config.xlabel);
-    char *old_ylabel = strdup(model_config->plot_config.ylabel);
-    char *old_title  = strdup(model_config->plot_config.title);
+    free(strata);
 
+    return design;
+}
 
-    int len          = shlen(model_config->var_indexes);
+static struct solve_job *start_sweep_point(struct model_config *model_config, const char *executable, double final_time, const struct sweep_param *params,
+                                           const double *values, int n_params, int cpu) {
 
-    sds all_vars     = sdscatfmt(sdsempty(), "%s", model_config->var_indexes[1].key);
+    struct run_info run_info = {0};
+    run_info.time            = final_time;
 
-    if(len - 2 > 10) {
-        printf("\nModel %s has %d ODE's. Do you want to plot all of them? [y]: ", model_config->model_name, len - 2);
-        char answer = (char) getchar();
+    char **args = NULL;
 
-        if(answer != 'Y' && answer != 'y' && answer != '\r') {
-            return false;
-        }
+    for(int p = 0; p < n_params; p++) {
+        struct run_param param = {strdup(params[p].name), values[p]};
+        arrput(run_info.params, param);
+        arrput(args, sdscatprintf(sdsempty(), "%s=%.17g", params[p].name, values[p]));
     }
 
-    for(int i = 2; i < len; i++) {
-        all_vars = sdscatfmt(all_vars, " %s", model_config->var_indexes[i].key);
-    }
+    model_config->num_runs++;
+    arrput(model_config->runs, run_info);
 
-    sds new_tokens[4] = {sdsnew("plotvar"), NULL, NULL, NULL};
+    sds output_file       = get_model_output_file(model_config, model_config->num_runs);
+    struct solve_job *job = start_solve_job(executable, final_time, output_file, args, cpu, false, true);
 
-    uint8_t to_free   = 1;
+    sdsfree(output_file);
+    for(int p = 0; p < n_params; p++) {
+        sdsfree(args[p]);
+    }
+    arrfree(args);
 
-    if(num_args == 0) {
-        new_tokens[1] = all_vars;
-        to_free       = 1;
-    } else if(num_args == 1) {
-        bool model_name_only;
-        string_to_long(tokens[1], &model_name_only);
+    if(!job) {
+        model_config->num_runs--;
+        struct run_info last = arrpop(model_config->runs);
+        for(int p = 0; p < n_params; p++) {
+            free(last.params[p].name);
+        }
+        arrfree(last.params);
+        return NULL;
+    }
 
-        if(model_name_only) {
-            new_tokens[1] = tokens[1];
-            new_tokens[2] = all_vars;
-            to_free       = 2;
+    job->model_config = model_config;
+    job->run_number   = model_config->num_runs;
+    model_config->running_jobs++;
+
+    run_solve_job(job);
+
+    return job;
+}
+
+// Runs all the points of the design with at most sweep_workers processes at a time, each one pinned to a core.
+// Every point is registered as a run of the model with its parameter values. Ctrl+C stops the sweep and keeps the finished points
+static bool run_sweep(struct shell_variables *shell_state, struct model_config *model_config, double final_time, const struct sweep_param *params,
+                      int n_params, const double *design, int n_points) {
+
+    char **param_names = NULL;
+    for(int p = 0; p < n_params; p++) {
+        arrput(param_names, params[p].name);
+    }
+
+    printf("Compiling model %s for the sweep\n", model_config->model_name);
+    sds executable = compile_model_with_runtime_params(model_config, param_names);
+    arrfree(param_names);
+
+    if(!executable) {
+        printf("Error compiling model %s for the sweep\n", model_config->model_name);
+        return false;
+    }
+
+    //the workers are pinned to the CPUs the shell can run on
+    int *cpus     = get_usable_cpus();
+    int n_cpus    = arrlen(cpus);
+    int n_workers = shell_state->sweep_workers > 0 ? shell_state->sweep_workers : n_cpus;
+    if(n_workers > n_points) n_workers = n_points;
+
+    struct solve_job **workers = calloc(n_workers, sizeof(struct solve_job *));
+    enum solve_job_status *status = malloc(sizeof(enum solve_job_status) * n_points);
+    unsigned int *runs            = calloc(n_points, sizeof(unsigned int));
+    int *worker_point             = malloc(sizeof(int) * n_workers);
+
+    printf("Running %d points on %d worker(s)\n", n_points, n_workers);
+
+    bool show_progress = isatty(STDOUT_FILENO);
+    bool stopping      = false;
+    int next_point     = 0;
+    int n_running      = 0;
+    int n_finished     = 0;
+
+    struct timespec interval = {0, 20000000};
+
+    set_waiting_for_jobs(true);
+
+    while(n_running > 0 || (next_point < n_points && !stopping)) {
+
+        if(!stopping && was_job_wait_interrupted()) {
+            stopping = true;
+            for(int w = 0; w < n_workers; w++) {
+                if(workers[w]) cancel_solve_job(workers[w]);
+            }
+        }
+
+        for(int w = 0; w < n_workers; w++) {
+
+            if(workers[w] && is_solve_job_finished(workers[w])) {
+                struct solve_job *job = workers[w];
+                join_solve_job(job);
+                finish_solve_job(job, false);
+                status[worker_point[w]] = job->status;
+                free_solve_job(job);
+                workers[w] = NULL;
+                n_running--;
+                n_finished++;
+            }
+
+            if(!workers[w] && !stopping && next_point < n_points) {
+                workers[w] = start_sweep_point(model_config, executable, final_time, params, &design[next_point * n_params], n_params, cpus[w % n_cpus]);
+                if(workers[w]) {
+                    worker_point[w]  = next_point;
+                    runs[next_point] = workers[w]->run_number;
+                    n_running++;
+                } else {
+                    status[next_point] = JOB_FAILED;
+                    n_finished++;
+                }
+                next_point++;
+            }
+        }
+
+        if(show_progress) {
+            printf("\r\033[KSweep: %d of %d points finished, %d running", n_finished, n_points, n_running);
+            fflush(stdout);
+        }
+
+        if(n_running > 0) nanosleep(&interval, NULL);
+    }
+
+    set_waiting_for_jobs(false);
+
+    if(show_progress) printf("\r\033[K");
+
+    unlink(executable);
+    sdsfree(executable);
+
+    CREATE_TABLE(table);
+
+    ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER);
+    ft_write(table, "Run");
+    for(int p = 0; p < n_params; p++) {
+        ft_write(table, params[p].name);
+    }
+    ft_write_ln(table, "Status");
+
+    for(int i = 0; i < n_finished; i++) {
+        if(runs[i]) {
+            ft_printf(table, "%u", runs[i]);
         } else {
-            new_tokens[1] = all_vars;
-            new_tokens[2] = tokens[1];
-            to_free       = 1;
+            ft_write(table, "-");
         }
-    } else {
-        new_tokens[1] = tokens[1];
-        new_tokens[2] = all_vars;
-        new_tokens[3] = tokens[2];
-        to_free       = 2;
+        for(int p = 0; p < n_params; p++) {
+            ft_printf(table, "%g", design[i * n_params + p]);
+        }
+        ft_write_ln(table, get_solve_job_status_name(status[i]));
     }
 
-    if(STRING_EQUALS(tokens[0], "plotvars")) {
-        plot_or_replot_var_helper(shell_state, new_tokens, CMD_PLOT, num_args + 1);
-    } else {
-        plot_or_replot_var_helper(shell_state, new_tokens, CMD_REPLOT, num_args + 1);
+    PRINT_AND_FREE_TABLE(table);
+
+    if(stopping) {
+        printf("Sweep interrupted. %d of %d points were run.\n", n_finished, n_points);
     }
 
-    //The tokens variable will be freed on the parse_and_execute_command function
-    //so we can free when new_tokens = tokens[x]
-    sdsfree(new_tokens[0]);
-    sdsfree(new_tokens[to_free]);
+    free(workers);
+    free(status);
+    free(runs);
+    free(worker_point);
+    arrfree(cpus);
 
+    return !stopping;
+}
 
-    //RESET to last configured plot
-    model_config->plot_config.xindex = old_xindex;
-    model_config->plot_config.yindex = old_yindex;
+static bool parse_sweep_params(const char *command, struct model_config *model_config, sds *tokens, int first, int last, int group_size,
+                               struct sweep_param **params, int **n_values) {
 
+    for(int i = first; i <= last; i += group_size) {
 
-    model_config->plot_config.xlabel = old_xlabel;
-    model_config->plot_config.ylabel = old_ylabel;
-    model_config->plot_config.title  = old_title;
+        struct sweep_param param = {0};
+        param.name               = tokens[i];
 
+        int stmt = get_statement_index(model_config, ast_assignment_stmt, param.name);
 
-    return false;
-}
+        if(stmt == -1 || !is_runtime_param_assignment(model_config->program[stmt])) {
+            printf("Error executing command %s. %s is not a parameter of model %s. You can list the parameters using getparamvalues %s\n", command,
+                   param.name, model_config->model_name, model_config->model_name);
+            return false;
+        }
 
-COMMAND_FUNCTION(replotvars) {
-    return plotvars(shell_state, tokens, num_args);
-}
+        param.start = string_to_double(tokens[i + 1]);
+        param.end   = string_to_double(tokens[i + 2]);
 
+        if(isnan(param.start) || isnan(param.end)) {
+            printf("Error executing command %s. Invalid range for parameter %s: %s %s\n", command, param.name, tokens[i + 1], tokens[i + 2]);
+            return false;
+        }
 
-COMMAND_FUNCTION(list) {
+        if(n_values) {
+            bool error;
+            long n = string_to_long(tokens[i + 3], &error);
+            if(error || n <= 0) {
+                printf("Error executing command %s. Invalid number of values for parameter %s: %s\n", command, param.name, tokens[i + 3]);
+                return false;
+            }
+            arrput(*n_values, (int) n);
+        }
 
-    (void) tokens;
-    (void) num_args;
+        arrput(*params, param);
+    }
 
-    int len = shlen(shell_state->loaded_models);
+    return true;
+}
 
-    CREATE_TABLE(table);
+COMMAND_FUNCTION(sweep) {
 
-    ft_set_cell_prop(table, FT_ANY_COLUMN, 0, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
-    ft_set_cell_prop(table, FT_ANY_COLUMN, 1, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+    //sweep [model] final_time param start end n [param2 start end n ...]
+    const char *command = tokens[0];
+    int first_arg;
 
-    if(len == 0) {
-        ft_printf_ln(table, "No models loaded");
+    if((num_args - 1) % 4 == 0) {
+        first_arg = 1;
+    } else if((num_args - 2) % 4 == 0) {
+        first_arg = 2;
     } else {
-        ft_printf_ln(table, "Available models|Num. of runs");
-        for(int i = 0; i < len; i++) {
-            char *name = shell_state->loaded_models[i].key;
-            if(!STR_EQUALS(name, shell_state->current_model->model_name)) {
-                ft_printf_ln(table, "%s|%d", name, shell_state->loaded_models[i].value->num_runs);
-            } else {
-                ft_printf_ln(table, "%s (*)|%d", name, shell_state->loaded_models[i].value->num_runs);
-            }
+        printf("Error executing command %s. Usage: %s [model] final_time param start end n [param2 start end n ...]\n", command, command);
+        return false;
+    }
+
+    struct model_config *model_config = load_model_config_or_print_error(shell_state, command, first_arg == 2 ? tokens[1] : NULL);
+    if(!model_config) return false;
+
+    double final_time = string_to_double(tokens[first_arg]);
+
+    if(isnan(final_time) || final_time <= 0) {
+        printf("Error executing command %s. Invalid final time: %s\n", command, tokens[first_arg]);
+        return false;
+    }
+
+    struct sweep_param *params = NULL;
+    int *n_values              = NULL;
+    bool success               = parse_sweep_params(command, model_config, tokens, first_arg + 1, num_args, 4, &params, &n_values);
+
+    long n_points = 1;
+    for(int p = 0; p < arrlen(n_values) && success; p++) {
+        n_points *= n_values[p];
+        if(n_points > MAX_SWEEP_POINTS) {
+            printf("Error executing command %s. The sweep has more than %d points\n", command, MAX_SWEEP_POINTS);
+            success = false;
         }
     }
 
-    if(len > 0) {
-        ft_printf_ln(table, "(*) - current model");
-        ft_set_cell_span(table, len + 1, 0, 2);
+    if(success) {
+        double *design = build_full_factorial_design(params, n_values, (int) arrlen(params), (int) n_points);
+        success        = run_sweep(shell_state, model_config, final_time, params, (int) arrlen(params), design, (int) n_points);
+        free(design);
     }
 
-    PRINT_AND_FREE_TABLE(table);
+    arrfree(params);
+    arrfree(n_values);
 
+    return success;
+}
 
-    return true;
+COMMAND_FUNCTION(sweeplhs) {
+
+    //sweeplhs [model] final_time n_points param min max [param2 min max ...]
+    const char *command = tokens[0];
+    int first_arg;
+
+    if((num_args - 2) % 3 == 0) {
+        first_arg = 1;
+    } else if((num_args - 3) % 3 == 0) {
+        first_arg = 2;
+    } else {
+        printf("Error executing command %s. Usage: %s [model] final_time n_points param min max [param2 min max ...]\n", command, command);
+        return false;
+    }
+
+    struct model_config *model_config = load_model_config_or_print_error(shell_state, command, first_arg == 2 ? tokens[1] : NULL);
+    if(!model_config) return false;
+
+    double final_time = string_to_double(tokens[first_arg]);
+
+    if(isnan(final_time) || final_time <= 0) {
+        printf("Error executing command %s. Invalid final time: %s\n", command, tokens[first_arg]);
+        return false;
+    }
+
+    bool error;
+    long n_points = string_to_long(tokens[first_arg + 1], &error);
+
+    if(error || n_points <= 0 || n_points > MAX_SWEEP_POINTS) {
+        printf("Error executing command %s. Invalid number of points: %s. It has to be between 1 and %d\n", command, tokens[first_arg + 1], MAX_SWEEP_POINTS);
+        return false;
+    }
+
+    struct sweep_param *params = NULL;
+    bool success               = parse_sweep_params(command, model_config, tokens, first_arg + 2, num_args, 3, &params, NULL);
+
+    if(success) {
+        double *design = build_latin_hypercube_design(params, (int) arrlen(params), (int) n_points);
+        success        = run_sweep(shell_state, model_config, final_time, params, (int) arrlen(params), design, (int) n_points);
+        free(design);
+    }
+
+    arrfree(params);
+
+    return success;
 }
 
-COMMAND_FUNCTION(vars) {
+COMMAND_FUNCTION(setsweepworkers) {
 
-    struct model_config *model_config = NULL;
+    (void) num_args;
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    bool error;
+    long n = string_to_long(tokens[1], &error);
 
-    int len = shlen(model_config->var_indexes);
+    if(error || n < 0) {
+        printf("Error executing command %s. Invalid number of workers: %s\n", tokens[0], tokens[1]);
+        return false;
+    }
 
-    CREATE_TABLE(table);
+    shell_state->sweep_workers = (int) n;
 
-    ft_set_cell_prop(table, FT_ANY_COLUMN, FT_ANY_ROW, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+    return true;
+}
 
-    ft_printf_ln(table, "%s", model_config->model_name);
-    ft_printf_ln(table, "Var name|Index");
+static bool open_gnuplot_if_needed(struct shell_variables *shell_state, const char *command, bool is_replot) {
 
-    for(int i = 0; i < len; i++) {
-        ft_printf_ln(table, "%s|%d", model_config->var_indexes[i].key, model_config->var_indexes[i].value);
+    if(shell_state->gnuplot_handle != NULL) {
+        return true;
     }
 
-    ft_set_cell_span(table, 0, 0, 2);
+    if(is_replot) {
+        printf("Error executing command %s. No previous plot. plot the model first using \"plot modelname\" or list loaded models using \"list\"\n", command);
+        return false;
+    }
 
-    PRINT_AND_FREE_TABLE(table);
+    shell_state->gnuplot_handle = (struct popen2 *) malloc(sizeof(struct popen2));
+    if(shell_state->gnuplot_handle == NULL) {
+        fprintf(stderr, "%s - error allocating memory for gnuplot handle\n", __FUNCTION__);
+        return false;
+    }
+
+    popen2("gnuplot", shell_state->gnuplot_handle);
+    if(strcmp(shell_state->default_gnuplot_term, "sixel") == 0) {
+        gnuplot_cmd(shell_state->gnuplot_handle, "set term sixel");
+    }
+
+    gnuplot_cmd(shell_state->gnuplot_handle, "set term push");
 
     return true;
 }
 
-COMMAND_FUNCTION(cd) {
+static unsigned int get_terminal_columns() {
+    struct winsize w;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_col > 0) {
+        return w.ws_col;
+    }
+    return 80;
+}
 
-    (void) num_args;
+// Returns the gnuplot data specification for the given columns of a run. Runs with many samples are plotted from a
+// min/max decimated view (cached in the run_info and sent to gnuplot as a datablock), the others from the output file.
+static sds get_plot_data_spec(struct shell_variables *shell_state, struct model_config *model_config, unsigned int run_number, int xindex, int yindex, unsigned int buckets) {
 
-    const char *path = tokens[1];
-    int ret          = -1;
+    if(run_number == 0) {
+        run_number = model_config->num_runs;
+    }
 
-    if(strlen(path) == 1 && path[0] == '-') {
-        if(shell_state->last_dir) {
-            ret = chdir(shell_state->last_dir);
+    struct run_info *run_info = &model_config->runs[run_number - 1];
+    sds output_file           = get_model_output_file(model_config, run_number);
+
+    if(run_info->num_samples > (uint64_t) DECIMATION_MIN_POINTS_PER_BUCKET * buckets) {
+
+        struct decimated_plot *plot = NULL;
+
+        int n = arrlen(run_info->plot_cache);
+        for(int i = 0; i < n; i++) {
+            struct decimated_plot *cached = &run_info->plot_cache[i];
+            if(cached->xindex == xindex && cached->yindex == yindex && cached->buckets == buckets) {
+                plot = cached;
+                break;
+            }
+        }
+
+        if(plot == NULL) {
+            struct decimated_plot new_plot;
+            double start = begin_stage();
+            if(decimate_output_file(output_file, xindex, yindex, buckets, &new_plot)) {
+                arrput(run_info->plot_cache, new_plot);
+                plot = &arrlast(run_info->plot_cache);
+            }
+            end_stage(STAGE_PLOT_DATA, start);
+        }
+
+        if(plot != NULL) {
+            gnuplot_send_datablock(shell_state->gnuplot_handle, plot);
+            sdsfree(output_file);
+            return sdscatfmt(sdsempty(), "$ode_plot_%u u 1:2", plot->id);
         }
-    } else {
-        ret = chdir(path);
     }
 
-    if(ret == -1) {
-        printf("Error changing working directory to %s\n", path);
+    sds spec = sdscatfmt(sdsempty(), "'%s' u %i:%i", output_file, xindex, yindex);
+    sdsfree(output_file);
+
+    return spec;
+}
+
+static bool plot_helper(struct shell_variables *shell_state, const char *command, command_type c_type, const char *model_name, unsigned int run_number, sds custom_gnuplot_cmd) {
+
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+
+    if(!model_config) return false;
+
+    if(!open_gnuplot_if_needed(shell_state, command, c_type == CMD_REPLOT || c_type == CMD_CUSTOM_REPLOT)) {
         return false;
+    }
+
+    command = "plot";
+
+    if(c_type == CMD_PLOT_TERM || c_type == CMD_REPLOT_TERM) {
+        gnuplot_cmd(shell_state->gnuplot_handle, "set term dumb");
+    }
+
+    if(c_type == CMD_REPLOT || c_type == CMD_REPLOT_TERM) {
+        command = "replot";
+    }
+
+    gnuplot_cmd(shell_state->gnuplot_handle, "set xlabel \"%s\"", model_config->plot_config.xlabel);
+
+    if(c_type == CMD_REPLOT) {
+        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"Variables\"");
+    } else if(c_type == CMD_PLOT) {
+        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"%s\"", model_config->plot_config.ylabel);
+    }
+
+    if((c_type == CMD_CUSTOM_PLOT || c_type == CMD_CUSTOM_REPLOT) && custom_gnuplot_cmd != NULL && sdslen(custom_gnuplot_cmd) > 0) {
+
+        gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"Variables\"");
+        gnuplot_cmd(shell_state->gnuplot_handle, custom_gnuplot_cmd);
+
     } else {
+        unsigned int buckets = DEFAULT_DECIMATION_BUCKETS;
 
-        free(shell_state->last_dir);
-        shell_state->last_dir    = shell_state->current_dir;
+        if(c_type == CMD_PLOT_TERM || c_type == CMD_REPLOT_TERM) {
+            buckets = get_terminal_columns();
+        }
 
-        shell_state->current_dir = get_current_directory();
-        print_current_dir();
-        return true;
+        sds data_spec = get_plot_data_spec(shell_state, model_config, run_number, model_config->plot_config.xindex,
+                                           model_config->plot_config.yindex, buckets);
+
+        gnuplot_cmd(shell_state->gnuplot_handle, "%s %s title \"%s\" w lines lw 2",
+                    command, data_spec, model_config->plot_config.title);
+
+        sdsfree(data_spec);
+    }
+    if(strcmp(shell_state->default_gnuplot_term, "sixel") == 0) {
+        printf("\n");
+    }
+
+    if(c_type == CMD_PLOT_TERM || c_type == CMD_REPLOT_TERM) {
+        reset_terminal(shell_state->gnuplot_handle);
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(plot) {
+
+    char *model_name        = NULL;
+    unsigned int run_number = 0;
+
+    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+        return false;
+    }
+    return plot_helper(shell_state, tokens[0], CMD_PLOT, model_name, run_number, NULL);
+}
+
+COMMAND_FUNCTION(replot) {
+
+    char *model_name        = NULL;
+    unsigned int run_number = 0;
+
+    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+        return false;
+    }
+    return plot_helper(shell_state, tokens[0], CMD_REPLOT, model_name, run_number, NULL);
+}
+
+COMMAND_FUNCTION(plottoterm) {
+
+    char *model_name        = NULL;
+    unsigned int run_number = 0;
+
+    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+        return false;
+    }
+
+    return plot_helper(shell_state, tokens[0], CMD_PLOT_TERM, model_name, run_number, NULL);
+}
+
+COMMAND_FUNCTION(replottoterm) {
+    char *model_name        = NULL;
+    unsigned int run_number = 0;
+
+    if(!get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number)) {
+        return false;
+    }
+
+    return plot_helper(shell_state, tokens[0], CMD_REPLOT_TERM, model_name, run_number, NULL);
+}
+
+
+static bool plot_file_helper(struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+
+    const char *command = tokens[0];
+    char *model_name;
+    char *file_name = NULL;
+    unsigned int run_number;
+
+    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &file_name);
+
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+
+    if(!model_config) return false;
+
+    if(!open_gnuplot_if_needed(shell_state, command, c_type == CMD_REPLOT_FILE)) {
+        return false;
+    }
+
+    if(c_type == CMD_PLOT_FILE) {
+        command = "plot";
+    } else {
+        command = "replot";
+    }
+
+    if(file_name == NULL) {
+        //This should not happen
+        printf("Error executing command %s. Invalid model file_name!\n", command);
+        return false;
+    }
+
+    const char *ext = get_filename_ext(file_name);
+
+    if(!FILE_HAS_EXTENSION(ext, "pdf") && !FILE_HAS_EXTENSION(ext, "png")) {
+        printf("Error executing command %s. Only .pdf and .png outputs are supported\n", command);
+        return false;
+    }
+
+    gnuplot_cmd(shell_state->gnuplot_handle, "set terminal %s", ext);
+    gnuplot_cmd(shell_state->gnuplot_handle, "set output \"%s", file_name);
+    gnuplot_cmd(shell_state->gnuplot_handle, "set xlabel \"%s\"", model_config->plot_config.xlabel);
+    gnuplot_cmd(shell_state->gnuplot_handle, "set ylabel \"%s\"", model_config->plot_config.ylabel);
+
+    sds data_spec = get_plot_data_spec(shell_state, model_config, run_number, model_config->plot_config.xindex,
+                                       model_config->plot_config.yindex, DEFAULT_DECIMATION_BUCKETS);
+
+    gnuplot_cmd(shell_state->gnuplot_handle, "%s %s title \"%s\" w lines lw 2",
+                command, data_spec, model_config->plot_config.title);
+
+    sdsfree(data_spec);
+
+    reset_terminal(shell_state->gnuplot_handle);
+
+    return true;
+}
+
+COMMAND_FUNCTION(plottofile) {
+    return plot_file_helper(shell_state, tokens, CMD_PLOT_FILE, num_args);
+}
+
+COMMAND_FUNCTION(replottofile) {
+    return plot_file_helper(shell_state, tokens, CMD_REPLOT_FILE, num_args);
+}
+
+static bool setplot_helper(struct shell_variables *shell_state, const sds *tokens, command_type c_type, int num_args, bool quiet) {
+
+    const char *command               = tokens[0];
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
+
+    const char *cmd_param = tokens[num_args];
+
+    if(c_type == CMD_SET_PLOT_X || c_type == CMD_SET_PLOT_Y) {
+
+        bool index_as_str;
+        int index      = (int) string_to_long(cmd_param, &index_as_str);
+        char *var_name = NULL;
+
+        if(index_as_str) {
+            //string was passed, try to get the index from the var_indexes on model_config
+            index = shget(model_config->var_indexes, cmd_param);
+
+            if(index == -1) {
+                printf("Error parsing command %s. Invalid variable name: %s. You can list model variable name using vars %s\n", command, cmd_param, model_config->model_name);
+                return false;
+            }
+        } else {
+            var_name = get_var_name(model_config, index);
+
+            if(!var_name) {
+                printf("Error parsing command %s. Invalid index: %d. You can list model variable name using vars %s\n", command, index, model_config->model_name);
+                return false;
+            }
+        }
+
+        CREATE_TABLE(table);
+        if(c_type == CMD_SET_PLOT_X) {
+            model_config->plot_config.xindex = index;
+            if(!quiet) {
+
+                free(model_config->plot_config.xlabel);
+
+                if(index_as_str) {
+                    model_config->plot_config.xlabel = strdup(cmd_param);
+                    ft_printf_ln(table, "\'%s\' variable will be plotted along the X axis", cmd_param);
+                } else {
+                    model_config->plot_config.xlabel = strdup(var_name);
+                    ft_printf_ln(table, "\'%s\' variable will be plotted along the X axis", var_name);
+                }
+            }
+        } else {
+
+            model_config->plot_config.yindex = index;
+
+            free(model_config->plot_config.ylabel);
+
+            if(index_as_str) {
+                model_config->plot_config.ylabel = strdup(cmd_param);
+                model_config->plot_config.title  = strdup(cmd_param);
+            } else {
+                model_config->plot_config.ylabel = strdup(var_name);
+                model_config->plot_config.title  = strdup(var_name);
+            }
+
+            if(!quiet) {
+                ft_printf_ln(table, "\'%s\' variable will be plotted along the Y axis", model_config->plot_config.ylabel);
+            }
+        }
+
+        PRINT_AND_FREE_TABLE(table);
+
+    } else if(c_type == CMD_SET_PLOT_X_LABEL || c_type == CMD_SET_PLOT_Y_LABEL) {
+
+        if(c_type == CMD_SET_PLOT_X_LABEL) {
+            free(model_config->plot_config.xlabel);
+            model_config->plot_config.xlabel = strdup(cmd_param);
+        } else {
+            free(model_config->plot_config.ylabel);
+            model_config->plot_config.ylabel = strdup(cmd_param);
+        }
+    } else if(c_type == CMD_SET_PLOT_TITLE) {
+        free(model_config->plot_config.title);
+        model_config->plot_config.title = strdup(cmd_param);
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(setplotx) {
+    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_X, num_args, false);
+}
+
+COMMAND_FUNCTION(setploty) {
+    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, num_args, false);
+}
+
+COMMAND_FUNCTION(setplotxlabel) {
+    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_X_LABEL, num_args, false);
+}
+
+COMMAND_FUNCTION(setplotylabel) {
+    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y_LABEL, num_args, false);
+}
+
+COMMAND_FUNCTION(setplotlegend) {
+    return setplot_helper(shell_state, tokens, CMD_SET_PLOT_TITLE, num_args, false);
+}
+
+static bool get_plotvar_command(sds *plot_command, struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+
+    if(plot_command == NULL || *plot_command == NULL) {
+        return false;
+    }
+
+    unsigned int run_number;
+    char *model_name = NULL;
+    char *tmp;
+
+    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &tmp);
+
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+
+    if(!model_config) return false;
+
+    bool ret = true;
+
+    if(num_args == 1) {
+        ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 1, true);
+    } else if(num_args == 2) {
+
+        bool error;
+        string_to_long(tokens[2], &error);
+
+        if(!error) {
+            ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 1, true);
+        } else {
+            ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 2, true);
+        }
+    } else if(num_args == 3) {
+        ret &= setplot_helper(shell_state, tokens, CMD_SET_PLOT_Y, 2, true);
+    }
+
+    if(ret == false) {
+        return false;
+    }
+
+    sds data_spec = get_plot_data_spec(shell_state, model_config, run_number, model_config->plot_config.xindex,
+                                       model_config->plot_config.yindex, DEFAULT_DECIMATION_BUCKETS);
+
+    char *first     = "plot";
+
+    if(c_type == CMD_REPLOT) {
+        first = "replot";
+    }
+
+    if(sdslen(*plot_command) > 0) first = ", ";
+
+    char *title   = get_var_name(model_config, model_config->plot_config.yindex);
+
+    *plot_command = sdscatfmt(*plot_command, "%s %s title '%s' w lines lw 2", first, data_spec, title);
+
+    sdsfree(data_spec);
+
+    return true;
+}
+
+static bool plot_or_replot_var_helper(struct shell_variables *shell_state, sds *tokens, command_type c_type, int num_args) {
+
+    int varcount      = 0;
+    sds *vars_to_plot = NULL;
+    int split_index;
+
+    if(num_args == 1) {
+        vars_to_plot = sdssplit(tokens[1], " ", &varcount);
+        split_index  = 1;
+    } else if(num_args == 2) {
+        bool dont_have_run_number;
+        string_to_long(tokens[2], &dont_have_run_number);
+
+        if(dont_have_run_number) {
+            vars_to_plot = sdssplit(tokens[2], " ", &varcount);
+            split_index  = 2;
+        } else {
+            vars_to_plot = sdssplit(tokens[1], " ", &varcount);
+            split_index  = 1;
+        }
+    } else if(num_args == 3) {
+        vars_to_plot = sdssplit(tokens[2], " ", &varcount);
+        split_index  = 2;
+    }
+
+    bool ret = true;
+
+    char *new_tokens[num_args + 1];
+
+    for(int i = 0; i < num_args + 1; i++) {
+        new_tokens[i] = tokens[i];
+    }
+
+    unsigned int run_number;
+    char *model_name = NULL;
+    char *tmp;
+
+    get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &tmp);
+
+    const struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+    if(!model_config || !open_gnuplot_if_needed(shell_state, tokens[0], c_type == CMD_REPLOT)) {
+        sdsfreesplitres(vars_to_plot, varcount);
+        return false;
+    }
+
+    sds gnuplot_cmd = sdsempty();
+
+    for(int i = 0; i < varcount; i++) {
+        new_tokens[split_index] = vars_to_plot[i];
+        bool success            = get_plotvar_command(&gnuplot_cmd, shell_state, new_tokens, c_type, num_args);
+
+        if(!success) {
+            sdsfree(gnuplot_cmd);
+            sdsfreesplitres(vars_to_plot, varcount);
+            return false;
+        }
+    }
+
+    command_type ct = CMD_CUSTOM_PLOT;
+
+    if(c_type == CMD_REPLOT) ct = CMD_CUSTOM_REPLOT;
+
+    ret = plot_helper(shell_state, tokens[0], ct, model_name, run_number, gnuplot_cmd);
+    sdsfree(gnuplot_cmd);
+    sdsfreesplitres(vars_to_plot, varcount);
+    return ret;
+}
+
+COMMAND_FUNCTION(plotvar) {
+    return plot_or_replot_var_helper(shell_state, tokens, CMD_PLOT, num_args);
+}
+
+COMMAND_FUNCTION(replotvar) {
+    return plot_or_replot_var_helper(shell_state, tokens, CMD_REPLOT, num_args);
+}
+
+COMMAND_FUNCTION(plotvars) {
+
+    unsigned int run_number;
+    char *model_name;
+
+    get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number);
+
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+
+    if(!model_config) return false;
+
+    int old_xindex   = model_config->plot_config.xindex;
+    int old_yindex   = model_config->plot_config.yindex;
+
+    char *old_xlabel = strdup(model_config->plot_config.xlabel);
+    char *old_ylabel = strdup(model_config->plot_config.ylabel);
+    char *old_title  = strdup(model_config->plot_config.title);
+
+
+    int len          = shlen(model_config->var_indexes);
+
+    sds all_vars     = sdscatfmt(sdsempty(), "%s", model_config->var_indexes[1].key);
+
+    if(len - 2 > 10) {
+        printf("\nModel %s has %d ODE's. Do you want to plot all of them? [y]: ", model_config->model_name, len - 2);
+
+        //the clients of the server do not read prompts, so they get the default answer
+        if(shell_state->non_interactive) {
+            printf("y\n");
+        } else {
+            char answer = (char) getchar();
+
+            if(answer != 'Y' && answer != 'y' && answer != '\r') {
+                return false;
+            }
+        }
+    }
+
+    for(int i = 2; i < len; i++) {
+        all_vars = sdscatfmt(all_vars, " %s", model_config->var_indexes[i].key);
+    }
+
+    sds new_tokens[4] = {sdsnew("plotvar"), NULL, NULL, NULL};
+
+    uint8_t to_free   = 1;
+
+    if(num_args == 0) {
+        new_tokens[1] = all_vars;
+        to_free       = 1;
+    } else if(num_args == 1) {
+        bool model_name_only;
+        string_to_long(tokens[1], &model_name_only);
+
+        if(model_name_only) {
+            new_tokens[1] = tokens[1];
+            new_tokens[2] = all_vars;
+            to_free       = 2;
+        } else {
+            new_tokens[1] = all_vars;
+            new_tokens[2] = tokens[1];
+            to_free       = 1;
+        }
+    } else {
+        new_tokens[1] = tokens[1];
+        new_tokens[2] = all_vars;
+        new_tokens[3] = tokens[2];
+        to_free       = 2;
+    }
+
+    if(STRING_EQUALS(tokens[0], "plotvars")) {
+        plot_or_replot_var_helper(shell_state, new_tokens, CMD_PLOT, num_args + 1);
+    } else {
+        plot_or_replot_var_helper(shell_state, new_tokens, CMD_REPLOT, num_args + 1);
+    }
+
+    //The tokens variable will be freed on the parse_and_execute_command function
+    //so we can free when new_tokens = tokens[x]
+    sdsfree(new_tokens[0]);
+    sdsfree(new_tokens[to_free]);
+
+
+    //RESET to last configured plot
+    model_config->plot_config.xindex = old_xindex;
+    model_config->plot_config.yindex = old_yindex;
+
+
+    model_config->plot_config.xlabel = old_xlabel;
+    model_config->plot_config.ylabel = old_ylabel;
+    model_config->plot_config.title  = old_title;
+
+
+    return false;
+}
+
+COMMAND_FUNCTION(replotvars) {
+    return plotvars(shell_state, tokens, num_args);
+}
+
+
+COMMAND_FUNCTION(list) {
+
+    (void) tokens;
+    (void) num_args;
+
+    int len = shlen(shell_state->loaded_models);
+
+    CREATE_TABLE(table);
+
+    ft_set_cell_prop(table, FT_ANY_COLUMN, 0, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+    ft_set_cell_prop(table, FT_ANY_COLUMN, 1, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+
+    if(len == 0) {
+        ft_printf_ln(table, "No models loaded");
+    } else {
+        ft_printf_ln(table, "Available models|Num. of runs");
+        for(int i = 0; i < len; i++) {
+            char *name = shell_state->loaded_models[i].key;
+            if(!STR_EQUALS(name, shell_state->current_model->model_name)) {
+                ft_printf_ln(table, "%s|%d", name, shell_state->loaded_models[i].value->num_runs);
+            } else {
+                ft_printf_ln(table, "%s (*)|%d", name, shell_state->loaded_models[i].value->num_runs);
+            }
+        }
+    }
+
+    if(len > 0) {
+        ft_printf_ln(table, "(*) - current model");
+        ft_set_cell_span(table, len + 1, 0, 2);
+    }
+
+    PRINT_AND_FREE_TABLE(table);
+
+
+    return true;
+}
+
+COMMAND_FUNCTION(vars) {
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    int len = shlen(model_config->var_indexes);
+
+    CREATE_TABLE(table);
+
+    ft_set_cell_prop(table, FT_ANY_COLUMN, FT_ANY_ROW, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+
+    ft_printf_ln(table, "%s", model_config->model_name);
+    ft_printf_ln(table, "Var name|Index");
+
+    for(int i = 0; i < len; i++) {
+        ft_printf_ln(table, "%s|%d", model_config->var_indexes[i].key, model_config->var_indexes[i].value);
+    }
+
+    ft_set_cell_span(table, 0, 0, 2);
+
+    PRINT_AND_FREE_TABLE(table);
+
+    return true;
+}
+
+COMMAND_FUNCTION(cd) {
+
+    (void) num_args;
+
+    const char *path = tokens[1];
+    int ret          = -1;
+
+    if(strlen(path) == 1 && path[0] == '-') {
+        if(shell_state->last_dir) {
+            ret = chdir(shell_state->last_dir);
+        }
+    } else {
+        ret = chdir(path);
+    }
+
+    if(ret == -1) {
+        printf("Error changing working directory to %s\n", path);
+        return false;
+    } else {
+
+        free(shell_state->last_dir);
+        shell_state->last_dir    = shell_state->current_dir;
+
+        shell_state->current_dir = get_current_directory();
+        print_current_dir();
+        return true;
+    }
+}
+
+COMMAND_FUNCTION(ls) {
+
+    (void) shell_state;
+    (void) num_args;
+
+    char *path_name;
+
+    if(num_args == 0) {
+        path_name = ".";
+    } else {
+        path_name = tokens[1];
+    }
+
+    print_path_contents(path_name);
+    return true;
+}
+
+COMMAND_FUNCTION(help) {
+
+    (void) shell_state;
+
+    CREATE_TABLE(table);
+
+    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+
+    if(num_args == 0) {
+
+        ft_printf_ln(table, "Available commands");
+        int nc = arrlen(commands_sorted);
+        for(int i = 0; i < nc; i += 3) {
+            if(i + 2 < nc) {
+                ft_printf_ln(table, "%s|%s|%s", commands_sorted[i], commands_sorted[i + 1], commands_sorted[i + 2]);
+            } else if(i + 1 < nc) {
+                ft_printf_ln(table, "%s|%s| ", commands_sorted[i], commands_sorted[i + 1]);
+            } else {
+                ft_printf_ln(table, "%s| | ", commands_sorted[i]);
+            }
+        }
+
+    } else {
+        command command = {0};
+        int index       = shgeti(commands, tokens[1]);
+
+        if(index != -1) {
+            command = commands[index];
+        }
+
+        if(command.help) {
+            ft_printf_ln(table, "Command|help");
+            ft_printf_ln(table, "%s|%s", tokens[1], command.help);
+        } else if(command.key) {
+            ft_printf_ln(table, "%s|No help available yet!", tokens[1]);
+        } else {
+            ft_printf_ln(table, "Invalid command %s!", tokens[1]);
+        }
+    }
+
+    if(num_args == 0) {
+        ft_set_cell_span(table, 0, 0, 3);
+    }
+
+    PRINT_AND_FREE_TABLE(table);
+
+    if(num_args == 0) {
+        printf("\ntype 'help command' for more information about a specific command\n\n");
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(getplotconfig) {
+
+    CREATE_TABLE(table);
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    char *xname = get_var_name(model_config, model_config->plot_config.xindex);
+    char *yname = get_var_name(model_config, model_config->plot_config.yindex);
+
+    ft_printf_ln(table, "Plot configuration for model %s|", model_config->model_name);
+
+    ft_printf_ln(table, "Gnuplot terminal|%s", shell_state->default_gnuplot_term);
+
+    ft_printf_ln(table, "Var on X|%s (%d)", xname, model_config->plot_config.xindex);
+    ft_printf_ln(table, "Var on Y|%s (%d)", yname, model_config->plot_config.yindex);
+
+    ft_printf_ln(table, "Label X|%s", model_config->plot_config.xlabel);
+    ft_printf_ln(table, "Label Y|%s", model_config->plot_config.ylabel);
+    ft_printf_ln(table, "Title (legend)|%s", model_config->plot_config.title);
+
+    ft_set_cell_span(table, 0, 0, 2);
+    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+    PRINT_AND_FREE_TABLE(table);
+
+    return true;
+}
+
+static bool set_or_get_value_helper(struct shell_variables *shell_state, sds *tokens, int num_args, ast_tag tag, command_type action) {
+
+    const char *command = tokens[0];
+    sds var_name;
+    char *new_value;
+
+    struct model_config *parent_model_config = NULL;
+
+    if(action == CMD_SET) {
+        var_name  = sdsnew(tokens[num_args - 1]);
+        new_value = tokens[num_args];
+
+        if(num_args == 2) {
+            parent_model_config = load_model_config_or_print_error(shell_state, command, NULL);
+        } else if(num_args == 3) {
+            parent_model_config = load_model_config_or_print_error(shell_state, command, tokens[1]);
+        }
+
+    } else {
+        var_name = sdsnew(tokens[num_args]);
+
+        if(tag == ast_ode_stmt) {
+            var_name = sdscat(var_name, "'");
+        }
+
+        if(num_args == 1) {
+            parent_model_config = load_model_config_or_print_error(shell_state, tokens[0], NULL);
+        } else if(num_args == 2) {
+            parent_model_config = load_model_config_or_print_error(shell_state, command, tokens[1]);
+        }
+    }
+
+    if(!parent_model_config) return false;
+
+    struct model_config *model_config;
+
+    if(action == CMD_SET) {
+        model_config = new_config_from_parent(parent_model_config);
+    } else {
+        model_config = parent_model_config;
+    }
+
+    int i = get_statement_index(model_config, tag, var_name);
+
+    if(i != -1) {
+        ast *a                         = model_config->program[i];
+        unsigned int indentation_level = 0;
+
+        if(action == CMD_SET) {
+            lexer *l        = new_lexer(new_value, model_config->model_name);
+            parser *p       = new_parser(l);
+            program program = parse_program(p, false, false, NULL);
+
+            if(program == NULL || arrlen(program) == 0) {
+                printf("Error parsing new value: %s\n", new_value);
+                free_parser(p);
+                if(program) free_program(program);
+                free_lexer(l);
+                free_model_config(model_config);
+                sdsfree(var_name);
+                return false;
+            }
+
+            sds tmp1        = ast_to_string(a->assignment_stmt.value, &indentation_level);
+            sds tmp2        = ast_to_string(program[0], &indentation_level);
+
+            printf("Changing value of variable %s from %s to %s for model %s\n",
+                   var_name, tmp1, tmp2, parent_model_config->model_name);
+
+            sdsfree(tmp1);
+            sdsfree(tmp2);
+
+            a = make_stmt_writable(model_config->program, i);
+
+            int old_decl_pos = a->assignment_stmt.declaration_position;
+            bool global      = a->assignment_stmt.name->identifier.global;
+
+            free_ast(a->assignment_stmt.value);
+
+            a->assignment_stmt.value                   = copy_ast(program[0]);
+            a->assignment_stmt.name->identifier.global = global;
+            a->assignment_stmt.declaration_position    = old_decl_pos;
+
+            free_parser(p);
+            free_program(program);
+            free_lexer(l);
+
+        } else {
+            sds tmp = ast_to_string(a->assignment_stmt.value, &indentation_level);
+            printf("%s = %s for model %s\n", var_name, tmp, model_config->model_name);
+            sdsfree(tmp);
+        }
+    }
+
+    if(i == -1) {
+        parent_model_config->version--;
+        int command_len = (int) strlen(command);
+        printf("Error parsing command %s. Invalid variable name: %s. You can list model variable using g%*ss %s\n",
+               command, var_name, command_len - 1, command + 1, parent_model_config->model_name);
+        if(action == CMD_SET) {
+            free_model_config(model_config);
+        }
+    } else {
+        if(action == CMD_SET) {
+            printf("Reloading model %s as %s\n", parent_model_config->model_name, model_config->model_name);
+            load_model(shell_state, NULL, model_config);
+        }
+    }
+
+    sdsfree(var_name);
+
+    return true;
+}
+
+COMMAND_FUNCTION(setinitialvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_initial_stmt, CMD_SET);
+}
+
+COMMAND_FUNCTION(getinitialvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_initial_stmt, CMD_GET);
+}
+
+COMMAND_FUNCTION(setparamvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_assignment_stmt, CMD_SET);
+}
+
+COMMAND_FUNCTION(getparamvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_assignment_stmt, CMD_GET);
+}
+
+COMMAND_FUNCTION(setglobalvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_global_stmt, CMD_SET);
+}
+
+COMMAND_FUNCTION(getglobalvalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_global_stmt, CMD_GET);
+}
+
+COMMAND_FUNCTION(setodevalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_ode_stmt, CMD_SET);
+}
+
+COMMAND_FUNCTION(getodevalue) {
+    return set_or_get_value_helper(shell_state, tokens, num_args, ast_ode_stmt, CMD_GET);
+}
+
+static bool get_values_helper(struct shell_variables *shell_state, sds *tokens, int num_args, ast_tag tag) {
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    struct var_index_hash_entry *statements = model_config->statements[get_symbol_kind(tag)];
+    int n                                   = shlen(statements);
+
+    CREATE_TABLE(table);
+
+    ft_printf_ln(table, "%s", model_config->model_name);
+    ft_printf_ln(table, "Variable|Value");
+
+    bool empty                    = true;
+
+    unsigned int indentaion_value = 0;
+
+    for(int i = 0; i < n; i++) {
+        ast *a            = model_config->program[statements[i].value];
+        sds ast_string    = ast_to_string(a->assignment_stmt.value, &indentaion_value);
+        char *first_paren = strchr(ast_string, '(');
+        if(first_paren) {
+            ft_printf_ln(table, "%s|%.*s", a->assignment_stmt.name->identifier.value, (int) strlen(first_paren + 1) - 1, first_paren + 1);
+        } else {
+            ft_printf_ln(table, "%s|%s", a->assignment_stmt.name->identifier.value, ast_string);
+        }
+        sdsfree(ast_string);
+        empty = false;
+    }
+
+    if(empty) {
+        ft_printf_ln(table, "No values to show");
+    }
+
+    ft_set_cell_span(table, 0, 0, 2);
+    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+
+    PRINT_AND_FREE_TABLE(table);
+
+    return true;
+}
+
+COMMAND_FUNCTION(getinitialvalues) {
+    return get_values_helper(shell_state, tokens, num_args, ast_initial_stmt);
+}
+
+COMMAND_FUNCTION(getparamvalues) {
+    return get_values_helper(shell_state, tokens, num_args, ast_assignment_stmt);
+}
+
+COMMAND_FUNCTION(getglobalvalues) {
+    return get_values_helper(shell_state, tokens, num_args, ast_global_stmt);
+}
+
+COMMAND_FUNCTION(getodevalues) {
+    return get_values_helper(shell_state, tokens, num_args, ast_ode_stmt);
+}
+
+COMMAND_FUNCTION(saveplot) {
+
+    (void) num_args;
+
+    const char *command   = tokens[0];
+
+    const char *file_name = tokens[1];
+
+    if(shell_state->gnuplot_handle == NULL) {
+        printf("Error executing command %s. No previous plot. plot the model first using \"plot modelname\" or list loaded models using \"list\"\n", command);
+        return false;
+    }
+
+    const char *ext = get_filename_ext(file_name);
+
+    if(!FILE_HAS_EXTENSION(ext, "pdf") && !FILE_HAS_EXTENSION(ext, "png")) {
+        printf("Error executing command %s. Only .pdf and .png outputs are supported\n", command);
+        return false;
+    }
+
+    gnuplot_cmd(shell_state->gnuplot_handle, "set terminal %s", ext);
+    gnuplot_cmd(shell_state->gnuplot_handle, "set output \"%s", file_name);
+    gnuplot_cmd(shell_state->gnuplot_handle, "replot");
+
+    reset_terminal(shell_state->gnuplot_handle);
+
+    return true;
+}
+
+COMMAND_FUNCTION(setcurrentmodel) {
+
+    (void) num_args;
+
+    struct model_config *model_config = load_model_config_or_print_error(shell_state, tokens[0], tokens[1]);
+
+    if(!model_config) return false;
+
+    shell_state->current_model = model_config;
+
+    printf("Current model set to %s\n", shell_state->current_model->model_name);
+
+    return true;
+}
+
+COMMAND_FUNCTION(solveplot) {
+
+    bool success     = solve(shell_state, tokens, num_args);
+    char *model_name = NULL;
+
+    if(!success) return false;
+
+    if(num_args == 2) {
+        model_name = tokens[2];
+    }
+
+    plot_helper(shell_state, tokens[0], CMD_PLOT, model_name, 0, NULL);
+
+    return true;
+}
+
+COMMAND_FUNCTION(printmodel) {
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    printf("\n");
+    print_program(model_config->program);
+    printf("\n");
+
+    return true;
+}
+
+COMMAND_FUNCTION(editmodel) {
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    if(!can_run_command("xdg-open")) {
+        printf("Error - xdg-open is not in your path or is not installed\n");
+        return false;
+    }
+
+    sds cmd = sdscatfmt(sdsempty(), "xdg-open %s.ode & 2> /dev/null", model_config->model_name);
+
+    FILE *f = popen(cmd, "r");
+    pclose(f);
+
+    sdsfree(cmd);
+
+    return true;
+}
+
+COMMAND_FUNCTION(unloadall) {
+
+    (void) tokens;
+    (void) num_args;
+
+    int len = shlen(shell_state->loaded_models);
+
+    if(len == 0) {
+        CREATE_TABLE(table);
+        ft_set_cell_prop(table, FT_ANY_COLUMN, 0, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+        ft_set_cell_prop(table, FT_ANY_COLUMN, 1, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+        ft_printf_ln(table, "No models loaded");
+        PRINT_AND_FREE_TABLE(table);
+
+    } else {
+
+        for(int i = 0; i < len; i++) {
+            if(has_running_jobs_print_error(tokens[0], shell_state->loaded_models[i].value)) return false;
+        }
+
+        while(shlen(shell_state->loaded_models) > 0) {
+            char *name                        = shell_state->loaded_models[0].key;
+            struct model_config *model_config = shell_state->loaded_models[0].value;
+            struct model_config **entries     = hmget(shell_state->notify_entries, model_config->notify_code);
+            arrfree(entries);
+
+            (void) hmdel(shell_state->notify_entries, model_config->notify_code);
+            (void) shdel(shell_state->loaded_models, name);
+
+            free_model_config(model_config);
+        }
+
+        shell_state->current_model = NULL;
+    }
+    return true;
+}
+
+COMMAND_FUNCTION(unload) {
+
+    struct model_config *model_config = NULL;
+
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    if(has_running_jobs_print_error(tokens[0], model_config)) return false;
+
+    bool is_current               = (model_config == shell_state->current_model);
+
+    struct model_config **entries = hmget(shell_state->notify_entries, model_config->notify_code);
+    arrfree(entries);
+
+    (void) hmdel(shell_state->notify_entries, model_config->notify_code);
+    (void) shdel(shell_state->loaded_models, tokens[1]);
+
+    free_model_config(model_config);
+
+    if(is_current) {
+        if(shlen(shell_state->loaded_models) > 0) {
+            shell_state->current_model = shell_state->loaded_models[0].value;
+        } else {
+            shell_state->current_model = NULL;
+        }
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(savesession) {
+
+    (void) num_args;
+
+    int n_models = shlen(shell_state->loaded_models);
+
+    if(n_models == 0) {
+        PRINT_NO_MODELS_LOADED_ERROR(tokens[0]);
+        return false;
+    }
+
+    struct model_config **models = NULL;
+
+    for(int i = 0; i < n_models; i++) {
+        if(has_running_jobs_print_error(tokens[0], shell_state->loaded_models[i].value)) {
+            arrfree(models);
+            return false;
+        }
+        arrput(models, shell_state->loaded_models[i].value);
+    }
+
+    const char *current_model_name = shell_state->current_model ? shell_state->current_model->model_name : NULL;
+    bool saved                     = save_session(tokens[1], models, n_models, current_model_name);
+
+    if(saved) {
+        printf("Session with %d model(s) saved to %s\n", n_models, tokens[1]);
+    }
+
+    arrfree(models);
+
+    return saved;
+}
+
+COMMAND_FUNCTION(loadsession) {
+
+    (void) num_args;
+
+    double start = get_wall_time();
+
+    char *current_model_name     = NULL;
+    struct model_config **models = load_session(tokens[1], shell_state->loaded_models, &current_model_name);
+
+    if(models == NULL) {
+        return false;
+    }
+
+    for(int i = 0; i < arrlen(models); i++) {
+
+        struct model_config *model_config = models[i];
+        add_loaded_model(shell_state, model_config);
+
+        if(model_config->is_derived || !file_exists(model_config->model_file)) continue;
+
+        //the file can have changed after the session was saved
+        size_t file_size;
+        char *source = read_entire_file_with_mmap(model_config->model_file, &file_size);
+        uint8_t hash[16];
+        md5Stringn(source, (uint8_t *) &hash, file_size);
+        munmap(source, file_size);
+
+        if(memcmp(hash, model_config->hash, sizeof(model_config->hash)) != 0) {
+            printf("Model %s was modified after the session was saved. Use reload %s to load the changes\n", model_config->model_name,
+                   model_config->model_name);
+        }
+    }
+
+    if(current_model_name && shgeti(shell_state->loaded_models, current_model_name) != -1) {
+        shell_state->current_model = shget(shell_state->loaded_models, current_model_name);
+    }
+
+    printf("Session %s loaded in %.3lf s\n", tokens[1], get_wall_time() - start);
+
+    free(current_model_name);
+    arrfree(models);
+
+    return true;
+}
+
+static bool set_reload_helper(struct shell_variables *shell_state, const sds *tokens, int num_args, command_type cmd_type) {
+
+    const char *command = tokens[0];
+    char *arg           = tokens[1];
+    bool is_zero;
+
+    if(STR_EQUALS(arg, "0")) {
+        is_zero = true;
+    } else if(STR_EQUALS(arg, "1")) {
+        is_zero = false;
+    } else {
+        printf("Error - Invalid value %s for command %s. Valid values are 0 or 1\n", arg, command);
+        return false;
+    }
+
+
+    if(cmd_type == CMD_SET_GLOBAL_RELOAD) {
+        shell_state->never_reload = is_zero;
+    } else {
+        struct model_config *model_config;
+
+        if(num_args == 1) {
+            model_config = shell_state->current_model;
+        } else {
+            model_config = load_model_config_or_print_error(shell_state, command, arg);
+        }
+
+        if(cmd_type == CMD_SET_RELOAD) {
+            model_config->should_reload = !is_zero;
+        } else if(cmd_type == CMD_SET_AUTO_RELOAD) {
+            model_config->auto_reload = !is_zero;
+
+            if(!is_zero) {
+                model_config->should_reload = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(setglobalreload) {
+    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_GLOBAL_RELOAD);
+}
+
+COMMAND_FUNCTION(setautolreload) {
+    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_AUTO_RELOAD);
+}
+
+COMMAND_FUNCTION(setshouldreload) {
+    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_RELOAD);
+}
+
+COMMAND_FUNCTION(setreportio) {
+
+    const char *command = tokens[0];
+    char *arg           = tokens[1];
+
+    if(STR_EQUALS(arg, "0")) {
+        shell_state->report_io = false;
+    } else if(STR_EQUALS(arg, "1")) {
+        shell_state->report_io = true;
+    } else {
+        printf("Error - Invalid value %s for command %s. Valid values are 0 or 1\n", arg, command);
+        return false;
+    }
+
+    return true;
+}
+
+COMMAND_FUNCTION(setmemoize) {
+
+    const char *command = tokens[0];
+    char *arg           = tokens[1];
+
+    (void) num_args;
+
+    if(STR_EQUALS(arg, "0")) {
+        shell_state->memoize_solves = false;
+    } else if(STR_EQUALS(arg, "1")) {
+        shell_state->memoize_solves = true;
+    } else {
+        printf("Error - Invalid value %s for command %s. Valid values are 0 or 1\n", arg, command);
+        return false;
+    }
+
+    return true;
+}
+
+// Prints the time of each stage that ran. Stages run by several threads (e.g., the loads of many models) can add up to
+// more than the total, the wall time of the command
+static void print_stage_times(const struct stage_times *times, double total_time) {
+
+    bool any_stage = false;
+
+    for(int k = 0; k < N_TIMING_STAGES; k++) {
+        any_stage = any_stage || times->calls[k] > 0;
+    }
+
+    if(!any_stage) return;
+
+    CREATE_TABLE(table);
+
+    ft_printf_ln(table, "Stage|Calls|Time (ms)|%% of total");
+
+    for(int k = 0; k < N_TIMING_STAGES; k++) {
+        if(times->calls[k] == 0) continue;
+        ft_printf_ln(table, "%s|%u|%.3lf|%.1lf", get_timing_stage_name(k), times->calls[k], times->time[k] * 1e3,
+                     total_time > 0 ? 100.0 * times->time[k] / total_time : 0.0);
+    }
+
+    ft_printf_ln(table, "total|-|%.3lf|100.0", total_time * 1e3);
+
+    ft_set_cell_prop(table, FT_ANY_ROW, 1, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+    ft_set_cell_prop(table, FT_ANY_ROW, 2, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+    ft_set_cell_prop(table, FT_ANY_ROW, 3, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+
+    PRINT_AND_FREE_TABLE(table);
+}
+
+COMMAND_FUNCTION(timing) {
+
+    const char *command = tokens[0];
+
+    if(STR_EQUALS(tokens[1], "on")) {
+
+        if(num_args == 2) {
+            if(get_trace_file()) {
+                printf("Trace written to %s\n", get_trace_file());
+                close_trace();
+            }
+
+            if(!open_trace(tokens[2])) {
+                printf("Error executing command %s. Could not open %s for writing\n", command, tokens[2]);
+                return false;
+            }
+        }
+
+        set_timing_enabled(true);
+
+    } else if(STR_EQUALS(tokens[1], "off") && num_args == 1) {
+
+        set_timing_enabled(false);
+
+        if(get_trace_file()) {
+            sds trace_file = sdsnew(get_trace_file());
+            if(close_trace()) {
+                printf("Trace written to %s\n", trace_file);
+            } else {
+                printf("Error executing command %s. Could not write the trace to %s\n", command, trace_file);
+            }
+            sdsfree(trace_file);
+        }
+
+    } else {
+        printf("Error executing command %s. Usage: timing on [trace_file] or timing off\n", command);
+        return false;
+    }
+
+    return true;
+}
+
+// Runs a command N times with timing enabled and prints the mean, minimum and maximum time of each stage per run. Only
+// the output of the first run is shown
+COMMAND_FUNCTION(bench) {
+
+    const char *command = tokens[0];
+
+    bool error;
+    long n_runs = string_to_long(tokens[num_args], &error);
+
+    if(error || n_runs < 1) {
+        printf("Error executing command %s. Invalid number of runs: %s\n", command, tokens[num_args]);
+        return false;
+    }
+
+    if(STR_EQUALS(tokens[1], "bench") || STR_EQUALS(tokens[1], "quit")) {
+        printf("Error executing command %s. %s can't be benchmarked\n", command, tokens[1]);
+        return false;
+    }
+
+    //a single argument is the whole command line (e.g., bench "solve sir 100" 10)
+    sds to_run = num_args == 2 ? sdsdup(tokens[1]) : sdsempty();
+
+    for(int i = 1; i < num_args && num_args > 2; i++) {
+        if(i > 1) to_run = sdscatlen(to_run, " ", 1);
+        if(sdslen(tokens[i]) == 0 || strpbrk(tokens[i], " \t\"'")) {
+            to_run = sdscatrepr(to_run, tokens[i], sdslen(tokens[i]));
+        } else {
+            to_run = sdscatsds(to_run, tokens[i]);
+        }
+    }
+
+    bool was_enabled = is_timing_enabled();
+    set_timing_enabled(true);
+
+    struct stage_times times, sum = {0}, min = {0}, max = {0};
+    double total_sum = 0, total_min = 0, total_max = 0;
+
+    take_stage_times(&times);
+
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    for(long r = 0; r < n_runs; r++) {
+
+        int saved[2];
+        bool quiet = r > 0 && null_fd != -1;
+
+        if(quiet) redirect_output(null_fd, saved);
+
+        double start = get_wall_time();
+        parse_and_execute_command(to_run, shell_state);
+        double total = get_wall_time() - start;
+
+        if(quiet) restore_output(saved);
+
+        take_stage_times(&times);
+
+        for(int k = 0; k < N_TIMING_STAGES; k++) {
+            sum.time[k] += times.time[k];
+            sum.calls[k] += times.calls[k];
+            min.time[k] = r == 0 || times.time[k] < min.time[k] ? times.time[k] : min.time[k];
+            max.time[k] = r == 0 || times.time[k] > max.time[k] ? times.time[k] : max.time[k];
+        }
+
+        total_sum += total;
+        total_min = r == 0 || total < total_min ? total : total_min;
+        total_max = r == 0 || total > total_max ? total : total_max;
+    }
+
+    if(null_fd != -1) close(null_fd);
+
+    set_timing_enabled(was_enabled);
+
+    printf("%s ran %ld time(s)\n", to_run, n_runs);
+
+    CREATE_TABLE(table);
+
+    ft_printf_ln(table, "Stage|Calls/run|Mean (ms)|Min (ms)|Max (ms)");
+
+    for(int k = 0; k < N_TIMING_STAGES; k++) {
+        if(sum.calls[k] == 0) continue;
+        ft_printf_ln(table, "%s|%.1lf|%.3lf|%.3lf|%.3lf", get_timing_stage_name(k), (double) sum.calls[k] / (double) n_runs,
+                     sum.time[k] * 1e3 / (double) n_runs, min.time[k] * 1e3, max.time[k] * 1e3);
+    }
+
+    ft_printf_ln(table, "total|-|%.3lf|%.3lf|%.3lf", total_sum * 1e3 / (double) n_runs, total_min * 1e3, total_max * 1e3);
+
+    for(int c = 1; c <= 4; c++) {
+        ft_set_cell_prop(table, FT_ANY_ROW, c, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+    }
+
+    PRINT_AND_FREE_TABLE(table);
+
+    sdsfree(to_run);
+
+    return true;
+}
+
+COMMAND_FUNCTION(cacheinfo) {
+
+    (void) tokens;
+    (void) num_args;
+    (void) shell_state;
+
+    struct import_cache_info import_info;
+    get_import_cache_info(&import_info);
+
+    printf("Imported files - cached: %u, hits: %u, misses: %u\n", import_info.n_entries, import_info.hits, import_info.misses);
+
+    struct build_cache_info info;
+
+    if(!get_build_cache_info(&info)) {
+        printf("The build cache is disabled. Enable it with setcachesize\n");
+        return true;
+    }
+
+    printf("Directory: %s\n", info.dir);
+    printf("Entries: %u\n", info.n_entries);
+    printf("Size: %.2lf MB of %.2lf MB\n", (double) info.size / (1024.0 * 1024.0), (double) info.size_limit / (1024.0 * 1024.0));
+    printf("Compiled models - hits: %u, misses: %u\n", info.hits, info.misses);
+    printf("Solve results - hits: %u, misses: %u\n", info.result_hits, info.result_misses);
+
+    return true;
+}
+
+#define MAX_MEMINFO_RUNS 20
+#define MAX_MEMINFO_SUGGESTIONS 5
+
+static sds format_bytes(uint64_t bytes) {
+    if(bytes >= 1024ULL * 1024 * 1024) return sdscatprintf(sdsempty(), "%.2lf GB", bytes / (1024.0 * 1024.0 * 1024.0));
+    if(bytes >= 1024ULL * 1024) return sdscatprintf(sdsempty(), "%.2lf MB", bytes / (1024.0 * 1024.0));
+    if(bytes >= 1024) return sdscatprintf(sdsempty(), "%.1lf KB", bytes / 1024.0);
+    return sdscatprintf(sdsempty(), "%lu B", (unsigned long) bytes);
+}
+
+// Writes the formatted size as the next cell of the table
+static void write_bytes_cell(ft_table_t *table, uint64_t bytes) {
+    sds cell = format_bytes(bytes);
+    ft_write(table, cell);
+    sdsfree(cell);
+}
+
+// Versions are named after the model they were derived from (see new_config_from_parent)
+static int count_loaded_versions(struct shell_variables *shell_state, const char *model_name) {
+
+    size_t len = strlen(model_name);
+    int n      = 0;
+
+    for(int i = 0; i < shlen(shell_state->loaded_models); i++) {
+        const char *name = shell_state->loaded_models[i].key;
+        if(strncmp(name, model_name, len) == 0 && strncmp(name + len, "_v", 2) == 0 && isdigit(name[len + 2])) {
+            n++;
+        }
+    }
+
+    return n;
+}
+
+struct run_size {
+    struct model_config *model_config;
+    unsigned int run_number;
+    uint64_t size;
+};
+
+static int compare_runs_by_size(const void *a, const void *b) {
+
+    uint64_t sa = ((const struct run_size *) a)->size;
+    uint64_t sb = ((const struct run_size *) b)->size;
+
+    if(sa != sb) return sa > sb ? -1 : 1;
+    return 0;
+}
+
+struct meminfo_suggestion {
+    const char *command;
+    const char *model_name;
+    uint64_t disk;
+    uint64_t memory;
+};
+
+static int compare_suggestions(const void *a, const void *b) {
+
+    const struct meminfo_suggestion *sa = (const struct meminfo_suggestion *) a;
+    const struct meminfo_suggestion *sb = (const struct meminfo_suggestion *) b;
+
+    uint64_t ta = sa->disk + sa->memory;
+    uint64_t tb = sb->disk + sb->memory;
+
+    if(ta != tb) return ta > tb ? -1 : 1;
+    return 0;
+}
+
+static uint64_t get_resident_memory(void) {
+
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if(fp == NULL) return 0;
+
+    unsigned long size, resident;
+    bool valid = fscanf(fp, "%lu %lu", &size, &resident) == 2;
+    fclose(fp);
+
+    return valid ? (uint64_t) resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+static void print_meminfo_suggestions(struct shell_variables *shell_state, struct model_config **models, struct model_memory *memory, int n_models) {
+
+    struct meminfo_suggestion *suggestions = NULL;
+
+    for(int i = 0; i < n_models; i++) {
+
+        struct model_config *model_config = models[i];
+
+        if(model_config->running_jobs > 0) continue;
+
+        //versions are created by the commands, so they are the ones that can go. The models loaded by the user are kept
+        if(model_config->is_derived && model_config != shell_state->current_model) {
+            struct meminfo_suggestion s = {"unload", model_config->model_name, memory[i].output_size + memory[i].binary_size,
+                                           memory[i].ast_bytes - memory[i].shared_ast_bytes + memory[i].runs_bytes};
+            arrput(suggestions, s);
+        } else if(model_config->num_runs > 1) {
+            struct meminfo_suggestion s = {"resetruns", model_config->model_name, memory[i].output_size, memory[i].runs_bytes};
+            arrput(suggestions, s);
+        }
+    }
+
+    int n = (int) arrlen(suggestions);
+
+    if(n == 0) {
+        printf("No candidates for unload or resetruns\n");
+        return;
+    }
+
+    qsort(suggestions, n, sizeof(struct meminfo_suggestion), compare_suggestions);
+
+    printf("Candidates to free space:\n");
+
+    for(int i = 0; i < n && i < MAX_MEMINFO_SUGGESTIONS; i++) {
+        sds disk   = format_bytes(suggestions[i].disk);
+        sds memory = format_bytes(suggestions[i].memory);
+        printf("    %s %s (frees %s on disk and %s of memory)\n", suggestions[i].command, suggestions[i].model_name, disk, memory);
+        sdsfree(disk);
+        sdsfree(memory);
+    }
+
+    arrfree(suggestions);
+}
+
+COMMAND_FUNCTION(meminfo) {
+
+    struct model_config **models = NULL;
+
+    if(num_args == 1) {
+        struct model_config *model_config = load_model_config_or_print_error(shell_state, tokens[0], tokens[1]);
+        if(!model_config) return false;
+        arrput(models, model_config);
+    } else {
+        if(shlen(shell_state->loaded_models) == 0) {
+            PRINT_NO_MODELS_LOADED_ERROR(tokens[0]);
+            return false;
+        }
+        for(int i = 0; i < shlen(shell_state->loaded_models); i++) {
+            arrput(models, shell_state->loaded_models[i].value);
+        }
+    }
+
+    int n_models                = (int) arrlen(models);
+    struct model_memory *memory = (struct model_memory *) malloc(sizeof(struct model_memory) * n_models);
+    struct model_memory total   = {0};
+    struct run_size *runs       = NULL;
+
+    CREATE_TABLE(table);
+    ft_printf_ln(table, "Model|Versions|AST nodes|AST memory|Symbols|Binary|Runs|Run outputs|Run memory");
+
+    for(int i = 0; i < n_models; i++) {
+
+        struct model_config *model_config = models[i];
+        struct model_memory *m            = &memory[i];
+
+        get_model_memory(model_config, m);
+
+        ft_printf(table, "%s|%d|%lu", model_config->model_name, count_loaded_versions(shell_state, model_config->model_name), (unsigned long) m->ast_nodes);
+
+        sds ast_bytes = format_bytes(m->ast_bytes);
+        if(m->shared_ast_bytes > 0) {
+            sds shared = format_bytes(m->shared_ast_bytes);
+            ast_bytes  = sdscatfmt(ast_bytes, " (%S shared)", shared);
+            sdsfree(shared);
+        }
+        ft_write(table, ast_bytes);
+        sdsfree(ast_bytes);
+
+        ft_printf(table, "%lu", (unsigned long) m->n_symbols);
+        write_bytes_cell(table, m->binary_size);
+        ft_printf(table, "%u", model_config->num_runs);
+        write_bytes_cell(table, m->output_size);
+        write_bytes_cell(table, m->runs_bytes + m->mapped_bytes);
+        ft_ln(table);
+
+        total.ast_nodes += m->ast_nodes;
+        total.ast_bytes += m->ast_bytes;
+        total.shared_ast_bytes += m->shared_ast_bytes;
+        total.symbol_bytes += m->symbol_bytes;
+        total.runs_bytes += m->runs_bytes;
+        total.mapped_bytes += m->mapped_bytes;
+        total.binary_size += m->binary_size;
+        total.output_size += m->output_size;
+
+        for(unsigned int r = 1; r <= model_config->num_runs; r++) {
+            struct run_size run = {model_config, r, get_run_output_size(model_config, r)};
+            arrput(runs, run);
+        }
+    }
+
+    PRINT_AND_FREE_TABLE(table);
+
+    int n_runs = (int) arrlen(runs);
+
+    if(n_runs > 0) {
+
+        qsort(runs, n_runs, sizeof(struct run_size), compare_runs_by_size);
+
+        CREATE_TABLE(runs_table);
+        ft_printf_ln(runs_table, "Model|Run|Time|Output size");
+
+        for(int i = 0; i < n_runs && i < MAX_MEMINFO_RUNS; i++) {
+            struct run_info *run_info = &runs[i].model_config->runs[runs[i].run_number - 1];
+            ft_printf(runs_table, "%s|%u|%lf", runs[i].model_config->model_name, runs[i].run_number, run_info->time);
+            write_bytes_cell(runs_table, runs[i].size);
+            ft_ln(runs_table);
+        }
+
+        PRINT_AND_FREE_TABLE(runs_table);
+
+        if(n_runs > MAX_MEMINFO_RUNS) {
+            printf("%d smaller runs not shown\n", n_runs - MAX_MEMINFO_RUNS);
+        }
+    }
+
+    sds ast_bytes    = format_bytes(total.ast_bytes);
+    sds symbol_bytes = format_bytes(total.symbol_bytes);
+    sds binaries     = format_bytes(total.binary_size);
+    sds outputs      = format_bytes(total.output_size);
+    sds runs_bytes   = format_bytes(total.runs_bytes + total.mapped_bytes);
+
+    printf("Total: %lu AST nodes (%s), name tables %s, binaries %s, run outputs %s, run memory %s\n", (unsigned long) total.ast_nodes, ast_bytes,
+           symbol_bytes, binaries, outputs, runs_bytes);
+
+    sdsfree(ast_bytes);
+    sdsfree(symbol_bytes);
+    sdsfree(binaries);
+    sdsfree(outputs);
+    sdsfree(runs_bytes);
+
+    //what the process holds, including the imported files, the programs being built and the statements not freed yet
+    struct ast_memory_stats ast_stats;
+    get_ast_memory_stats(&ast_stats);
+
+    size_t interned_bytes;
+    size_t n_interned = get_symbol_table_size(&interned_bytes);
+
+    sds arena_bytes    = format_bytes(ast_stats.arena_bytes);
+    sds heap_bytes     = format_bytes(ast_stats.heap_bytes);
+    sds interned       = format_bytes(interned_bytes);
+    sds resident       = format_bytes(get_resident_memory());
+
+    printf("Process: %u model configs, %lu parser arenas with %lu nodes (%s), %lu copied nodes (%s), %lu interned symbols (%s), resident memory %s\n",
+           get_live_model_configs(), (unsigned long) ast_stats.n_arenas, (unsigned long) ast_stats.arena_nodes, arena_bytes,
+           (unsigned long) ast_stats.heap_nodes, heap_bytes, (unsigned long) n_interned, interned, resident);
+
+    sdsfree(arena_bytes);
+    sdsfree(heap_bytes);
+    sdsfree(interned);
+    sdsfree(resident);
+
+    print_meminfo_suggestions(shell_state, models, memory, n_models);
+
+    free(memory);
+    arrfree(models);
+    arrfree(runs);
+
+    return true;
+}
+
+COMMAND_FUNCTION(clearcache) {
+
+    (void) num_args;
+    (void) shell_state;
+
+    clear_import_cache();
+
+    int removed = clear_build_cache();
+
+    if(removed == -1) {
+        printf("Error executing command %s. The build cache directory can not be accessed\n", tokens[0]);
+        return false;
+    }
+
+    printf("Removed %d compiled models from the build cache\n", removed);
+
+    return true;
+}
+
+COMMAND_FUNCTION(setcachesize) {
+
+    (void) num_args;
+    (void) shell_state;
+
+    bool error;
+    long size_mb = string_to_long(tokens[1], &error);
+
+    if(error || size_mb < 0) {
+        printf("Error executing command %s. Invalid cache size: %s\n", tokens[0], tokens[1]);
+        return false;
+    }
+
+    set_build_cache_size_limit((uint64_t) size_mb * 1024 * 1024);
+
+    return true;
+}
+
+COMMAND_FUNCTION(savemodeloutput) {
+
+    const char *command     = tokens[0];
+
+    char *model_name        = NULL;
+    char *file_name         = NULL;
+
+    unsigned int run_number = 0;
+
+    if(!get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &file_name)) {
+        return false;
+    }
+
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+
+    if(!model_config) return false;
+
+    if(run_number == 0) {
+        run_number = model_config->num_runs;
+    }
+
+    sds output_file = get_model_output_file(model_config, run_number);
+
+    if(file_name == NULL || cp_file(file_name, output_file, true) == -1) {
+        printf("Error executing command %s. Could not copy %s to %s\n", command, output_file, file_name);
+        sdsfree(output_file);
+        return false;
+    }
+
+    model_config->runs[run_number - 1].filename = strdup(file_name);
+    model_config->runs[run_number - 1].saved    = true;
+
+    sdsfree(output_file);
+    return true;
+}
+
+bool run_commands_from_file(struct shell_variables *shell_state, char *file_name) {
+
+
+    if(!file_exists(file_name)) {
+        printf("File '%s' does not exist!\n", file_name);
+    } else {
+        FILE *f = fopen(file_name, "r");
+
+        if(!f) {
+            printf("Error opening file '%s' for reading!\n", file_name);
+        } else {
+            char *line = NULL;
+            size_t len = 0;
+            sds command;
+
+            bool quit_shell = false;
+
+            //a script run by a server client waits for each of its solves
+            bool detach_solves         = shell_state->detach_solves;
+            shell_state->detach_solves = false;
+
+            while((getline(&line, &len, f)) != -1) {
+
+                if(!line[0] || line[0] == '#' || line[0] == '\n') continue;
+
+                command = sdsnew(line);
+                command = sdstrim(command, "\n ");
+
+                add_history(command);
+                printf("%s%s\n", PROMPT, command);
+
+                int cmd_count     = 0;
+                sds *all_commands = sdssplit(command, ";", &cmd_count);
+
+                for(int i = 0; i < cmd_count; i++) {
+                    if(*all_commands[i]) {
+                        quit_shell = parse_and_execute_command(all_commands[i], shell_state);
+                        if(quit_shell) break;
+                    }
+                }
+
+                sdsfreesplitres(all_commands, cmd_count);
+                sdsfree(command);
+                if(quit_shell) break;
+            }
+
+            shell_state->detach_solves = detach_solves;
+
+            fclose(f);
+            if(line) {
+                free(line);
+            }
+
+            if(quit_shell) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// A command of a script run with loadcmds -j. Its output goes straight to stdout when the output of all the previous
+// commands was already printed and to a temporary file otherwise, so the script prints the same as when run in order
+struct script_command {
+    sds line; //echoed before the first command of each line, NULL for the others
+    sds command;
+    FILE *output;
+    struct solve_job *job; //solve still running
+    bool finished;
+};
+
+struct script_runner {
+    struct shell_variables *shell_state;
+    struct script_command *commands;
+    int n_printed;
+    int max_jobs;
+    int n_running_jobs;
+};
+
+// These commands depend on all the models (or on the jobs), so they wait for every solve of the script
+static bool waits_for_all_solves(const char *command) {
+
+    static const char *commands_names[] = {"jobs", "wait", "killjob", "unloadall", "savesession", "loadsession", "loadcmds", "setglobalreload", "quit"};
+
+    for(size_t i = 0; i < sizeof(commands_names) / sizeof(commands_names[0]); i++) {
+        if(STR_EQUALS(command, commands_names[i])) return true;
+    }
+
+    return false;
+}
+
+static struct script_command *read_script_commands(FILE *f) {
+
+    struct script_command *commands = NULL;
+
+    char *line = NULL;
+    size_t len = 0;
+
+    while((getline(&line, &len, f)) != -1) {
+
+        if(!line[0] || line[0] == '#' || line[0] == '\n') continue;
+
+        sds command = sdsnew(line);
+        command     = sdstrim(command, "\n ");
+
+        add_history(command);
+
+        int cmd_count     = 0;
+        sds *all_commands = sdssplit(command, ";", &cmd_count);
+        bool echoed       = false;
+
+        for(int i = 0; i < cmd_count; i++) {
+            if(*all_commands[i]) {
+                struct script_command script_command = {0};
+                script_command.line                  = echoed ? NULL : sdsdup(command);
+                script_command.command               = sdsdup(all_commands[i]);
+                arrput(commands, script_command);
+                echoed = true;
+            }
+        }
+
+        sdsfreesplitres(all_commands, cmd_count);
+        sdsfree(command);
+    }
+
+    free(line);
+
+    return commands;
+}
+
+static void print_finished_commands(struct script_runner *runner) {
+
+    fflush(stdout);
+    fflush(stderr);
+
+    while(runner->n_printed < arrlen(runner->commands) && runner->commands[runner->n_printed].finished) {
+
+        struct script_command *command = &runner->commands[runner->n_printed];
+
+        if(command->output) {
+            char buf[4096];
+            size_t n;
+
+            rewind(command->output);
+            while((n = fread(buf, 1, sizeof(buf), command->output)) > 0) {
+                fwrite(buf, 1, n, stdout);
+            }
+
+            fclose(command->output);
+            command->output = NULL;
+        }
+
+        runner->n_printed++;
     }
+
+    fflush(stdout);
 }
 
-COMMAND_FUNCTION(ls) {
+// Returns true if the output of the command was redirected to its temporary file
+static bool begin_command_output(struct script_runner *runner, int i, int saved[2]) {
 
-    (void) shell_state;
-    (void) num_args;
+    struct script_command *command = &runner->commands[i];
 
-    char *path_name;
+    //once part of the output is in the file, the rest goes after it
+    if(i == runner->n_printed && !command->output) return false;
 
-    if(num_args == 0) {
-        path_name = ".";
-    } else {
-        path_name = tokens[1];
+    if(!command->output) {
+        command->output = tmpfile();
+        if(!command->output) return false;
     }
 
-    print_path_contents(path_name);
+    redirect_output(fileno(command->output), saved);
+
     return true;
 }
 
-COMMAND_FUNCTION(help) {
-
-    (void) shell_state;
+// Ctrl+C cancels the solves of the script, as it does with a solve run in the shell
+static void wait_for_script_job(struct script_runner *runner, struct solve_job *job) {
 
-    CREATE_TABLE(table);
+    set_waiting_for_jobs(true);
 
-    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+    struct timespec interval = {0, 50000000};
 
-    if(num_args == 0) {
+    while(!is_solve_job_finished(job)) {
 
-        ft_printf_ln(table, "Available commands");
-        int nc = arrlen(commands_sorted);
-        for(int i = 0; i < nc; i += 3) {
-            if(i + 2 < nc) {
-                ft_printf_ln(table, "%s|%s|%s", commands_sorted[i], commands_sorted[i + 1], commands_sorted[i + 2]);
-            } else if(i + 1 < nc) {
-                ft_printf_ln(table, "%s|%s| ", commands_sorted[i], commands_sorted[i + 1]);
-            } else {
-                ft_printf_ln(table, "%s| | ", commands_sorted[i]);
+        if(was_job_wait_interrupted()) {
+            for(int i = runner->n_printed; i < arrlen(runner->commands); i++) {
+                if(runner->commands[i].job) cancel_solve_job(runner->commands[i].job);
             }
+            //clears the interruption
+            set_waiting_for_jobs(true);
         }
 
-    } else {
-        command command = {0};
-        int index       = shgeti(commands, tokens[1]);
+        nanosleep(&interval, NULL);
+    }
 
-        if(index != -1) {
-            command = commands[index];
-        }
+    set_waiting_for_jobs(false);
 
-        if(command.help) {
-            ft_printf_ln(table, "Command|help");
-            ft_printf_ln(table, "%s|%s", tokens[1], command.help);
-        } else if(command.key) {
-            ft_printf_ln(table, "%s|No help available yet!", tokens[1]);
-        } else {
-            ft_printf_ln(table, "Invalid command %s!", tokens[1]);
+    join_solve_job(job);
+}
+
+static void finish_script_command_job(struct script_runner *runner, int i) {
+
+    struct script_command *command = &runner->commands[i];
+
+    wait_for_script_job(runner, command->job);
+
+    int saved[2];
+    bool redirected = begin_command_output(runner, i, saved);
+
+    pthread_mutex_lock(&runner->shell_state->lock);
+    report_detached_job(command->job);
+    pthread_mutex_unlock(&runner->shell_state->lock);
+
+    if(redirected) restore_output(saved);
+
+    command->job      = NULL;
+    command->finished = true;
+    runner->n_running_jobs--;
+
+    print_finished_commands(runner);
+}
+
+// Waits, in script order, for the solves of the given model (or of all models when model_config is NULL)
+static void finish_script_jobs(struct script_runner *runner, struct model_config *model_config) {
+
+    for(int i = runner->n_printed; i < arrlen(runner->commands); i++) {
+        struct solve_job *job = runner->commands[i].job;
+        if(job && (!model_config || job->model_config == model_config)) {
+            finish_script_command_job(runner, i);
         }
     }
+}
 
-    if(num_args == 0) {
-        ft_set_cell_span(table, 0, 0, 3);
+static void finish_oldest_script_job(struct script_runner *runner) {
+
+    for(int i = runner->n_printed; i < arrlen(runner->commands); i++) {
+        if(runner->commands[i].job) {
+            finish_script_command_job(runner, i);
+            return;
+        }
     }
+}
 
-    PRINT_AND_FREE_TABLE(table);
+// A command depends on the solves of the current model and of the loaded models named in its arguments. The run
+// numbers, the results and the plots of a model are the same as when the script runs in order
+static void finish_script_command_dependencies(struct script_runner *runner, sds *tokens, int token_count) {
 
-    if(num_args == 0) {
-        printf("\ntype 'help command' for more information about a specific command\n\n");
+    struct shell_variables *shell_state = runner->shell_state;
+
+    if(waits_for_all_solves(tokens[0])) {
+        finish_script_jobs(runner, NULL);
+        return;
     }
 
-    return true;
-}
+    pthread_mutex_lock(&shell_state->lock);
 
-COMMAND_FUNCTION(getplotconfig) {
+    struct model_config **models = NULL;
 
-    CREATE_TABLE(table);
+    if(shell_state->current_model) {
+        arrput(models, shell_state->current_model);
+    }
 
-    struct model_config *model_config = NULL;
+    for(int i = 1; i < token_count; i++) {
+        struct model_config *model_config = shget(shell_state->loaded_models, tokens[i]);
+        if(model_config) arrput(models, model_config);
+    }
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    pthread_mutex_unlock(&shell_state->lock);
 
-    char *xname = get_var_name(model_config, model_config->plot_config.xindex);
-    char *yname = get_var_name(model_config, model_config->plot_config.yindex);
+    for(int i = 0; i < arrlen(models); i++) {
+        finish_script_jobs(runner, models[i]);
+    }
 
-    ft_printf_ln(table, "Plot configuration for model %s|", model_config->model_name);
+    arrfree(models);
+}
 
-    ft_printf_ln(table, "Gnuplot terminal|%s", shell_state->default_gnuplot_term);
+// "solve ... &" is a background job of the shell and is left to it
+static bool is_background_command(sds *tokens, int token_count) {
+    sds last = tokens[token_count - 1];
+    return sdslen(last) > 0 && last[sdslen(last) - 1] == '&';
+}
 
-    ft_printf_ln(table, "Var on X|%s (%d)", xname, model_config->plot_config.xindex);
-    ft_printf_ln(table, "Var on Y|%s (%d)", yname, model_config->plot_config.yindex);
+static bool is_script_load(const struct script_command *command) {
 
-    ft_printf_ln(table, "Label X|%s", model_config->plot_config.xlabel);
-    ft_printf_ln(table, "Label Y|%s", model_config->plot_config.ylabel);
-    ft_printf_ln(table, "Title (legend)|%s", model_config->plot_config.title);
+    int argc;
+    sds *args = sdssplitargs(command->command, &argc);
+    bool load = args && argc > 1 && STR_EQUALS(args[0], "load") && !is_background_command(args, argc);
 
-    ft_set_cell_span(table, 0, 0, 2);
-    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
-    PRINT_AND_FREE_TABLE(table);
+    if(args) sdsfreesplitres(args, argc);
 
-    return true;
+    return load;
 }
 
-static bool set_or_get_value_helper(struct shell_variables *shell_state, sds *tokens, int num_args, ast_tag tag, command_type action) {
-
-    const char *command = tokens[0];
-    sds var_name;
-    char *new_value;
+// Consecutive loads are merged into a single load, which parses and compiles the models in parallel. Returns the
+// command and the index of the last command that was merged
+static sds merge_script_loads(struct script_runner *runner, int first, int *last) {
 
-    struct model_config *parent_model_config = NULL;
+    sds command = sdsnew("load");
 
-    if(action == CMD_SET) {
-        var_name  = sdsnew(tokens[num_args - 1]);
-        new_value = tokens[num_args];
+    *last = first;
 
-        if(num_args == 2) {
-            parent_model_config = load_model_config_or_print_error(shell_state, command, NULL);
-        } else if(num_args == 3) {
-            parent_model_config = load_model_config_or_print_error(shell_state, command, tokens[1]);
-        }
+    for(int i = first; i < arrlen(runner->commands) && is_script_load(&runner->commands[i]); i++) {
 
-    } else {
-        var_name = sdsnew(tokens[num_args]);
+        int argc;
+        sds *args = sdssplitargs(runner->commands[i].command, &argc);
 
-        if(tag == ast_ode_stmt) {
-            var_name = sdscat(var_name, "'");
+        for(int a = 1; a < argc; a++) {
+            command = sdscatlen(command, " ", 1);
+            command = sdscatrepr(command, args[a], sdslen(args[a]));
         }
 
-        if(num_args == 1) {
-            parent_model_config = load_model_config_or_print_error(shell_state, tokens[0], NULL);
-        } else if(num_args == 2) {
-            parent_model_config = load_model_config_or_print_error(shell_state, command, tokens[1]);
-        }
+        sdsfreesplitres(args, argc);
+        *last = i;
     }
 
-    if(!parent_model_config) return false;
+    return command;
+}
 
-    struct model_config *model_config;
+// Runs the commands in order, but a solve leaves its job running and the next commands only wait for it when they use
+// its model. At most max_jobs solves run at the same time
+static bool run_script_commands(struct script_runner *runner) {
 
-    if(action == CMD_SET) {
-        model_config = new_config_from_parent(parent_model_config);
-    } else {
-        model_config = parent_model_config;
-    }
+    struct shell_variables *shell_state = runner->shell_state;
 
-    int n = arrlen(model_config->program);
+    bool quit_shell = false;
 
-    int i;
-    for(i = 0; i < n; i++) {
-        ast *a                         = model_config->program[i];
-        unsigned int indentation_level = 0;
-        if(a->tag == tag) {
-            if(STR_EQUALS(a->assignment_stmt.name->identifier.value, var_name)) {
-                if(action == CMD_SET) {
-                    lexer *l        = new_lexer(new_value, model_config->model_name);
-                    parser *p       = new_parser(l);
-                    program program = parse_program(p, false, false, NULL);
-
-                    if(program == NULL || arrlen(program) == 0) {
-                        printf("Error parsing new value: %s\n", new_value);
-                        free_parser(p);
-                        if(program) free_program(program);
-                        free_lexer(l);
-                        free_model_config(model_config);
-                        sdsfree(var_name);
-                        return false;
-                    }
+    for(int i = 0; i < arrlen(runner->commands) && !quit_shell; i++) {
 
-                    sds tmp1        = ast_to_string(a->assignment_stmt.value, &indentation_level);
-                    sds tmp2        = ast_to_string(program[0], &indentation_level);
+        struct script_command *command = &runner->commands[i];
 
-                    printf("Changing value of variable %s from %s to %s for model %s\n",
-                           var_name, tmp1, tmp2, parent_model_config->model_name);
+        int token_count;
+        sds *tokens = sdssplitargs(command->command, &token_count);
 
-                    sdsfree(tmp1);
-                    sdsfree(tmp2);
+        bool solve = false;
 
-                    int old_decl_pos = a->assignment_stmt.declaration_position;
-                    bool global      = a->assignment_stmt.name->identifier.global;
+        if(tokens && token_count > 0) {
+            finish_script_command_dependencies(runner, tokens, token_count);
+            solve = STR_EQUALS(tokens[0], "solve") && !is_background_command(tokens, token_count);
+        }
 
-                    free_ast(a->assignment_stmt.value);
+        if(tokens) sdsfreesplitres(tokens, token_count);
 
-                    a->assignment_stmt.value                   = copy_ast(program[0]);
-                    a->assignment_stmt.name->identifier.global = global;
-                    a->assignment_stmt.declaration_position    = old_decl_pos;
+        if(solve && runner->n_running_jobs == runner->max_jobs) {
+            finish_oldest_script_job(runner);
+        }
 
-                    free_parser(p);
-                    free_program(program);
-                    free_lexer(l);
+        int last   = i;
+        sds to_run = is_script_load(command) ? merge_script_loads(runner, i, &last) : sdsdup(command->command);
 
-                } else {
-                    sds tmp = ast_to_string(a->assignment_stmt.value, &indentation_level);
-                    printf("%s = %s for model %s\n", var_name, tmp, model_config->model_name);
-                    sdsfree(tmp);
-                }
-                break;
-            }
-        }
-    }
+        int saved[2];
+        bool redirected = begin_command_output(runner, i, saved);
 
-    if(i == n) {
-        parent_model_config->version--;
-        int command_len = (int) strlen(command);
-        printf("Error parsing command %s. Invalid variable name: %s. You can list model variable using g%*ss %s\n",
-               command, var_name, command_len - 1, command + 1, parent_model_config->model_name);
-        if(action == CMD_SET) {
-            free_model_config(model_config);
-        }
-    } else {
-        if(action == CMD_SET) {
-            printf("Reloading model %s as %s\n", parent_model_config->model_name, model_config->model_name);
-            load_model(shell_state, NULL, model_config);
+        for(int j = i; j <= last; j++) {
+            if(runner->commands[j].line) printf("%s%s\n", PROMPT, runner->commands[j].line);
         }
-    }
 
-    sdsfree(var_name);
+        shell_state->detach_solves = solve;
+        quit_shell                 = parse_and_execute_command(to_run, shell_state);
+        shell_state->detach_solves = false;
 
-    return true;
-}
+        command->job              = shell_state->detached_job;
+        shell_state->detached_job = NULL;
 
-COMMAND_FUNCTION(setinitialvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_initial_stmt, CMD_SET);
-}
+        if(redirected) restore_output(saved);
 
-COMMAND_FUNCTION(getinitialvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_initial_stmt, CMD_GET);
-}
+        sdsfree(to_run);
 
-COMMAND_FUNCTION(setparamvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_assignment_stmt, CMD_SET);
-}
+        for(int j = i + 1; j <= last; j++) {
+            runner->commands[j].finished = true;
+        }
 
-COMMAND_FUNCTION(getparamvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_assignment_stmt, CMD_GET);
-}
+        if(command->job) {
+            runner->n_running_jobs++;
+        } else {
+            command->finished = true;
+        }
 
-COMMAND_FUNCTION(setglobalvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_global_stmt, CMD_SET);
-}
+        print_finished_commands(runner);
 
-COMMAND_FUNCTION(getglobalvalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_global_stmt, CMD_GET);
-}
+        i = last;
+    }
 
-COMMAND_FUNCTION(setodevalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_ode_stmt, CMD_SET);
-}
+    finish_script_jobs(runner, NULL);
 
-COMMAND_FUNCTION(getodevalue) {
-    return set_or_get_value_helper(shell_state, tokens, num_args, ast_ode_stmt, CMD_GET);
+    return quit_shell;
 }
 
-static bool get_values_helper(struct shell_variables *shell_state, sds *tokens, int num_args, ast_tag tag) {
+static bool run_commands_from_file_in_parallel(struct shell_variables *shell_state, char *file_name, int max_jobs) {
 
-    struct model_config *model_config = NULL;
+    if(!file_exists(file_name)) {
+        printf("File '%s' does not exist!\n", file_name);
+        return true;
+    }
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    FILE *f = fopen(file_name, "r");
 
-    int n = arrlen(model_config->program);
+    if(!f) {
+        printf("Error opening file '%s' for reading!\n", file_name);
+        return true;
+    }
 
-    CREATE_TABLE(table);
+    struct script_runner runner = {0};
+    runner.shell_state          = shell_state;
+    runner.commands             = read_script_commands(f);
+    runner.max_jobs             = max_jobs;
 
-    ft_printf_ln(table, "%s", model_config->model_name);
-    ft_printf_ln(table, "Variable|Value");
+    fclose(f);
 
-    bool empty                    = true;
+    bool detach_solves = shell_state->detach_solves;
+    bool quit_shell    = run_script_commands(&runner);
 
-    unsigned int indentaion_value = 0;
+    shell_state->detach_solves = detach_solves;
 
-    for(int i = 0; i < n; i++) {
-        ast *a = model_config->program[i];
-        if(a->tag == tag) {
-            sds ast_string    = ast_to_string(a->assignment_stmt.value, &indentaion_value);
-            char *first_paren = strchr(ast_string, '(');
-            if(first_paren) {
-                ft_printf_ln(table, "%s|%.*s", a->assignment_stmt.name->identifier.value, (int) strlen(first_paren + 1) - 1, first_paren + 1);
-            } else {
-                ft_printf_ln(table, "%s|%s", a->assignment_stmt.name->identifier.value, ast_string);
-            }
-            sdsfree(ast_string);
-            empty = false;
-        }
+    for(int i = 0; i < arrlen(runner.commands); i++) {
+        sdsfree(runner.commands[i].line);
+        sdsfree(runner.commands[i].command);
     }
 
-    if(empty) {
-        ft_printf_ln(table, "No values to show");
-    }
+    arrfree(runner.commands);
 
-    ft_set_cell_span(table, 0, 0, 2);
-    ft_set_cell_prop(table, FT_ANY_ROW, FT_ANY_COLUMN, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
+    return !quit_shell;
+}
 
-    PRINT_AND_FREE_TABLE(table);
+COMMAND_FUNCTION(loadcmds) {
 
-    return true;
-}
+    if(num_args == 1) {
+        return run_commands_from_file(shell_state, tokens[1]);
+    }
 
-COMMAND_FUNCTION(getinitialvalues) {
-    return get_values_helper(shell_state, tokens, num_args, ast_initial_stmt);
-}
+    if(num_args != 3 || !STR_EQUALS(tokens[1], "-j")) {
+        printf("Error executing command %s. Usage: loadcmds [-j N] file\n", tokens[0]);
+        return false;
+    }
 
-COMMAND_FUNCTION(getparamvalues) {
-    return get_values_helper(shell_state, tokens, num_args, ast_assignment_stmt);
-}
+    bool error;
+    long max_jobs = string_to_long(tokens[2], &error);
 
-COMMAND_FUNCTION(getglobalvalues) {
-    return get_values_helper(shell_state, tokens, num_args, ast_global_stmt);
-}
+    if(error || max_jobs < 1) {
+        printf("Error executing command %s. Invalid number of jobs: %s\n", tokens[0], tokens[2]);
+        return false;
+    }
 
-COMMAND_FUNCTION(getodevalues) {
-    return get_values_helper(shell_state, tokens, num_args, ast_ode_stmt);
+    return run_commands_from_file_in_parallel(shell_state, tokens[3], (int) max_jobs);
 }
 
-COMMAND_FUNCTION(saveplot) {
+COMMAND_FUNCTION(quit) {
+    (void) shell_state;
+    (void) tokens;
+    (void) num_args;
+
+    printf("Bye!\n");
+    return true;
+}
 
+COMMAND_FUNCTION(pwd) {
+    (void) shell_state;
+    (void) tokens;
     (void) num_args;
 
-    const char *command   = tokens[0];
+    print_current_dir();
+    return true;
+}
 
-    const char *file_name = tokens[1];
+COMMAND_FUNCTION(odestolatex) {
 
-    if(shell_state->gnuplot_handle == NULL) {
-        printf("Error executing command %s. No previous plot. plot the model first using \"plot modelname\" or list loaded models using \"list\"\n", command);
-        return false;
-    }
+    struct model_config *model_config = NULL;
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
 
-    const char *ext = get_filename_ext(file_name);
+    sds *odes = odes_to_latex(model_config->program);
 
-    if(!FILE_HAS_EXTENSION(ext, "pdf") && !FILE_HAS_EXTENSION(ext, "png")) {
-        printf("Error executing command %s. Only .pdf and .png outputs are supported\n", command);
-        return false;
+    for(int i = 0; i < arrlen(odes); i++) {
+        const char *first_paren = strchr(odes[i], '(');
+        if(first_paren) {
+            printf("%.*s ", (int) (first_paren - &odes[i][0]), odes[i]);
+            printf("%.*s\n", (int) strlen(first_paren + 1) - 1, first_paren + 1);
+        } else {
+            printf("%s\n", odes[i]);
+        }
+        sdsfree(odes[i]);
     }
 
-    gnuplot_cmd(shell_state->gnuplot_handle, "set terminal %s", ext);
-    gnuplot_cmd(shell_state->gnuplot_handle, "set output \"%s", file_name);
-    gnuplot_cmd(shell_state->gnuplot_handle, "replot");
-
-    reset_terminal(shell_state->gnuplot_handle);
+    arrfree(odes);
 
     return true;
 }
 
-COMMAND_FUNCTION(setcurrentmodel) {
 
-    (void) num_args;
+static sds run_params_to_string(const struct run_info *run_info) {
 
-    struct model_config *model_config = load_model_config_or_print_error(shell_state, tokens[0], tokens[1]);
+    sds params = sdsempty();
 
-    if(!model_config) return false;
+    for(int p = 0; p < arrlen(run_info->params); p++) {
+        params = sdscatprintf(params, "%s%s=%g", p ? " " : "", run_info->params[p].name, run_info->params[p].value);
+    }
 
-    shell_state->current_model = model_config;
+    return params;
+}
 
-    printf("Current model set to %s\n", shell_state->current_model->model_name);
+static const char *get_run_cache_status_name(enum run_cache_status status) {
+    switch(status) {
+        case RUN_CACHE_HIT:
+            return "hit";
+        case RUN_CACHE_MISS:
+            return "miss";
+        default:
+            return "-";
+    }
+}
 
-    return true;
+// The times are estimated from the samples taken by the solver, so they are not shown for runs too short to be sampled
+static sds format_solver_time(const struct solver_stats *s, double time) {
+    if(s->time_samples == 0) {
+        return sdsnew("-");
+    }
+    return sdscatprintf(sdsempty(), "%.3lf s (%.1lf%%)", time, s->total_time > 0 ? 100.0 * time / s->total_time : 0.0);
 }
 
-COMMAND_FUNCTION(solveplot) {
+static void print_solver_stats(const struct solver_stats *s) {
 
-    bool success     = solve(shell_state, tokens, num_args);
-    char *model_name = NULL;
+    CREATE_TABLE(table);
 
-    if(!success) return false;
+    ft_printf_ln(table, "Solver|RHS evals|Accepted steps|Rejected steps|Lin solv setups|Min dt|Mean dt|Max dt");
+    ft_printf(table, "%s|%lu|%lu|%lu", s->solver_type == CVODE_SOLVER ? "cvode" : "euler", (unsigned long) s->rhs_evals,
+              (unsigned long) s->accepted_steps, (unsigned long) s->rejected_steps);
 
-    if(num_args == 2) {
-        model_name = tokens[2];
+    if(s->solver_type == CVODE_SOLVER) {
+        ft_printf(table, "%lu", (unsigned long) s->lin_solv_setups);
+    } else {
+        ft_write(table, "-");
     }
 
-    plot_helper(shell_state, tokens[0], CMD_PLOT, model_name, 0, NULL);
+    ft_printf_ln(table, "%e|%e|%e", s->min_dt, s->mean_dt, s->max_dt);
 
-    return true;
-}
+    PRINT_AND_FREE_TABLE(table);
 
-COMMAND_FUNCTION(printmodel) {
+    sds rhs_time    = format_solver_time(s, s->rhs_time);
+    sds output_time = format_solver_time(s, s->output_time);
+    sds other_time  = format_solver_time(s, fmax(0.0, s->total_time - s->rhs_time - s->output_time));
 
-    struct model_config *model_config = NULL;
+    CREATE_TABLE(table2);
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    ft_printf_ln(table2, "Total time|RHS time|Output time|Solver time");
+    ft_printf(table2, "%.3lf s", s->total_time);
+    ft_write_ln(table2, rhs_time, output_time, other_time);
 
-    printf("\n");
-    print_program(model_config->program);
-    printf("\n");
+    sdsfree(rhs_time);
+    sdsfree(output_time);
+    sdsfree(other_time);
 
-    return true;
+    PRINT_AND_FREE_TABLE(table2);
 }
 
-COMMAND_FUNCTION(editmodel) {
+COMMAND_FUNCTION(listruns) {
 
     struct model_config *model_config = NULL;
-
     GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
 
-    if(!can_run_command("xdg-open")) {
-        printf("Error - xdg-open is not in your path or is not installed\n");
-        return false;
+    unsigned int n_runs       = model_config->num_runs;
+
+    struct run_info *run_info = model_config->runs;
+
+    printf("\nModel %s was solved %u time(s).\n\n", model_config->model_name, n_runs);
+
+    CREATE_TABLE(table);
+
+    int yindex     = model_config->plot_config.yindex;
+    char *var_name = get_var_name(model_config, yindex);
+    if(var_name == NULL) var_name = "y";
+
+    bool has_params = false;
+    for(unsigned int i = 0; i < n_runs; i++) {
+        if(arrlen(run_info[i].params) > 0) has_params = true;
     }
 
-    sds cmd = sdscatfmt(sdsempty(), "xdg-open %s.ode & 2> /dev/null", model_config->model_name);
+    if(n_runs > 0) {
+        ft_printf(table, "Run|Time|Samples|Min %s|Max %s|Mean %s", var_name, var_name, var_name);
+        if(has_params) ft_write(table, "Parameters");
+        ft_write(table, "Cache");
+        ft_write_ln(table, "Output File");
+    }
 
-    FILE *f = popen(cmd, "r");
-    pclose(f);
+    for(unsigned int i = 0; i < n_runs; i++) {
+        const char *filename = run_info[i].saved ? run_info[i].filename : "output not saved!";
+        if(run_info[i].vars_stats && yindex > 1) {
+            struct var_stats *s = &run_info[i].vars_stats[yindex - 2];
+            ft_printf(table, "%d|%lf|%lu|%e|%e|%e", i + 1, run_info[i].time, (unsigned long) run_info[i].num_samples, s->min, s->max, s->mean);
+        } else {
+            ft_printf(table, "%d|%lf|-|-|-|-", i + 1, run_info[i].time);
+        }
+        if(has_params) {
+            sds params = run_params_to_string(&run_info[i]);
+            ft_write(table, params);
+            sdsfree(params);
+        }
+        ft_write(table, get_run_cache_status_name(run_info[i].cache_status));
+        ft_write_ln(table, filename);
+    }
 
-    sdsfree(cmd);
+    PRINT_AND_FREE_TABLE(table);
 
     return true;
 }
 
-COMMAND_FUNCTION(unloadall) {
+COMMAND_FUNCTION(getruninfo) {
 
-    (void) tokens;
-    (void) num_args;
+    unsigned int run_number;
+    char *model_name = NULL;
 
-    int len = shlen(shell_state->loaded_models);
+    get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number);
 
-    if(len == 0) {
-        CREATE_TABLE(table);
-        ft_set_cell_prop(table, FT_ANY_COLUMN, 0, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_CENTER);
-        ft_set_cell_prop(table, FT_ANY_COLUMN, 1, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
-        ft_printf_ln(table, "No models loaded");
-        PRINT_AND_FREE_TABLE(table);
+    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
 
-    } else {
+    if(!model_config) return false;
 
-        while(shlen(shell_state->loaded_models) > 0) {
-            char *name                        = shell_state->loaded_models[0].key;
-            struct model_config *model_config = shell_state->loaded_models[0].value;
-            struct model_config **entries     = hmget(shell_state->notify_entries, model_config->notify_code);
-            arrfree(entries);
+    if(run_number == 0) {
+        run_number = model_config->num_runs;
+    }
 
-            (void) hmdel(shell_state->notify_entries, model_config->notify_code);
-            (void) shdel(shell_state->loaded_models, name);
+    struct run_info run_info = model_config->runs[run_number - 1];
 
-            free_model_config(model_config);
-        }
+    CREATE_TABLE(table);
 
-        shell_state->current_model = NULL;
-    }
-    return true;
-}
+    bool has_params = arrlen(run_info.params) > 0;
 
-COMMAND_FUNCTION(unload) {
+    ft_write(table, "Run", "Time");
+    if(has_params) ft_write(table, "Parameters");
+    ft_write(table, "Cache");
+    ft_write_ln(table, "Output File");
 
-    struct model_config *model_config = NULL;
+    ft_printf(table, "%d|%lf", run_number, run_info.time);
+    if(has_params) {
+        sds params = run_params_to_string(&run_info);
+        ft_write(table, params);
+        sdsfree(params);
+    }
+    ft_write(table, get_run_cache_status_name(run_info.cache_status));
+    ft_write_ln(table, run_info.saved ? run_info.filename : "output not saved!");
 
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    PRINT_AND_FREE_TABLE(table);
 
-    bool is_current               = (model_config == shell_state->current_model);
+    if(run_info.solver_stats) {
+        print_solver_stats(run_info.solver_stats);
+    }
 
-    struct model_config **entries = hmget(shell_state->notify_entries, model_config->notify_code);
-    arrfree(entries);
+    int len = shlen(model_config->var_indexes);
 
-    (void) hmdel(shell_state->notify_entries, model_config->notify_code);
-    (void) shdel(shell_state->loaded_models, tokens[1]);
+    if(run_info.vars_stats == NULL) {
+        printf("No statistics available for run %u\n", run_number);
+        return true;
+    }
 
-    free_model_config(model_config);
+    printf("Statistics computed over %lu samples\n", (unsigned long) run_info.num_samples);
 
-    if(is_current) {
-        if(shlen(shell_state->loaded_models) > 0) {
-            shell_state->current_model = shell_state->loaded_models[0].value;
-        } else {
-            shell_state->current_model = NULL;
+    CREATE_TABLE(table2);
+    ft_printf_ln(table2, "Var name|Min value|Min time|Max value|Max time|Mean|Variance|Integral");
+
+    for(int i = 0; i < len; i++) {
+        int var_index = model_config->var_indexes[i].value;
+        if(var_index > 1) {
+            struct var_stats *s = &run_info.vars_stats[var_index - 2];
+            ft_printf_ln(table2, "%s|%e|%lf|%e|%lf|%e|%e|%e", model_config->var_indexes[i].key, s->min, s->min_time, s->max, s->max_time, s->mean, s->variance, s->integral);
         }
     }
 
+    PRINT_AND_FREE_TABLE(table2);
+
     return true;
 }
 
-static bool set_reload_helper(struct shell_variables *shell_state, const sds *tokens, int num_args, command_type cmd_type) {
+#define MAX_QUERY_ROWS 50
 
-    const char *command = tokens[0];
-    char *arg           = tokens[1];
-    bool is_zero;
+static struct run_columns *get_run_columns(struct model_config *model_config, unsigned int run_number) {
 
-    if(STR_EQUALS(arg, "0")) {
-        is_zero = true;
-    } else if(STR_EQUALS(arg, "1")) {
-        is_zero = false;
-    } else {
-        printf("Error - Invalid value %s for command %s. Valid values are 0 or 1\n", arg, command);
-        return false;
-    }
+    struct run_info *run_info = &model_config->runs[run_number - 1];
 
+    if(run_info->columns == NULL) {
+        sds output_file   = get_model_output_file(model_config, run_number);
+        run_info->columns = open_run_columns(output_file);
+        sdsfree(output_file);
+    }
 
-    if(cmd_type == CMD_SET_GLOBAL_RELOAD) {
-        shell_state->never_reload = is_zero;
-    } else {
-        struct model_config *model_config;
+    return run_info->columns;
+}
 
-        if(num_args == 1) {
-            model_config = shell_state->current_model;
-        } else {
-            model_config = load_model_config_or_print_error(shell_state, command, arg);
-        }
+static bool get_query_column(const char *command, struct model_config *model_config, const char *var_name, uint32_t *column) {
 
-        if(cmd_type == CMD_SET_RELOAD) {
-            model_config->should_reload = !is_zero;
-        } else if(cmd_type == CMD_SET_AUTO_RELOAD) {
-            model_config->auto_reload = !is_zero;
+    int var_index = shgeti(model_config->var_indexes, var_name);
 
-            if(!is_zero) {
-                model_config->should_reload = true;
-            }
-        }
+    if(var_index == -1) {
+        printf("Error executing command %s. Invalid variable name: %s. You can list model variables using vars %s\n", command, var_name, model_config->model_name);
+        return false;
     }
 
-    return true;
-}
-
-COMMAND_FUNCTION(setglobalreload) {
-    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_GLOBAL_RELOAD);
-}
+    *column = model_config->var_indexes[var_index].value - 1;
 
-COMMAND_FUNCTION(setautolreload) {
-    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_AUTO_RELOAD);
+    return true;
 }
 
-COMMAND_FUNCTION(setshouldreload) {
-    return set_reload_helper(shell_state, tokens, num_args, CMD_SET_RELOAD);
-}
+// Query commands have the form: command [model] var [numeric args...] [run]
+// The model is optional and it is detected by checking the loaded models
+static struct model_config *get_query_model_and_column(struct shell_variables *shell_state, sds *tokens, int num_args, uint32_t *column, int *next_arg) {
 
-COMMAND_FUNCTION(savemodeloutput) {
+    const char *model_name = NULL;
+    *next_arg              = 1;
 
-    const char *command     = tokens[0];
+    if(num_args >= 2 && shgeti(shell_state->loaded_models, tokens[1]) != -1) {
+        model_name = tokens[1];
+        *next_arg  = 2;
+    }
 
-    char *model_name        = NULL;
-    char *file_name         = NULL;
+    struct model_config *model_config = load_model_config_or_print_error(shell_state, tokens[0], model_name);
 
-    unsigned int run_number = 0;
+    if(!model_config) return NULL;
 
-    if(!get_model_name_and_n_run_one_to_three_args(tokens, num_args, &model_name, &run_number, &file_name)) {
-        return false;
+    if(!get_query_column(tokens[0], model_config, tokens[*next_arg], column)) {
+        return NULL;
     }
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, command, model_name, run_number);
+    (*next_arg)++;
 
-    if(!model_config) return false;
+    return model_config;
+}
 
-    sds output_file = get_model_output_file(model_config, run_number);
+static bool parse_query_numbers(const char *command, sds *tokens, int first, int last, double *values) {
 
-    if(file_name == NULL || cp_file(file_name, output_file, true) == -1) {
-        printf("Error executing command %s. Could not copy %s to %s\n", command, output_file, file_name);
-        sdsfree(output_file);
-        return false;
+    for(int i = first; i <= last; i++) {
+        values[i - first] = string_to_double(tokens[i]);
+        if(isnan(values[i - first])) {
+            printf("Error parsing command %s. Invalid number: %s\n", command, tokens[i]);
+            return false;
+        }
     }
 
-    model_config->runs[run_number - 1].filename = strdup(file_name);
-    model_config->runs[run_number - 1].saved    = true;
-
-    sdsfree(output_file);
     return true;
 }
 
-bool run_commands_from_file(struct shell_variables *shell_state, char *file_name) {
+static bool get_query_run(const char *command, struct model_config *model_config, const char *run_str, unsigned int *run_number) {
 
+    *run_number = model_config->num_runs;
 
-    if(!file_exists(file_name)) {
-        printf("File '%s' does not exist!\n", file_name);
-    } else {
-        FILE *f = fopen(file_name, "r");
+    if(run_str != NULL) {
+        bool error;
+        long run = string_to_long(run_str, &error);
+        if(error || run <= 0) {
+            printf("Error parsing command %s. Invalid run number: %s\n", command, run_str);
+            return false;
+        }
+        *run_number = (unsigned int) run;
+    }
 
-        if(!f) {
-            printf("Error opening file '%s' for reading!\n", file_name);
-        } else {
-            char *line = NULL;
-            size_t len = 0;
-            sds command;
+    if(model_config->num_runs == 0) {
+        printf("Error executing command %s. Model %s was not executed. Run then model first using \"solve %s\"\n", command, model_config->model_name, model_config->model_name);
+        return false;
+    }
 
-            bool quit_shell = false;
+    if(*run_number > model_config->num_runs) {
+        printf("Error executing command %s. The model was executed %u time(s), but run %u was requested!\n", command, model_config->num_runs, *run_number);
+        return false;
+    }
 
-            while((getline(&line, &len, f)) != -1) {
+    return true;
+}
 
-                if(!line[0] || line[0] == '#' || line[0] == '\n') continue;
+COMMAND_FUNCTION(windowstats) {
 
-                command = sdsnew(line);
-                command = sdstrim(command, "\n ");
+    uint32_t column;
+    int next_arg;
+    struct model_config *model_config = get_query_model_and_column(shell_state, tokens, num_args, &column, &next_arg);
 
-                add_history(command);
-                printf("%s%s\n", PROMPT, command);
+    if(!model_config) return false;
 
-                int cmd_count     = 0;
-                sds *all_commands = sdssplit(command, ";", &cmd_count);
+    if(num_args - next_arg + 1 < 2 || num_args - next_arg + 1 > 3) {
+        printf("Error executing command %s. Usage: windowstats [model] var t0 t1 [run]\n", tokens[0]);
+        return false;
+    }
 
-                for(int i = 0; i < cmd_count; i++) {
-                    if(*all_commands[i]) {
-                        quit_shell = parse_and_execute_command(all_commands[i], shell_state);
-                        if(quit_shell) break;
-                    }
-                }
+    double window[2];
+    if(!parse_query_numbers(tokens[0], tokens, next_arg, next_arg + 1, window)) return false;
 
-                sdsfreesplitres(all_commands, cmd_count);
-                sdsfree(command);
-                if(quit_shell) break;
-            }
+    unsigned int run_number;
+    if(!get_query_run(tokens[0], model_config, next_arg + 2 <= num_args ? tokens[next_arg + 2] : NULL, &run_number)) return false;
 
-            fclose(f);
-            if(line) {
-                free(line);
-            }
+    struct run_columns *columns = get_run_columns(model_config, run_number);
+    if(!columns) return false;
 
-            if(quit_shell) {
-                return false;
-            }
-        }
+    uint64_t begin, end;
+    get_time_window(columns, window[0], window[1], &begin, &end);
+
+    struct window_stats stats;
+    compute_window_stats(columns, column, begin, end, &stats);
+
+    if(stats.n_samples == 0) {
+        printf("No samples in the time window [%lf, %lf] of run %u\n", window[0], window[1], run_number);
+        return true;
     }
 
+    CREATE_TABLE(table);
+    ft_printf_ln(table, "Var name|Window|Samples|Min value|Min time|Max value|Max time|Mean|Std|Integral");
+    ft_printf_ln(table, "%s|[%lf, %lf]|%lu|%e|%lf|%e|%lf|%e|%e|%e", tokens[next_arg - 1], window[0], window[1], (unsigned long) stats.n_samples,
+                 stats.min, stats.min_time, stats.max, stats.max_time, stats.mean, stats.std, stats.integral);
+    PRINT_AND_FREE_TABLE(table);
+
     return true;
 }
 
-COMMAND_FUNCTION(loadcmds) {
-    (void) num_args;
-    return run_commands_from_file(shell_state, tokens[1]);
-}
+COMMAND_FUNCTION(crossings) {
 
-COMMAND_FUNCTION(quit) {
-    (void) shell_state;
-    (void) tokens;
-    (void) num_args;
+    uint32_t column;
+    int next_arg;
+    struct model_config *model_config = get_query_model_and_column(shell_state, tokens, num_args, &column, &next_arg);
 
-    printf("Bye!\n");
-    return true;
-}
+    if(!model_config) return false;
 
-COMMAND_FUNCTION(pwd) {
-    (void) shell_state;
-    (void) tokens;
-    (void) num_args;
+    if(num_args - next_arg + 1 < 1 || num_args - next_arg + 1 > 2) {
+        printf("Error executing command %s. Usage: crossings [model] var threshold [run]\n", tokens[0]);
+        return false;
+    }
 
-    print_current_dir();
-    return true;
-}
+    double threshold;
+    if(!parse_query_numbers(tokens[0], tokens, next_arg, next_arg, &threshold)) return false;
 
-COMMAND_FUNCTION(odestolatex) {
+    unsigned int run_number;
+    if(!get_query_run(tokens[0], model_config, next_arg + 1 <= num_args ? tokens[next_arg + 1] : NULL, &run_number)) return false;
 
-    struct model_config *model_config = NULL;
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    struct run_columns *columns = get_run_columns(model_config, run_number);
+    if(!columns) return false;
 
-    sds *odes = odes_to_latex(model_config->program);
+    struct crossing *crossings = find_crossings(columns, column, 0, columns->n_rows, threshold);
 
-    for(int i = 0; i < arrlen(odes); i++) {
-        const char *first_paren = strchr(odes[i], '(');
-        if(first_paren) {
-            printf("%.*s ", (int) (first_paren - &odes[i][0]), odes[i]);
-            printf("%.*s\n", (int) strlen(first_paren + 1) - 1, first_paren + 1);
-        } else {
-            printf("%s\n", odes[i]);
+    int n = arrlen(crossings);
+    int n_up = 0;
+    double first_up = 0, last_up = 0;
+
+    for(int i = 0; i < n; i++) {
+        if(crossings[i].upward) {
+            if(n_up == 0) first_up = crossings[i].time;
+            last_up = crossings[i].time;
+            n_up++;
         }
-        sdsfree(odes[i]);
     }
 
-    arrfree(odes);
+    printf("%s crosses %lf %d time(s) in run %u (%d upward, %d downward)\n", tokens[next_arg - 1], threshold, n, run_number, n_up, n - n_up);
+
+    if(n_up > 1) {
+        printf("Mean interval between upward crossings: %lf\n", (last_up - first_up) / (n_up - 1));
+    }
+
+    if(n > 0) {
+        CREATE_TABLE(table);
+        ft_printf_ln(table, "#|Time|Direction");
+        for(int i = 0; i < n && i < MAX_QUERY_ROWS; i++) {
+            ft_printf_ln(table, "%d|%lf|%s", i + 1, crossings[i].time, crossings[i].upward ? "up" : "down");
+        }
+        PRINT_AND_FREE_TABLE(table);
+
+        if(n > MAX_QUERY_ROWS) {
+            printf("... %d more\n", n - MAX_QUERY_ROWS);
+        }
+    }
+
+    arrfree(crossings);
 
     return true;
 }
 
+COMMAND_FUNCTION(peaks) {
 
-COMMAND_FUNCTION(listruns) {
+    uint32_t column;
+    int next_arg;
+    struct model_config *model_config = get_query_model_and_column(shell_state, tokens, num_args, &column, &next_arg);
 
-    struct model_config *model_config = NULL;
-    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+    if(!model_config) return false;
 
-    unsigned int n_runs       = model_config->num_runs;
+    int remaining = num_args - next_arg + 1;
 
-    struct run_info *run_info = model_config->runs;
+    if(remaining > 2) {
+        printf("Error executing command %s. Usage: peaks [model] var [threshold] [run]\n", tokens[0]);
+        return false;
+    }
 
-    printf("\nModel %s was solved %u time(s).\n\n", model_config->model_name, n_runs);
+    double threshold = -INFINITY;
+    if(remaining >= 1 && !parse_query_numbers(tokens[0], tokens, next_arg, next_arg, &threshold)) return false;
 
-    CREATE_TABLE(table);
+    unsigned int run_number;
+    if(!get_query_run(tokens[0], model_config, remaining == 2 ? tokens[next_arg + 1] : NULL, &run_number)) return false;
 
-    if(n_runs > 0) {
-        ft_printf_ln(table, "Run|Time|Output File");
-    }
+    struct run_columns *columns = get_run_columns(model_config, run_number);
+    if(!columns) return false;
 
-    for(unsigned int i = 0; i < n_runs; i++) {
-        if(run_info[i].saved) {
-            ft_printf_ln(table, "%d|%lf|%s", i + 1, run_info[i].time, run_info[i].filename);
-        } else {
-            ft_printf_ln(table, "%d|%lf|%s", i + 1, run_info[i].time, "output not saved!");
+    uint64_t *peaks = find_peaks(columns, column, 0, columns->n_rows, threshold);
+
+    const double *time   = get_run_column(columns, 0);
+    const double *values = get_run_column(columns, column);
+
+    int n = arrlen(peaks);
+
+    printf("%d peak(s) of %s found in run %u\n", n, tokens[next_arg - 1], run_number);
+
+    if(n > 0) {
+        CREATE_TABLE(table);
+        ft_printf_ln(table, "#|Time|Value");
+        for(int i = 0; i < n && i < MAX_QUERY_ROWS; i++) {
+            ft_printf_ln(table, "%d|%lf|%e", i + 1, time[peaks[i]], values[peaks[i]]);
+        }
+        PRINT_AND_FREE_TABLE(table);
+
+        if(n > MAX_QUERY_ROWS) {
+            printf("... %d more\n", n - MAX_QUERY_ROWS);
         }
     }
 
-    PRINT_AND_FREE_TABLE(table);
+    arrfree(peaks);
 
     return true;
 }
 
-COMMAND_FUNCTION(getruninfo) {
-
-    unsigned int run_number;
-    char *model_name = NULL;
+COMMAND_FUNCTION(diffruns) {
 
-    get_model_name_and_n_run_zero_to_two_args(tokens, num_args, &model_name, &run_number);
+    struct model_config *model_a = load_model_config_or_print_error(shell_state, tokens[0], tokens[1]);
+    if(!model_a) return false;
 
-    struct model_config *model_config = get_model_and_n_runs_for_plot_cmds(shell_state, tokens[0], model_name, run_number);
+    struct model_config *model_b = load_model_config_or_print_error(shell_state, tokens[0], tokens[2]);
+    if(!model_b) return false;
 
-    if(!model_config) return false;
+    const char *var_name = tokens[3];
+    uint32_t column_a, column_b;
 
-    if(run_number == 0) {
-        run_number = model_config->num_runs;
+    if(!get_query_column(tokens[0], model_a, var_name, &column_a) || !get_query_column(tokens[0], model_b, var_name, &column_b)) {
+        return false;
     }
 
-    struct run_info run_info = model_config->runs[run_number - 1];
-
-    CREATE_TABLE(table);
-
-    ft_printf_ln(table, "Run|Time|Output File");
+    unsigned int run_a, run_b;
 
-    if(run_info.saved) {
-        ft_printf_ln(table, "%d|%lf|%s", run_number, run_info.time, run_info.filename);
-    } else {
-        ft_printf_ln(table, "%d|%lf|%s", run_number, run_info.time, "output not saved!");
-    }
+    if(!get_query_run(tokens[0], model_a, num_args >= 4 ? tokens[4] : NULL, &run_a)) return false;
+    if(!get_query_run(tokens[0], model_b, num_args >= 5 ? tokens[5] : NULL, &run_b)) return false;
 
-    PRINT_AND_FREE_TABLE(table);
+    struct run_columns *columns_a = get_run_columns(model_a, run_a);
+    struct run_columns *columns_b = get_run_columns(model_b, run_b);
 
-    int len = shlen(model_config->var_indexes);
+    if(!columns_a || !columns_b) return false;
 
-    CREATE_TABLE(table2);
-    ft_printf_ln(table2, "Var name|Min value|Max value");
+    struct run_diff diff;
 
-    for(int i = 0; i < len; i++) {
-        int var_index = model_config->var_indexes[i].value;
-        if(var_index > 1) {
-            double min_value = model_config->runs[run_number - 1].vars_min_value[var_index - 2];
-            double max_value = model_config->runs[run_number - 1].vars_max_value[var_index - 2];
-            ft_printf_ln(table2, "%s|%e|%e", model_config->var_indexes[i].key, min_value, max_value);
-        }
+    if(!compute_run_diff(columns_a, column_a, columns_b, column_b, &diff)) {
+        printf("Runs %s %u and %s %u have no common time range\n", model_a->model_name, run_a, model_b->model_name, run_b);
+        return true;
     }
 
-    PRINT_AND_FREE_TABLE(table2);
+    CREATE_TABLE(table);
+    ft_printf_ln(table, "Var name|Run A|Run B|Samples|Max abs diff|Max diff time|Mean diff|RMS diff");
+    ft_printf_ln(table, "%s|%s %u|%s %u|%lu|%e|%lf|%e|%e", var_name, model_a->model_name, run_a, model_b->model_name, run_b,
+                 (unsigned long) diff.n_samples, diff.max_abs_diff, diff.max_abs_diff_time, diff.mean_diff, diff.rms_diff);
+    PRINT_AND_FREE_TABLE(table);
 
     return true;
 }
@@ -1905,19 +4323,9 @@ COMMAND_FUNCTION(resetruns) {
     struct model_config *model_config = NULL;
     GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
 
-    for(unsigned int r = 0; r < model_config->num_runs; r++) {
-
-        free(model_config->runs[r].filename);
-        free(model_config->runs[r].vars_max_value);
-        free(model_config->runs[r].vars_min_value);
-
-        sds out = get_model_output_file(model_config, r);
-        unlink(out);
-        sdsfree(out);
-    }
+    if(has_running_jobs_print_error(tokens[0], model_config)) return false;
 
-    arrfree(model_config->runs);
-    model_config->num_runs = 0;
+    free_model_runs(model_config);
 
     return true;
 }
@@ -1935,17 +4343,69 @@ COMMAND_FUNCTION(closeplot) {
     free(shell_state->gnuplot_handle);
     shell_state->gnuplot_handle = NULL;
 
+    //the datablocks went away with gnuplot
+    unsigned int *released = take_released_plot_ids();
+    arrfree(released);
+
     return true;
 }
 
+COMMAND_FUNCTION(recordvar) {
+
+    struct model_config *parent_model_config = NULL;
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(parent_model_config, 1);
+
+    int varcount;
+    sds *vars_to_record = sdssplit(tokens[num_args], " ", &varcount);
+
+    for(int i = 0; i < varcount; i++) {
+
+        if(sdslen(vars_to_record[i]) == 0) continue;
+
+        if(!is_recordable_var(parent_model_config->program, vars_to_record[i])) {
+            printf("Error executing command %s. %s is not a top-level variable of model %s. Only intermediate variables (e.g, currents) can be recorded\n",
+                   tokens[0], vars_to_record[i], parent_model_config->model_name);
+            sdsfreesplitres(vars_to_record, varcount);
+            return false;
+        }
+
+        if(shgeti(parent_model_config->var_indexes, vars_to_record[i]) != -1) {
+            printf("Error executing command %s. %s is already an output of model %s\n", tokens[0], vars_to_record[i], parent_model_config->model_name);
+            sdsfreesplitres(vars_to_record, varcount);
+            return false;
+        }
+    }
+
+    struct model_config *model_config = new_config_from_parent(parent_model_config);
+
+    for(int i = 0; i < varcount; i++) {
+        if(sdslen(vars_to_record[i]) == 0 || shgeti(model_config->var_indexes, vars_to_record[i]) != -1) continue;
+        int new_index = (int) shlen(model_config->var_indexes) + 1;
+        arrput(model_config->recorded_vars, strdup(vars_to_record[i]));
+        shput(model_config->var_indexes, arrlast(model_config->recorded_vars), new_index);
+    }
+
+    index_model_symbols(model_config);
+
+    sdsfreesplitres(vars_to_record, varcount);
+
+    printf("Reloading model %s as %s\n", parent_model_config->model_name, model_config->model_name);
+
+    return load_model(shell_state, NULL, model_config);
+}
+
 COMMAND_FUNCTION(converttoc) {
 
     const char *file_name             = tokens[num_args];
     struct model_config *model_config = NULL;
     GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 1);
 
+    solver_config config = {0};
+    config.solver_type   = EULER_ADPT_SOLVER;
+    config.recorded_vars = model_config->recorded_vars;
+
     FILE *outfile = fopen(file_name, "w");
-    bool error    = convert_to_c(model_config->program, outfile, EULER_ADPT_SOLVER);
+    bool error    = convert_to_c_with_config(model_config->program, outfile, &config);
     fclose(outfile);
 
     if(!error) {
@@ -1961,6 +4421,29 @@ void clean_and_exit(struct shell_variables *shell_state) {
     sds history_path = sdsnew(get_home_dir());
     history_path     = sdscatfmt(history_path, "/%s", HISTORY_FILE);
 
+    int n_jobs = arrlen(shell_state->jobs);
+
+    for(int i = 0; i < n_jobs; i++) {
+        cancel_solve_job(shell_state->jobs[i]);
+    }
+
+    for(int i = 0; i < n_jobs; i++) {
+        join_solve_job(shell_state->jobs[i]);
+        free_solve_job(shell_state->jobs[i]);
+    }
+
+    arrfree(shell_state->jobs);
+
+    for(int i = 0; i < arrlen(shell_state->reload_messages); i++) {
+        sdsfree(shell_state->reload_messages[i]);
+    }
+
+    arrfree(shell_state->reload_messages);
+
+    if(get_trace_file()) {
+        close_trace();
+    }
+
     int n_models     = shlen(shell_state->loaded_models);
 
     for(int i = 0; i < n_models; i++) {
@@ -1994,6 +4477,8 @@ void clean_and_exit(struct shell_variables *shell_state) {
     exit(0);
 }
 
+static _Thread_local int command_depth = 0;
+
 bool parse_and_execute_command(sds line, struct shell_variables *shell_state) {
 
     int num_args, token_count;
@@ -2005,6 +4490,18 @@ bool parse_and_execute_command(sds line, struct shell_variables *shell_state) {
         goto dealloc_vars;
     }
 
+    //"solve ... &" runs in the background
+    bool background = false;
+    if(token_count > 1 && sdslen(tokens[token_count - 1]) > 0 && tokens[token_count - 1][sdslen(tokens[token_count - 1]) - 1] == '&') {
+        background = true;
+        tokens[token_count - 1][sdslen(tokens[token_count - 1]) - 1] = '\0';
+        sdsupdatelen(tokens[token_count - 1]);
+        if(sdslen(tokens[token_count - 1]) == 0) {
+            sdsfree(tokens[token_count - 1]);
+            token_count--;
+        }
+    }
+
     num_args  = token_count - 1;
 
     int index = shgeti(commands, tokens[0]);
@@ -2029,13 +4526,47 @@ bool parse_and_execute_command(sds line, struct shell_variables *shell_state) {
         return true;
     }
 
-    if(!STR_EQUALS(tokens[0], "loadcmds")) {
+    if(background && !STR_EQUALS(command.key, "solve")) {
+        printf("Error: only the solve command can run in the background!\n");
+        goto dealloc_vars;
+    }
+
+    //these run other commands, which take the lock themselves
+    bool runs_commands = STR_EQUALS(tokens[0], "loadcmds") || STR_EQUALS(tokens[0], "bench");
+
+    if(!runs_commands) {
         pthread_mutex_lock(&shell_state->lock);
     }
 
+    report_finished_jobs(shell_state, false);
+
+    //with timing on, the stages of each command typed (not of the commands run by loadcmds or bench) are printed
+    bool print_times = command_depth == 0 && is_timing_enabled() && !STR_EQUALS(command.key, "bench") && !STR_EQUALS(command.key, "timing");
+    struct stage_times times;
+
+    if(print_times) take_stage_times(&times);
+
+    bool traced  = get_trace_file() != NULL;
+    double start = get_wall_time();
+
+    command_depth++;
+    shell_state->run_in_background = background;
     command.command_function(shell_state, tokens, num_args);
+    shell_state->run_in_background = false;
+    command_depth--;
 
-    if(!STR_EQUALS(tokens[0], "loadcmds")) {
+    double end = get_wall_time();
+
+    if(traced) {
+        add_trace_event(line, start, end);
+    }
+
+    if(print_times) {
+        take_stage_times(&times);
+        print_stage_times(&times, end - start);
+    }
+
+    if(!runs_commands) {
         pthread_mutex_unlock(&shell_state->lock);
     }
 
@@ -2050,14 +4581,121 @@ dealloc_vars:
     return false;
 }
 
+// Parses the next generation of a model and compiles it when its statements are not the ones of current. The changes
+// are described in changes. Returns true on errors
+static bool build_model_generation(struct model_config *next, program current, bool current_is_compiled, sds *changes) {
+
+    if(generate_model_program(next)) {
+        return true;
+    }
+
+    //edits that do not change any statement (comments, blank lines, formatting) do not need a new executable
+    struct program_diff diff;
+    diff_programs(current, next->program, &diff);
+
+    bool error = false;
+
+    if(diff.n_changed == 0 && diff.n_removed == 0 && current_is_compiled) {
+        *changes = sdscat(*changes, " - no statements changed");
+    } else {
+        if(diff.n_changed > 0 && diff.first_line == diff.last_line) {
+            *changes = sdscatprintf(*changes, " - %d statement(s) changed (line %u), %d affected", diff.n_changed, diff.first_line, diff.n_affected);
+        } else if(diff.n_changed > 0) {
+            *changes = sdscatprintf(*changes, " - %d statement(s) changed (lines %u-%u), %d affected", diff.n_changed, diff.first_line, diff.last_line,
+                                    diff.n_affected);
+        } else if(diff.n_removed > 0) {
+            *changes = sdscatprintf(*changes, " - %d statement(s) removed, %d affected", diff.n_removed, diff.n_affected);
+        }
+
+        error = compile_model(next);
+    }
+
+    free_program_diff(&diff);
+
+    return error;
+}
+
+COMMAND_FUNCTION(reload) {
+
+    struct model_config *model_config = NULL;
+    GET_MODEL_ONE_ARG_OR_RETURN_FALSE(model_config, 0);
+
+    if(model_config->is_derived) {
+        printf("Error executing command %s. Model %s was not loaded from a file\n", tokens[0], model_config->model_name);
+        return false;
+    }
+
+    struct model_config *next = new_model_generation(model_config);
+    sds changes               = sdsempty();
+
+    bool error = build_model_generation(next, model_config->program, model_config->is_compiled, &changes);
+
+    if(!error) {
+        swap_model_generation(model_config, next);
+        printf("Model %s reloaded%s\n", model_config->model_name, changes);
+    } else {
+        printf("Error reloading model %s\n", model_config->model_name);
+    }
+
+    free_model_config(next);
+    sdsfree(changes);
+
+    return !error;
+}
+
 #ifdef __linux__
-void maybe_reload_from_file_change(struct shell_variables *shell_state, struct inotify_event *event) {
+#define RELOAD_DEBOUNCE_TIME 0.3
+
+// Editors write a file several times when saving it, so the reload of a model waits until its file was not changed for
+// RELOAD_DEBOUNCE_TIME seconds
+static void schedule_model_reload(struct shell_variables *shell_state, const char *model_name) {
+
+    pthread_mutex_lock(&shell_state->reload_lock);
+
+    double deadline = get_wall_time() + RELOAD_DEBOUNCE_TIME;
+    int n_pending   = arrlen(shell_state->pending_reloads);
+    int i;
+
+    for(i = 0; i < n_pending; i++) {
+        if(STR_EQUALS(shell_state->pending_reloads[i].model_name, model_name)) {
+            shell_state->pending_reloads[i].deadline = deadline;
+            break;
+        }
+    }
+
+    if(i == n_pending) {
+        struct pending_reload reload = {.model_name = strdup(model_name), .deadline = deadline};
+        arrput(shell_state->pending_reloads, reload);
+    }
+
+    pthread_cond_signal(&shell_state->reload_cond);
+    pthread_mutex_unlock(&shell_state->reload_lock);
+}
 
-    if(shell_state->never_reload) return;
+void maybe_reload_from_file_change(struct shell_variables *shell_state, struct inotify_event *event) {
 
     pthread_mutex_lock(&shell_state->lock);
 
     struct model_config **model_configs = hmget(shell_state->notify_entries, event->wd);
+
+    //the changed file can be imported by the models. The import cache also checks the contents of the files, this
+    //only releases the entry early
+    if(arrlen(model_configs) > 0) {
+        char *dir       = get_dir_from_path(model_configs[0]->model_file);
+        sds changed     = sdscatfmt(sdsempty(), "%s%s", dir, event->name);
+        char *real_path = realpath(changed, NULL);
+
+        invalidate_cached_import(real_path ? real_path : changed);
+
+        free(real_path);
+        sdsfree(changed);
+        free(dir);
+    }
+
+    if(shell_state->never_reload) {
+        pthread_mutex_unlock(&shell_state->lock);
+        return;
+    }
     struct model_config *model_config   = NULL;
 
     for(int i = 0; i < arrlen(model_configs); i++) {
@@ -2073,13 +4711,34 @@ void maybe_reload_from_file_change(struct shell_variables *shell_state, struct i
         free(file_name);
     }
 
-    if(!model_config || !model_config->should_reload) {
+    if(model_config && model_config->should_reload && !model_config->is_derived) {
+        schedule_model_reload(shell_state, model_config->model_name);
+    }
+
+    pthread_mutex_unlock(&shell_state->lock);
+}
+
+// Builds the next generation of a model without holding the shell lock, so the commands keep using the current one,
+// and swaps it in if the model was not unloaded or reloaded meanwhile
+static void reload_model_in_background(struct shell_variables *shell_state, const char *model_name) {
+
+    pthread_mutex_lock(&shell_state->lock);
+
+    struct model_config *model_config = shget(shell_state->loaded_models, model_name);
+
+    if(!model_config || shell_state->never_reload || !model_config->should_reload) {
         pthread_mutex_unlock(&shell_state->lock);
         return;
     }
 
     size_t file_size;
     char *source = read_entire_file_with_mmap(model_config->model_file, &file_size);
+
+    if(source == NULL) {
+        pthread_mutex_unlock(&shell_state->lock);
+        return;
+    }
+
     uint8_t hash[16];
     md5Stringn(source, (uint8_t *) &hash, file_size);
     munmap(source, file_size);
@@ -2089,39 +4748,89 @@ void maybe_reload_from_file_change(struct shell_variables *shell_state, struct i
         return;
     }
 
-    if(!model_config->is_derived) {
+    if(!model_config->auto_reload) {
+        arrput(shell_state->reload_messages, sdscatfmt(sdsempty(), "Model %s was modified externally. Use reload %s to load the changes",
+                                                       model_name, model_name));
+        pthread_mutex_unlock(&shell_state->lock);
+        return;
+    }
+
+    struct model_config *next = new_model_generation(model_config);
+    program current           = share_program(model_config->program);
+    bool current_is_compiled  = model_config->is_compiled;
+    unsigned int generation   = model_config->generation;
+
+    pthread_mutex_unlock(&shell_state->lock);
+
+    sds changes = sdsempty();
+    bool error  = build_model_generation(next, current, current_is_compiled, &changes);
 
-        char answer = 0;
+    pthread_mutex_lock(&shell_state->lock);
 
-        if(!model_config->auto_reload) {
-            printf("\nModel %s was modified externally. Would you like to reload it? [y]: ", model_config->model_name);
-            answer = (char) getchar();
+    if(shget(shell_state->loaded_models, model_name) != model_config || model_config->generation != generation) {
+        //the model was unloaded or reloaded while this generation was built
+        if(shget(shell_state->loaded_models, model_name) == model_config) {
+            schedule_model_reload(shell_state, model_name);
         }
+    } else if(error) {
+        arrput(shell_state->reload_messages, sdscatfmt(sdsempty(), "Error reloading model %s", model_name));
+    } else {
+        swap_model_generation(model_config, next);
+        arrput(shell_state->reload_messages, sdscatfmt(sdsempty(), "Model %s reloaded%s", model_name, changes));
+    }
 
-        if(model_config->auto_reload || answer == 'Y' || answer == 'y' || answer == '\r') {
-            printf("\nReloading model %s", model_config->model_name);
-            fflush(stdout);
-            program tmp = model_config->program;
-            bool error  = generate_model_program(model_config);
+    pthread_mutex_unlock(&shell_state->lock);
 
-            if(!error) {
-                error = compile_model(model_config);
-                free_program(tmp);
+    free_model_config(next);
+    free_program(current);
+    sdsfree(changes);
+}
 
-                if(error) {
-                    printf("Error compiling model %s", model_config->model_name);
-                }
+_Noreturn void *reload_changed_models(void *args) {
 
-            } else {
-                printf("Error compiling model %s", model_config->model_name);
+    pthread_detach(pthread_self());
+
+    struct shell_variables *shell_state = (struct shell_variables *) args;
+
+    while(1) {
+
+        pthread_mutex_lock(&shell_state->reload_lock);
+
+        int n_pending = arrlen(shell_state->pending_reloads);
+
+        if(n_pending == 0) {
+            pthread_cond_wait(&shell_state->reload_cond, &shell_state->reload_lock);
+            pthread_mutex_unlock(&shell_state->reload_lock);
+            continue;
+        }
+
+        int next = 0;
+        for(int i = 1; i < n_pending; i++) {
+            if(shell_state->pending_reloads[i].deadline < shell_state->pending_reloads[next].deadline) {
+                next = i;
             }
         }
-    }
 
-    printf("\n%s", PROMPT);
-    fflush(stdout);
+        double deadline = shell_state->pending_reloads[next].deadline;
 
-    pthread_mutex_unlock(&shell_state->lock);
+        if(get_wall_time() < deadline) {
+            struct timespec until;
+            until.tv_sec  = (time_t) deadline;
+            until.tv_nsec = (long) ((deadline - (double) until.tv_sec) * 1e9);
+
+            pthread_cond_timedwait(&shell_state->reload_cond, &shell_state->reload_lock, &until);
+            pthread_mutex_unlock(&shell_state->reload_lock);
+            continue;
+        }
+
+        char *model_name = shell_state->pending_reloads[next].model_name;
+        arrdel(shell_state->pending_reloads, next);
+
+        pthread_mutex_unlock(&shell_state->reload_lock);
+
+        reload_model_in_background(shell_state, model_name);
+        free(model_name);
+    }
 }
 #endif
 
@@ -2171,11 +4880,14 @@ void initialize_commands(struct shell_variables *state, bool plot_enabled) {
     ADD_CMD(quit, 0, 0, "Quits the shell (CTRL+d also quits).");
     ADD_CMD(help, 0, 1, "Prints all available commands or the help for a specific command.\nE.g., help run");
     ADD_CMD(list, 0, 0, "Lists all loaded models");
-    ADD_CMD(loadcmds, 1, 1, "Loads a list of command from a file and execute them.\nE.g., loadcmds file");
-    ADD_CMD(load, 1, 1, "Loads a model from a ode file.\nE.g., load sir.ode");
+    ADD_CMD(loadcmds, 1, 3, "Loads a list of command from a file and execute them. With -j N, up to N solves of different models run at the same time\nand consecutive loads compile in parallel. The output is the same as running the commands in order.\nE.g., loadcmds file or loadcmds -j 4 file");
+    ADD_CMD(load, 1, 64, "Loads one or more models from ode files. Several models are parsed and compiled in parallel.\nE.g., load sir.ode or load sir.ode lorenz.ode");
     ADD_CMD(listruns, 0, 1, "List all runs of a model." NO_ARGS " listruns sir");
     ADD_CMD(unload, 1, 1, "Unloads previously loaded model." NO_ARGS " unload sir");
     ADD_CMD(unloadall, 0, 0, "Unloads all previously loaded models.");
+    ADD_CMD(savesession, 1, 1, "Saves the loaded models, with their runs, to a session file. The outputs of the runs are kept in the file name followed by " SESSION_RUNS_DIR_SUFFIX ".\nE.g., savesession work.session");
+    ADD_CMD(loadsession, 1, 1, "Loads the models and runs of a session saved with savesession, without parsing, compiling or solving them again.\nE.g., loadsession work.session");
+    ADD_CMD(reload, 0, 1, "Reloads a model from its file, recompiling it only if its statements changed." NO_ARGS " reload sir");
     ADD_CMD(ls, 0, 1, "Lists the content of a given directory.");
 
     if(plot_enabled) {
@@ -2222,9 +4934,37 @@ void initialize_commands(struct shell_variables *state, bool plot_enabled) {
     ADD_CMD(setautolreload, 1, 2, "Enable/disable auto reload value of a model. " ONE_ARG " setautolreload sir 1 or setautolreload sir 0");
     ADD_CMD(setshouldreload, 1, 2, "Enable/disable reloading when changed for a model. " ONE_ARG " setshouldreload sir 1 or setshouldreload sir 0");
     ADD_CMD(setglobalreload, 1, 1, "Enable/disable reloading for all models.\nE.g., setglobalreload 1 or setglobalreload 0");
+    ADD_CMD(setreportio, 1, 1, "Enable/disable printing how long the solver waited on the output writer after each solve and sampling the time spent in the RHS and in the output (shown by getruninfo).\nE.g., setreportio 1 or setreportio 0");
     ADD_CMD(savemodeloutput, 1, 3, "Saves the model output to a file. " PLOTFILE_ARGS " savemodeloutput sir output_sir.txt or savemodeloutput sir output_sir.txt 1");
     ADD_CMD(resetruns, 0, 1, "Resets the runs information of a model. " NO_ARGS " resetruns sir");
     ADD_CMD(getruninfo, 0, 2, "Prints the information about an specific run. " GETRUN_ARGS " getruninfo sir or getruninfo sir 1 or getruninfo 1");
+    ADD_CMD(recordvar, 1, 2, "Records intermediate variables (e.g., currents) as extra output columns and reloads the model. " ONE_ARG " recordvar hh \"i_Na i_K\" or recordvar i_Na");
+    ADD_CMD(windowstats, 3, 5, "Prints the statistics of a variable in a time window. " ONE_ARG " windowstats sir I 10 20 or windowstats I 10 20 2");
+    ADD_CMD(crossings, 2, 4, "Prints the times where a variable crosses a threshold. " ONE_ARG " crossings hh V 0 or crossings V -40 2");
+    ADD_CMD(peaks, 1, 4, "Prints the peaks (local maxima) of a variable, optionally only the ones with a value (not prominence) of at least threshold. " ONE_ARG " peaks hh V 0 or peaks V");
+    ADD_CMD(diffruns, 3, 5, "Compares a variable between two runs (of the same or of different models).\nBy default the last run of each model is used.\nE.g., diffruns hh hh_v1 V or diffruns sir sir S 1 2");
+    ADD_CMD(jobs, 0, 0, "Lists the background solve jobs and their progress.\nE.g., solve sir 1000 & and then jobs");
+    add_cmd(waitjobs, "wait", 0, 1, "Waits for a background job, or for all of them. Ctrl+C stops waiting.\nE.g., wait or wait 1");
+    num_commands++;
+    add_cmd(killjob, "kill", 1, 1, "Stops a background job. The output computed so far is kept as a run.\nE.g., kill 1");
+    num_commands++;
+    ADD_CMD(sweep, 5, 34, "Solves a model for all combinations of parameter values (full factorial design), running the points in parallel.\n"
+                          "Each point becomes a run. Usage: sweep [model] final_time param start end n [param2 start end n ...]\n"
+                          "E.g., sweep sir 100 gamma 0.01 0.1 10 or sweep 100 gamma 0.01 0.1 5 beta 0.0001 0.001 5");
+    ADD_CMD(sweeplhs, 5, 27, "Solves a model for n_points parameter values sampled with a latin hypercube, running the points in parallel.\n"
+                             "Each point becomes a run. Usage: sweeplhs [model] final_time n_points param min max [param2 min max ...]\n"
+                             "E.g., sweeplhs sir 100 20 gamma 0.01 0.1 beta 0.0001 0.001");
+    ADD_CMD(profile, 1, 2, "Solves a model with a build that samples the statement of the RHS being run and prints the statements where most of the time\n"
+                           "was spent. The output is kept as a run. " ONE_ARG " profile ToRORd 1000 or profile 1000");
+    ADD_CMD(setsweepworkers, 1, 1, "Sets the maximum number of processes used by sweep and sweeplhs. 0 uses one per core.\nE.g., setsweepworkers 4");
+    ADD_CMD(meminfo, 0, 1, "Prints the memory and disk used by each loaded model and its runs, the totals and the models that are candidates for unload or resetruns.\n"
+                           "E.g., meminfo or meminfo sir");
+    ADD_CMD(cacheinfo, 0, 0, "Prints the location, size and hit rate of the cache of compiled models and solve results, and the hit rate of the cache of imported files.\nE.g., cacheinfo");
+    ADD_CMD(clearcache, 0, 0, "Removes all compiled models and solve results from the build cache and all the parsed files from the import cache.\nE.g., clearcache");
+    ADD_CMD(timing, 1, 2, "Enable/disable printing the time spent in each stage (parse, convert to C, compile, solve, plot data, gnuplot) after each command.\nWith a file, the stages and commands are also written to it as a Chrome trace when timing is turned off or the shell exits.\nE.g., timing on, timing on trace.json or timing off");
+    ADD_CMD(bench, 2, 64, "Runs a command N times and prints the mean, minimum and maximum time of each stage per run. Only the output of the first run is shown.\nE.g., bench solve sir 100 10 or bench \"solve sir 100\" 10");
+    ADD_CMD(setmemoize, 1, 1, "Enable/disable reusing the cached output of a previous solve with the same model, parameters and final time. Models with endfn functions are always solved, so their side effects happen.\nE.g., setmemoize 1 or setmemoize 0");
+    ADD_CMD(setcachesize, 1, 1, "Sets the maximum size of the build cache in MB. The least recently used models are removed first. 0 disables the cache.\nE.g., setcachesize 512");
     ADD_CMD(converttoc, 1, 2, "Convert the current model to a C program.\nE.g., converttoc model_name.c or converttoc sir model_name.c");
 
     qsort(commands_sorted, arrlen(commands_sorted), sizeof(char *), string_cmp);
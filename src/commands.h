@@ -61,9 +61,12 @@ typedef enum cmd_type_t {
 void initialize_commands(struct shell_variables* state, bool plot_enabled);
 bool parse_and_execute_command(sds line, struct shell_variables *shell_state);
 void clean_and_exit(struct shell_variables *shell_state);
+bool report_finished_jobs(struct shell_variables *shell_state, bool at_prompt);
+bool report_detached_job(struct solve_job *job);
 
 #ifdef __linux__
 void maybe_reload_from_file_change(struct shell_variables *shell_state, struct inotify_event *event);
+_Noreturn void *reload_changed_models(void *args);
 #endif
 bool run_commands_from_file(struct shell_variables *shell_state, char *file_name);
 
@@ -0,0 +1,162 @@
+#include "arena.h"
+#include "../stb/stb_ds.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT (sizeof(max_align_t))
+
+//totals of the live arenas, updated atomically as the parsers run in parallel (see get_arena_memory_stats)
+static struct arena_memory_stats live_arenas;
+
+ast_arena *new_arena(void) {
+
+    ast_arena *a = (ast_arena *) calloc(1, sizeof(ast_arena));
+
+    if(a == NULL) {
+        fprintf(stderr, "%s - Error allocating memory for the new arena\n", __FUNCTION__);
+        return NULL;
+    }
+
+    a->ref_count = 1;
+
+    __atomic_add_fetch(&live_arenas.n_arenas, 1, __ATOMIC_RELAXED);
+
+    return a;
+}
+
+ast_arena *retain_arena(ast_arena *a) {
+    if(a != NULL) {
+        __atomic_add_fetch(&a->ref_count, 1, __ATOMIC_RELAXED);
+    }
+    return a;
+}
+
+void release_arena(ast_arena *a) {
+
+    if(a == NULL) return;
+
+    if(__atomic_sub_fetch(&a->ref_count, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    __atomic_sub_fetch(&live_arenas.n_arenas, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&live_arenas.n_bytes, a->total_size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&live_arenas.n_nodes, a->n_nodes, __ATOMIC_RELAXED);
+
+    struct arena_chunk *c = a->chunks;
+
+    while(c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+
+    free(a);
+}
+
+void *arena_alloc(ast_arena *a, size_t size) {
+
+    size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+    struct arena_chunk *c = a->chunks;
+
+    if(c == NULL || c->used + size > c->size) {
+
+        //big requests get a chunk of their own
+        size_t chunk_size = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+
+        c = (struct arena_chunk *) malloc(sizeof(struct arena_chunk) + chunk_size);
+
+        if(c == NULL) {
+            fprintf(stderr, "%s - Error allocating memory for a new arena chunk\n", __FUNCTION__);
+            return NULL;
+        }
+
+        c->size = chunk_size;
+        c->used = 0;
+        c->next = a->chunks;
+
+        a->chunks = c;
+        a->total_size += sizeof(struct arena_chunk) + chunk_size;
+        __atomic_add_fetch(&live_arenas.n_bytes, sizeof(struct arena_chunk) + chunk_size, __ATOMIC_RELAXED);
+    }
+
+    void *ptr = (char *) c->data + c->used;
+    c->used += size;
+
+    return ptr;
+}
+
+// Same as arena_alloc, counting the allocation as an ast node
+void *arena_alloc_node(ast_arena *a, size_t size) {
+
+    void *ptr = arena_alloc(a, size);
+
+    if(ptr) {
+        a->n_nodes++;
+        __atomic_add_fetch(&live_arenas.n_nodes, 1, __ATOMIC_RELAXED);
+    }
+
+    return ptr;
+}
+
+char *arena_strndup(ast_arena *a, const char *s, size_t n) {
+
+    size_t len = strnlen(s, n);
+    char *dst  = (char *) arena_alloc(a, len + 1);
+
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+
+    return dst;
+}
+
+char *arena_strdup(ast_arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+// All the tokens of a file have the same file name, so it is stored once per run of tokens from that file
+const char *arena_file_name(ast_arena *a, const char *file_name) {
+
+    if(file_name == NULL) return NULL;
+
+    if(a->file_name == NULL || strcmp(a->file_name, file_name) != 0) {
+        a->file_name = arena_strdup(a, file_name);
+    }
+
+    return a->file_name;
+}
+
+// Allocates an array of len elements that can be read with the stb macros but can not grow
+void *arena_new_array(ast_arena *a, size_t len, size_t elem_size) {
+
+    stbds_array_header *header = (stbds_array_header *) arena_alloc(a, sizeof(stbds_array_header) + len * elem_size);
+
+    header->length     = len;
+    header->capacity   = len;
+    header->hash_table = NULL;
+    header->temp       = 0;
+
+    return header + 1;
+}
+
+// Moves an stb array to the arena. The result can still be read with the stb macros but can not grow anymore
+void *arena_copy_array(ast_arena *a, void *arr, size_t elem_size) {
+
+    if(arr == NULL) return NULL;
+
+    size_t len = arrlenu(arr);
+
+    void *copy = arena_new_array(a, len, elem_size);
+    memcpy(copy, arr, len * elem_size);
+
+    arrfree(arr);
+
+    return copy;
+}
+
+void get_arena_memory_stats(struct arena_memory_stats *stats) {
+    stats->n_arenas = __atomic_load_n(&live_arenas.n_arenas, __ATOMIC_RELAXED);
+    stats->n_bytes  = __atomic_load_n(&live_arenas.n_bytes, __ATOMIC_RELAXED);
+    stats->n_nodes  = __atomic_load_n(&live_arenas.n_nodes, __ATOMIC_RELAXED);
+}
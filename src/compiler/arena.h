@@ -0,0 +1,46 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator for the nodes, strings and child arrays of the programs created by one parser. Nothing is freed
+// individually: the whole arena is released when its last reference is dropped (the parser holds one and each
+// top-level statement holds another)
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+typedef struct ast_arena_t {
+    struct arena_chunk *chunks;
+    unsigned int ref_count; //updated atomically, only the parser allocates from the arena
+    size_t total_size;
+    size_t n_nodes; //ast nodes allocated with arena_alloc_node
+    const char *file_name; //the file name of the last token, shared by the nodes that come from the same file
+} ast_arena;
+
+// Arenas, bytes and nodes held by all the live arenas of the process
+struct arena_memory_stats {
+    size_t n_arenas;
+    size_t n_bytes;
+    size_t n_nodes;
+};
+
+ast_arena *new_arena(void);
+ast_arena *retain_arena(ast_arena *a);
+void release_arena(ast_arena *a);
+
+void *arena_alloc(ast_arena *a, size_t size);
+void *arena_alloc_node(ast_arena *a, size_t size);
+char *arena_strndup(ast_arena *a, const char *s, size_t n);
+char *arena_strdup(ast_arena *a, const char *s);
+const char *arena_file_name(ast_arena *a, const char *file_name);
+void *arena_new_array(ast_arena *a, size_t len, size_t elem_size);
+void *arena_copy_array(ast_arena *a, void *arr, size_t elem_size);
+void get_arena_memory_stats(struct arena_memory_stats *stats);
+
+#endif /* __ARENA_H */
@@ -17,76 +17,119 @@
 
 char *indent_spaces[] = {NO_SPACES, _4SPACES, _8SPACES, _12SPACES, _16SPACES, _20SPACES, _24SPACES, _28SPACES};
 
-static ast *make_base_ast(const token *t, ast_tag tag) {
-    ast *a = (ast *) calloc(1, sizeof(ast));
+//nodes allocated outside of the arenas, updated atomically as programs are copied and freed from different threads
+static size_t live_heap_nodes = 0;
+
+//the token strings are not counted, as the commands can replace them after the node is created
+static void count_heap_node(bool allocated) {
+    if(allocated) {
+        __atomic_add_fetch(&live_heap_nodes, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_sub_fetch(&live_heap_nodes, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static char *ast_strndup(ast_arena *arena, const char *s, size_t n) {
+    if(arena) {
+        return arena_strndup(arena, s, n);
+    }
+    return strndup(s, n);
+}
+
+static ast *make_base_ast(ast_arena *arena, const token *t, ast_tag tag) {
+
+    ast *a;
+
+    if(arena) {
+        a = (ast *) arena_alloc_node(arena, sizeof(ast));
+        if(a) memset(a, 0, sizeof(ast));
+    } else {
+        a = (ast *) calloc(1, sizeof(ast));
+    }
 
     if (a == NULL) {
         fprintf(stderr, "%s - Error allocating memory for the new ast node\n,", __FUNCTION__);
         return NULL;
     }
     a->tag = tag;
+    a->ref_count = 1;
+    a->arena = arena;
+
+    if(arena) {
+        a->token.type        = t->type;
+        a->token.line_number = t->line_number;
 
-    copy_token(&a->token, t);
+        if(t->literal) {
+            a->token.literal     = arena_strndup(arena, t->literal, t->literal_len);
+            a->token.literal_len = t->literal_len;
+        }
+
+        a->token.file_name = arena_file_name(arena, t->file_name);
+    } else {
+        copy_token(&a->token, t);
+        count_heap_node(true);
+    }
 
     return a;
 }
 
-ast *make_import_stmt(const token *t) {
-    return make_base_ast(t, ast_import_stmt);
+ast *make_import_stmt(ast_arena *arena, const token *t) {
+    return make_base_ast(arena, t, ast_import_stmt);
 }
 
-ast *make_assignment_stmt(const token *t, ast_tag tag) {
-    ast *a = make_base_ast(t, tag);
+ast *make_assignment_stmt(ast_arena *arena, const token *t, ast_tag tag) {
+    ast *a = make_base_ast(arena, t, tag);
     return a;
 }
 
-ast *make_grouped_assignment_stmt(const token *t) {
-    ast *a = make_base_ast(t, ast_grouped_assignment_stmt);
+ast *make_grouped_assignment_stmt(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_grouped_assignment_stmt);
     return a;
 }
 
-ast *make_while_stmt(const token *t) {
-    ast *a = make_base_ast(t, ast_while_stmt);
+ast *make_while_stmt(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_while_stmt);
     return a;
 }
 
-ast *make_identifier(const token *t) {
-    ast *a = make_base_ast(t, ast_identifier);
+ast *make_identifier(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_identifier);
 
     if (a != NULL) {
-        a->identifier.value = strndup(t->literal, t->literal_len);
+        a->identifier.symbol = t->symbol != NO_SYMBOL ? t->symbol : intern_symbol(t->literal, t->literal_len);
+        a->identifier.value  = (char *) symbol_name(a->identifier.symbol);
         a->identifier.global = false;
     }
 
     return a;
 }
 
-ast *make_string_literal(const token *t) {
-    ast *a = make_base_ast(t, ast_string_literal);
+ast *make_string_literal(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_string_literal);
 
     if (a != NULL) {
-        a->str_literal.value = strndup(t->literal, t->literal_len);
+        a->str_literal.value = ast_strndup(arena, t->literal, t->literal_len);
     }
     return a;
 }
 
-ast *make_return_stmt(const token *t) {
-    ast *a = make_base_ast(t, ast_return_stmt);
+ast *make_return_stmt(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_return_stmt);
     return a;
 }
 
-ast *make_expression_stmt(const token *t) {
-    ast *a = make_base_ast(t, ast_expression_stmt);
+ast *make_expression_stmt(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_expression_stmt);
     return a;
 }
 
-ast *make_number_literal(const token *t) {
-    ast *a = make_base_ast(t, ast_number_literal);
+ast *make_number_literal(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_number_literal);
     return a;
 }
 
-ast *make_boolean_literal(const token *t, bool value) {
-    ast *a = make_base_ast(t, ast_boolean_literal);
+ast *make_boolean_literal(ast_arena *arena, const token *t, bool value) {
+    ast *a = make_base_ast(arena, t, ast_boolean_literal);
 
     if (a != NULL) {
         a->bool_literal.value = value;
@@ -95,34 +138,34 @@ ast *make_boolean_literal(const token *t, bool value) {
     return a;
 }
 
-ast *make_prefix_expression(const token *t) {
-    ast *a = make_base_ast(t, ast_prefix_expression);
+ast *make_prefix_expression(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_prefix_expression);
 
     if (a != NULL) {
-        a->prefix_expr.op = strndup(t->literal, t->literal_len);
+        a->prefix_expr.op = ast_strndup(arena, t->literal, t->literal_len);
     }
 
     return a;
 }
 
-ast *make_infix_expression(const token *t, ast *left) {
-    ast *a = make_base_ast(t, ast_infix_expression);
+ast *make_infix_expression(ast_arena *arena, const token *t, ast *left) {
+    ast *a = make_base_ast(arena, t, ast_infix_expression);
 
     if(a != NULL) {
-        a->infix_expr.op = strndup(t->literal, t->literal_len);
+        a->infix_expr.op = ast_strndup(arena, t->literal, t->literal_len);
         a->infix_expr.left = left;
     }
     return a;
 }
 
-ast *make_if_expression(const token *t) {
-    ast *a = make_base_ast(t, ast_if_expr);
+ast *make_if_expression(ast_arena *arena, const token *t) {
+    ast *a = make_base_ast(arena, t, ast_if_expr);
     return a;
 }
 
-ast *make_function_statement(const token *t) {
+ast *make_function_statement(ast_arena *arena, const token *t) {
 
-    ast *a = make_base_ast(t, ast_function_statement);
+    ast *a = make_base_ast(arena, t, ast_function_statement);
 
     if(a != NULL) {
         a->function_stmt.body = NULL;
@@ -137,8 +180,8 @@ ast *make_function_statement(const token *t) {
     return a;
 }
 
-ast *make_call_expression(const token *t, ast *function) {
-    ast *a = make_base_ast(t, ast_call_expression);
+ast *make_call_expression(ast_arena *arena, const token *t, ast *function) {
+    ast *a = make_base_ast(arena, t, ast_call_expression);
 
     if(a != NULL) {
         a->call_expr.function_identifier = function;
@@ -515,6 +558,8 @@ sds ast_to_string(ast *a, unsigned int *indentation_level) {
 
 ast *copy_ast(ast *src) {
 
+    if(src == NULL) return NULL;
+
     ast *a = (ast *) malloc(sizeof(ast));
 
     if(a == NULL) {
@@ -523,15 +568,20 @@ ast *copy_ast(ast *src) {
     }
 
     a->tag = src->tag;
+    a->ref_count = 1;
+    a->arena = NULL;
+    a->owns_arena_ref = false;
 
     a->token = src->token;
     a->token.literal = strdup(src->token.literal);
     a->token.file_name = strdup(src->token.file_name);
+    count_heap_node(true);
 
     switch (src->tag) {
 
         case ast_identifier:
-            a->identifier.value  = strdup(src->identifier.value);
+            a->identifier.value  = src->identifier.value;
+            a->identifier.symbol = src->identifier.symbol;
             a->identifier.global = src->identifier.global;
             break;
         case ast_number_literal:
@@ -565,10 +615,10 @@ ast *copy_ast(ast *src) {
                                                   arrput(a->grouped_assignment_stmt.names, copy_ast(src->grouped_assignment_stmt.names[i])); //NOLINT
                                               }
 
-                                              a->grouped_assignment_stmt.call_expr = src->grouped_assignment_stmt.call_expr;
+                                              a->grouped_assignment_stmt.call_expr = copy_ast(src->grouped_assignment_stmt.call_expr);
                                           } break;
         case ast_function_statement: {
-                                         a->function_stmt.name = copy_ast(src->assignment_stmt.name);
+                                         a->function_stmt.name = copy_ast(src->function_stmt.name);
 
                                          int n = arrlen(src->function_stmt.parameters);
                                          a->function_stmt.parameters = NULL;
@@ -633,6 +683,8 @@ ast *copy_ast(ast *src) {
                                   arrput(a->if_expr.alternative, copy_ast(src->if_expr.alternative[i])); //NOLINT
                               }
 
+                              a->if_expr.elif_alternative = copy_ast(src->if_expr.elif_alternative);
+
                           } break;
         case ast_call_expression:
                           a->call_expr.function_identifier = copy_ast(src->call_expr.function_identifier);
@@ -665,17 +717,106 @@ void free_asts(ast **asts) {
 }
 
 
+ast *retain_ast(ast *src) {
+    if(src != NULL) {
+        __atomic_add_fetch(&src->ref_count, 1, __ATOMIC_RELAXED);
+    }
+    return src;
+}
+
+// Moves the child arrays of a parsed statement to its arena, so all its memory is released with the arena
+void move_ast_arrays_to_arena(ast *a) {
+
+    if(a == NULL || a->arena == NULL) return;
+
+    ast_arena *arena = a->arena;
+
+#define MOVE_ARRAY(arr)                                         \
+    do {                                                        \
+        for(int i = 0; i < arrlen(arr); i++) {                  \
+            move_ast_arrays_to_arena((arr)[i]);                 \
+        }                                                       \
+        (arr) = arena_copy_array(arena, (arr), sizeof(ast *));  \
+    } while(0)
+
+    switch (a->tag) {
+        case ast_identifier:
+        case ast_number_literal:
+        case ast_boolean_literal:
+        case ast_string_literal:
+            break;
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            move_ast_arrays_to_arena(a->assignment_stmt.name);
+            move_ast_arrays_to_arena(a->assignment_stmt.value);
+            break;
+        case ast_grouped_assignment_stmt:
+            MOVE_ARRAY(a->grouped_assignment_stmt.names);
+            move_ast_arrays_to_arena(a->grouped_assignment_stmt.call_expr);
+            break;
+        case ast_function_statement:
+            move_ast_arrays_to_arena(a->function_stmt.name);
+            MOVE_ARRAY(a->function_stmt.parameters);
+            MOVE_ARRAY(a->function_stmt.body);
+            break;
+        case ast_return_stmt:
+            MOVE_ARRAY(a->return_stmt.return_values);
+            break;
+        case ast_expression_stmt:
+            move_ast_arrays_to_arena(a->expr_stmt);
+            break;
+        case ast_while_stmt:
+            move_ast_arrays_to_arena(a->while_stmt.condition);
+            MOVE_ARRAY(a->while_stmt.body);
+            break;
+        case ast_import_stmt:
+            move_ast_arrays_to_arena(a->import_stmt.filename);
+            break;
+        case ast_prefix_expression:
+            move_ast_arrays_to_arena(a->prefix_expr.right);
+            break;
+        case ast_infix_expression:
+            move_ast_arrays_to_arena(a->infix_expr.left);
+            move_ast_arrays_to_arena(a->infix_expr.right);
+            break;
+        case ast_if_expr:
+            move_ast_arrays_to_arena(a->if_expr.condition);
+            MOVE_ARRAY(a->if_expr.consequence);
+            MOVE_ARRAY(a->if_expr.alternative);
+            move_ast_arrays_to_arena(a->if_expr.elif_alternative);
+            break;
+        case ast_call_expression:
+            move_ast_arrays_to_arena(a->call_expr.function_identifier);
+            MOVE_ARRAY(a->call_expr.arguments);
+            break;
+    }
+
+#undef MOVE_ARRAY
+}
+
 void free_ast(ast *src) {
 
     if(src == NULL) return;
 
+    //programs that share statements can be freed from different threads
+    if(__atomic_sub_fetch(&src->ref_count, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    //the memory of arena nodes (and of their children) is released with the arena
+    if(src->arena) {
+        if(src->owns_arena_ref) {
+            release_arena(src->arena);
+        }
+        return;
+    }
+
     switch (src->tag) {
 
         case ast_number_literal:
         case ast_boolean_literal:
             break;
         case ast_identifier:
-            free(src->identifier.value);
             break;
         case ast_string_literal:
             free(src->str_literal.value);
@@ -731,7 +872,100 @@ void free_ast(ast *src) {
             break;
     }
 
+    count_heap_node(false);
     free(src->token.literal);
     free( (char*) src->token.file_name);
     free(src);
 }
+
+void get_ast_memory_stats(struct ast_memory_stats *stats) {
+
+    struct arena_memory_stats arenas;
+    get_arena_memory_stats(&arenas);
+
+    stats->n_arenas    = arenas.n_arenas;
+    stats->arena_bytes = arenas.n_bytes;
+    stats->arena_nodes = arenas.n_nodes;
+    stats->heap_nodes  = __atomic_load_n(&live_heap_nodes, __ATOMIC_RELAXED);
+    stats->heap_bytes  = stats->heap_nodes * sizeof(ast);
+}
+
+// Adds the nodes of a tree and the bytes of the nodes, their token strings and their child arrays. Strings shared by the
+// nodes of an arena (the file names) and the interned names are not counted
+void add_ast_memory(const ast *a, size_t *n_nodes, size_t *n_bytes) {
+
+    if(a == NULL) return;
+
+    (*n_nodes)++;
+    *n_bytes += sizeof(ast);
+    if(a->token.literal) *n_bytes += a->token.literal_len + 1;
+
+#define ADD_ARRAY(arr)                                  \
+    do {                                                \
+        for(int i = 0; i < arrlen(arr); i++) {          \
+            add_ast_memory((arr)[i], n_nodes, n_bytes); \
+        }                                               \
+        *n_bytes += arrlenu(arr) * sizeof(ast *);       \
+    } while(0)
+
+    switch (a->tag) {
+        case ast_identifier:
+        case ast_number_literal:
+        case ast_boolean_literal:
+            break;
+        case ast_string_literal:
+            if(a->str_literal.value) *n_bytes += strlen(a->str_literal.value) + 1;
+            break;
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            add_ast_memory(a->assignment_stmt.name, n_nodes, n_bytes);
+            add_ast_memory(a->assignment_stmt.value, n_nodes, n_bytes);
+            if(a->assignment_stmt.unit) *n_bytes += strlen(a->assignment_stmt.unit) + 1;
+            break;
+        case ast_grouped_assignment_stmt:
+            ADD_ARRAY(a->grouped_assignment_stmt.names);
+            add_ast_memory(a->grouped_assignment_stmt.call_expr, n_nodes, n_bytes);
+            break;
+        case ast_function_statement:
+            add_ast_memory(a->function_stmt.name, n_nodes, n_bytes);
+            ADD_ARRAY(a->function_stmt.parameters);
+            ADD_ARRAY(a->function_stmt.body);
+            break;
+        case ast_return_stmt:
+            ADD_ARRAY(a->return_stmt.return_values);
+            break;
+        case ast_expression_stmt:
+            add_ast_memory(a->expr_stmt, n_nodes, n_bytes);
+            break;
+        case ast_while_stmt:
+            add_ast_memory(a->while_stmt.condition, n_nodes, n_bytes);
+            ADD_ARRAY(a->while_stmt.body);
+            break;
+        case ast_import_stmt:
+            add_ast_memory(a->import_stmt.filename, n_nodes, n_bytes);
+            break;
+        case ast_prefix_expression:
+            if(a->prefix_expr.op) *n_bytes += strlen(a->prefix_expr.op) + 1;
+            add_ast_memory(a->prefix_expr.right, n_nodes, n_bytes);
+            break;
+        case ast_infix_expression:
+            add_ast_memory(a->infix_expr.left, n_nodes, n_bytes);
+            if(a->infix_expr.op) *n_bytes += strlen(a->infix_expr.op) + 1;
+            add_ast_memory(a->infix_expr.right, n_nodes, n_bytes);
+            break;
+        case ast_if_expr:
+            add_ast_memory(a->if_expr.condition, n_nodes, n_bytes);
+            ADD_ARRAY(a->if_expr.consequence);
+            ADD_ARRAY(a->if_expr.alternative);
+            add_ast_memory(a->if_expr.elif_alternative, n_nodes, n_bytes);
+            break;
+        case ast_call_expression:
+            add_ast_memory(a->call_expr.function_identifier, n_nodes, n_bytes);
+            ADD_ARRAY(a->call_expr.arguments);
+            break;
+    }
+
+#undef ADD_ARRAY
+}
@@ -2,6 +2,7 @@
 #define AST_H
 
 #include "../string/sds.h"
+#include "arena.h"
 #include "token.h"
 #include <stdbool.h>
 
@@ -43,7 +44,8 @@ typedef struct boolean_literal_t {
 } boolean_literal;
 
 typedef struct identifier_t {
-    char *value;
+    char *value; //the interned name of the symbol, shared by all the nodes and never freed
+    symbol_id symbol;
     bool global;
 } identifier_node;
 
@@ -104,6 +106,15 @@ typedef struct ast_t {
     token token;
     ast_tag tag;
 
+    // Versions of a model share their statements. free_ast only releases a node when its last reference is dropped,
+    // so a shared node must be copied (see make_stmt_writable in program.h) before being modified. Updated atomically
+    unsigned int ref_count;
+
+    // Nodes created by the parser live in its arena (NULL for nodes created by copy_ast) and are released with it.
+    // Each top-level statement holds a reference to the arena, dropped when the statement is freed
+    ast_arena *arena;
+    bool owns_arena_ref;
+
     union {
         identifier_node identifier;
         assignment_statement assignment_stmt;
@@ -124,25 +135,39 @@ typedef struct ast_t {
 
 } ast;
 
-ast *make_assignment_stmt(const token *t, ast_tag tag);
-ast *make_grouped_assignment_stmt(const token *t);
-ast *make_identifier(const token *t);
-ast *make_return_stmt(const token *t);
-ast *make_while_stmt(const token *t);
-ast *make_expression_stmt(const token *t);
-ast *make_number_literal(const token *t);
-ast *make_boolean_literal(const token *t, bool value);
-ast *make_prefix_expression(const token *t);
-ast *make_infix_expression(const token *t, ast *left);
-ast *make_if_expression(const token *t);
-ast *make_function_statement(const token *t);
-ast *make_call_expression(const token *t, ast *function);
-ast *make_import_stmt(const token *t);
-ast *make_string_literal(const token *t);
+ast *make_assignment_stmt(ast_arena *arena, const token *t, ast_tag tag);
+ast *make_grouped_assignment_stmt(ast_arena *arena, const token *t);
+ast *make_identifier(ast_arena *arena, const token *t);
+ast *make_return_stmt(ast_arena *arena, const token *t);
+ast *make_while_stmt(ast_arena *arena, const token *t);
+ast *make_expression_stmt(ast_arena *arena, const token *t);
+ast *make_number_literal(ast_arena *arena, const token *t);
+ast *make_boolean_literal(ast_arena *arena, const token *t, bool value);
+ast *make_prefix_expression(ast_arena *arena, const token *t);
+ast *make_infix_expression(ast_arena *arena, const token *t, ast *left);
+ast *make_if_expression(ast_arena *arena, const token *t);
+ast *make_function_statement(ast_arena *arena, const token *t);
+ast *make_call_expression(ast_arena *arena, const token *t, ast *function);
+ast *make_import_stmt(ast_arena *arena, const token *t);
+ast *make_string_literal(ast_arena *arena, const token *t);
+
+// Nodes held by all the live programs: the ones in the arenas of the parsers and the ones copied to the heap by
+// copy_ast (or created without an arena). The bytes of the heap nodes do not include their strings
+struct ast_memory_stats {
+    size_t n_arenas;
+    size_t arena_bytes;
+    size_t arena_nodes;
+    size_t heap_nodes;
+    size_t heap_bytes;
+};
 
 sds ast_to_string(ast *a, unsigned int *indentation_level);
 ast *copy_ast(ast *src);
+ast *retain_ast(ast *src);
+void move_ast_arrays_to_arena(ast *a);
 void free_ast(ast *src);
 void free_asts(ast **asts);
+void get_ast_memory_stats(struct ast_memory_stats *stats);
+void add_ast_memory(const ast *a, size_t *n_nodes, size_t *n_bytes);
 
 #endif /* AST_H */
@@ -0,0 +1,119 @@
+#include "import_cache.h"
+#include "../stb/stb_ds.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+struct import_cache_entry {
+    char *key;
+    struct import_entry *value;
+};
+
+static struct import_cache_entry *import_cache = NULL;
+static unsigned int import_cache_hits          = 0;
+static unsigned int import_cache_misses        = 0;
+static pthread_mutex_t import_cache_lock       = PTHREAD_MUTEX_INITIALIZER;
+
+static struct import_entry *retain_import_entry(struct import_entry *entry) {
+    __atomic_add_fetch(&entry->ref_count, 1, __ATOMIC_RELAXED);
+    return entry;
+}
+
+void release_import_entry(struct import_entry *entry) {
+
+    if(entry == NULL) return;
+
+    if(__atomic_sub_fetch(&entry->ref_count, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    free(entry->path);
+    free_program(entry->statements);
+    arrfree(entry->functions);
+    arrfree(entry->globals);
+    arrfree(entry->skipped_lines);
+    free(entry);
+}
+
+// Returns a reference to the entry of path if it was parsed from the same contents, NULL otherwise.
+// The reference has to be dropped with release_import_entry
+struct import_entry *get_cached_import(const char *path, uint64_t content_hash) {
+
+    struct import_entry *entry = NULL;
+
+    pthread_mutex_lock(&import_cache_lock);
+
+    if(import_cache == NULL) {
+        sh_new_strdup(import_cache);
+    }
+
+    struct import_entry *cached = shget(import_cache, path);
+
+    if(cached != NULL && cached->content_hash == content_hash) {
+        entry = retain_import_entry(cached);
+        import_cache_hits++;
+    } else {
+        import_cache_misses++;
+    }
+
+    pthread_mutex_unlock(&import_cache_lock);
+
+    return entry;
+}
+
+// The cache takes a reference to the entry, replacing the entry of the same path
+void add_cached_import(struct import_entry *entry) {
+
+    pthread_mutex_lock(&import_cache_lock);
+
+    if(import_cache == NULL) {
+        sh_new_strdup(import_cache);
+    }
+
+    struct import_entry *old = shget(import_cache, entry->path);
+    shput(import_cache, entry->path, retain_import_entry(entry));
+
+    pthread_mutex_unlock(&import_cache_lock);
+
+    release_import_entry(old);
+}
+
+void invalidate_cached_import(const char *path) {
+
+    struct import_entry *old = NULL;
+
+    pthread_mutex_lock(&import_cache_lock);
+
+    int i = import_cache ? shgeti(import_cache, path) : -1;
+
+    if(i != -1) {
+        old = import_cache[i].value;
+        (void) shdel(import_cache, path);
+    }
+
+    pthread_mutex_unlock(&import_cache_lock);
+
+    release_import_entry(old);
+}
+
+void clear_import_cache(void) {
+
+    pthread_mutex_lock(&import_cache_lock);
+
+    for(int i = 0; i < shlen(import_cache); i++) {
+        release_import_entry(import_cache[i].value);
+    }
+
+    shfree(import_cache);
+
+    pthread_mutex_unlock(&import_cache_lock);
+}
+
+void get_import_cache_info(struct import_cache_info *info) {
+
+    pthread_mutex_lock(&import_cache_lock);
+
+    info->n_entries = (unsigned int) shlen(import_cache);
+    info->hits      = import_cache_hits;
+    info->misses    = import_cache_misses;
+
+    pthread_mutex_unlock(&import_cache_lock);
+}
@@ -0,0 +1,33 @@
+#ifndef __IMPORT_CACHE_H
+#define __IMPORT_CACHE_H
+
+#include "parser.h"
+
+// Imported files are parsed once per process. The functions and globals of a file are kept with their signatures,
+// keyed by the real path of the file and validated with the hash of its contents, so a file that changed is parsed
+// again even if nobody invalidated its entry. The statements are shared (see share_program) with the programs that
+// import them. Entries are reference counted, so an entry can be used while it is being replaced or invalidated.
+struct import_entry {
+    char *path;
+    uint64_t content_hash;
+    unsigned int ref_count;
+    program statements;                 //the functions and globals of the file, in order
+    declared_function_entry *functions; //stb array, one entry per function of statements
+    declared_variable_entry *globals;   //stb array, one entry per global of statements
+    uint32_t *skipped_lines;            //stb array, lines of the statements that can not be imported
+};
+
+struct import_cache_info {
+    unsigned int n_entries;
+    unsigned int hits;
+    unsigned int misses;
+};
+
+struct import_entry *get_cached_import(const char *path, uint64_t content_hash);
+void add_cached_import(struct import_entry *entry);
+void release_import_entry(struct import_entry *entry);
+void invalidate_cached_import(const char *path);
+void clear_import_cache(void);
+void get_import_cache_info(struct import_cache_info *info);
+
+#endif /* __IMPORT_CACHE_H */
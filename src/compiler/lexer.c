@@ -327,6 +327,9 @@ token next_token(lexer *l) {
             if(isalpha(l->ch) || l->ch == '_') {
                 tok.literal = read_identifier(l, &tok.literal_len, false);
                 tok.type = lookup_ident(&tok);
+                if(tok.type == IDENT || tok.type == ODE_IDENT) {
+                    tok.symbol = intern_symbol(tok.literal, tok.literal_len);
+                }
                 tok.line_number = current_line;
                 tok.file_name   = file_name;
 
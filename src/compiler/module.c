@@ -0,0 +1,887 @@
+#include "module.h"
+#include "../file_utils/file_utils.h"
+#include "../stb/stb_ds.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MODULE_MAGIC "ODM"
+#define MODULE_HEADER_SIZE (4 + 4 + 8 + 8 + 8)
+#define MAX_MODULE_DEPTH 4096
+
+// Writing
+
+struct module_string {
+    char *key;
+    uint32_t value;
+};
+
+struct module_writer {
+    sds body;
+    struct module_string *strings; //string -> index in the string table
+    char **string_table;
+    uint32_t line; //line of the last node
+};
+
+static sds put_varint(sds buf, uint64_t v) {
+
+    unsigned char bytes[10];
+    int n = 0;
+
+    do {
+        bytes[n] = v & 0x7f;
+        v >>= 7;
+        if(v) bytes[n] |= 0x80;
+        n++;
+    } while(v);
+
+    return sdscatlen(buf, bytes, n);
+}
+
+static sds put_u32(sds buf, uint32_t v) {
+    unsigned char bytes[4];
+    for(int i = 0; i < 4; i++) bytes[i] = (v >> (8 * i)) & 0xff;
+    return sdscatlen(buf, bytes, 4);
+}
+
+static sds put_u64(sds buf, uint64_t v) {
+    unsigned char bytes[8];
+    for(int i = 0; i < 8; i++) bytes[i] = (v >> (8 * i)) & 0xff;
+    return sdscatlen(buf, bytes, 8);
+}
+
+static uint32_t string_index(struct module_writer *w, const char *s) {
+
+    int i = shgeti(w->strings, s);
+
+    if(i != -1) return w->strings[i].value;
+
+    uint32_t index = (uint32_t) arrlen(w->string_table);
+    shput(w->strings, s, index);
+    arrput(w->string_table, w->strings[shgeti(w->strings, s)].key);
+
+    return index;
+}
+
+// 0 is NULL, any other value is the index of the string plus one
+static void put_optional_string(struct module_writer *w, const char *s) {
+    w->body = put_varint(w->body, s ? string_index(w, s) + 1 : 0);
+}
+
+// Names, values and operators are almost always the literal of their token: 0 is the literal, 1 is NULL and any other
+// value is the index of the string plus two
+static void put_token_string(struct module_writer *w, const char *s, const char *literal) {
+    if(s && literal && strcmp(s, literal) == 0) {
+        w->body = put_varint(w->body, 0);
+    } else {
+        w->body = put_varint(w->body, s ? string_index(w, s) + 2 : 1);
+    }
+}
+
+// Lines are written as the (zigzag encoded) difference to the line of the previous node
+static void put_line(struct module_writer *w, uint32_t line) {
+    int64_t delta = (int64_t) line - (int64_t) w->line;
+    w->body       = put_varint(w->body, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63));
+    w->line       = line;
+}
+
+// Integer values are written as varints plus one, 0 is followed by the bits of the double
+static void put_number(struct module_writer *w, double value) {
+
+    if(value >= 0 && value < 9007199254740992.0 && value == (double) (uint64_t) value && !(value == 0 && signbit(value))) {
+        w->body = put_varint(w->body, (uint64_t) value + 1);
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        w->body = put_varint(w->body, 0);
+        w->body = put_u64(w->body, bits);
+    }
+}
+
+static void put_node(struct module_writer *w, const ast *a);
+
+static void put_nodes(struct module_writer *w, ast **nodes) {
+
+    int n = arrlen(nodes);
+    w->body = put_varint(w->body, n);
+
+    for(int i = 0; i < n; i++) {
+        put_node(w, nodes[i]);
+    }
+}
+
+// The tag is written plus one, 0 is a NULL node
+static void put_node(struct module_writer *w, const ast *a) {
+
+    if(a == NULL) {
+        w->body = put_varint(w->body, 0);
+        return;
+    }
+
+    w->body = put_varint(w->body, a->tag + 1);
+    w->body = put_varint(w->body, a->token.type);
+    put_line(w, a->token.line_number);
+    put_optional_string(w, a->token.literal);
+
+    switch(a->tag) {
+        case ast_identifier:
+            put_token_string(w, a->identifier.value, a->token.literal);
+            w->body = put_varint(w->body, a->identifier.global);
+            break;
+        case ast_number_literal:
+            put_number(w, a->num_literal.value);
+            break;
+        case ast_boolean_literal:
+            w->body = put_varint(w->body, a->bool_literal.value);
+            break;
+        case ast_string_literal:
+            put_token_string(w, a->str_literal.value, a->token.literal);
+            break;
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            put_node(w, a->assignment_stmt.name);
+            put_node(w, a->assignment_stmt.value);
+            w->body = put_varint(w->body, a->assignment_stmt.declaration_position);
+            put_optional_string(w, a->assignment_stmt.unit);
+            break;
+        case ast_grouped_assignment_stmt:
+            put_nodes(w, a->grouped_assignment_stmt.names);
+            put_node(w, a->grouped_assignment_stmt.call_expr);
+            break;
+        case ast_function_statement:
+            put_node(w, a->function_stmt.name);
+            put_nodes(w, a->function_stmt.parameters);
+            put_nodes(w, a->function_stmt.body);
+            w->body = put_varint(w->body, (uint32_t) a->function_stmt.num_return_values);
+            w->body = put_varint(w->body, a->function_stmt.is_end_fn);
+            break;
+        case ast_return_stmt:
+            put_nodes(w, a->return_stmt.return_values);
+            break;
+        case ast_expression_stmt:
+            put_node(w, a->expr_stmt);
+            break;
+        case ast_while_stmt:
+            put_node(w, a->while_stmt.condition);
+            put_nodes(w, a->while_stmt.body);
+            break;
+        case ast_import_stmt:
+            put_node(w, a->import_stmt.filename);
+            break;
+        case ast_prefix_expression:
+            put_token_string(w, a->prefix_expr.op, a->token.literal);
+            put_node(w, a->prefix_expr.right);
+            break;
+        case ast_infix_expression:
+            put_node(w, a->infix_expr.left);
+            put_token_string(w, a->infix_expr.op, a->token.literal);
+            put_node(w, a->infix_expr.right);
+            break;
+        case ast_if_expr:
+            put_node(w, a->if_expr.condition);
+            put_nodes(w, a->if_expr.consequence);
+            put_nodes(w, a->if_expr.alternative);
+            put_node(w, a->if_expr.elif_alternative);
+            break;
+        case ast_call_expression:
+            put_node(w, a->call_expr.function_identifier);
+            put_nodes(w, a->call_expr.arguments);
+            break;
+    }
+}
+
+static sds put_strings(sds buf, const struct module_writer *w) {
+
+    for(int i = 0; i < arrlen(w->string_table); i++) {
+        size_t len = strlen(w->string_table[i]);
+        buf        = put_varint(buf, len);
+        buf        = sdscatlen(buf, w->string_table[i], len);
+    }
+
+    return buf;
+}
+
+// x.ode -> x.odm
+sds get_module_path(const char *source_path) {
+
+    sds module_path = sdsnew(source_path);
+    const char *ext = get_filename_ext(source_path);
+
+    if(ext && *ext) {
+        sdsrange(module_path, 0, (ssize_t) (strlen(source_path) - strlen(ext) - 1));
+    } else {
+        module_path = sdscat(module_path, ".");
+    }
+
+    return sdscat(module_path, MODULE_EXTENSION);
+}
+
+// The module is written to a temporary file and renamed, so a process loading it never sees a partial module
+bool write_module(const char *module_path, const struct import_entry *entry, uint64_t source_size) {
+
+    struct module_writer w = {0};
+    w.body                 = sdsempty();
+    sh_new_strdup(w.strings);
+
+    int n_functions = arrlen(entry->functions);
+    int n_globals   = arrlen(entry->globals);
+    int n_skipped   = arrlen(entry->skipped_lines);
+    int n_stmt      = arrlen(entry->statements);
+
+    for(int i = 0; i < n_functions; i++) {
+        declared_function_entry_value fn = entry->functions[i].value;
+        w.body = put_varint(w.body, string_index(&w, symbol_name(entry->functions[i].key)));
+        w.body = put_varint(w.body, (uint32_t) fn.n_returns);
+        w.body = put_varint(w.body, (uint32_t) fn.n_args);
+    }
+
+    for(int i = 0; i < n_globals; i++) {
+        declared_variable_entry_value var = entry->globals[i].value;
+        w.body = put_varint(w.body, string_index(&w, symbol_name(entry->globals[i].key)));
+        w.body = put_varint(w.body, var.declaration_position);
+        w.body = put_varint(w.body, var.initialized);
+        w.body = put_varint(w.body, var.line_number);
+        w.body = put_varint(w.body, var.tag);
+    }
+
+    for(int i = 0; i < n_skipped; i++) {
+        w.body = put_varint(w.body, entry->skipped_lines[i]);
+    }
+
+    for(int i = 0; i < n_stmt; i++) {
+        put_node(&w, entry->statements[i]);
+    }
+
+    sds data = sdsempty();
+    data     = put_varint(data, arrlen(w.string_table));
+    data     = put_varint(data, n_stmt);
+    data     = put_varint(data, n_functions);
+    data     = put_varint(data, n_globals);
+    data     = put_varint(data, n_skipped);
+    data     = put_strings(data, &w);
+    data     = sdscatsds(data, w.body);
+
+    sds buf = sdsnewlen(MODULE_MAGIC, 4);
+    buf     = put_u32(buf, MODULE_VERSION);
+    buf     = put_u64(buf, entry->content_hash);
+    buf     = put_u64(buf, source_size);
+    buf     = put_u64(buf, stbds_hash_bytes(data, sdslen(data), 0));
+    buf     = sdscatsds(buf, data);
+
+    sds tmp_path = sdscatprintf(sdsempty(), "%s.%d.tmp", module_path, (int) getpid());
+    FILE *f      = fopen(tmp_path, "wb");
+    bool ok      = f != NULL;
+
+    if(ok) {
+        ok = fwrite(buf, 1, sdslen(buf), f) == sdslen(buf);
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmp_path, module_path) == 0;
+
+        if(!ok) {
+            unlink(tmp_path);
+        }
+    }
+
+    if(!ok) {
+        fprintf(stderr, "[WARN] - Error writing the module %s\n", module_path);
+    }
+
+    sdsfree(tmp_path);
+    sdsfree(buf);
+    sdsfree(data);
+    sdsfree(w.body);
+    shfree(w.strings);
+    arrfree(w.string_table);
+
+    return ok;
+}
+
+// Reading
+
+struct module_reader {
+    const unsigned char *pos;
+    const unsigned char *end;
+    bool error;
+
+    ast_arena *arena;
+    const char *file_name;
+    uint32_t line;
+
+    uint32_t n_strings;
+    char **strings;      //copied to the arena, shared by all the nodes of the module
+    uint32_t *lengths;
+    symbol_id *symbols;  //interned when first used
+};
+
+static uint64_t get_varint(struct module_reader *r) {
+
+    uint64_t v = 0;
+
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(r->pos >= r->end) break;
+
+        unsigned char b = *r->pos++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+
+        if(!(b & 0x80)) return v;
+    }
+
+    r->error = true;
+    return 0;
+}
+
+// Each string, statement and entry of a count takes at least one byte, so a count can not be larger than the bytes left.
+// The counts are checked one by one, as their sum may wrap
+static bool check_count(struct module_reader *r, uint64_t n) {
+    if(n > (uint64_t) (r->end - r->pos)) {
+        r->error = true;
+    }
+    return !r->error;
+}
+
+static uint64_t get_fixed(struct module_reader *r, int n_bytes) {
+
+    if(r->end - r->pos < n_bytes) {
+        r->error = true;
+        return 0;
+    }
+
+    uint64_t v = 0;
+    for(int i = 0; i < n_bytes; i++) {
+        v |= (uint64_t) r->pos[i] << (8 * i);
+    }
+
+    r->pos += n_bytes;
+
+    return v;
+}
+
+static char *get_optional_string(struct module_reader *r) {
+
+    uint64_t i = get_varint(r);
+
+    if(i == 0) return NULL;
+
+    if(i > r->n_strings) {
+        r->error = true;
+        return NULL;
+    }
+
+    return r->strings[i - 1];
+}
+
+static char *get_token_string(struct module_reader *r, const token *t) {
+
+    uint64_t i = get_varint(r);
+
+    if(i == 0) return t->literal;
+    if(i == 1) return NULL;
+
+    if(i - 2 >= r->n_strings) {
+        r->error = true;
+        return NULL;
+    }
+
+    return r->strings[i - 2];
+}
+
+static uint32_t get_line(struct module_reader *r) {
+    uint64_t zigzag = get_varint(r);
+    r->line += (uint32_t) ((zigzag >> 1) ^ -(zigzag & 1));
+    return r->line;
+}
+
+static double get_number(struct module_reader *r) {
+
+    uint64_t v = get_varint(r);
+
+    if(v > 0) return (double) (v - 1);
+
+    double value;
+    uint64_t bits = get_fixed(r, 8);
+    memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+// Names are interned the first time they are used
+static symbol_id intern_string(struct module_reader *r, uint64_t i) {
+
+    if(r->symbols[i] == NO_SYMBOL) {
+        r->symbols[i] = intern_symbol(r->strings[i], r->lengths[i]);
+    }
+
+    return r->symbols[i];
+}
+
+static symbol_id get_symbol(struct module_reader *r) {
+
+    uint64_t i = get_varint(r);
+
+    if(i >= r->n_strings) {
+        r->error = true;
+        return NO_SYMBOL;
+    }
+
+    return intern_string(r, i);
+}
+
+static ast *get_node(struct module_reader *r, int depth);
+
+// The arrays are allocated in the arena, as the parser does when a statement is complete
+static ast **get_nodes(struct module_reader *r, int depth) {
+
+    uint64_t n = get_varint(r);
+
+    if(n == 0) return NULL;
+
+    //each node takes at least one byte
+    if(n > (uint64_t) (r->end - r->pos)) {
+        r->error = true;
+        return NULL;
+    }
+
+    ast **nodes = (ast **) arena_new_array(r->arena, n, sizeof(ast *));
+
+    for(uint64_t i = 0; i < n && !r->error; i++) {
+        nodes[i] = get_node(r, depth);
+
+        if(nodes[i] == NULL) {
+            r->error = true;
+        }
+    }
+
+    return nodes;
+}
+
+static bool is_identifier(const ast *a) {
+    return a != NULL && a->tag == ast_identifier;
+}
+
+// The code generators and the parser dereference these children without checking them, as the parser always sets
+// them. Returns false if a was not written from a parsed statement
+static bool has_valid_children(const ast *a) {
+
+    switch(a->tag) {
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            return is_identifier(a->assignment_stmt.name) && a->assignment_stmt.value != NULL;
+        case ast_grouped_assignment_stmt:
+            for(int i = 0; i < arrlen(a->grouped_assignment_stmt.names); i++) {
+                if(!is_identifier(a->grouped_assignment_stmt.names[i])) return false;
+            }
+            return a->grouped_assignment_stmt.names != NULL && a->grouped_assignment_stmt.call_expr != NULL &&
+                   a->grouped_assignment_stmt.call_expr->tag == ast_call_expression;
+        case ast_function_statement:
+            for(int i = 0; i < arrlen(a->function_stmt.parameters); i++) {
+                if(!is_identifier(a->function_stmt.parameters[i])) return false;
+            }
+            return is_identifier(a->function_stmt.name);
+        case ast_expression_stmt:
+            return a->expr_stmt != NULL;
+        case ast_while_stmt:
+            return a->while_stmt.condition != NULL;
+        case ast_import_stmt:
+            return a->import_stmt.filename != NULL && a->import_stmt.filename->tag == ast_string_literal;
+        case ast_prefix_expression:
+            return a->prefix_expr.right != NULL;
+        case ast_infix_expression:
+            return a->infix_expr.left != NULL && a->infix_expr.right != NULL;
+        case ast_if_expr:
+            return a->if_expr.condition != NULL && (a->if_expr.elif_alternative == NULL || a->if_expr.elif_alternative->tag == ast_if_expr);
+        case ast_call_expression:
+            return is_identifier(a->call_expr.function_identifier);
+        default:
+            return true;
+    }
+}
+
+static ast *get_node(struct module_reader *r, int depth) {
+
+    uint64_t tag = get_varint(r);
+
+    if(tag == 0 || r->error) return NULL;
+
+    if(tag > ast_call_expression + 1 || depth > MAX_MODULE_DEPTH) {
+        r->error = true;
+        return NULL;
+    }
+
+    ast *a = (ast *) arena_alloc_node(r->arena, sizeof(ast));
+    memset(a, 0, sizeof(ast));
+
+    a->tag       = (ast_tag) (tag - 1);
+    a->ref_count = 1;
+    a->arena     = r->arena;
+
+    a->token.type        = (token_type) get_varint(r);
+    a->token.line_number = get_line(r);
+    uint64_t literal = get_varint(r);
+
+    if(literal > r->n_strings) {
+        r->error = true;
+        return a;
+    }
+
+    a->token.literal     = literal ? r->strings[literal - 1] : NULL;
+    a->token.literal_len = a->token.literal ? (uint32_t) strlen(a->token.literal) : 0;
+    a->token.file_name   = r->file_name;
+
+    depth++;
+
+    switch(a->tag) {
+        case ast_identifier: {
+            //same encoding as get_token_string, but the name is interned from its index
+            uint64_t name = get_varint(r);
+
+            if(name == 0 && literal != 0) {
+                name = literal - 1;
+            } else if(name >= 2 && name - 2 < r->n_strings) {
+                name = name - 2;
+            } else {
+                r->error = true;
+                break;
+            }
+
+            a->identifier.symbol = intern_string(r, name);
+            a->identifier.value  = (char *) symbol_name(a->identifier.symbol);
+            a->identifier.global = get_varint(r);
+        } break;
+        case ast_number_literal:
+            a->num_literal.value = get_number(r);
+            break;
+        case ast_boolean_literal:
+            a->bool_literal.value = get_varint(r);
+            break;
+        case ast_string_literal:
+            a->str_literal.value = get_token_string(r, &a->token);
+            break;
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            a->assignment_stmt.name                 = get_node(r, depth);
+            a->assignment_stmt.value                = get_node(r, depth);
+            a->assignment_stmt.declaration_position = (uint32_t) get_varint(r);
+            a->assignment_stmt.unit                 = get_optional_string(r);
+            break;
+        case ast_grouped_assignment_stmt:
+            a->grouped_assignment_stmt.names     = get_nodes(r, depth);
+            a->grouped_assignment_stmt.call_expr = get_node(r, depth);
+            break;
+        case ast_function_statement:
+            a->function_stmt.name              = get_node(r, depth);
+            a->function_stmt.parameters        = get_nodes(r, depth);
+            a->function_stmt.body              = get_nodes(r, depth);
+            a->function_stmt.num_return_values = (int) (uint32_t) get_varint(r);
+            a->function_stmt.is_end_fn         = get_varint(r);
+            break;
+        case ast_return_stmt:
+            a->return_stmt.return_values = get_nodes(r, depth);
+            break;
+        case ast_expression_stmt:
+            a->expr_stmt = get_node(r, depth);
+            break;
+        case ast_while_stmt:
+            a->while_stmt.condition = get_node(r, depth);
+            a->while_stmt.body      = get_nodes(r, depth);
+            break;
+        case ast_import_stmt:
+            a->import_stmt.filename = get_node(r, depth);
+            break;
+        case ast_prefix_expression:
+            a->prefix_expr.op    = get_token_string(r, &a->token);
+            a->prefix_expr.right = get_node(r, depth);
+            break;
+        case ast_infix_expression:
+            a->infix_expr.left  = get_node(r, depth);
+            a->infix_expr.op    = get_token_string(r, &a->token);
+            a->infix_expr.right = get_node(r, depth);
+            break;
+        case ast_if_expr:
+            a->if_expr.condition        = get_node(r, depth);
+            a->if_expr.consequence      = get_nodes(r, depth);
+            a->if_expr.alternative      = get_nodes(r, depth);
+            a->if_expr.elif_alternative = get_node(r, depth);
+            break;
+        case ast_call_expression:
+            a->call_expr.function_identifier = get_node(r, depth);
+            a->call_expr.arguments           = get_nodes(r, depth);
+            break;
+    }
+
+    if(!r->error && !has_valid_children(a)) {
+        r->error = true;
+    }
+
+    return a;
+}
+
+// Creates the arena of the nodes and reads the string table
+static void begin_reading(struct module_reader *r, const char *file_name, uint64_t n_strings) {
+
+    r->arena     = new_arena();
+    r->file_name = arena_file_name(r->arena, file_name);
+
+    //the strings are indexed with 32 bits
+    if(n_strings > UINT32_MAX || !check_count(r, n_strings)) {
+        r->error = true;
+        return;
+    }
+
+    r->n_strings = (uint32_t) n_strings;
+    r->strings   = (char **) malloc(sizeof(char *) * (n_strings + 1));
+    r->lengths   = (uint32_t *) malloc(sizeof(uint32_t) * (n_strings + 1));
+    r->symbols   = (symbol_id *) calloc(n_strings + 1, sizeof(symbol_id));
+
+    for(uint64_t i = 0; i < n_strings && !r->error; i++) {
+        uint64_t len = get_varint(r);
+
+        if((uint64_t) (r->end - r->pos) < len) {
+            r->error = true;
+            break;
+        }
+
+        r->strings[i] = arena_strndup(r->arena, (const char *) r->pos, len);
+        r->lengths[i] = (uint32_t) strlen(r->strings[i]);
+        r->pos += len;
+    }
+}
+
+// The arena stays alive while the nodes read reference it
+static void end_reading(struct module_reader *r) {
+    release_arena(r->arena);
+    free(r->strings);
+    free(r->lengths);
+    free(r->symbols);
+}
+
+// The nodes parse_statement returns
+static bool is_statement(const ast *a) {
+
+    switch(a->tag) {
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+        case ast_grouped_assignment_stmt:
+        case ast_function_statement:
+        case ast_return_stmt:
+        case ast_expression_stmt:
+        case ast_while_stmt:
+        case ast_import_stmt:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Reads n_stmt statements into statements. Returns false on errors
+static bool get_statements(struct module_reader *r, uint64_t n_stmt, program *statements) {
+
+    for(uint64_t i = 0; i < n_stmt && !r->error; i++) {
+        ast *stmt = get_node(r, 0);
+
+        if(stmt == NULL || r->error || !is_statement(stmt)) {
+            r->error = true;
+            break;
+        }
+
+        stmt->owns_arena_ref = true;
+        retain_arena(r->arena);
+        arrput(*statements, stmt);
+    }
+
+    return !r->error;
+}
+
+// add_imported_statements takes the entries of the tables in the order of the statements, so a module only holds
+// functions and globals, in the order and with the names of its tables
+static bool statements_match_tables(const struct import_entry *entry) {
+
+    int n_stmt         = arrlen(entry->statements);
+    int function_index = 0;
+    int global_index   = 0;
+
+    for(int s = 0; s < n_stmt; s++) {
+        const ast *a = entry->statements[s];
+
+        if(a->tag == ast_function_statement) {
+            if(function_index == arrlen(entry->functions) || entry->functions[function_index++].key != a->function_stmt.name->identifier.symbol) {
+                return false;
+            }
+        } else if(a->tag == ast_global_stmt) {
+            if(global_index == arrlen(entry->globals) || entry->globals[global_index++].key != a->assignment_stmt.name->identifier.symbol) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return function_index == arrlen(entry->functions) && global_index == arrlen(entry->globals);
+}
+
+// Returns a new entry (with one reference) for the file in path, or NULL if the module does not exist, is not valid or
+// was compiled from other contents
+struct import_entry *read_module(const char *module_path, const char *path, uint64_t content_hash, uint64_t source_size, const char *file_name) {
+
+    size_t module_size = 0;
+    char *module       = read_entire_file_with_mmap(module_path, &module_size);
+
+    if(module == NULL || module == MAP_FAILED) return NULL;
+
+    struct module_reader r = {0};
+    r.pos                  = (const unsigned char *) module;
+    r.end                  = r.pos + module_size;
+
+    if(module_size < MODULE_HEADER_SIZE || memcmp(module, MODULE_MAGIC, 4) != 0) {
+        munmap(module, module_size);
+        return NULL;
+    }
+
+    r.pos += 4;
+
+    uint32_t version     = (uint32_t) get_fixed(&r, 4);
+    uint64_t module_hash = get_fixed(&r, 8);
+    uint64_t module_src  = get_fixed(&r, 8);
+
+    if(version != MODULE_VERSION || module_hash != content_hash || module_src != source_size) {
+        munmap(module, module_size);
+        return NULL;
+    }
+
+    uint64_t checksum = get_fixed(&r, 8);
+
+    if(checksum != stbds_hash_bytes((void *) r.pos, r.end - r.pos, 0)) {
+        fprintf(stderr, "[WARN] - Ignoring the corrupted module %s\n", module_path);
+        munmap(module, module_size);
+        return NULL;
+    }
+
+    uint64_t n_strings   = get_varint(&r);
+    uint64_t n_stmt      = get_varint(&r);
+    uint64_t n_functions = get_varint(&r);
+    uint64_t n_globals   = get_varint(&r);
+    uint64_t n_skipped   = get_varint(&r);
+
+    if(!check_count(&r, n_strings) || !check_count(&r, n_stmt) || !check_count(&r, n_functions) || !check_count(&r, n_globals) ||
+       !check_count(&r, n_skipped) || n_strings + n_stmt + n_functions + n_globals + n_skipped > (uint64_t) (r.end - r.pos)) {
+        munmap(module, module_size);
+        return NULL;
+    }
+
+    begin_reading(&r, file_name, n_strings);
+
+    struct import_entry *entry = (struct import_entry *) calloc(1, sizeof(struct import_entry));
+
+    entry->path         = strdup(path);
+    entry->content_hash = content_hash;
+    entry->ref_count    = 1;
+
+    for(uint64_t i = 0; i < n_functions && !r.error; i++) {
+        declared_function_entry fn = {0};
+        fn.key                     = get_symbol(&r);
+        fn.value.n_returns         = (int) (uint32_t) get_varint(&r);
+        fn.value.n_args            = (int) (uint32_t) get_varint(&r);
+        arrput(entry->functions, fn);
+    }
+
+    for(uint64_t i = 0; i < n_globals && !r.error; i++) {
+        declared_variable_entry var     = {0};
+        var.key                         = get_symbol(&r);
+        var.value.declaration_position = (uint32_t) get_varint(&r);
+        var.value.initialized          = get_varint(&r);
+        var.value.line_number          = (uint32_t) get_varint(&r);
+        var.value.tag                  = (ast_tag) get_varint(&r);
+        arrput(entry->globals, var);
+    }
+
+    for(uint64_t i = 0; i < n_skipped && !r.error; i++) {
+        arrput(entry->skipped_lines, (uint32_t) get_varint(&r));
+    }
+
+    get_statements(&r, n_stmt, &entry->statements);
+
+    if(!r.error && (!statements_match_tables(entry) || r.pos != r.end)) {
+        r.error = true;
+    }
+
+    end_reading(&r);
+    munmap(module, module_size);
+
+    if(r.error) {
+        fprintf(stderr, "[WARN] - Ignoring the invalid module %s\n", module_path);
+        release_import_entry(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+// Programs
+
+sds encode_program(sds buf, program statements) {
+
+    struct module_writer w = {0};
+    w.body                 = sdsempty();
+    sh_new_strdup(w.strings);
+
+    int n_stmt = arrlen(statements);
+
+    for(int i = 0; i < n_stmt; i++) {
+        put_node(&w, statements[i]);
+    }
+
+    buf = put_varint(buf, arrlen(w.string_table));
+    buf = put_varint(buf, n_stmt);
+    buf = put_strings(buf, &w);
+    buf = sdscatsds(buf, w.body);
+
+    sdsfree(w.body);
+    shfree(w.strings);
+    arrfree(w.string_table);
+
+    return buf;
+}
+
+// The tokens of the statements are attributed to file_name. Returns false if data is not a valid encoded program
+bool decode_program(const char *data, size_t size, const char *file_name, program *statements) {
+
+    struct module_reader r = {0};
+    r.pos                  = (const unsigned char *) data;
+    r.end                  = r.pos + size;
+
+    uint64_t n_strings = get_varint(&r);
+    uint64_t n_stmt    = get_varint(&r);
+
+    if(!check_count(&r, n_strings) || !check_count(&r, n_stmt) || n_strings + n_stmt > (uint64_t) (r.end - r.pos)) {
+        return false;
+    }
+
+    *statements = NULL;
+
+    begin_reading(&r, file_name, n_strings);
+
+    if(get_statements(&r, n_stmt, statements) && r.pos != r.end) {
+        r.error = true;
+    }
+
+    end_reading(&r);
+
+    if(r.error) {
+        free_program(*statements);
+        *statements = NULL;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef __MODULE_H
+#define __MODULE_H
+
+#include "import_cache.h"
+
+// A module (.odm) is the precompiled form of an imported file, written by odec next to the file. It has the
+// statements of the file serialized in preorder, the signatures of its functions and globals and the hash of the
+// source it was compiled from. An import loads the module instead of parsing the file when the hash matches.
+// The format is:
+//
+//   header:   magic "ODM\0", version, content hash, source size and the hash of the rest of the module (fixed size,
+//             little endian), number of strings, statements, functions, globals and skipped lines (varints)
+//   strings:  length (varint) and bytes of each name, literal and operator, without the NUL
+//   entries:  functions (name, n_returns, n_args), globals (name, position, initialized, line, tag), skipped lines
+//   nodes:    tag, token and the fields of each node, followed by its children
+//
+// Numbers are unsigned LEB128 varints and strings are referenced by their index in the string table. Lines are
+// stored as the difference to the previous node and the names, values and operators that are the literal of their
+// token are not stored again
+#define MODULE_EXTENSION "odm"
+#define MODULE_VERSION 1
+
+sds get_module_path(const char *source_path);
+bool write_module(const char *module_path, const struct import_entry *entry, uint64_t source_size);
+struct import_entry *read_module(const char *module_path, const char *path, uint64_t content_hash, uint64_t source_size, const char *file_name);
+
+// Programs (e.g., the models of a saved session) are encoded as the strings and nodes of a module, without the header
+sds encode_program(sds buf, program statements);
+bool decode_program(const char *data, size_t size, const char *file_name, program *statements);
+
+#endif /* __MODULE_H */
@@ -1,10 +1,14 @@
 #include "parser.h"
+#include "import_cache.h"
+#include "module.h"
 #include "../file_utils/file_utils.h"
 #include "../stb/stb_ds.h"
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define ERROR_PREFIX "Parse error on line %d of file %s: "
 #define NEW_ERROR_PREFIX(ln, fn) sdscatprintf(sdsempty(), ERROR_PREFIX, ln, fn)
@@ -32,10 +36,6 @@
     return value
 
 
-static int global_count    = 1;
-static int local_var_count = 1;
-static int ode_count       = 1;
-
 ast **parse_expression_list(parser *, bool);
 
 static inline void advance_token(parser *p) {
@@ -78,7 +78,7 @@ static bool can_be_in_init(parser *p, const ast *a) {
             return true;
 
         case ast_identifier:
-            return shgeti(p->global_scope, a->identifier.value) != -1 || shgeti(p->declared_functions, a->identifier.value) != -1;
+            return hmgeti(p->global_scope, a->identifier.symbol) != -1 || hmgeti(p->declared_functions, a->identifier.symbol) != -1;
 
         case ast_grouped_assignment_stmt: {
             bool can = false;
@@ -119,7 +119,7 @@ static bool can_be_in_init(parser *p, const ast *a) {
 
 static void add_builtin_function(parser *p, char *name, int n_args) {
     declared_function_entry_value value = {1, n_args};
-    shput(p->declared_functions, name, value);
+    hmput(p->declared_functions, intern_symbol(name, strlen(name)), value);
 }
 
 static enum operator_precedence get_precedence(token t) {
@@ -166,8 +166,9 @@ parser *new_parser(lexer *l) {
         return NULL;
     }
 
-    sh_new_arena(p->declared_functions);
-    shdefault(p->declared_functions, (declared_function_entry_value) {0});
+    p->arena = new_arena();
+
+    hmdefault(p->declared_functions, (declared_function_entry_value) {0});
 
     add_builtin_function(p, "acos", 1);
     add_builtin_function(p, "asin", 1);
@@ -231,11 +232,10 @@ parser *new_parser(lexer *l) {
     add_builtin_function(p, ODE_GET_TIME, 2);
     add_builtin_function(p, ODE_GET_N_IT, 0);
 
-    sh_new_arena(p->declared_variables);
-    shdefault(p->declared_variables, ((declared_variable_entry_value) {0}));
+    hmdefault(p->declared_variables, ((declared_variable_entry_value) {0}));
 
     //variable time is auto declared in the scope
-    shput(p->declared_variables, "time", ((declared_variable_entry_value) {0, true, 0, ast_global_stmt}));
+    hmput(p->declared_variables, intern_symbol("time", 4), ((declared_variable_entry_value) {0, true, 0, ast_global_stmt}));
 
     p->l = l;
 
@@ -246,10 +246,18 @@ parser *new_parser(lexer *l) {
 }
 
 void free_parser(parser *p) {
-    shfree(p->declared_variables);
-    shfree(p->declared_functions);
-    shfree(p->global_scope);
-    shfree(p->local_scope);
+    for(int i = 0; i < arrlen(p->errors); i++) {
+        sdsfree(p->errors[i]);
+    }
+    arrfree(p->errors);
+
+    hmfree(p->declared_variables);
+    hmfree(p->declared_functions);
+    hmfree(p->global_scope);
+    hmfree(p->local_scope);
+
+    //the statements of the parsed programs keep the arena alive
+    release_arena(p->arena);
 
     free(p);
 }
@@ -274,16 +282,16 @@ bool check_parser_errors(parser *p, bool exit_on_error) {
 }
 
 ast *parse_identifier(parser *p) {
-    return make_identifier(&p->cur_token);
+    return make_identifier(p->arena, &p->cur_token);
 }
 
 ast *parse_boolean_literal(parser *p) {
-    return make_boolean_literal(&p->cur_token, cur_token_is(p, TRUE));
+    return make_boolean_literal(p->arena, &p->cur_token, cur_token_is(p, TRUE));
 }
 
 ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
 
-    ast *stmt = make_assignment_stmt(&p->cur_token, tag);
+    ast *stmt = make_assignment_stmt(p->arena, &p->cur_token, tag);
 
     if(!skip_ident) {
         if(tag == ast_ode_stmt) {
@@ -308,7 +316,7 @@ ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
     }
 
     if(tag == ast_global_stmt) {
-        int builtin = shgeti(p->declared_functions, stmt->assignment_stmt.name->identifier.value);
+        int builtin = hmgeti(p->declared_functions, stmt->assignment_stmt.name->identifier.symbol);
 
         if(builtin != -1) {
             RETURN_ERROR("%.*s is a function name and cannot be used as an global identifier\n", p->cur_token.literal_len, p->cur_token.literal);
@@ -320,44 +328,42 @@ ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
     }
 
     if(tag == ast_assignment_stmt) {
-        declared_variable_entry_value value = {local_var_count, false, p->cur_token.line_number, tag};
+        declared_variable_entry_value value = {p->local_var_count, false, p->cur_token.line_number, tag};
         if(!has_ode_symbol) {
-            shput(p->declared_variables, stmt->assignment_stmt.name->identifier.value, value);
-            stmt->assignment_stmt.declaration_position = local_var_count;
-            local_var_count++;
+            hmput(p->declared_variables, stmt->assignment_stmt.name->identifier.symbol, value);
+            stmt->assignment_stmt.declaration_position = p->local_var_count;
+            p->local_var_count++;
         }
     } else if(tag == ast_global_stmt) {
-        declared_variable_entry_value value = {global_count, false, p->cur_token.line_number, tag};
+        declared_variable_entry_value value = {p->global_count, false, p->cur_token.line_number, tag};
 
-        bool already_declared                = shgeti(p->global_scope, stmt->assignment_stmt.name->identifier.value) != -1;
+        bool already_declared                = hmgeti(p->global_scope, stmt->assignment_stmt.name->identifier.symbol) != -1;
 
         if(already_declared) {
             RETURN_VALUE_AND_ERROR_EXPRESSION(stmt, "global variable %s has already been declared.\n", stmt->assignment_stmt.name->identifier.value);
         }
 
-        shput(p->global_scope, stmt->assignment_stmt.name->identifier.value, value);
-        stmt->assignment_stmt.declaration_position = global_count;
-        global_count++;
+        hmput(p->global_scope, stmt->assignment_stmt.name->identifier.symbol, value);
+        stmt->assignment_stmt.declaration_position = p->global_count;
+        p->global_count++;
     } else if(tag == ast_ode_stmt) {
         p->have_ode = true;
-        char *tmp   = strndup(stmt->assignment_stmt.name->identifier.value, (int) strlen(stmt->assignment_stmt.name->identifier.value) - 1);
+        symbol_id base_symbol = get_ode_base_symbol(stmt->assignment_stmt.name->identifier.symbol);
         //The key in this hash is the order of appearance of the ODE. This is important to define the order of the initial conditions
-        declared_variable_entry_value value     = {ode_count, false, p->cur_token.line_number, tag};
+        declared_variable_entry_value value     = {p->ode_count, false, p->cur_token.line_number, tag};
 
-        declared_variable_entry *existing_entry = stbds_shgetp_null(p->declared_variables, tmp);
+        declared_variable_entry *existing_entry = hmgetp_null(p->declared_variables, base_symbol);
         if(existing_entry != NULL) {
             printf("[WARN] - ODE %s redeclared on line %d! Ignore if it was intentionally redeclared!\n",
                    stmt->assignment_stmt.name->identifier.value,
                    p->cur_token.line_number);
             stmt->assignment_stmt.declaration_position = existing_entry->value.declaration_position;
-            shput(p->declared_variables, tmp, value);
+            hmput(p->declared_variables, base_symbol, value);
         } else {
-            shput(p->declared_variables, tmp, value);
-            stmt->assignment_stmt.declaration_position = ode_count;
-            ode_count++;
+            hmput(p->declared_variables, base_symbol, value);
+            stmt->assignment_stmt.declaration_position = p->ode_count;
+            p->ode_count++;
         }
-
-        free(tmp);
     }
 
     if(p->cur_token.line_number != p->peek_token.line_number) {
@@ -370,7 +376,7 @@ ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
 
     if(peek_token_is(p, UNIT_DECL)) {
         advance_token(p);
-        stmt->assignment_stmt.unit = strndup(p->cur_token.literal, p->cur_token.literal_len);
+        stmt->assignment_stmt.unit = arena_strndup(p->arena, p->cur_token.literal, p->cur_token.literal_len);
     }
 
     if(peek_token_is(p, SEMICOLON)) {
@@ -382,7 +388,7 @@ ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
         if(stmt->assignment_stmt.unit != NULL) {
             //TODO: warning about unit definition
         }
-        stmt->assignment_stmt.unit = strndup(p->cur_token.literal, p->cur_token.literal_len);
+        stmt->assignment_stmt.unit = arena_strndup(p->arena, p->cur_token.literal, p->cur_token.literal_len);
     }
 
     return stmt;
@@ -390,7 +396,7 @@ ast *parse_assignment_statement(parser *p, ast_tag tag, bool skip_ident) {
 
 ast *parse_return_statement(parser *p) {
 
-    ast *stmt = make_return_stmt(&p->cur_token);
+    ast *stmt = make_return_stmt(p->arena, &p->cur_token);
 
     advance_token(p);
 
@@ -405,13 +411,13 @@ ast *parse_return_statement(parser *p) {
 
 ast *parse_import_statement(parser *p) {
 
-    ast *stmt = make_import_stmt(&p->cur_token);
+    ast *stmt = make_import_stmt(p->arena, &p->cur_token);
 
     if(!expect_peek(p, STRING)) {
         RETURN_ERROR("missing file name after import directive\n");
     }
 
-    stmt->import_stmt.filename = make_string_literal(&p->cur_token);
+    stmt->import_stmt.filename = make_string_literal(p->arena, &p->cur_token);
 
     if(peek_token_is(p, SEMICOLON)) {
         advance_token(p);
@@ -440,7 +446,7 @@ ast **parse_block_statement(parser *p) {
 
 ast *parse_while_statement(parser *p) {
 
-    ast *exp = make_while_stmt(&p->cur_token);
+    ast *exp = make_while_stmt(p->arena, &p->cur_token);
 
     if(!expect_peek(p, LPAREN)) {
         RETURN_ERROR("( expected\n");
@@ -464,7 +470,7 @@ ast *parse_while_statement(parser *p) {
 }
 
 ast *parse_number_literal(parser *p) {
-    ast *lit = make_number_literal(&p->cur_token);
+    ast *lit = make_number_literal(p->arena, &p->cur_token);
     char *end;
     double value = strtod(p->cur_token.literal, &end);
     if(p->cur_token.literal == end) {
@@ -476,12 +482,12 @@ ast *parse_number_literal(parser *p) {
 }
 
 ast *parse_string_literal(parser *p) {
-    return make_string_literal(&p->cur_token);
+    return make_string_literal(p->arena, &p->cur_token);
 }
 
 ast *parse_prefix_expression(parser *p) {
 
-    ast *expression = make_prefix_expression(&p->cur_token);
+    ast *expression = make_prefix_expression(p->arena, &p->cur_token);
     advance_token(p);
     expression->prefix_expr.right = parse_expression(p, PREFIX);
 
@@ -490,7 +496,7 @@ ast *parse_prefix_expression(parser *p) {
 
 ast *parse_infix_expression(parser *p, ast *left) {
 
-    ast *expression                     = make_infix_expression(&p->cur_token, left);
+    ast *expression                     = make_infix_expression(p->arena, &p->cur_token, left);
 
     enum operator_precedence precedence = cur_precedence(p);
 
@@ -523,7 +529,7 @@ ast **parse_grouped_assignment_names(parser *p) {
 
     declared_variable_entry_value value = {p->cur_token.line_number, false, p->cur_token.line_number, ast_grouped_assignment_stmt};
 
-    shput(p->declared_variables, ident->identifier.value, value);
+    hmput(p->declared_variables, ident->identifier.symbol, value);
 
     while(peek_token_is(p, COMMA)) {
         advance_token(p);
@@ -531,7 +537,7 @@ ast **parse_grouped_assignment_names(parser *p) {
         ident = parse_identifier(p);
         arrput(identifiers, ident);//NOLINT
         value = (declared_variable_entry_value) {p->cur_token.line_number, false, p->cur_token.line_number, ast_grouped_assignment_stmt};
-        shput(p->declared_variables, ident->identifier.value, value);
+        hmput(p->declared_variables, ident->identifier.symbol, value);
     }
 
     return identifiers;
@@ -539,7 +545,7 @@ ast **parse_grouped_assignment_names(parser *p) {
 
 ast *parse_grouped_assignment(parser *p) {
 
-    ast *stmt = make_grouped_assignment_stmt(&p->cur_token);
+    ast *stmt = make_grouped_assignment_stmt(p->arena, &p->cur_token);
 
     if(peek_token_is(p, RBRACKET)) {
         RETURN_ERROR("expected at least one identifier\n");
@@ -573,7 +579,7 @@ ast *parse_grouped_assignment(parser *p) {
 
 ast *parse_if_expression(parser *p) {
 
-    ast *exp = make_if_expression(&p->cur_token);
+    ast *exp = make_if_expression(p->arena, &p->cur_token);
 
     if(!expect_peek(p, LPAREN)) {
         sds msg = sdscatprintf(sdsempty(), "Parse error on line %d: ( expected\n", p->cur_token.line_number);
@@ -693,7 +699,7 @@ void count_return(ast *a, program *stmts) {
 
 ast *parse_function_statement(parser *p) {
 
-    ast *stmt = make_function_statement(&p->cur_token);
+    ast *stmt = make_function_statement(p->arena, &p->cur_token);
 
     if(!expect_peek(p, IDENT)) {
         RETURN_ERROR("expected identifier after fn statement\n");
@@ -745,7 +751,7 @@ ast *parse_function_statement(parser *p) {
     int n_args                            = arrlen(stmt->function_stmt.parameters);
 
     declared_function_entry_value value   = {return_len, n_args};
-    shput(p->declared_functions, stmt->function_stmt.name->identifier.value, value);
+    hmput(p->declared_functions, stmt->function_stmt.name->identifier.symbol, value);
 
     return stmt;
 }
@@ -781,7 +787,7 @@ ast **parse_expression_list(parser *p, bool with_paren) {
 }
 
 ast *parse_call_expression(parser *p, ast *function) {
-    ast *exp                 = make_call_expression(&p->cur_token, function);
+    ast *exp                 = make_call_expression(p->arena, &p->cur_token, function);
     exp->call_expr.arguments = parse_expression_list(p, true);
     return exp;
 }
@@ -865,7 +871,7 @@ ast *parse_expression(parser *p, enum operator_precedence precedence) {
 
 ast *parse_expression_statement(parser *p) {
 
-    ast *stmt       = make_expression_stmt(&p->cur_token);
+    ast *stmt       = make_expression_stmt(p->arena, &p->cur_token);
     stmt->expr_stmt = parse_expression(p, LOWEST);
     if(peek_token_is(p, SEMICOLON)) {
         advance_token(p);
@@ -933,15 +939,16 @@ static void check_declaration(parser *p, ast *src) {
 
         case ast_identifier: {
             char *id_name    = src->identifier.value;
+            symbol_id id     = src->identifier.symbol;
 
-            bool is_local    = shgeti(p->declared_variables, id_name) != -1;
-            bool is_global   = shgeti(p->global_scope, id_name) != -1;
-            bool is_function = shgeti(p->declared_functions, id_name) != -1;
+            bool is_local    = hmgeti(p->declared_variables, id) != -1;
+            bool is_global   = hmgeti(p->global_scope, id) != -1;
+            bool is_function = hmgeti(p->declared_functions, id) != -1;
 
             bool is_fn_param = false;
 
             if(!is_local && !is_global && !is_function) {
-                is_fn_param = shgeti(p->local_scope, id_name) != -1;
+                is_fn_param = hmgeti(p->local_scope, id) != -1;
             }
 
             if(!is_local && !is_global && !is_function && !is_fn_param) {
@@ -956,11 +963,7 @@ static void check_declaration(parser *p, ast *src) {
             bool has_ode_symbol = (id_name[s] == '\'');
 
             if(has_ode_symbol) {
-                char *tmp = strndup(id_name, s);
-
-                int i     = shgeti(p->declared_variables, tmp);
-
-                free(tmp);
+                int i = hmgeti(p->declared_variables, get_ode_base_symbol(src->assignment_stmt.name->identifier.symbol));
 
                 if(i == -1) {
                     ADD_ERROR_WITH_LINE(src->token.line_number, src->token.file_name, "ODE %s not declared. Declare with 'ode %s = expr' before using!\n",
@@ -974,8 +977,9 @@ static void check_declaration(parser *p, ast *src) {
                 }
             }
 
-            bool var_is_global = shgeti(p->global_scope, id_name) != -1;
-            if(var_is_global) {
+            bool var_is_global = hmgeti(p->global_scope, src->assignment_stmt.name->identifier.symbol) != -1;
+            //only written when it changes, the statement can be shared with other programs (see process_imports)
+            if(var_is_global && !src->assignment_stmt.name->identifier.global) {
                 src->assignment_stmt.name->identifier.global = true;
             }
 
@@ -985,9 +989,10 @@ static void check_declaration(parser *p, ast *src) {
         case ast_global_stmt: {
             check_declaration(p, src->assignment_stmt.value);
             if(src->assignment_stmt.value != NULL && src->assignment_stmt.value->tag == ast_call_expression) {
-                char *f_name               = src->assignment_stmt.value->call_expr.function_identifier->identifier.value;
+                ast *f_id                  = src->assignment_stmt.value->call_expr.function_identifier;
+                char *f_name               = f_id->identifier.value;
 
-                declared_function_entry dv = shgets(p->declared_functions, f_name);
+                declared_function_entry dv = hmgets(p->declared_functions, f_id->identifier.symbol);
                 int num_return_values      = dv.value.n_returns;
 
                 if(num_return_values != 1) {
@@ -995,8 +1000,8 @@ static void check_declaration(parser *p, ast *src) {
                                         num_return_values);
                 }
             }
-            bool var_is_global = shgeti(p->global_scope, src->assignment_stmt.name->identifier.value) != -1;
-            if(var_is_global) {
+            bool var_is_global = hmgeti(p->global_scope, src->assignment_stmt.name->identifier.symbol) != -1;
+            if(var_is_global && !src->assignment_stmt.name->identifier.global) {
                 src->assignment_stmt.name->identifier.global = true;
             }
         } break;
@@ -1010,7 +1015,7 @@ static void check_declaration(parser *p, ast *src) {
 
             char *ode_name = src->assignment_stmt.name->identifier.value;
 
-            int i          = shgeti(p->declared_variables, ode_name);
+            int i          = hmgeti(p->declared_variables, src->assignment_stmt.name->identifier.symbol);
 
             if(i != -1) {
 
@@ -1034,16 +1039,17 @@ static void check_declaration(parser *p, ast *src) {
             int n = arrlen(src->grouped_assignment_stmt.names);
 
             for(int i = 0; i < n; i++) {
-                bool var_is_global = shgeti(p->global_scope, src->grouped_assignment_stmt.names[i]->identifier.value) != -1;
-                if(var_is_global) {
+                bool var_is_global = hmgeti(p->global_scope, src->grouped_assignment_stmt.names[i]->identifier.symbol) != -1;
+                if(var_is_global && !src->grouped_assignment_stmt.names[i]->identifier.global) {
                     src->grouped_assignment_stmt.names[i]->identifier.global = true;
                 }
             }
 
             if(n > 1) {
 
-                char *f_name                 = src->grouped_assignment_stmt.call_expr->call_expr.function_identifier->identifier.value;
-                declared_function_entry dv   = shgets(p->declared_functions, f_name);
+                ast *f_id                    = src->grouped_assignment_stmt.call_expr->call_expr.function_identifier;
+                char *f_name                 = f_id->identifier.value;
+                declared_function_entry dv   = hmgets(p->declared_functions, f_id->identifier.symbol);
 
                 int num_expected_assignments = dv.value.n_returns;
 
@@ -1060,9 +1066,8 @@ static void check_declaration(parser *p, ast *src) {
             int np = arrlen(src->function_stmt.parameters);
 
             for(int i = 0; i < np; i++) {
-                char *var_name                    = src->function_stmt.parameters[i]->identifier.value;
-                declared_variable_entry var_entry = {var_name, {0}};
-                shputs(p->local_scope, var_entry);
+                declared_variable_entry var_entry = {src->function_stmt.parameters[i]->identifier.symbol, {0}};
+                hmputs(p->local_scope, var_entry);
             }
 
             for(int i = 0; i < n; i++) {
@@ -1070,8 +1075,7 @@ static void check_declaration(parser *p, ast *src) {
             }
 
             for(int i = 0; i < np; i++) {
-                char *var_name = src->function_stmt.parameters[i]->identifier.value;
-                (void) shdel(p->local_scope, var_name);
+                (void) hmdel(p->local_scope, src->function_stmt.parameters[i]->identifier.symbol);
             }
         } break;
         case ast_return_stmt: {
@@ -1110,7 +1114,7 @@ static void check_declaration(parser *p, ast *src) {
             check_variable_declarations(p, src->call_expr.arguments);
 
             char *f_name               = src->call_expr.function_identifier->identifier.value;
-            declared_function_entry dv = shgets(p->declared_functions, f_name);
+            declared_function_entry dv = hmgets(p->declared_functions, src->call_expr.function_identifier->identifier.symbol);
 
             int num_expected_args      = dv.value.n_args;
             int n_real_args            = arrlen(src->call_expr.arguments);
@@ -1139,107 +1143,355 @@ static void check_ode_initializations(parser *p, program program) {
         if(program[i]->tag == ast_ode_stmt) {
 
             ast *src                   = program[i];
-            char *ode_name             = strndup(src->assignment_stmt.name->identifier.value, (int) strlen(src->assignment_stmt.name->identifier.value) - 1);
-            declared_variable_entry dv = shgets(p->declared_variables, ode_name);
+            symbol_id base_symbol      = get_ode_base_symbol(src->assignment_stmt.name->identifier.symbol);
+            declared_variable_entry dv = hmgets(p->declared_variables, base_symbol);
 
             if(!dv.value.initialized) {
-                fprintf(stderr, "Warning - No initial condition provided for %s' (declared on line %d)!\n", ode_name, dv.value.line_number);
+                fprintf(stderr, "Warning - No initial condition provided for %s' (declared on line %d)!\n", symbol_name(base_symbol), dv.value.line_number);
             }
-            free(ode_name);
         }
     }
 }
 
-static void process_imports(parser *p, program original_program, char *import_path) {
+// An import of the program being parsed. Files that are not in the import cache are parsed in parallel
+struct pending_import {
+    ast *stmt;
+    sds file_name;
+    char *path; //real path of the file, the key of the import cache
+    char *source;
+    size_t file_size;
+    uint64_t content_hash;
+    int same_file_as; //index of a previous import of the same file, -1 if none
+    struct import_entry *entry;
+    bool from_source; //the entry was parsed from the source, not loaded from the module of the file
+    sds *errors; //errors found parsing the file
+};
+
+struct import_queue {
+    struct pending_import *imports;
+    int *to_parse;
+    int n_to_parse;
+    int next;
+    pthread_mutex_t lock;
+};
+
+static void parse_imported_file(struct pending_import *imp) {
+
+    sds module_path = get_module_path(imp->path);
+    imp->entry      = read_module(module_path, imp->path, imp->content_hash, imp->file_size, imp->file_name);
+    sdsfree(module_path);
+
+    if(imp->entry) return;
+
+    imp->from_source = true;
+
+    lexer *l            = new_lexer(imp->source, imp->file_name);
+    parser *parser_new  = new_parser(l);
+    program program_new = parse_program_without_exiting_on_error(parser_new, false, false, NULL);
+
+    if(arrlen(parser_new->errors) > 0) {
+        imp->errors        = parser_new->errors;
+        parser_new->errors = NULL;
+        free_program(program_new);
+    } else {
+        struct import_entry *entry = (struct import_entry *) calloc(1, sizeof(struct import_entry));
+
+        entry->path         = strdup(imp->path);
+        entry->content_hash = imp->content_hash;
+        entry->ref_count    = 1;
+
+        int n_stmt = arrlen(program_new);
+
+        for(int s = 0; s < n_stmt; s++) {
+            ast *a = program_new[s];
+            //we only import functions and global variables for now
+            if(a->tag == ast_function_statement) {
+                arrput(entry->functions, hmgets(parser_new->declared_functions, a->function_stmt.name->identifier.symbol));
+                arrput(entry->statements, a);
+            } else if(a->tag == ast_global_stmt) {
+                arrput(entry->globals, hmgets(parser_new->global_scope, a->assignment_stmt.name->identifier.symbol));
+                arrput(entry->statements, a);
+            } else {
+                arrput(entry->skipped_lines, a->token.line_number);
+                free_ast(a);
+            }
+        }
+
+        arrfree(program_new);
+        imp->entry = entry;
+    }
+
+    free_parser(parser_new);
+    free_lexer(l);
+}
+
+static void *import_worker(void *arg) {
+
+    struct import_queue *queue = (struct import_queue *) arg;
+
+    while(true) {
+        pthread_mutex_lock(&queue->lock);
+        int i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if(i >= queue->n_to_parse) break;
+
+        parse_imported_file(&queue->imports[queue->to_parse[i]]);
+    }
+
+    return NULL;
+}
+
+static void parse_imported_files(struct pending_import *imports, int *to_parse) {
+
+    struct import_queue queue = {0};
+    queue.imports             = imports;
+    queue.to_parse            = to_parse;
+    queue.n_to_parse          = arrlen(to_parse);
+    pthread_mutex_init(&queue.lock, NULL);
+
+    int n_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if(n_threads > queue.n_to_parse) n_threads = queue.n_to_parse;
+
+    if(n_threads <= 1) {
+        import_worker(&queue);
+    } else {
+        pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * n_threads);
+
+        for(int t = 0; t < n_threads; t++) {
+            pthread_create(&threads[t], NULL, import_worker, &queue);
+        }
+
+        for(int t = 0; t < n_threads; t++) {
+            pthread_join(threads[t], NULL);
+        }
+
+        free(threads);
+    }
+
+    pthread_mutex_destroy(&queue.lock);
+}
+
+// check_declaration marks the assignments to global variables. Imported statements are shared with the import cache
+// and with the other programs that import them, so a function that assigns to a global of this program is copied
+static bool assigns_unmarked_global(parser *p, ast *a) {
 
-    int n = arrlen(original_program);
+    if(a == NULL) return false;
+
+    switch(a->tag) {
+        case ast_assignment_stmt:
+            return !a->assignment_stmt.name->identifier.global && hmgeti(p->global_scope, a->assignment_stmt.name->identifier.symbol) != -1;
+        case ast_grouped_assignment_stmt:
+            for(int i = 0; i < arrlen(a->grouped_assignment_stmt.names); i++) {
+                ast *name = a->grouped_assignment_stmt.names[i];
+                if(!name->identifier.global && hmgeti(p->global_scope, name->identifier.symbol) != -1) return true;
+            }
+            return false;
+        case ast_expression_stmt:
+            return assigns_unmarked_global(p, a->expr_stmt);
+        case ast_if_expr:
+            for(int i = 0; i < arrlen(a->if_expr.consequence); i++) {
+                if(assigns_unmarked_global(p, a->if_expr.consequence[i])) return true;
+            }
+            for(int i = 0; i < arrlen(a->if_expr.alternative); i++) {
+                if(assigns_unmarked_global(p, a->if_expr.alternative[i])) return true;
+            }
+            return assigns_unmarked_global(p, a->if_expr.elif_alternative);
+        case ast_while_stmt:
+            for(int i = 0; i < arrlen(a->while_stmt.body); i++) {
+                if(assigns_unmarked_global(p, a->while_stmt.body[i])) return true;
+            }
+            return false;
+        case ast_function_statement:
+            for(int i = 0; i < arrlen(a->function_stmt.body); i++) {
+                if(assigns_unmarked_global(p, a->function_stmt.body[i])) return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static void add_imported_statements(parser *p, program *original_program, struct pending_import *imp) {
+
+    struct import_entry *entry = imp->entry;
+
+    int n_stmt        = arrlen(entry->statements);
+    int function_index = 0;
+    int global_index   = 0;
+
+    for(int s = 0; s < n_stmt; s++) {
+        ast *a = entry->statements[s];
+
+        if(a->tag == ast_function_statement) {
+            declared_function_entry fn_entry = entry->functions[function_index++];
+
+            if(hmgeti(p->declared_functions, fn_entry.key) != -1) {
+                ADD_ERROR("Function %s alread exists.\n", a->function_stmt.name->identifier.value);
+            } else {
+                hmputs(p->declared_functions, fn_entry);
+                arrput(*original_program, retain_ast(a));
+            }
+        } else {
+            declared_variable_entry var_entry = entry->globals[global_index++];
+
+            if(hmgeti(p->global_scope, var_entry.key) != -1) {
+                ADD_ERROR("Global variable %s alread exists.\n", a->assignment_stmt.name->identifier.value);
+            } else {
+                hmputs(p->global_scope, var_entry);
+                arrput(*original_program, retain_ast(a));
+            }
+        }
+    }
+
+    for(int s = 0; s < arrlen(entry->skipped_lines); s++) {
+        fprintf(stderr, "[WARN] - Importing from file %s in line %d. Currently, we only import functions or global variables. Nested imports will not be imported!\n", imp->file_name, entry->skipped_lines[s]);
+    }
+}
+
+// The imported files are taken from the import cache when they did not change. The others are parsed in parallel and
+// added to the cache. The statements are added to the program in the order of the imports
+static void process_imports(parser *p, program *original_program, char *import_path) {
+
+    struct pending_import *imports = NULL;
+    int *to_parse                  = NULL;
+
+    int n = arrlen(*original_program);
 
     for(int i = 0; i < n; i++) {
-        ast *a = original_program[i];
+        ast *a = (*original_program)[i];
 
         if(a->tag != ast_import_stmt) continue;
 
-        sds import_file_name;
+        struct pending_import imp = {0};
+        imp.stmt                  = a;
+        imp.same_file_as          = -1;
 
         if(import_path == NULL) {
-            import_file_name = sdsnew(a->import_stmt.filename->identifier.value);
+            imp.file_name = sdsnew(a->import_stmt.filename->str_literal.value);
         } else {
-            import_file_name = sdscatprintf(sdsempty(), "%s/%s", import_path, a->import_stmt.filename->identifier.value);
+            imp.file_name = sdscatprintf(sdsempty(), "%s/%s", import_path, a->import_stmt.filename->str_literal.value);
         }
 
-        size_t file_size;
+        imp.path = realpath(imp.file_name, NULL);
 
-        char *source = read_entire_file_with_mmap(import_file_name, &file_size);
+        if(imp.path) {
+            imp.source = read_entire_file_with_mmap(imp.path, &imp.file_size);
+        }
 
-        if(!source) {
-            fprintf(stderr, "Error importing file %s.\n", import_file_name);
-            sdsfree(import_file_name);
-            exit(0);
+        if(!imp.source) {
+            ADD_ERROR_WITH_LINE(a->token.line_number, a->token.file_name, "Error importing file %s.\n", imp.file_name);
+            sdsfree(imp.file_name);
+            free(imp.path);
+            continue;
         }
 
-        lexer *l            = new_lexer(source, import_file_name);
-        parser *parser_new  = new_parser(l);
-        program program_new = parse_program(parser_new, false, true, NULL);
+        imp.content_hash = stbds_hash_bytes(imp.source, imp.file_size, 0);
+        imp.entry        = get_cached_import(imp.path, imp.content_hash);
 
-        int n_stmt          = arrlen(program_new);
-        for(int s = 0; s < n_stmt; s++) {
-            //we only import functions for now
-            if(program_new[s]->tag == ast_function_statement) {
-                int exists = shgeti(p->declared_functions, program_new[s]->function_stmt.name->identifier.value) != -1;
-                if(exists) {
-                    ADD_ERROR("Function %s alread exists.\n", program_new[s]->function_stmt.name->identifier.value);
-                } else {
-                    declared_function_entry fn_entry = shgets(parser_new->declared_functions, program_new[s]->function_stmt.name->identifier.value);
-                    shputs(p->declared_functions, fn_entry);
-                    arrput(original_program, program_new[s]);//NOLINT
+        if(imp.entry == NULL) {
+            for(int j = 0; j < arrlen(imports) && imp.same_file_as == -1; j++) {
+                if(imports[j].entry == NULL && STRING_EQUALS(imports[j].path, imp.path)) {
+                    imp.same_file_as = j;
                 }
+            }
 
-            } else if(program_new[s]->tag == ast_global_stmt) {
-                int exists = shgeti(p->global_scope, program_new[s]->assignment_stmt.name->identifier.value) != -1;
-                if(exists) {
-                    ADD_ERROR("Global variable %s alread exists.\n", program_new[s]->function_stmt.name->identifier.value);
-                } else {
-                    declared_variable_entry var_entry = shgets(parser_new->global_scope, program_new[s]->function_stmt.name->identifier.value);
-                    shputs(p->global_scope, var_entry);
+            if(imp.same_file_as == -1) {
+                arrput(to_parse, (int) arrlen(imports));
+            }
+        }
 
-                    arrput(original_program, program_new[s]);//NOLINT
-                }
-            } else {
-                free_ast(program_new[s]);
-                fprintf(stderr, "[WARN] - Importing from file %s in line %d. Currently, we only import functions or global variables. Nested imports will not be imported!\n", import_file_name, program_new[s]->token.line_number);
+        arrput(imports, imp);
+    }
+
+    parse_imported_files(imports, to_parse);
+
+    for(int i = 0; i < arrlen(to_parse); i++) {
+        struct pending_import *imp = &imports[to_parse[i]];
+        if(imp->entry) {
+            add_cached_import(imp->entry);
+
+            if(p->write_modules && imp->from_source) {
+                sds module_path = get_module_path(imp->path);
+                write_module(module_path, imp->entry, imp->file_size);
+                sdsfree(module_path);
             }
         }
+    }
 
-        sdsfree(import_file_name);
-        free_lexer(l);
-        free_parser(parser_new);
-        arrfree(program_new);
-        munmap(source, file_size);
+    int n_imports = arrlen(imports);
+    int first_imported = arrlen(*original_program);
+
+    for(int i = 0; i < n_imports; i++) {
+        struct pending_import *imp = &imports[i];
+
+        if(imp->same_file_as != -1 && imports[imp->same_file_as].entry) {
+            imp->entry = imports[imp->same_file_as].entry;
+            __atomic_add_fetch(&imp->entry->ref_count, 1, __ATOMIC_RELAXED);
+        }
+
+        for(int e = 0; e < arrlen(imp->errors); e++) {
+            arrput(p->errors, imp->errors[e]);
+        }
+        arrfree(imp->errors);
+
+        if(imp->entry) {
+            add_imported_statements(p, original_program, imp);
+        }
     }
+
+    for(int i = first_imported; i < arrlen(*original_program); i++) {
+        if(assigns_unmarked_global(p, (*original_program)[i])) {
+            make_stmt_writable(*original_program, i);
+        }
+    }
+
+    for(int i = 0; i < n_imports; i++) {
+        release_import_entry(imports[i].entry);
+        munmap(imports[i].source, imports[i].file_size);
+        sdsfree(imports[i].file_name);
+        free(imports[i].path);
+    }
+
+    arrfree(imports);
+    arrfree(to_parse);
 }
 
-static program parse_program_helper(parser *p, bool proc_imports, bool check_errors, bool exit_on_error, char *import_path) {
+program parse_program_statements(parser *p, bool proc_imports, char *import_path) {
 
-    global_count    = 1;
-    local_var_count = 1;
-    ode_count       = 1;
+    p->global_count    = 1;
+    p->local_var_count = 1;
+    p->ode_count       = 1;
 
     program program = NULL;
 
     while(TOKEN_TYPE_NOT_EQUALS(p->cur_token, ENDOF)) {
         ast *stmt = parse_statement(p);
         if(stmt != NULL) {
+            move_ast_arrays_to_arena(stmt);
+            stmt->owns_arena_ref = true;
+            retain_arena(p->arena);
             arrput(program, stmt);
         }
         advance_token(p);
     }
 
     if(proc_imports) {
-        process_imports(p, program, import_path);
+        process_imports(p, &program, import_path);
     }
 
+    return program;
+}
+
+void check_program_semantics(parser *p, program program) {
     check_variable_declarations(p, program);
     check_ode_initializations(p, program);
+}
+
+static program parse_program_helper(parser *p, bool proc_imports, bool check_errors, bool exit_on_error, char *import_path) {
+
+    program program = parse_program_statements(p, proc_imports, import_path);
+    check_program_semantics(p, program);
 
     if(check_errors) {
 
@@ -23,12 +23,12 @@ typedef struct declared_function_entry_value_t {
 } declared_function_entry_value;
 
 typedef struct declared_variable_entry_t {
-    char *key;
+    symbol_id key;
     declared_variable_entry_value value;
 } declared_variable_entry;
 
 typedef struct declared_function_entry_t {
-    char *key;
+    symbol_id key;
     declared_function_entry_value value;
 } declared_function_entry;
 
@@ -48,6 +48,7 @@ enum operator_precedence {
     CALL
 };
 
+// All the state of a parse lives in its parser, so different parsers can be used at the same time from different threads
 typedef struct parser_t {
     lexer *l;
     char **errors;
@@ -58,12 +59,21 @@ typedef struct parser_t {
     declared_variable_hash local_scope;
     declared_function_hash declared_functions;
     bool have_ode;
+    int global_count;
+    int local_var_count;
+    int ode_count;
+    ast_arena *arena; //holds the nodes of the parsed programs
+    bool write_modules; //writes the module (see module.h) of each imported file parsed from its source
 } parser;
 
 parser * new_parser(lexer *l);
 void free_parser(parser *p);
 program parse_program(parser *p, bool process_imports, bool check_errors, char *import_path);
 program parse_program_without_exiting_on_error(parser *p, bool proc_imports, bool check_errors, char *import_path);
+// The two halves of parse_program, to be timed separately: the statements (and imports) are parsed first and the
+// declarations and initial conditions of the whole program are checked after. The errors are left in p->errors
+program parse_program_statements(parser *p, bool proc_imports, char *import_path);
+void check_program_semantics(parser *p, program program);
 ast *parse_prefix_expression(parser *p);
 ast *parse_infix_expression(parser *p, ast *left);
 ast *parse_expression(parser *p, enum operator_precedence precedence);
@@ -1,6 +1,7 @@
 #include "program.h"
 #include "../stb/stb_ds.h"
 #include <stdio.h>
+#include <string.h>
 
 void print_program(program p) {
 
@@ -47,7 +48,307 @@ program copy_program(program src_program) {
     return dst_program;
 }
 
+// The new program references the statements of src instead of copying them
+program share_program(program src_program) {
+
+    program dst_program = NULL;
+
+    int p_len = arrlen(src_program);
+
+    arrsetcap(dst_program, p_len);
+
+    for (int i = 0; i < p_len; i++) {
+        arrput(dst_program, retain_ast(src_program[i]));
+    }
+
+    return dst_program;
+}
+
+// Copies the statement at index if it is shared with other programs, so it can be modified
+ast *make_stmt_writable(program p, int index) {
+
+    ast *a = p[index];
+
+    if(__atomic_load_n(&a->ref_count, __ATOMIC_ACQUIRE) > 1) {
+        p[index] = copy_ast(a);
+        free_ast(a);
+    }
+
+    return p[index];
+}
+
 void free_program(program src_program) {
     free_asts(src_program);
 }
 
+
+// FNV-1a
+#define STMT_HASH_OFFSET 14695981039346656037ull
+#define STMT_HASH_PRIME 1099511628211ull
+
+struct symbol_set_entry {
+    symbol_id key;
+    bool value;
+};
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for(size_t i = 0; i < len; i++) {
+        h ^= bytes[i];
+        h *= STMT_HASH_PRIME;
+    }
+    return h;
+}
+
+static uint64_t hash_u64(uint64_t h, uint64_t v) {
+    return hash_bytes(h, &v, sizeof(v));
+}
+
+static uint64_t hash_string(uint64_t h, const char *s) {
+    //the NUL separates the string from the next field
+    return s ? hash_bytes(h, s, strlen(s) + 1) : hash_u64(h, 0);
+}
+
+static uint64_t hash_ast(uint64_t h, const ast *a, struct symbol_set_entry **used);
+
+static uint64_t hash_asts(uint64_t h, ast **asts, struct symbol_set_entry **used) {
+
+    int n = arrlen(asts);
+    h     = hash_u64(h, n);
+
+    for(int i = 0; i < n; i++) {
+        h = hash_ast(h, asts[i], used);
+    }
+
+    return h;
+}
+
+// Hashes the contents of a, adding the identifiers it uses to used (when not NULL)
+static uint64_t hash_ast(uint64_t h, const ast *a, struct symbol_set_entry **used) {
+
+    if(a == NULL) return hash_u64(h, UINT64_MAX);
+
+    h = hash_u64(h, a->tag);
+
+    switch(a->tag) {
+        case ast_identifier:
+            h = hash_u64(h, a->identifier.symbol);
+            h = hash_u64(h, a->identifier.global);
+            if(used) hmput(*used, a->identifier.symbol, true);
+            break;
+        case ast_number_literal:
+            h = hash_bytes(h, &a->num_literal.value, sizeof(a->num_literal.value));
+            break;
+        case ast_boolean_literal:
+            h = hash_u64(h, a->bool_literal.value);
+            break;
+        case ast_string_literal:
+            h = hash_string(h, a->str_literal.value);
+            break;
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            h = hash_ast(h, a->assignment_stmt.name, used);
+            h = hash_ast(h, a->assignment_stmt.value, used);
+            h = hash_u64(h, a->assignment_stmt.declaration_position);
+            h = hash_string(h, a->assignment_stmt.unit);
+            break;
+        case ast_grouped_assignment_stmt:
+            h = hash_asts(h, a->grouped_assignment_stmt.names, used);
+            h = hash_ast(h, a->grouped_assignment_stmt.call_expr, used);
+            break;
+        case ast_function_statement:
+            h = hash_ast(h, a->function_stmt.name, used);
+            h = hash_asts(h, a->function_stmt.parameters, used);
+            h = hash_asts(h, a->function_stmt.body, used);
+            h = hash_u64(h, a->function_stmt.num_return_values);
+            h = hash_u64(h, a->function_stmt.is_end_fn);
+            break;
+        case ast_return_stmt:
+            h = hash_asts(h, a->return_stmt.return_values, used);
+            break;
+        case ast_expression_stmt:
+            h = hash_ast(h, a->expr_stmt, used);
+            break;
+        case ast_while_stmt:
+            h = hash_ast(h, a->while_stmt.condition, used);
+            h = hash_asts(h, a->while_stmt.body, used);
+            break;
+        case ast_import_stmt:
+            h = hash_ast(h, a->import_stmt.filename, used);
+            break;
+        case ast_prefix_expression:
+            h = hash_string(h, a->prefix_expr.op);
+            h = hash_ast(h, a->prefix_expr.right, used);
+            break;
+        case ast_infix_expression:
+            h = hash_ast(h, a->infix_expr.left, used);
+            h = hash_string(h, a->infix_expr.op);
+            h = hash_ast(h, a->infix_expr.right, used);
+            break;
+        case ast_if_expr:
+            h = hash_ast(h, a->if_expr.condition, used);
+            h = hash_asts(h, a->if_expr.consequence, used);
+            h = hash_asts(h, a->if_expr.alternative, used);
+            h = hash_ast(h, a->if_expr.elif_alternative, used);
+            break;
+        case ast_call_expression:
+            h = hash_ast(h, a->call_expr.function_identifier, used);
+            h = hash_asts(h, a->call_expr.arguments, used);
+            break;
+    }
+
+    return h;
+}
+
+uint64_t hash_statement(const ast *a) {
+    return hash_ast(STMT_HASH_OFFSET, a, NULL);
+}
+
+static void add_defined_symbol(struct symbol_set_entry **defined, const ast *name) {
+
+    hmput(*defined, name->identifier.symbol, true);
+
+    //the ODE x' also defines x
+    symbol_id base = get_ode_base_symbol(name->identifier.symbol);
+    if(base != NO_SYMBOL) hmput(*defined, base, true);
+}
+
+// The symbols a top-level statement gives a value to. The local variables of functions are not included
+static void add_defined_symbols(struct symbol_set_entry **defined, const ast *a) {
+
+    if(a == NULL) return;
+
+    switch(a->tag) {
+        case ast_assignment_stmt:
+        case ast_ode_stmt:
+        case ast_global_stmt:
+        case ast_initial_stmt:
+            add_defined_symbol(defined, a->assignment_stmt.name);
+            break;
+        case ast_grouped_assignment_stmt:
+            for(int i = 0; i < arrlen(a->grouped_assignment_stmt.names); i++) {
+                add_defined_symbol(defined, a->grouped_assignment_stmt.names[i]);
+            }
+            break;
+        case ast_function_statement:
+            add_defined_symbol(defined, a->function_stmt.name);
+            break;
+        case ast_while_stmt:
+            for(int i = 0; i < arrlen(a->while_stmt.body); i++) {
+                add_defined_symbols(defined, a->while_stmt.body[i]);
+            }
+            break;
+        case ast_expression_stmt:
+            add_defined_symbols(defined, a->expr_stmt);
+            break;
+        case ast_if_expr:
+            for(int i = 0; i < arrlen(a->if_expr.consequence); i++) {
+                add_defined_symbols(defined, a->if_expr.consequence[i]);
+            }
+            for(int i = 0; i < arrlen(a->if_expr.alternative); i++) {
+                add_defined_symbols(defined, a->if_expr.alternative[i]);
+            }
+            add_defined_symbols(defined, a->if_expr.elif_alternative);
+            break;
+        default:
+            break;
+    }
+}
+
+// An edit usually changes a few consecutive statements, so the programs are matched from the start and from the end and
+// the statements in between are the changed ones. The statements that use the symbols defined by the changed (or
+// removed) statements are affected too, transitively
+void diff_programs(program old_program, program new_program, struct program_diff *diff) {
+
+    memset(diff, 0, sizeof(struct program_diff));
+
+    int n_old = arrlen(old_program);
+    int n_new = arrlen(new_program);
+
+    uint64_t *old_hashes = NULL;
+    uint64_t *new_hashes = NULL;
+    struct symbol_set_entry **used = NULL;
+
+    for(int i = 0; i < n_old; i++) {
+        arrput(old_hashes, hash_statement(old_program[i]));
+    }
+
+    for(int i = 0; i < n_new; i++) {
+        struct symbol_set_entry *stmt_used = NULL;
+        arrput(new_hashes, hash_ast(STMT_HASH_OFFSET, new_program[i], &stmt_used));
+        arrput(used, stmt_used);
+    }
+
+    int prefix = 0;
+    while(prefix < n_old && prefix < n_new && old_hashes[prefix] == new_hashes[prefix]) {
+        prefix++;
+    }
+
+    int suffix = 0;
+    while(suffix < n_old - prefix && suffix < n_new - prefix && old_hashes[n_old - 1 - suffix] == new_hashes[n_new - 1 - suffix]) {
+        suffix++;
+    }
+
+    diff->first_changed = prefix;
+    diff->n_changed     = n_new - prefix - suffix;
+    diff->n_removed     = n_old - prefix - suffix;
+
+    if(diff->n_changed > 0) {
+        diff->first_line = new_program[prefix]->token.line_number;
+        diff->last_line  = new_program[prefix + diff->n_changed - 1]->token.line_number;
+    } else if(diff->n_removed > 0) {
+        diff->first_line = old_program[prefix]->token.line_number;
+        diff->last_line  = old_program[prefix + diff->n_removed - 1]->token.line_number;
+    }
+
+    struct symbol_set_entry *changed_symbols = NULL;
+
+    for(int i = prefix; i < prefix + diff->n_removed; i++) {
+        add_defined_symbols(&changed_symbols, old_program[i]);
+    }
+
+    arrsetlen(diff->affected, n_new);
+
+    for(int i = 0; i < n_new; i++) {
+        diff->affected[i] = i >= prefix && i < prefix + diff->n_changed;
+        if(diff->affected[i]) {
+            add_defined_symbols(&changed_symbols, new_program[i]);
+            diff->n_affected++;
+        }
+    }
+
+    bool added = hmlen(changed_symbols) > 0;
+
+    while(added) {
+        added = false;
+
+        for(int i = 0; i < n_new; i++) {
+            if(diff->affected[i]) continue;
+
+            for(int s = 0; s < hmlen(used[i]); s++) {
+                if(hmgeti(changed_symbols, used[i][s].key) != -1) {
+                    diff->affected[i] = true;
+                    diff->n_affected++;
+                    add_defined_symbols(&changed_symbols, new_program[i]);
+                    added = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for(int i = 0; i < n_new; i++) {
+        hmfree(used[i]);
+    }
+
+    hmfree(changed_symbols);
+    arrfree(used);
+    arrfree(old_hashes);
+    arrfree(new_hashes);
+}
+
+void free_program_diff(struct program_diff *diff) {
+    arrfree(diff->affected);
+}
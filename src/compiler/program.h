@@ -8,6 +8,24 @@ typedef ast **program;
 void print_program(program p);
 sds *program_to_string(program p);
 program copy_program(program src);
+program share_program(program src);
+ast *make_stmt_writable(program p, int index);
 void free_program(program src_program);
 
+// The statements of a new version of a program that differ from the old version. The programs are compared statement
+// by statement, with a hash of the contents of each statement (the lines where the statements are are not hashed)
+struct program_diff {
+    int first_changed;  // index of the first changed statement, in both programs
+    int n_changed;      // statements [first_changed, first_changed + n_changed) of the new program are new or changed
+    int n_removed;      // ... and replace this number of statements of the old program
+    uint32_t first_line;
+    uint32_t last_line; // first lines of the first and the last changed statements of the new program
+    bool *affected;     // stb array, one per statement of the new program. Changed or using a symbol of a changed one
+    int n_affected;
+};
+
+uint64_t hash_statement(const ast *a);
+void diff_programs(program old_program, program new_program, struct program_diff *diff);
+void free_program_diff(struct program_diff *diff);
+
 #endif //__PROGRAM_H
@@ -0,0 +1,220 @@
+#include "symbol_table.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The names are kept in blocks that never move, so symbol_name can be called without taking the lock.
+// The table is open addressing on the hash of the name, so the lookup reads the name straight from the source,
+// without copying it or terminating it first
+#define SYMBOL_BLOCK_SIZE 4096
+#define MAX_SYMBOL_BLOCKS 4096
+#define SYMBOL_NAMES_CHUNK_SIZE (64 * 1024)
+#define SYMBOL_TABLE_INITIAL_SIZE 1024
+
+struct symbol_t {
+    const char *name;
+    uint32_t len;
+};
+
+struct symbol_slot_t {
+    uint32_t hash;
+    symbol_id id;
+};
+
+static struct symbol_t *symbol_blocks[MAX_SYMBOL_BLOCKS];
+static symbol_id n_symbols = 0;
+
+static struct symbol_slot_t *slots = NULL;
+static uint32_t n_slots = 0;
+
+static char *names_chunk = NULL;
+static size_t names_chunk_used = 0;
+static size_t names_bytes = 0; //allocated for the copies of the names
+
+static pthread_mutex_t symbols_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t hash_name(const char *name, size_t len) {
+    //FNV-1a
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static const struct symbol_t *get_symbol(symbol_id id) {
+    return &symbol_blocks[id / SYMBOL_BLOCK_SIZE][id % SYMBOL_BLOCK_SIZE];
+}
+
+static char *copy_name(const char *name, size_t len) {
+
+    if(len + 1 > SYMBOL_NAMES_CHUNK_SIZE) {
+        char *copy = (char *) malloc(len + 1);
+        if(copy) {
+            names_bytes += len + 1;
+            memcpy(copy, name, len);
+            copy[len] = '\0';
+        }
+        return copy;
+    }
+
+    if(names_chunk == NULL || names_chunk_used + len + 1 > SYMBOL_NAMES_CHUNK_SIZE) {
+        names_chunk      = (char *) malloc(SYMBOL_NAMES_CHUNK_SIZE);
+        names_chunk_used = 0;
+        if(names_chunk == NULL) return NULL;
+        names_bytes += SYMBOL_NAMES_CHUNK_SIZE;
+    }
+
+    char *copy = names_chunk + names_chunk_used;
+    memcpy(copy, name, len);
+    copy[len] = '\0';
+    names_chunk_used += len + 1;
+
+    return copy;
+}
+
+static bool grow_table(void) {
+
+    uint32_t new_n_slots = n_slots ? n_slots * 2 : SYMBOL_TABLE_INITIAL_SIZE;
+
+    struct symbol_slot_t *new_slots = (struct symbol_slot_t *) calloc(new_n_slots, sizeof(struct symbol_slot_t));
+
+    if(new_slots == NULL) {
+        fprintf(stderr, "%s - Error allocating memory for the symbol table!\n", __FUNCTION__);
+        return false;
+    }
+
+    for(uint32_t i = 0; i < n_slots; i++) {
+        if(slots[i].id == NO_SYMBOL) continue;
+
+        uint32_t j = slots[i].hash & (new_n_slots - 1);
+        while(new_slots[j].id != NO_SYMBOL) {
+            j = (j + 1) & (new_n_slots - 1);
+        }
+        new_slots[j] = slots[i];
+    }
+
+    free(slots);
+    slots   = new_slots;
+    n_slots = new_n_slots;
+
+    return true;
+}
+
+static symbol_id add_symbol(const char *name, size_t len, uint32_t hash, uint32_t slot) {
+
+    symbol_id id   = n_symbols + 1;
+    uint32_t block = id / SYMBOL_BLOCK_SIZE;
+
+    if(block >= MAX_SYMBOL_BLOCKS) {
+        fprintf(stderr, "%s - Too many symbols!\n", __FUNCTION__);
+        return NO_SYMBOL;
+    }
+
+    if(symbol_blocks[block] == NULL) {
+        symbol_blocks[block] = (struct symbol_t *) calloc(SYMBOL_BLOCK_SIZE, sizeof(struct symbol_t));
+
+        if(symbol_blocks[block] == NULL) {
+            fprintf(stderr, "%s - Error allocating memory for the symbol names!\n", __FUNCTION__);
+            return NO_SYMBOL;
+        }
+    }
+
+    char *copy = copy_name(name, len);
+
+    if(copy == NULL) {
+        fprintf(stderr, "%s - Error allocating memory for the symbol names!\n", __FUNCTION__);
+        return NO_SYMBOL;
+    }
+
+    symbol_blocks[block][id % SYMBOL_BLOCK_SIZE] = (struct symbol_t) {copy, (uint32_t) len};
+    slots[slot] = (struct symbol_slot_t) {hash, id};
+    n_symbols   = id;
+
+    //keeps the load factor under 1/2
+    if(2 * n_symbols > n_slots) {
+        grow_table();
+    }
+
+    return id;
+}
+
+static symbol_id lookup_symbol(const char *name, size_t len, bool add) {
+
+    uint32_t hash = hash_name(name, len);
+    symbol_id id  = NO_SYMBOL;
+
+    pthread_mutex_lock(&symbols_lock);
+
+    if(slots == NULL && !grow_table()) {
+        pthread_mutex_unlock(&symbols_lock);
+        return NO_SYMBOL;
+    }
+
+    uint32_t i = hash & (n_slots - 1);
+
+    while(slots[i].id != NO_SYMBOL) {
+        if(slots[i].hash == hash) {
+            const struct symbol_t *s = get_symbol(slots[i].id);
+            if(s->len == len && memcmp(s->name, name, len) == 0) {
+                id = slots[i].id;
+                break;
+            }
+        }
+        i = (i + 1) & (n_slots - 1);
+    }
+
+    if(id == NO_SYMBOL && add) {
+        id = add_symbol(name, len, hash, i);
+    }
+
+    pthread_mutex_unlock(&symbols_lock);
+
+    return id;
+}
+
+symbol_id intern_symbol(const char *name, size_t len) {
+    return lookup_symbol(name, len, true);
+}
+
+// Returns NO_SYMBOL if the name was never interned, which means no program uses it
+symbol_id find_symbol(const char *name, size_t len) {
+    return lookup_symbol(name, len, false);
+}
+
+const char *symbol_name(symbol_id id) {
+
+    if(id == NO_SYMBOL) return NULL;
+
+    return get_symbol(id)->name;
+}
+
+// x' -> x
+symbol_id get_ode_base_symbol(symbol_id ode_symbol) {
+
+    if(ode_symbol == NO_SYMBOL) return NO_SYMBOL;
+
+    const struct symbol_t *s = get_symbol(ode_symbol);
+
+    if(s->len < 2 || s->name[s->len - 1] != '\'') return NO_SYMBOL;
+
+    return intern_symbol(s->name, s->len - 1);
+}
+
+// Number of interned symbols and the bytes used by the table, the symbols and their names
+size_t get_symbol_table_size(size_t *n_bytes) {
+
+    pthread_mutex_lock(&symbols_lock);
+
+    size_t n_blocks = n_symbols / SYMBOL_BLOCK_SIZE + 1;
+    *n_bytes        = n_slots * sizeof(struct symbol_slot_t) + names_bytes + (n_symbols ? n_blocks * SYMBOL_BLOCK_SIZE * sizeof(struct symbol_t) : 0);
+    size_t n        = n_symbols;
+
+    pthread_mutex_unlock(&symbols_lock);
+
+    return n;
+}
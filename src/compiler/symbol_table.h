@@ -0,0 +1,20 @@
+#ifndef __SYMBOL_TABLE_H
+#define __SYMBOL_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Identifiers are interned when they are lexed: each distinct name gets a small integer id and one copy of the name,
+// shared by all the programs of the process. The compiler and the converter symbol tables are keyed on these ids.
+// Ids and names are never released.
+typedef uint32_t symbol_id;
+
+#define NO_SYMBOL 0
+
+symbol_id intern_symbol(const char *name, size_t len);
+symbol_id find_symbol(const char *name, size_t len);
+const char *symbol_name(symbol_id id);
+symbol_id get_ode_base_symbol(symbol_id ode_symbol);
+size_t get_symbol_table_size(size_t *n_bytes);
+
+#endif /* __SYMBOL_TABLE_H */
@@ -5,6 +5,7 @@ void copy_token(token *dest, const token *src) {
 
     dest->type = src->type;
     dest->line_number = src->line_number;
+    dest->symbol = src->symbol;
 
     if(src->literal) {
         dest->literal = strndup(src->literal, src->literal_len);
@@ -23,6 +24,7 @@ token new_token(token_type type, char *ch, uint32_t len, uint32_t line, const ch
     t.file_name = file_name;
     t.literal = ch;
     t.literal_len = len;
+    t.symbol = NO_SYMBOL;
     return t;
 }
 #ifdef DEBUG_INFO
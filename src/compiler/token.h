@@ -8,13 +8,15 @@
 #define TOKEN_TYPE_NOT_EQUALS(t1, t2) ((t1).type != t2)
 
 #include "token_enum.h"
+#include "symbol_table.h"
 #include <stdbool.h>
 #include <stdint.h>
 
 typedef struct token_t {
     token_type type;
-    char *literal;
+    char *literal; //points into the source, it is not NUL terminated
     uint32_t literal_len;
+    symbol_id symbol; //set for identifiers
     uint32_t line_number;
     const char *file_name;
 } token;
@@ -1,5 +1,7 @@
 #include "gnuplot_utils.h"
 #include "file_utils/file_utils.h"
+#include "stb/stb_ds.h"
+#include "timing.h"
 #include <unistd.h>
 #include <string.h>
 #include <sys/wait.h>
@@ -44,6 +46,15 @@ static bool check_sixel_support() {
 void gnuplot_cmd(struct popen2 *handle, char const *cmd, ...) {
     va_list ap;
 
+    double start = begin_stage();
+
+    //the datablocks of the plots freed since the last command are only memory in gnuplot
+    unsigned int *released = take_released_plot_ids();
+    for(int i = 0; i < arrlen(released); i++) {
+        dprintf(handle->to_child, "undefine $ode_plot_%u\n", released[i]);
+    }
+    arrfree(released);
+
     va_start(ap, cmd);
     vdprintf(handle->to_child, cmd, ap);
     va_end(ap);
@@ -54,6 +65,25 @@ void gnuplot_cmd(struct popen2 *handle, char const *cmd, ...) {
     char msg[20];
     read(handle->from_child, msg, 20);
 
+    end_stage(STAGE_GNUPLOT, start);
+
+}
+
+//Defines (or redefines) the datablock $ode_plot_<id> holding the decimated points. It is undefined when the plot is freed
+void gnuplot_send_datablock(struct popen2 *handle, struct decimated_plot *plot) {
+
+    sds block = sdscatfmt(sdsempty(), "$ode_plot_%u << EOD\n", plot->id);
+
+    for(size_t i = 0; i < plot->n_points; i++) {
+        block = sdscatprintf(block, "%.17g %.17g\n", plot->x[i], plot->y[i]);
+    }
+
+    block = sdscat(block, "EOD");
+
+    gnuplot_cmd(handle, "%s", block);
+    sdsfree(block);
+
+    plot->in_gnuplot = true;
 }
 
 void reset_terminal(struct popen2 *handle) {
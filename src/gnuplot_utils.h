@@ -1,6 +1,8 @@
 #include <stdbool.h>
 #include "ode_shell.h"
+#include "plot_decimation.h"
 
 void gnuplot_cmd(struct popen2 *handle, char const *cmd, ...);
 void reset_terminal(struct popen2 *handle);
+void gnuplot_send_datablock(struct popen2 *handle, struct decimated_plot *plot);
 bool check_gnuplot_and_set_default_terminal(struct shell_variables *shell_state);
@@ -88,7 +88,6 @@ _Noreturn void *check_for_model_file_changes(void *args) {
                     if (event->mask & IN_ISDIR) {
                     } else {
                         maybe_reload_from_file_change(shell_state, event);
-						break;
                     }
                 }
             }
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #ifdef __linux__
 #include <linux/limits.h>
 #endif
@@ -11,11 +12,22 @@
 #include "file_utils/file_utils.h"
 #include "md5/md5.h"
 #include "code_converter.h"
+#include "build_cache.h"
+#include "timing.h"
 
 #define MODEL_OUTPUT_TEMPLATE "/tmp/%s_%i_out.txt"
 #define COMPILED_MODEL_NAME_TEMPLATE "/tmp/%s_auto_compiled_model_tmp_file"
+#define SWEEP_MODEL_NAME_TEMPLATE "/tmp/%s_sweep_model_tmp_file"
+#define PROFILE_MODEL_NAME_TEMPLATE "/tmp/%s_profile_model_tmp_file"
 #define COMPILE_FILE_TEMPLATE "/tmp/%s_XXXXXX.c"
 #define C_COMPILER "gcc"
+#define LINK_FLAGS "-lm -lpthread"
+
+#ifdef DEBUG_INFO
+#define COMPILER_FLAGS "-g3"
+#else
+#define COMPILER_FLAGS "-O2"
+#endif
 
 static bool check_and_print_execution_errors(FILE *fp) {
     bool error = false;
@@ -43,6 +55,11 @@ sds get_model_output_file(struct model_config *model_config, unsigned int run_nu
     return model_out_file;
 }
 
+sds get_model_stats_file(struct model_config *model_config, unsigned int run_number) {
+    sds stats_file = get_model_output_file(model_config, run_number);
+    return sdscat(stats_file, RUN_STATS_FILE_SUFFIX);
+}
+
 //TODO: do not substitute model program if we fail to compile
 bool generate_model_program(struct model_config *model) {
 
@@ -59,7 +76,9 @@ bool generate_model_program(struct model_config *model) {
 
     lexer *l = new_lexer(source, file_name);
     parser *p = new_parser(l);
+    double start    = begin_stage();
     program program = parse_program_without_exiting_on_error(p, true, true, NULL);
+    end_stage(STAGE_PARSE, start);
 
     if(program) {
         shfree(model->var_indexes);
@@ -82,7 +101,17 @@ bool generate_model_program(struct model_config *model) {
 
             }
         }
+
+        //recorded intermediates are written after the ODEs
+        int n_rec = arrlen(model->recorded_vars);
+        for(int i = 0; i < n_rec; i++) {
+            shput(model->var_indexes, model->recorded_vars[i], ode_count);
+            ode_count++;
+        }
+
         model->program = program;
+
+        index_model_symbols(model);
     }
 
     munmap(source, file_size);
@@ -99,6 +128,24 @@ bool generate_model_program(struct model_config *model) {
 
 }
 
+//configs allocated with new_model_config and not freed yet: the loaded models and the generations being built
+static unsigned int live_model_configs = 0;
+
+struct model_config *new_model_config(void) {
+
+    struct model_config *model_config = calloc(1, sizeof(struct model_config));
+
+    if(model_config) {
+        __atomic_add_fetch(&live_model_configs, 1, __ATOMIC_RELAXED);
+    }
+
+    return model_config;
+}
+
+unsigned int get_live_model_configs(void) {
+    return __atomic_load_n(&live_model_configs, __ATOMIC_RELAXED);
+}
+
 struct model_config *new_config_from_parent(struct model_config *parent_model_config) {
 
     parent_model_config->version++;
@@ -106,7 +153,7 @@ struct model_config *new_config_from_parent(struct model_config *parent_model_co
     sds new_model_name = sdsnew(parent_model_config->model_name);
     new_model_name     = sdscatfmt(new_model_name, "_v%i", parent_model_config->version);
 
-    struct model_config *model_config = calloc(1, sizeof(struct model_config));
+    struct model_config *model_config = new_model_config();
 
     if(model_config == NULL) {
         fprintf(stderr, "%s - Error allocating memory for the new model config!\n", __FUNCTION__);
@@ -123,7 +170,15 @@ struct model_config *new_config_from_parent(struct model_config *parent_model_co
     model_config->plot_config.ylabel = strdup(parent_model_config->plot_config.ylabel);
     model_config->plot_config.title = strdup(parent_model_config->plot_config.title);
 
-    model_config->program = copy_program(parent_model_config->program);
+    //statements are copied on write by the commands that change the new version
+    model_config->program = share_program(parent_model_config->program);
+
+    for(int i = 0; i < arrlen(parent_model_config->recorded_vars); i++) {
+        arrput(model_config->recorded_vars, strdup(parent_model_config->recorded_vars[i]));
+    }
+
+    sh_new_arena(model_config->var_indexes);
+    shdefault(model_config->var_indexes, -1);
 
     int n = shlen(parent_model_config->var_indexes);
 
@@ -131,26 +186,112 @@ struct model_config *new_config_from_parent(struct model_config *parent_model_co
         shput(model_config->var_indexes,parent_model_config->var_indexes[i].key, parent_model_config->var_indexes[i].value);
     }
 
+    index_model_symbols(model_config);
+
     sdsfree(new_model_name);
 
     return model_config;
 }
 
-void free_model_config(struct model_config *model_config) {
+static unsigned int last_generation = 0;
 
-    if(model_config == NULL) return;
+// The next generation of a model is built from its file in a separate config, so the model can still be used while the
+// new program is parsed and compiled. Only the name, the file and the recorded variables are taken from the model.
+// Generations are unique in the process, so two builds of the same model never share an executable
+struct model_config *new_model_generation(struct model_config *model_config) {
+
+    struct model_config *next = new_model_config();
+
+    if(next == NULL) {
+        fprintf(stderr, "%s - Error allocating memory for the new model generation!\n", __FUNCTION__);
+        return NULL;
+    }
+
+    next->model_name = strdup(model_config->model_name);
+    next->model_file = strdup(model_config->model_file);
+    next->generation = __atomic_add_fetch(&last_generation, 1, __ATOMIC_RELAXED);
+
+    for(int i = 0; i < arrlen(model_config->recorded_vars); i++) {
+        arrput(next->recorded_vars, strdup(model_config->recorded_vars[i]));
+    }
+
+    return next;
+}
+
+#define SWAP(type, a, b) do { type tmp__ = (a); (a) = (b); (b) = tmp__; } while(0)
+
+// Swaps in the program of next and, when next was compiled, its executable. The model keeps its runs and settings and
+// next is left with what it replaced, to be freed with free_model_config
+void swap_model_generation(struct model_config *model_config, struct model_config *next) {
+
+    SWAP(program, model_config->program, next->program);
+    SWAP(struct var_index_hash_entry *, model_config->var_indexes, next->var_indexes);
+    SWAP(char **, model_config->var_names, next->var_names);
+
+    for(int k = 0; k < N_SYMBOL_KINDS; k++) {
+        SWAP(struct var_index_hash_entry *, model_config->statements[k], next->statements[k]);
+    }
+
+    memcpy(model_config->hash, next->hash, sizeof(model_config->hash));
+    model_config->generation = next->generation;
+
+    if(next->is_compiled) {
+        SWAP(sds, model_config->model_command, next->model_command);
+        memcpy(model_config->build_key, next->build_key, sizeof(model_config->build_key));
+        model_config->has_build_key = next->has_build_key;
+        model_config->is_compiled   = true;
+    }
+}
+
+#undef SWAP
+
+//Releases the runs of a model and removes their output files
+void free_model_runs(struct model_config *model_config) {
+
+    for(unsigned int r = 1; r <= model_config->num_runs; r++) {
+
+        struct run_info *run_info = &model_config->runs[r - 1];
+
+        free(run_info->filename);
+        free(run_info->vars_stats);
+        free(run_info->solver_stats);
 
-    for(unsigned int r = 0; r < model_config->num_runs; r++) {
+        for(int p = 0; p < arrlen(run_info->params); p++) {
+            free(run_info->params[p].name);
+        }
+        arrfree(run_info->params);
+
+        for(int p = 0; p < arrlen(run_info->plot_cache); p++) {
+            free_decimated_plot(&run_info->plot_cache[p]);
+        }
+        arrfree(run_info->plot_cache);
 
-        free(model_config->runs[r].filename);
-        free(model_config->runs[r].vars_max_value);
-        free(model_config->runs[r].vars_min_value);
+        close_run_columns(run_info->columns);
 
         sds out = get_model_output_file(model_config, r);
         unlink(out);
+
+        sds aux = sdscat(sdsdup(out), RUN_STATS_FILE_SUFFIX);
+        unlink(aux);
+        sdsfree(aux);
+
+        aux = sdscat(sdsdup(out), RUN_COLUMNS_FILE_SUFFIX);
+        unlink(aux);
+        sdsfree(aux);
+
         sdsfree(out);
     }
 
+    arrfree(model_config->runs);
+    model_config->num_runs = 0;
+}
+
+void free_model_config(struct model_config *model_config) {
+
+    if(model_config == NULL) return;
+
+    free_model_runs(model_config);
+
     if(model_config->model_command) {
         unlink(model_config->model_command);
     }
@@ -163,58 +304,243 @@ void free_model_config(struct model_config *model_config) {
 
     sdsfree(model_config->model_command);
     free_program(model_config->program);
-    arrfree(model_config->runs);
 
     shfree(model_config->var_indexes);
+    arrfree(model_config->var_names);
+
+    for(int k = 0; k < N_SYMBOL_KINDS; k++) {
+        shfree(model_config->statements[k]);
+    }
+
+    for(int i = 0; i < arrlen(model_config->recorded_vars); i++) {
+        free(model_config->recorded_vars[i]);
+    }
+    arrfree(model_config->recorded_vars);
 
     free(model_config);
+
+    __atomic_sub_fetch(&live_model_configs, 1, __ATOMIC_RELAXED);
 }
 
-char *get_var_name(struct model_config *model_config, int index) {
+static uint64_t get_file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t) st.st_size : 0;
+}
+
+// Size of the output of a run and of its statistics and columns sidecars
+uint64_t get_run_output_size(struct model_config *model_config, unsigned int run_number) {
 
-    struct var_index_hash_entry *var_indexes = model_config->var_indexes;
+    static const char *suffixes[] = {"", RUN_STATS_FILE_SUFFIX, RUN_COLUMNS_FILE_SUFFIX};
 
-    int len = shlen(var_indexes);
+    sds output_file = get_model_output_file(model_config, run_number);
+    uint64_t size   = 0;
 
-    for(int i = 0; i < len; i++) {
-        if(var_indexes[i].value == index)
-            return var_indexes[i].key;
+    for(size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]); s++) {
+        sds file = sdscat(sdsdup(output_file), suffixes[s]);
+        size += get_file_size(file);
+        sdsfree(file);
     }
 
-    return NULL;
+    sdsfree(output_file);
 
+    return size;
 }
 
-bool compile_model(struct model_config *model_config) {
+// Memory held by the runs of a model: statistics, parameters and decimated plots. The mapped columns are not included
+static size_t get_run_memory(const struct run_info *run_info, size_t n_stats, size_t *mapped_bytes) {
+
+    size_t size = 0;
+
+    if(run_info->filename) size += strlen(run_info->filename) + 1;
+    if(run_info->vars_stats) size += n_stats * sizeof(struct var_stats);
+    if(run_info->solver_stats) size += sizeof(struct solver_stats);
+
+    for(int p = 0; p < arrlen(run_info->params); p++) {
+        size += sizeof(struct run_param) + strlen(run_info->params[p].name) + 1;
+    }
+
+    for(int p = 0; p < arrlen(run_info->plot_cache); p++) {
+        size += sizeof(struct decimated_plot) + 2 * run_info->plot_cache[p].n_points * sizeof(double);
+    }
+
+    if(run_info->columns) {
+        *mapped_bytes += run_info->columns->map_size;
+    }
+
+    return size;
+}
+
+static size_t get_name_table_size(struct var_index_hash_entry *table) {
+
+    size_t size = 0;
+
+    for(int i = 0; i < shlen(table); i++) {
+        size += sizeof(struct var_index_hash_entry) + strlen(table[i].key) + 1;
+    }
+
+    return size;
+}
+
+// The statements shared with other versions of the model (see share_program) are counted by each version and also
+// added to shared_ast_bytes
+void get_model_memory(struct model_config *model_config, struct model_memory *memory) {
+
+    memset(memory, 0, sizeof(struct model_memory));
+
+    for(int i = 0; i < arrlen(model_config->program); i++) {
+
+        size_t n_nodes = 0, n_bytes = 0;
+        add_ast_memory(model_config->program[i], &n_nodes, &n_bytes);
+
+        memory->ast_nodes += n_nodes;
+        memory->ast_bytes += n_bytes;
+
+        if(__atomic_load_n(&model_config->program[i]->ref_count, __ATOMIC_RELAXED) > 1) {
+            memory->shared_ast_bytes += n_bytes;
+        }
+    }
+
+    memory->n_symbols    = shlen(model_config->var_indexes);
+    memory->symbol_bytes = get_name_table_size(model_config->var_indexes) + arrlen(model_config->var_names) * sizeof(char *);
+
+    for(int k = 0; k < N_SYMBOL_KINDS; k++) {
+        memory->n_symbols += shlen(model_config->statements[k]);
+        memory->symbol_bytes += get_name_table_size(model_config->statements[k]);
+    }
+
+    size_t n_stats = shlen(model_config->var_indexes) > 0 ? shlen(model_config->var_indexes) - 1 : 0;
+
+    for(unsigned int r = 1; r <= model_config->num_runs; r++) {
+        memory->runs_bytes += get_run_memory(&model_config->runs[r - 1], n_stats, &memory->mapped_bytes);
+        memory->output_size += get_run_output_size(model_config, r);
+    }
+
+    if(model_config->model_command) {
+        memory->binary_size = get_file_size(model_config->model_command);
+    }
+}
+
+int get_symbol_kind(ast_tag tag) {
+    switch(tag) {
+        case ast_assignment_stmt:
+            return SYMBOL_PARAM;
+        case ast_global_stmt:
+            return SYMBOL_GLOBAL;
+        case ast_initial_stmt:
+            return SYMBOL_INITIAL;
+        case ast_ode_stmt:
+            return SYMBOL_ODE;
+        default:
+            return -1;
+    }
+}
+
+// Builds the tables that the commands use to find the statements by name and the variables by column without scanning
+// the model. Called whenever the program or var_indexes of the model are replaced
+void index_model_symbols(struct model_config *model_config) {
+
+    for(int k = 0; k < N_SYMBOL_KINDS; k++) {
+        shfree(model_config->statements[k]);
+        sh_new_arena(model_config->statements[k]);
+        shdefault(model_config->statements[k], -1);
+    }
+
+    int n_stmt = arrlen(model_config->program);
+
+    for(int i = 0; i < n_stmt; i++) {
+        ast *a   = model_config->program[i];
+        int kind = get_symbol_kind(a->tag);
+
+        //the first statement that defines a name is the one the commands change
+        if(kind != -1 && shgeti(model_config->statements[kind], a->assignment_stmt.name->identifier.value) == -1) {
+            shput(model_config->statements[kind], a->assignment_stmt.name->identifier.value, i);
+        }
+    }
+
+    int n_vars    = shlen(model_config->var_indexes);
+    int max_index = 0;
+
+    for(int i = 0; i < n_vars; i++) {
+        if(model_config->var_indexes[i].value > max_index) max_index = model_config->var_indexes[i].value;
+    }
+
+    arrfree(model_config->var_names);
+    arrsetlen(model_config->var_names, max_index + 1);
+    memset(model_config->var_names, 0, sizeof(char *) * (max_index + 1));
+
+    for(int i = 0; i < n_vars; i++) {
+        if(model_config->var_indexes[i].value >= 0) {
+            model_config->var_names[model_config->var_indexes[i].value] = model_config->var_indexes[i].key;
+        }
+    }
+}
+
+// Returns the position in the program of the statement with the given tag that defines name, or -1
+int get_statement_index(struct model_config *model_config, ast_tag tag, const char *name) {
+
+    int kind = get_symbol_kind(tag);
+
+    if(kind == -1 || model_config->statements[kind] == NULL) return -1;
+
+    return shget(model_config->statements[kind], name);
+}
+
+char *get_var_name(struct model_config *model_config, int index) {
+
+    if(index < 0 || index >= arrlen(model_config->var_names)) {
+        return NULL;
+    }
+
+    return model_config->var_names[index];
+}
+
+// build_key is set to the build cache key of the executable when has_build_key is true
+static bool compile_model_executable(struct model_config *model_config, solver_config *config, const char *executable, uint8_t build_key[16],
+                                     bool *has_build_key) {
+
+    *has_build_key = false;
 
     sds modified_model_name = sdsnew(model_config->model_name);
     modified_model_name = sdsmapchars(modified_model_name, "/", ".", 1);
 
-    sdsfree(model_config->model_command);
-    model_config->model_command = sdscatfmt(sdsempty(), COMPILED_MODEL_NAME_TEMPLATE, modified_model_name);
-
     sds compiled_file = sdscatfmt(sdsempty(), COMPILE_FILE_TEMPLATE, modified_model_name);
 
     int fd = mkstemps(compiled_file, 2);
 
     FILE *outfile = fdopen(fd, "w");
-    bool error = convert_to_c(model_config->program, outfile, EULER_ADPT_SOLVER);
+    config->solver_type   = EULER_ADPT_SOLVER;
+    config->recorded_vars = model_config->recorded_vars;
+
+    double start = begin_stage();
+    bool error   = convert_to_c_with_config(model_config->program, outfile, config);
     fclose(outfile);
+    end_stage(STAGE_CONVERT, start);
 
     if(!error) {
 
-        sds compiler_command = sdsnew(C_COMPILER);
-#ifdef DEBUG_INFO
-        compiler_command = sdscatfmt(compiler_command, " -g3 %s -o %s -lm", compiled_file, model_config->model_command);
-#else
-        compiler_command = sdscatfmt(compiler_command, " -O2 %s -o %s -lm", compiled_file, model_config->model_command);
-#endif
-        FILE *fp = popen(compiler_command, "r");
-        error = check_and_print_execution_errors(fp);
+        start = begin_stage();
+
+        bool has_key   = get_build_cache_key(compiled_file, C_COMPILER, COMPILER_FLAGS " " LINK_FLAGS, build_key);
+        *has_build_key = has_key;
+
+        if(!has_key || !fetch_from_build_cache(build_key, executable)) {
+            sds compiler_command = sdscatfmt(sdsempty(), "%s %s %s -o %s %s", C_COMPILER, COMPILER_FLAGS, compiled_file, executable, LINK_FLAGS);
+
+            FILE *fp = popen(compiler_command, "r");
+            error = check_and_print_execution_errors(fp);
+            pclose(fp);
+
+            if(!error && has_key) {
+                store_in_build_cache(build_key, executable);
+            }
+
+            sdsfree(compiler_command);
+        }
+
+        //taking the executable from the build cache is also counted as compiling
+        end_stage(STAGE_COMPILE, start);
 
-        pclose(fp);
         unlink(compiled_file);
-        sdsfree(compiler_command);
     }
 
     //Clean
@@ -224,3 +550,94 @@ bool compile_model(struct model_config *model_config) {
     return error;
 
 }
+
+static sds get_model_executable(struct model_config *model_config) {
+
+    sds modified_model_name = sdsnew(model_config->model_name);
+    modified_model_name = sdsmapchars(modified_model_name, "/", ".", 1);
+
+    sds executable = sdscatfmt(sdsempty(), COMPILED_MODEL_NAME_TEMPLATE, modified_model_name);
+    sdsfree(modified_model_name);
+
+    //each generation has its own executable, so the previous one can still be run while the new one is compiled
+    if(model_config->generation > 0) {
+        executable = sdscatfmt(executable, "_g%u", model_config->generation);
+    }
+
+    return executable;
+}
+
+bool compile_model(struct model_config *model_config) {
+
+    sdsfree(model_config->model_command);
+    model_config->model_command = get_model_executable(model_config);
+
+    solver_config config = {0};
+
+    bool error = compile_model_executable(model_config, &config, model_config->model_command, model_config->build_key, &model_config->has_build_key);
+    model_config->is_compiled = !error;
+
+    return error;
+}
+
+// For models restored with their build key (e.g., from a session) the executable is taken from the build cache. It is
+// compiled only when the cache does not have it anymore
+bool restore_model_executable(struct model_config *model_config) {
+
+    if(model_config->has_build_key) {
+
+        sds executable = get_model_executable(model_config);
+
+        if(fetch_from_build_cache(model_config->build_key, executable)) {
+            sdsfree(model_config->model_command);
+            model_config->model_command = executable;
+            model_config->is_compiled   = true;
+            return false;
+        }
+
+        sdsfree(executable);
+    }
+
+    return compile_model(model_config);
+}
+
+// Executables compiled with other options than the one of the model, named after executable_template
+static sds compile_model_variant(struct model_config *model_config, solver_config *config, const char *executable_template) {
+
+    sds modified_model_name = sdsnew(model_config->model_name);
+    modified_model_name = sdsmapchars(modified_model_name, "/", ".", 1);
+
+    sds executable = sdscatfmt(sdsempty(), executable_template, modified_model_name);
+    sdsfree(modified_model_name);
+
+    uint8_t build_key[16];
+    bool has_build_key;
+
+    if(compile_model_executable(model_config, config, executable, build_key, &has_build_key)) {
+        unlink(executable);
+        sdsfree(executable);
+        return NULL;
+    }
+
+    return executable;
+}
+
+// Compiles a separate executable where the given parameters are read from the command line as name=value, so all the
+// points of a sweep run without recompiling. Returns the path of the executable or NULL on errors
+sds compile_model_with_runtime_params(struct model_config *model_config, char **runtime_params) {
+
+    solver_config config  = {0};
+    config.runtime_params = runtime_params;
+
+    return compile_model_variant(model_config, &config, SWEEP_MODEL_NAME_TEMPLATE);
+}
+
+// Compiles a separate executable that also samples the statement of the RHS being run (see RUN_PROFILE_FILE_SUFFIX).
+// Returns the path of the executable or NULL on errors
+sds compile_model_for_profiling(struct model_config *model_config) {
+
+    solver_config config      = {0};
+    config.profile_statements = true;
+
+    return compile_model_variant(model_config, &config, PROFILE_MODEL_NAME_TEMPLATE);
+}
@@ -2,6 +2,8 @@
 #define __MODEL_CONFIG_H
 
 #include "compiler/parser.h"
+#include "plot_decimation.h"
+#include "run_query.h"
 #include <stdint.h>
 
 struct var_index_hash_entry {
@@ -17,12 +19,76 @@ struct plot_config {
     int yindex;
 };
 
+struct var_stats {
+    double min;
+    double min_time;
+    double max;
+    double max_time;
+    double mean;
+    double variance;
+    double integral;
+};
+
+// Counters of the integration written by the solver. The times are estimated by sampling (see SOLVER_SAMPLING_INTERVAL_US)
+struct solver_stats {
+    uint32_t solver_type;
+    uint64_t rhs_evals;
+    uint64_t accepted_steps;
+    uint64_t rejected_steps;
+    uint64_t lin_solv_setups;
+    uint64_t time_samples;
+    double min_dt;
+    double mean_dt;
+    double max_dt;
+    double rhs_time;
+    double output_time;
+    double total_time;
+};
+
+struct run_param {
+    char *name;
+    double value;
+};
+
+enum run_cache_status {
+    RUN_NOT_CACHED,
+    RUN_CACHE_MISS,
+    RUN_CACHE_HIT
+};
+
 struct run_info {
     char *filename;
-    double *vars_max_value;
-    double *vars_min_value;
+    struct run_param *params; //parameter values set for this run (e.g., by a sweep)
+    struct var_stats *vars_stats;
+    struct solver_stats *solver_stats;
+    uint64_t num_samples;
+    struct decimated_plot *plot_cache;
+    struct run_columns *columns;
     bool saved;
     double time;
+    enum run_cache_status cache_status; //whether the output was taken from the result cache
+};
+
+// Kinds of the named statements of a model, indexed in model_config->statements
+enum symbol_kind {
+    SYMBOL_PARAM,
+    SYMBOL_GLOBAL,
+    SYMBOL_INITIAL,
+    SYMBOL_ODE,
+    N_SYMBOL_KINDS
+};
+
+// Memory and disk used by a loaded model, see get_model_memory
+struct model_memory {
+    size_t ast_nodes;
+    size_t ast_bytes;
+    size_t shared_ast_bytes; //statements also referenced by other versions of the model
+    size_t n_symbols;
+    size_t symbol_bytes;     //name tables of the model (var_indexes, var_names and statements)
+    size_t runs_bytes;       //statistics, parameters and decimated plots of the runs
+    size_t mapped_bytes;     //columns of the runs mapped by the queries
+    uint64_t binary_size;
+    uint64_t output_size;    //outputs of the runs and their sidecars
 };
 
 struct model_config {
@@ -31,15 +97,23 @@ struct model_config {
     sds   model_command;
     unsigned int version;
     unsigned int num_runs;
+    unsigned int running_jobs;
     struct run_info *runs;
     program program;
     struct var_index_hash_entry *var_indexes;
+    char **var_names; //name of each output column (the inverse of var_indexes), built by index_model_symbols
+    struct var_index_hash_entry *statements[N_SYMBOL_KINDS]; //position in program of each statement by name, built by index_model_symbols
+    char **recorded_vars;
     struct plot_config plot_config;
     bool is_derived;
     bool should_reload;
     bool auto_reload;
     int notify_code;
     uint8_t hash[16];
+    uint8_t build_key[16]; //build cache key of model_command, also used to find its cached solve results
+    bool has_build_key;
+    bool is_compiled; //model_command was built from the current program
+    unsigned int generation; //build that the last reload swapped in (see new_model_generation), 0 for the loaded one
 };
 
 
@@ -58,9 +132,23 @@ struct model_config {
 
 
 struct model_config *new_config_from_parent(struct model_config *parent_model_config);
+int get_symbol_kind(ast_tag tag);
+void index_model_symbols(struct model_config *model_config);
+int get_statement_index(struct model_config *model_config, ast_tag tag, const char *name);
 char *get_var_name(struct model_config *model_config, int index);
 void free_model_config(struct model_config *model_config);
+void free_model_runs(struct model_config *model_config);
 bool generate_model_program(struct model_config *model);
 sds get_model_output_file(struct model_config *model_config, unsigned int run_number);
+sds get_model_stats_file(struct model_config *model_config, unsigned int run_number);
 bool compile_model(struct model_config *model_config);
+bool restore_model_executable(struct model_config *model_config);
+struct model_config *new_model_generation(struct model_config *model_config);
+void swap_model_generation(struct model_config *model_config, struct model_config *next);
+sds compile_model_with_runtime_params(struct model_config *model_config, char **runtime_params);
+sds compile_model_for_profiling(struct model_config *model_config);
+struct model_config *new_model_config(void);
+unsigned int get_live_model_configs(void);
+uint64_t get_run_output_size(struct model_config *model_config, unsigned int run_number);
+void get_model_memory(struct model_config *model_config, struct model_memory *memory);
 #endif /* __MODEL_CONFIG_H */
@@ -0,0 +1,644 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "compiler/import_cache.h"
+#include "compiler/parser.h"
+#include "code_converter.h"
+#include "pipe_utils.h"
+#include "string_utils.h"
+#include "timing.h"
+#include "file_utils/file_utils.h"
+#include "libfort/src/fort.h"
+#include "stb/stb_ds.h"
+#include <argp.h>
+
+// The executables are built as the shell builds them (see compile_model)
+#define C_COMPILER "gcc"
+#define COMPILER_FLAGS "-O2"
+#define LINK_FLAGS "-lm -lpthread"
+#define CVODE_LINK_FLAGS "-lsundials_cvode -lsundials_nvecserial -lsundials_sunlinsoldense -lsundials_sunmatrixdense"
+
+#define BENCH_FILE_TEMPLATE "/tmp/%s_%s_%d_bench"
+#define BENCH_RESULTS_VERSION 1
+
+const char *argp_program_version = "odebench 0.1";
+const char *argp_program_bug_address = "<rsachetto@gmail.com>";
+
+static char doc[] = "Measures each stage of the pipeline (parsing, checks, conversion, build and solve) for the models of a directory.";
+
+static char args_doc[] = "";
+
+static struct argp_option options[] = {
+    {"dir",         'd', "DIR",   0, "Directory with the .ode models. Default: examples", 0},
+    {"runs",        'n', "N",     0, "Number of measured runs of each model. Default: 5", 0},
+    {"warmup",      'w', "N",     0, "Number of runs of each model before measuring. Default: 1", 0},
+    {"end-time",    'e', "TIME",  0, "Final time of the solves. Default: 100", 0},
+    {"output",      'o', "FILE",  0, "Write the results as JSON to FILE", 0},
+    {"baseline",    'b', "FILE",  0, "Compare the medians with the results of a previous run in FILE", 0},
+    {"threshold",   't', "PCT",   0, "Slowdown (in percent) over the baseline reported as a regression. Default: 10", 0},
+    {"min-delta",   'm', "MS",    0, "Slowdowns smaller than MS milliseconds are not regressions. Default: 0.1", 0},
+    {"cvode-flags", 'c', "FLAGS", 0, "Link flags of the CVODE executables. Default: " CVODE_LINK_FLAGS, 0},
+    { 0 }
+};
+
+struct arguments {
+    char *dir;
+    char *output_file;
+    char *baseline_file;
+    char *cvode_flags;
+    long n_runs;
+    long n_warmup;
+    double end_time;
+    double threshold;
+    double min_delta;
+};
+
+enum bench_stage {
+    BENCH_PARSE,
+    BENCH_CHECK,
+    BENCH_CONVERT_EULER,
+    BENCH_CONVERT_CVODE,
+    BENCH_BUILD_EULER,
+    BENCH_BUILD_CVODE,
+    BENCH_SOLVE_EULER,
+    BENCH_SOLVE_CVODE,
+    N_BENCH_STAGES
+};
+
+static const char *bench_stage_names[N_BENCH_STAGES] = {"parse", "check", "convert_euler", "convert_cvode",
+                                                        "build_euler", "build_cvode", "solve_euler", "solve_cvode"};
+
+// The stages of each solver are consecutive in enum bench_stage, euler first
+#define N_SOLVERS 2
+static const solver_type bench_solvers[N_SOLVERS] = {EULER_ADPT_SOLVER, CVODE_SOLVER};
+static const char *bench_solver_names[N_SOLVERS]  = {"euler", "cvode"};
+
+struct model_bench {
+    sds name;
+    sds path;
+    double *times[N_BENCH_STAGES]; //stb arrays, one time (in seconds) per measured run
+    double median[N_BENCH_STAGES];
+    double variance[N_BENCH_STAGES];
+    bool failed;
+};
+
+struct baseline_entry {
+    sds model;
+    int stage;
+    double median;
+};
+
+static double parse_number_option(const char *arg, struct argp_state *state, const char *option) {
+    char *end;
+    double value = strtod(arg, &end);
+
+    if(*arg == '\0' || *end != '\0' || value < 0) {
+        argp_error(state, "invalid value for %s: %s", option, arg);
+    }
+
+    return value;
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+
+    struct arguments *arguments = state->input;
+
+    switch(key) {
+        case 'd':
+            arguments->dir = arg;
+            break;
+        case 'n':
+            arguments->n_runs = (long) parse_number_option(arg, state, "--runs");
+            if(arguments->n_runs < 1) {
+                argp_error(state, "at least one run is needed");
+            }
+            break;
+        case 'w':
+            arguments->n_warmup = (long) parse_number_option(arg, state, "--warmup");
+            break;
+        case 'e':
+            arguments->end_time = parse_number_option(arg, state, "--end-time");
+            break;
+        case 'o':
+            arguments->output_file = arg;
+            break;
+        case 'b':
+            arguments->baseline_file = arg;
+            break;
+        case 't':
+            arguments->threshold = parse_number_option(arg, state, "--threshold");
+            break;
+        case 'm':
+            arguments->min_delta = parse_number_option(arg, state, "--min-delta");
+            break;
+        case 'c':
+            arguments->cvode_flags = arg;
+            break;
+
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {options, parse_opt, args_doc, doc, NULL, NULL, NULL};
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double get_median(const double *times) {
+    int n = arrlen(times);
+
+    double *sorted = malloc(n * sizeof(double));
+    memcpy(sorted, times, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), compare_doubles);
+
+    double median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2.0;
+    free(sorted);
+
+    return median;
+}
+
+//sample variance, 0 for a single run
+static double get_variance(const double *times) {
+    int n = arrlen(times);
+
+    if(n < 2) {
+        return 0;
+    }
+
+    double mean = 0;
+    for(int i = 0; i < n; i++) {
+        mean += times[i];
+    }
+    mean /= n;
+
+    double sum = 0;
+    for(int i = 0; i < n; i++) {
+        sum += (times[i] - mean) * (times[i] - mean);
+    }
+
+    return sum / (n - 1);
+}
+
+//runs the command and returns false when it fails. The first line of its output is kept in first_line (if given)
+static bool run_command(const char *command, sds *first_line) {
+    sds cmd = sdscatfmt(sdsempty(), "%s 2>&1", command);
+
+    FILE *fp = popen(cmd, "r");
+    sdsfree(cmd);
+
+    if(fp == NULL) {
+        return false;
+    }
+
+    char line[PATH_MAX];
+    bool first = true;
+
+    while(fgets(line, PATH_MAX, fp) != NULL) {
+        if(first && first_line) {
+            *first_line = sdscpy(*first_line, line);
+            sdstrim(*first_line, "\n");
+        }
+        first = false;
+    }
+
+    return pclose(fp) == 0;
+}
+
+static sds get_bench_file(const struct model_bench *model, const char *suffix) {
+    return sdscatprintf(sdsempty(), BENCH_FILE_TEMPLATE, model->name, suffix, (int) getpid());
+}
+
+// Runs every stage of a model once. The times are added to the model when measure is true. Returns false when the
+// model can not be benchmarked (e.g., it has errors or does not build); cvode_available is cleared when the CVODE
+// executable of the model can not be built, as the library is probably missing
+static bool run_model_once(struct model_bench *model, const struct arguments *arguments, bool measure, bool *cvode_available) {
+
+    double times[N_BENCH_STAGES] = {0};
+    bool measured[N_BENCH_STAGES] = {0};
+    bool success = true;
+
+    size_t file_size;
+    char *source = read_entire_file_with_mmap(model->path, &file_size);
+
+    if(source == NULL) {
+        fprintf(stderr, "Error: could not read %s\n", model->path);
+        return false;
+    }
+
+    //each run parses the imported files again
+    clear_import_cache();
+
+    double start = get_wall_time();
+    lexer *l = new_lexer(source, model->path);
+    parser *p = new_parser(l);
+    program program = parse_program_statements(p, true, arguments->dir);
+    times[BENCH_PARSE] = get_wall_time() - start;
+
+    start = get_wall_time();
+    check_program_semantics(p, program);
+    times[BENCH_CHECK] = get_wall_time() - start;
+
+    measured[BENCH_PARSE] = measured[BENCH_CHECK] = true;
+
+    if(!p->have_ode) {
+        fprintf(stderr, "Skipping %s: no ODE(s) defined\n", model->path);
+        success = false;
+    } else if(check_parser_errors(p, false)) {
+        fprintf(stderr, "Skipping %s: the model has errors\n", model->path);
+        success = false;
+    }
+
+    sds sources[N_SOLVERS] = {0};
+    sds executables[N_SOLVERS] = {0};
+    bool built[N_SOLVERS] = {0};
+
+    for(int s = 0; s < N_SOLVERS && success; s++) {
+
+        sources[s] = get_bench_file(model, bench_solver_names[s]);
+        sources[s] = sdscat(sources[s], ".c");
+
+        start = get_wall_time();
+        FILE *outfile = fopen(sources[s], "w");
+
+        if(outfile == NULL) {
+            fprintf(stderr, "Error: could not create %s\n", sources[s]);
+            success = false;
+            break;
+        }
+
+        solver_config config = {0};
+        config.solver_type = bench_solvers[s];
+
+        bool error = convert_to_c_with_config(program, outfile, &config);
+        fclose(outfile);
+        times[BENCH_CONVERT_EULER + s] = get_wall_time() - start;
+        measured[BENCH_CONVERT_EULER + s] = true;
+
+        if(error) {
+            fprintf(stderr, "Skipping %s: the %s conversion failed\n", model->path, bench_solver_names[s]);
+            success = false;
+        }
+    }
+
+    for(int s = 0; s < N_SOLVERS && success; s++) {
+
+        bool is_cvode = bench_solvers[s] == CVODE_SOLVER;
+
+        //the code is converted even without the library
+        if(is_cvode && !*cvode_available) continue;
+
+        executables[s] = get_bench_file(model, bench_solver_names[s]);
+
+        sds command = sdscatfmt(sdsempty(), "%s %s %s -o %s %s %s", C_COMPILER, COMPILER_FLAGS, sources[s], executables[s],
+                                is_cvode ? arguments->cvode_flags : "", LINK_FLAGS);
+        sds output = sdsempty();
+
+        start = get_wall_time();
+        built[s] = run_command(command, &output);
+        times[BENCH_BUILD_EULER + s] = get_wall_time() - start;
+        measured[BENCH_BUILD_EULER + s] = built[s];
+
+        if(!built[s]) {
+            if(is_cvode) {
+                fprintf(stderr, "Skipping the CVODE builds and solves (%s). Set the link flags with --cvode-flags\n", output);
+                *cvode_available = false;
+            } else {
+                fprintf(stderr, "Skipping %s: the %s build failed (%s)\n", model->path, bench_solver_names[s], output);
+                success = false;
+            }
+        }
+
+        sdsfree(output);
+        sdsfree(command);
+    }
+
+    for(int s = 0; s < N_SOLVERS && success; s++) {
+
+        if(!built[s]) continue;
+
+        sds output_file = get_bench_file(model, bench_solver_names[s]);
+        output_file = sdscat(output_file, "_out.txt");
+
+        sds command = sdscatprintf(sdsempty(), "%s %lf %s", executables[s], arguments->end_time, output_file);
+        sds output = sdsempty();
+
+        start = get_wall_time();
+        bool solved = run_command(command, &output);
+        times[BENCH_SOLVE_EULER + s] = get_wall_time() - start;
+        measured[BENCH_SOLVE_EULER + s] = solved;
+
+        if(!solved) {
+            fprintf(stderr, "Skipping %s: the %s solve failed (%s)\n", model->path, bench_solver_names[s], output);
+            success = false;
+        }
+
+        //and the statistics the solver writes next to it
+        sds stats_file = sdscat(sdsdup(output_file), RUN_STATS_FILE_SUFFIX);
+        unlink(stats_file);
+        sdsfree(stats_file);
+
+        unlink(output_file);
+        sdsfree(output_file);
+        sdsfree(output);
+        sdsfree(command);
+    }
+
+    for(int s = 0; s < N_SOLVERS; s++) {
+        if(sources[s]) unlink(sources[s]);
+        if(executables[s]) unlink(executables[s]);
+        sdsfree(sources[s]);
+        sdsfree(executables[s]);
+    }
+
+    if(success && measure) {
+        for(int k = 0; k < N_BENCH_STAGES; k++) {
+            if(measured[k]) arrput(model->times[k], times[k]);
+        }
+    }
+
+    free_program(program);
+    free_parser(p);
+    free_lexer(l);
+    munmap(source, file_size);
+
+    return success;
+}
+
+static struct model_bench *find_models(const char *dir) {
+
+    struct dirent **entries;
+    int n = scandir(dir, &entries, NULL, alphasort);
+
+    if(n < 0) {
+        fprintf(stderr, "Error: could not read the directory %s\n", dir);
+        return NULL;
+    }
+
+    struct model_bench *models = NULL;
+
+    for(int i = 0; i < n; i++) {
+        const char *ext = get_filename_ext(entries[i]->d_name);
+
+        if(entries[i]->d_type != DT_DIR && STR_EQUALS(ext, "ode")) {
+            struct model_bench model = {0};
+            model.name = sdsnewlen(entries[i]->d_name, strlen(entries[i]->d_name) - strlen(".ode"));
+            model.path = sdscatfmt(sdsempty(), "%s/%s", dir, entries[i]->d_name);
+            arrput(models, model);
+        }
+
+        free(entries[i]);
+    }
+
+    free(entries);
+
+    return models;
+}
+
+static bool write_results(const char *file_name, const struct model_bench *models, const struct arguments *arguments) {
+
+    FILE *f = fopen(file_name, "w");
+
+    if(f == NULL) {
+        fprintf(stderr, "Error: could not create %s\n", file_name);
+        return false;
+    }
+
+    //one result per line, as read_baseline expects
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": %d,\n", BENCH_RESULTS_VERSION);
+    fprintf(f, "  \"runs\": %ld,\n", arguments->n_runs);
+    fprintf(f, "  \"end_time\": %lf,\n", arguments->end_time);
+    fprintf(f, "  \"results\": [");
+
+    bool first = true;
+
+    for(int i = 0; i < arrlen(models); i++) {
+        if(models[i].failed) continue;
+
+        for(int k = 0; k < N_BENCH_STAGES; k++) {
+            if(arrlen(models[i].times[k]) == 0) continue;
+
+            fprintf(f, "%s\n    {\"model\": \"%s\", \"stage\": \"%s\", \"median_ms\": %.6lf, \"variance_ms2\": %.6lf}",
+                    first ? "" : ",", models[i].name, bench_stage_names[k], models[i].median[k] * 1e3, models[i].variance[k] * 1e6);
+            first = false;
+        }
+    }
+
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
+
+    return true;
+}
+
+static struct baseline_entry *read_baseline(const char *file_name) {
+
+    FILE *f = fopen(file_name, "r");
+
+    if(f == NULL) {
+        fprintf(stderr, "Error: could not open the baseline %s\n", file_name);
+        return NULL;
+    }
+
+    struct baseline_entry *entries = NULL;
+    char line[PATH_MAX];
+    char model[PATH_MAX];
+    char stage[64];
+    double median;
+
+    while(fgets(line, PATH_MAX, f) != NULL) {
+        if(sscanf(line, " {\"model\": \"%4095[^\"]\", \"stage\": \"%63[^\"]\", \"median_ms\": %lf", model, stage, &median) != 3) {
+            continue;
+        }
+
+        for(int k = 0; k < N_BENCH_STAGES; k++) {
+            if(STR_EQUALS(stage, bench_stage_names[k])) {
+                struct baseline_entry entry = {sdsnew(model), k, median * 1e-3};
+                arrput(entries, entry);
+                break;
+            }
+        }
+    }
+
+    fclose(f);
+
+    if(arrlen(entries) == 0) {
+        fprintf(stderr, "Warning: no results found in the baseline %s\n", file_name);
+    }
+
+    return entries;
+}
+
+static const struct baseline_entry *find_baseline(const struct baseline_entry *entries, const char *model, int stage) {
+    for(int i = 0; i < arrlen(entries); i++) {
+        if(entries[i].stage == stage && STR_EQUALS(entries[i].model, model)) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Prints the table and returns the number of regressions over the baseline (if any)
+static int print_results(const struct model_bench *models, const struct baseline_entry *baseline, const struct arguments *arguments) {
+
+    ft_table_t *table = ft_create_table();
+    ft_set_border_style(table, FT_SOLID_ROUND_STYLE);
+    ft_set_cell_prop(table, 0, FT_ANY_COLUMN, FT_CPROP_ROW_TYPE, FT_ROW_HEADER);
+
+    int n_columns = 4;
+
+    if(baseline) {
+        ft_printf_ln(table, "Model|Stage|Median (ms)|Std dev (ms)|Baseline (ms)|Change");
+        n_columns = 6;
+    } else {
+        ft_printf_ln(table, "Model|Stage|Median (ms)|Std dev (ms)");
+    }
+
+    int n_regressions = 0;
+
+    for(int i = 0; i < arrlen(models); i++) {
+        if(models[i].failed) continue;
+
+        //the name of the model only in its first row
+        bool first = true;
+
+        for(int k = 0; k < N_BENCH_STAGES; k++) {
+            if(arrlen(models[i].times[k]) == 0) continue;
+
+            double median = models[i].median[k];
+            ft_printf(table, "%s|%s|%.3lf|%.3lf", first ? models[i].name : "", bench_stage_names[k], median * 1e3,
+                      sqrt(models[i].variance[k]) * 1e3);
+            first = false;
+
+            if(baseline) {
+                const struct baseline_entry *entry = find_baseline(baseline, models[i].name, k);
+
+                if(entry == NULL || entry->median <= 0) {
+                    ft_printf(table, "-|-");
+                } else {
+                    double change = (median - entry->median) / entry->median * 100.0;
+                    bool regression = change > arguments->threshold && (median - entry->median) * 1e3 > arguments->min_delta;
+
+                    ft_printf(table, "%.3lf|%+.1lf%%%s", entry->median * 1e3, change, regression ? " REGRESSION" : "");
+                    n_regressions += regression;
+                }
+            }
+
+            ft_ln(table);
+        }
+    }
+
+    for(int c = 2; c < n_columns; c++) {
+        ft_set_cell_prop(table, FT_ANY_ROW, c, FT_CPROP_TEXT_ALIGN, FT_ALIGNED_RIGHT);
+    }
+
+    printf("%s", ft_to_string(table));
+    ft_destroy_table(table);
+
+    return n_regressions;
+}
+
+int main(int argc, char **argv) {
+
+    struct arguments arguments = {0};
+    arguments.dir         = "examples";
+    arguments.cvode_flags = CVODE_LINK_FLAGS;
+    arguments.n_runs      = 5;
+    arguments.n_warmup    = 1;
+    arguments.end_time    = 100;
+    arguments.threshold   = 10;
+    arguments.min_delta   = 0.1;
+
+    argp_parse(&argp, argc, argv, ARGP_NO_ARGS, 0, &arguments);
+
+    struct model_bench *models = find_models(arguments.dir);
+
+    if(arrlen(models) == 0) {
+        fprintf(stderr, "Error: no .ode models found in %s\n", arguments.dir);
+        return EXIT_FAILURE;
+    }
+
+    struct baseline_entry *baseline = NULL;
+
+    if(arguments.baseline_file) {
+        baseline = read_baseline(arguments.baseline_file);
+        if(baseline == NULL) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    bool cvode_available = true;
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    printf("Benchmarking %d model(s) from %s: %ld warmup and %ld measured run(s), solving until %g\n", (int) arrlen(models),
+           arguments.dir, arguments.n_warmup, arguments.n_runs, arguments.end_time);
+
+    for(int i = 0; i < arrlen(models); i++) {
+        struct model_bench *model = &models[i];
+
+        for(long r = 0; r < arguments.n_warmup + arguments.n_runs && !model->failed; r++) {
+            //the warnings of the model are printed only once
+            int saved[2];
+            bool quiet = r > 0 && null_fd != -1;
+
+            if(quiet) redirect_output(null_fd, saved);
+            model->failed = !run_model_once(model, &arguments, r >= arguments.n_warmup, &cvode_available);
+            if(quiet) restore_output(saved);
+        }
+
+        for(int k = 0; k < N_BENCH_STAGES && !model->failed; k++) {
+            if(arrlen(model->times[k]) == 0) continue;
+            model->median[k]   = get_median(model->times[k]);
+            model->variance[k] = get_variance(model->times[k]);
+        }
+    }
+
+    if(null_fd != -1) close(null_fd);
+
+    int n_regressions = print_results(models, baseline, &arguments);
+
+    bool error = false;
+
+    if(arguments.output_file) {
+        error = !write_results(arguments.output_file, models, &arguments);
+        if(!error) {
+            printf("Results written to %s\n", arguments.output_file);
+        }
+    }
+
+    if(baseline) {
+        if(n_regressions) {
+            printf("%d stage(s) regressed more than %g%% (and %g ms) over %s\n", n_regressions, arguments.threshold, arguments.min_delta,
+                   arguments.baseline_file);
+        } else {
+            printf("No regressions over %s\n", arguments.baseline_file);
+        }
+    }
+
+    for(int i = 0; i < arrlen(baseline); i++) {
+        sdsfree(baseline[i].model);
+    }
+    arrfree(baseline);
+
+    for(int i = 0; i < arrlen(models); i++) {
+        sdsfree(models[i].name);
+        sdsfree(models[i].path);
+        for(int k = 0; k < N_BENCH_STAGES; k++) {
+            arrfree(models[i].times[k]);
+        }
+    }
+    arrfree(models);
+
+    return error || n_regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -4,7 +4,9 @@
 #include "compiler/parser.h"
 #include "code_converter.h"
 #include "string_utils.h"
+#include "timing.h"
 #include "file_utils/file_utils.h"
+#include "stb/stb_ds.h"
 #include <argp.h>
 
 const char *argp_program_version = "odecompiler 0.3";
@@ -22,6 +24,10 @@ static struct argp_option options[] = {
     {"output",       'o', "FILE", 0, "Output FILE", 0},
     {"import_path",  'I', "PATH", 0, "PATH to search for imported files", 0},
     {"solver_impl",  't', "IMPL", 0, "Solver implementation. Available options: cvode, euler. Default: euler", 0},
+    {"record",       'r', "VARS", 0, "Space or comma separated list of intermediate variables to be written as extra output columns", 0},
+    {"modules",      'm', 0,      0, "Write a precompiled module (.odm) next to each imported file, used by the next imports of the file", 0},
+    {"time-passes",  'T', 0,      0, "Print the time spent in each stage of the compilation to stderr", 0},
+    {"profile",      'p', 0,      0, "Sample the time spent in each statement of the model and write it to <output file>_profile", 0},
     { 0 }
 };
 
@@ -31,6 +37,10 @@ struct arguments {
     char *output_file;
     char *solver_impl;
     char *import_path;
+    char *recorded_vars;
+    bool write_modules;
+    bool time_passes;
+    bool profile_statements;
 };
 
 /* Parse a single option. */
@@ -51,6 +61,18 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 't':
             arguments->solver_impl = arg;
             break;
+        case 'r':
+            arguments->recorded_vars = arg;
+            break;
+        case 'm':
+            arguments->write_modules = true;
+            break;
+        case 'T':
+            arguments->time_passes = true;
+            break;
+        case 'p':
+            arguments->profile_statements = true;
+            break;
 
         case ARGP_KEY_END:
             if (arguments->input_file == NULL || arguments->output_file == NULL) {
@@ -74,6 +96,9 @@ int main(int argc, char **argv) {
 
     argp_parse (&argp, argc, argv, ARGP_NO_ARGS, 0, &arguments);
 
+    set_timing_enabled(arguments.time_passes);
+    double start_time = get_wall_time();
+
     char *file_name = arguments.input_file;
 
     if(!file_exists(file_name)) {
@@ -86,7 +111,10 @@ int main(int argc, char **argv) {
 
     lexer *l = new_lexer(source, file_name);
     parser *p = new_parser(l);
+    p->write_modules = arguments.write_modules;
+    double start = begin_stage();
     program program = parse_program(p, true, true, arguments.import_path);
+    end_stage(STAGE_PARSE, start);
 
     check_parser_errors(p, true);
 
@@ -103,9 +131,45 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Error - invalid implementation %s. Available options: cvode, euler. Default: euler\n", arguments.solver_impl);
     }
 
-    convert_to_c(program, outfile, solver_type);
+    solver_config config = {0};
+    config.solver_type   = solver_type;
+    config.profile_statements = arguments.profile_statements;
+
+    int n_rec    = 0;
+    sds *rec_vars = NULL;
+
+    if(arguments.recorded_vars) {
+        sds tmp  = sdsmapchars(sdsnew(arguments.recorded_vars), ",", " ", 1);
+        rec_vars = sdssplit(tmp, " ", &n_rec);
+        sdsfree(tmp);
+        for(int i = 0; i < n_rec; i++) {
+            if(sdslen(rec_vars[i]) > 0) arrput(config.recorded_vars, rec_vars[i]);
+        }
+    }
+
+    start = begin_stage();
+    bool error = convert_to_c_with_config(program, outfile, &config);
+    end_stage(STAGE_CONVERT, start);
+
+    arrfree(config.recorded_vars);
+    sdsfreesplitres(rec_vars, n_rec);
     free_lexer(l);
     free_parser(p);
     free_program(program);
     fclose(outfile);
+
+    if(arguments.time_passes) {
+        struct stage_times times;
+        take_stage_times(&times);
+
+        for(int k = 0; k < N_TIMING_STAGES; k++) {
+            if(times.calls[k] > 0) {
+                fprintf(stderr, "%-14s %10.3lf ms\n", get_timing_stage_name(k), times.time[k] * 1e3);
+            }
+        }
+
+        fprintf(stderr, "%-14s %10.3lf ms\n", "total", (get_wall_time() - start_time) * 1e3);
+    }
+
+    return error ? EXIT_FAILURE : EXIT_SUCCESS;
 }
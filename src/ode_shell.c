@@ -9,6 +9,7 @@
 #include "file_utils/file_utils.h"
 #include "inotify_helpers.h"
 #include "ode_shell.h"
+#include "server.h"
 #include "stb/stb_ds.h"
 #include "string/sds.h"
 #include "gnuplot_utils.h"
@@ -16,6 +17,7 @@
 #include <argp.h>
 
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 #include <signal.h>
 
@@ -38,6 +40,8 @@ static struct argp_option options[] = {
     {"work_dir", 'w', "DIR", 0, "DIR where the shell will use as working directory.", 0},
     {"enable_sixel", 's', 0, 0, "Enable sixel gnuplot terminal when available", 0},
     {"force_sixel",  'f', 0, 0, "Force sixel gnuplot terminal (may not work)", 0},
+    {"session", 'S', "FILE", 0, "Restore the session saved in FILE (see savesession) before running the commands.", 0},
+    {"server", 'l', "SOCKET", 0, "Run as a server for the clients that connect to the Unix domain SOCKET, after running the commands.", 0},
     { 0 }
 };
 
@@ -45,6 +49,8 @@ static struct argp_option options[] = {
 struct arguments {
     char *command_file;
     char *work_dir;
+    char *session_file;
+    char *server_socket;
     bool enable_sixel;
     bool force_sixel;
 };
@@ -64,6 +70,12 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
         case 'f':
             arguments->force_sixel = true;
             break;
+        case 'S':
+            arguments->session_file = arg;
+            break;
+        case 'l':
+            arguments->server_socket = arg;
+            break;
         case ARGP_KEY_ARG:
             if (state->arg_num >= 1) {
                 /* Too many arguments. */
@@ -86,9 +98,30 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state) {
 static sigjmp_buf env;
 #define CTRL_C_CONTEXT 42
 static void ctrl_c_handler(__attribute__((unused)) int sig) {
+    //a running solve or a wait gets the Ctrl+C instead of the prompt
+    if(forward_sigint_to_jobs()) return;
     siglongjmp(env, CTRL_C_CONTEXT);
 }
 
+static struct shell_variables *hook_shell_state;
+
+//readline calls this while waiting for input, so finished background jobs are reported without waiting for the next command
+static int report_finished_jobs_hook(void) {
+
+    if(pthread_mutex_trylock(&hook_shell_state->lock) != 0) {
+        return 0;
+    }
+
+    if(report_finished_jobs(hook_shell_state, true)) {
+        rl_on_new_line();
+        rl_redisplay();
+    }
+
+    pthread_mutex_unlock(&hook_shell_state->lock);
+
+    return 0;
+}
+
 static void setup_ctrl_c_handler() {
     /* Setup SIGINT */
     struct sigaction s;
@@ -138,6 +171,7 @@ int main(int argc, char **argv) {
 
     shell_state.current_dir = get_current_directory();
     shell_state.never_reload = false;
+    shell_state.memoize_solves = true;
 
     sh_new_strdup(shell_state.loaded_models);
 
@@ -157,13 +191,38 @@ int main(int argc, char **argv) {
     shell_state.fd_notify = inotify_init();
     pthread_t inotify_thread;
 
-    if (pthread_mutex_init(&shell_state.lock, NULL) != 0) {
+    //the server takes the lock around the commands of its clients, which take it again
+    pthread_mutexattr_t lock_attr;
+    pthread_mutexattr_init(&lock_attr);
+    pthread_mutexattr_settype(&lock_attr, PTHREAD_MUTEX_RECURSIVE);
+
+    if (pthread_mutex_init(&shell_state.lock, &lock_attr) != 0) {
         printf("\n mutex init has failed\n");
         return EXIT_FAILURE;
     }
 
+    pthread_mutexattr_destroy(&lock_attr);
+
     pthread_create(&inotify_thread, NULL, check_for_model_file_changes, (void *) &shell_state);
+
+    //the reloads wait for deadlines measured with get_wall_time
+    pthread_condattr_t reload_cond_attr;
+    pthread_condattr_init(&reload_cond_attr);
+    pthread_condattr_setclock(&reload_cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&shell_state.reload_lock, NULL);
+    pthread_cond_init(&shell_state.reload_cond, &reload_cond_attr);
+    pthread_condattr_destroy(&reload_cond_attr);
+
+    pthread_t reload_thread;
+    pthread_create(&reload_thread, NULL, reload_changed_models, (void *) &shell_state);
 #endif
+
+    if (arguments.session_file) {
+        sds command = sdscatfmt(sdsempty(), "loadsession %s\n", arguments.session_file);
+        parse_and_execute_command(command, &shell_state);
+        sdsfree(command);
+    }
     
     if (arguments.command_file) {
         bool continue_ = run_commands_from_file(&shell_state, arguments.command_file);
@@ -171,6 +230,16 @@ int main(int argc, char **argv) {
             clean_and_exit(&shell_state);
     }
 
+    if (arguments.server_socket) {
+        if (!run_server(&shell_state, arguments.server_socket)) {
+            return EXIT_FAILURE;
+        }
+
+        //waits for the command of a client that is still running
+        pthread_mutex_lock(&shell_state.lock);
+        clean_and_exit(&shell_state);
+    }
+
     sds history_path = sdsnew(get_home_dir());
     history_path = sdscatfmt(history_path, "/%s", HISTORY_FILE);
 
@@ -178,6 +247,9 @@ int main(int argc, char **argv) {
 
     setup_ctrl_c_handler();
 
+    hook_shell_state = &shell_state;
+    rl_event_hook    = report_finished_jobs_hook;
+
     char *line;
 
     //if CTRL+C is pressed, we print a new line
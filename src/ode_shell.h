@@ -7,6 +7,7 @@
 
 #include "model_config.h"
 #include "pipe_utils.h"
+#include "solve_jobs.h"
 
 #include <stdio.h>
 #include <pthread.h>
@@ -21,6 +22,12 @@ struct model_hash_entry {
     struct model_config *value;
 };
 
+struct pending_reload {
+    char *model_name;
+    double deadline; //wall time of the reload, moved forward by each change of the file
+};
+
+
 struct shell_variables {
     struct model_hash_entry *loaded_models;
     struct model_config *current_model;
@@ -35,6 +42,19 @@ struct shell_variables {
     bool never_reload;
     bool enable_sixel;
     bool force_sixel;
+    bool report_io;
+    bool memoize_solves;
+    bool run_in_background;
+    struct solve_job **jobs;
+    int next_job_id;
+    int sweep_workers;
+    pthread_mutex_t reload_lock; //protects pending_reloads. Taken after lock when both are needed
+    pthread_cond_t reload_cond;
+    struct pending_reload *pending_reloads;
+    sds *reload_messages; //reports of the background reloads, printed with the finished jobs
+    bool detach_solves; //solve leaves its job in detached_job instead of waiting for it (server mode and loadcmds -j)
+    struct solve_job *detached_job;
+    bool non_interactive; //the commands take the default answer of their prompts, as stdin is not the user's (server mode)
 };
 
 #define PROMPT "ode_shell> "
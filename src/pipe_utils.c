@@ -1,5 +1,7 @@
 #include "pipe_utils.h"
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #define	DUP2CLOSE(oldfd, newfd)	(dup2(oldfd, newfd) == 0  &&  close(oldfd) == 0)
 
@@ -111,3 +113,21 @@ int popen2(const char *cmdline, struct popen2 *childinfo) {
     childinfo->from_child = PARENT_READ;
     return 0;
 }
+
+void redirect_output(int fd, int saved[2]) {
+    fflush(stdout);
+    fflush(stderr);
+    saved[0] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    saved[1] = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+}
+
+void restore_output(int saved[2]) {
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved[0], STDOUT_FILENO);
+    dup2(saved[1], STDERR_FILENO);
+    close(saved[0]);
+    close(saved[1]);
+}
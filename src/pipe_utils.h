@@ -10,4 +10,8 @@ struct popen2 {
 
 int popen2(const char *cmdline, struct popen2 *childinfo);
 
+// Points stdout and stderr to fd, saving the previous ones to be restored by restore_output
+void redirect_output(int fd, int saved[2]);
+void restore_output(int saved[2]);
+
 #endif /* __PIPE_UTILS_H */
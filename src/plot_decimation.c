@@ -0,0 +1,177 @@
+#include "plot_decimation.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb/stb_ds.h"
+
+static unsigned int next_plot_id = 0;
+
+//the runs (and their plots) can be freed by the reload threads
+static pthread_mutex_t released_lock    = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int *released_plot_ids = NULL;
+
+static bool read_columns(FILE *fp, int xindex, int yindex, double **x, double **y, bool *x_is_monotonic) {
+
+    char *line = NULL;
+    size_t len = 0;
+
+    int last_column = xindex > yindex ? xindex : yindex;
+
+    *x_is_monotonic = true;
+
+    //skip the header
+    if(getline(&line, &len, fp) == -1) {
+        free(line);
+        return false;
+    }
+
+    while(getline(&line, &len, fp) != -1) {
+
+        char *start = line;
+        char *end;
+        double x_value = 0, y_value = 0;
+        int column;
+
+        for(column = 1; column <= last_column; column++) {
+            double value = strtod(start, &end);
+            if(end == start) break;
+            if(column == xindex) x_value = value;
+            if(column == yindex) y_value = value;
+            start = end;
+        }
+
+        //incomplete line (e.g. a run that is still being written)
+        if(column <= last_column) continue;
+
+        if(arrlen(*x) > 0 && x_value < arrlast(*x)) {
+            *x_is_monotonic = false;
+        }
+
+        arrput(*x, x_value);
+        arrput(*y, y_value);
+    }
+
+    free(line);
+    return true;
+}
+
+// Min/max per bucket decimation. When x is monotonic (e.g. time) the buckets split the x range evenly, so each bucket
+// maps to a pixel column. Otherwise (phase plots) the buckets split the samples evenly in time order.
+// The first and last samples are always kept and the selected points are emitted in their original order.
+bool decimate_output_file(const char *file_name, int xindex, int yindex, unsigned int buckets, struct decimated_plot *result) {
+
+    FILE *fp = fopen(file_name, "r");
+
+    if(fp == NULL) {
+        fprintf(stderr, "Error reading file %s\n", file_name);
+        return false;
+    }
+
+    double *x = NULL;
+    double *y = NULL;
+    bool x_is_monotonic;
+
+    bool success = read_columns(fp, xindex, yindex, &x, &y, &x_is_monotonic);
+    fclose(fp);
+
+    size_t n = arrlen(x);
+
+    if(!success || n == 0 || buckets == 0) {
+        arrfree(x);
+        arrfree(y);
+        return false;
+    }
+
+    double x_min   = x[0];
+    double x_range = x[n - 1] - x[0];
+
+    if(x_range <= 0) x_is_monotonic = false;
+
+    size_t max_points = 2 * (size_t) buckets + 2;
+
+    result->xindex     = xindex;
+    result->yindex     = yindex;
+    result->buckets    = buckets;
+    result->id         = next_plot_id++;
+    result->in_gnuplot = false;
+    result->n_points   = 0;
+    result->x          = (double *) malloc(sizeof(double) * max_points);
+    result->y          = (double *) malloc(sizeof(double) * max_points);
+
+#define EMIT_POINT(i)                          \
+    do {                                       \
+        result->x[result->n_points] = x[(i)]; \
+        result->y[result->n_points] = y[(i)]; \
+        result->n_points++;                    \
+    } while(0)
+
+    EMIT_POINT(0);
+
+    size_t current_bucket = 0;
+    size_t i_min = 1, i_max = 1;
+
+    for(size_t i = 1; i < n - 1; i++) {
+
+        size_t bucket;
+
+        if(x_is_monotonic) {
+            bucket = (size_t) ((x[i] - x_min) / x_range * buckets);
+        } else {
+            bucket = i * buckets / n;
+        }
+
+        if(bucket >= buckets) bucket = buckets - 1;
+
+        if(bucket != current_bucket && i > 1) {
+            EMIT_POINT(i_min < i_max ? i_min : i_max);
+            if(i_min != i_max) EMIT_POINT(i_min < i_max ? i_max : i_min);
+            i_min = i_max = i;
+        }
+
+        current_bucket = bucket;
+
+        if(y[i] < y[i_min]) i_min = i;
+        if(y[i] > y[i_max]) i_max = i;
+    }
+
+    if(n > 2) {
+        EMIT_POINT(i_min < i_max ? i_min : i_max);
+        if(i_min != i_max) EMIT_POINT(i_min < i_max ? i_max : i_min);
+    }
+
+    if(n > 1) {
+        EMIT_POINT(n - 1);
+    }
+
+#undef EMIT_POINT
+
+    arrfree(x);
+    arrfree(y);
+
+    return true;
+}
+
+void free_decimated_plot(struct decimated_plot *plot) {
+
+    if(plot->in_gnuplot) {
+        pthread_mutex_lock(&released_lock);
+        arrput(released_plot_ids, plot->id);
+        pthread_mutex_unlock(&released_lock);
+    }
+
+    free(plot->x);
+    free(plot->y);
+}
+
+unsigned int *take_released_plot_ids(void) {
+
+    pthread_mutex_lock(&released_lock);
+    unsigned int *ids = released_plot_ids;
+    released_plot_ids = NULL;
+    pthread_mutex_unlock(&released_lock);
+
+    return ids;
+}
@@ -0,0 +1,29 @@
+#ifndef __PLOT_DECIMATION_H
+#define __PLOT_DECIMATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Runs with fewer samples than DECIMATION_MIN_POINTS_PER_BUCKET * buckets are plotted directly from the output file
+#define DECIMATION_MIN_POINTS_PER_BUCKET 4
+#define DEFAULT_DECIMATION_BUCKETS 2048
+
+struct decimated_plot {
+    int xindex;
+    int yindex;
+    unsigned int buckets;
+    unsigned int id;
+    bool in_gnuplot; //its datablock was defined (see gnuplot_send_datablock)
+    size_t n_points;
+    double *x;
+    double *y;
+};
+
+bool decimate_output_file(const char *file_name, int xindex, int yindex, unsigned int buckets, struct decimated_plot *result);
+void free_decimated_plot(struct decimated_plot *plot);
+
+// The datablocks of the freed plots are undefined with the next gnuplot command. Returns and forgets their ids (free
+// the array with arrfree)
+unsigned int *take_released_plot_ids(void);
+
+#endif /* __PLOT_DECIMATION_H */
@@ -0,0 +1,457 @@
+#include "run_query.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stb/stb_ds.h"
+#include "string/sds.h"
+
+struct run_columns_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_cols;
+    uint64_t n_rows;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+};
+
+// A rewrite of the output can keep its size, so its modification time is also compared
+static struct run_columns *map_run_columns_file(const char *file_name, const struct stat *source) {
+
+    int fd = open(file_name, O_RDONLY);
+
+    if(fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || (size_t) st.st_size < RUN_COLUMNS_HEADER_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) {
+        return NULL;
+    }
+
+    const struct run_columns_header *header = map;
+
+    size_t expected_size = RUN_COLUMNS_HEADER_SIZE + sizeof(double) * header->n_cols * header->n_rows;
+
+    if(memcmp(header->magic, RUN_COLUMNS_MAGIC, sizeof(header->magic)) != 0 || header->version != RUN_COLUMNS_VERSION ||
+       header->source_size != (uint64_t) source->st_size || header->source_mtime_sec != (int64_t) source->st_mtim.tv_sec ||
+       header->source_mtime_nsec != (int64_t) source->st_mtim.tv_nsec || expected_size != (size_t) st.st_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    struct run_columns *columns = malloc(sizeof(struct run_columns));
+
+    columns->map      = map;
+    columns->map_size = st.st_size;
+    columns->n_cols   = header->n_cols;
+    columns->n_rows   = header->n_rows;
+    columns->data     = (const double *) ((char *) map + RUN_COLUMNS_HEADER_SIZE);
+
+    //the queries scan the columns sequentially
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    return columns;
+}
+
+// Fast path for the "%lf" values written by the solvers. m / 10^k is correctly rounded when both are exact doubles,
+// so the result is the same as strtod. Anything else (exponents, nan, too many digits) falls back to strtod
+static double parse_output_value(const char *str, char **end) {
+
+    static const double powers_of_10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15};
+
+    const char *c = str;
+
+    while(*c == ' ') c++;
+
+    bool negative = *c == '-';
+    if(negative || *c == '+') c++;
+
+    uint64_t mantissa  = 0;
+    int n_digits       = 0;
+    int n_fraction     = 0;
+    const char *digits = c;
+
+    while(*c >= '0' && *c <= '9') {
+        mantissa = mantissa * 10 + (*c - '0');
+        n_digits++;
+        c++;
+    }
+
+    if(*c == '.') {
+        c++;
+        while(*c >= '0' && *c <= '9') {
+            mantissa = mantissa * 10 + (*c - '0');
+            n_digits++;
+            n_fraction++;
+            c++;
+        }
+    }
+
+    if(c == digits || n_digits > 15 || n_fraction > 15 || *c == 'e' || *c == 'E') {
+        return strtod(str, end);
+    }
+
+    *end = (char *) c;
+
+    double value = (double) mantissa / powers_of_10[n_fraction];
+    return negative ? -value : value;
+}
+
+static bool build_run_columns_file(const char *output_file, const char *file_name) {
+
+    int fd = open(output_file, O_RDONLY);
+
+    if(fd == -1) {
+        fprintf(stderr, "Error reading file %s\n", output_file);
+        return false;
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+
+    if(st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    const char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(text == MAP_FAILED) {
+        fprintf(stderr, "Error mapping file %s\n", output_file);
+        return false;
+    }
+
+    madvise((void *) text, st.st_size, MADV_SEQUENTIAL);
+
+    const char *text_end   = text + st.st_size;
+    const char *header_end = memchr(text, '\n', st.st_size);
+
+    if(header_end == NULL) {
+        munmap((void *) text, st.st_size);
+        return false;
+    }
+
+    //the header is "#t, var1, var2, ..."
+    uint32_t n_cols = 1;
+    for(const char *c = text; c < header_end; c++) {
+        if(*c == ',') n_cols++;
+    }
+
+    //only complete lines are converted (the output may still be being written)
+    uint64_t n_rows = 0;
+    for(const char *c = header_end + 1; c < text_end && (c = memchr(c, '\n', text_end - c)) != NULL; c++) {
+        n_rows++;
+    }
+
+    size_t size  = RUN_COLUMNS_HEADER_SIZE + sizeof(double) * n_cols * n_rows;
+    sds tmp_file = sdscat(sdsnew(file_name), ".tmp");
+
+    fd = open(tmp_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if(fd == -1 || ftruncate(fd, size) == -1) {
+        fprintf(stderr, "Error creating file %s\n", tmp_file);
+        if(fd != -1) close(fd);
+        munmap((void *) text, st.st_size);
+        sdsfree(tmp_file);
+        return false;
+    }
+
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    bool success = map != MAP_FAILED;
+
+    if(success) {
+        double *data     = (double *) (map + RUN_COLUMNS_HEADER_SIZE);
+        const char *line = header_end + 1;
+
+        for(uint64_t r = 0; r < n_rows && success; r++) {
+            //the values of a row are parsed up to its end, so a short row is an error instead of taking the next one
+            const char *row_end = memchr(line, '\n', text_end - line);
+
+            if(row_end == NULL) {
+                fprintf(stderr, "Error parsing file %s. Line %lu is incomplete\n", output_file, (unsigned long) r + 2);
+                success = false;
+                break;
+            }
+
+            char *end;
+            for(uint32_t c = 0; c < n_cols; c++) {
+                while(line < row_end && (*line == ' ' || *line == '\t')) line++;
+
+                if(line == row_end) {
+                    fprintf(stderr, "Error parsing file %s. Line %lu has %u values, expected %u\n", output_file, (unsigned long) r + 2, c, n_cols);
+                    success = false;
+                    break;
+                }
+
+                data[c * n_rows + r] = parse_output_value(line, &end);
+                if(end == line || end > row_end) {
+                    fprintf(stderr, "Error parsing file %s. Invalid value in line %lu\n", output_file, (unsigned long) r + 2);
+                    success = false;
+                    break;
+                }
+                line = end;
+            }
+            line = row_end + 1;
+        }
+
+        struct run_columns_header header = {0};
+        memcpy(header.magic, RUN_COLUMNS_MAGIC, sizeof(header.magic));
+        header.version           = RUN_COLUMNS_VERSION;
+        header.n_cols            = n_cols;
+        header.n_rows            = n_rows;
+        header.source_size       = st.st_size;
+        header.source_mtime_sec  = st.st_mtim.tv_sec;
+        header.source_mtime_nsec = st.st_mtim.tv_nsec;
+        memcpy(map, &header, sizeof(header));
+
+        munmap(map, size);
+    }
+
+    munmap((void *) text, st.st_size);
+
+    if(success) {
+        rename(tmp_file, file_name);
+    } else {
+        unlink(tmp_file);
+    }
+
+    sdsfree(tmp_file);
+
+    return success;
+}
+
+struct run_columns *open_run_columns(const char *output_file) {
+
+    struct stat st;
+
+    if(stat(output_file, &st) == -1) {
+        fprintf(stderr, "Error reading file %s\n", output_file);
+        return NULL;
+    }
+
+    sds file_name = sdscat(sdsnew(output_file), RUN_COLUMNS_FILE_SUFFIX);
+
+    struct run_columns *columns = map_run_columns_file(file_name, &st);
+
+    if(columns == NULL && build_run_columns_file(output_file, file_name)) {
+        columns = map_run_columns_file(file_name, &st);
+    }
+
+    sdsfree(file_name);
+
+    return columns;
+}
+
+void close_run_columns(struct run_columns *columns) {
+    if(columns == NULL) return;
+    munmap(columns->map, columns->map_size);
+    free(columns);
+}
+
+// [begin, end) are the rows with t0 <= time <= t1, found by binary search on the time column
+void get_time_window(const struct run_columns *columns, double t0, double t1, uint64_t *begin, uint64_t *end) {
+
+    const double *time = get_run_column(columns, 0);
+
+    uint64_t lo = 0, hi = columns->n_rows;
+    while(lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(time[mid] < t0) lo = mid + 1;
+        else hi = mid;
+    }
+    *begin = lo;
+
+    hi = columns->n_rows;
+    while(lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if(time[mid] <= t1) lo = mid + 1;
+        else hi = mid;
+    }
+    *end = lo;
+}
+
+// The scans below keep four independent accumulators and branchless min/max so the compiler can vectorize them
+void compute_window_stats(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, struct window_stats *stats) {
+
+    memset(stats, 0, sizeof(struct window_stats));
+
+    if(end <= begin) return;
+
+    const double *time   = get_run_column(columns, 0);
+    const double *values = get_run_column(columns, col);
+
+    uint64_t n = end - begin;
+    const double *v = values + begin;
+    const double *t = time + begin;
+
+    double min = v[0], max = v[0];
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    uint64_t i = 0;
+    for(; i + 4 <= n; i += 4) {
+        s0 += v[i];
+        s1 += v[i + 1];
+        s2 += v[i + 2];
+        s3 += v[i + 3];
+    }
+    for(; i < n; i++) s0 += v[i];
+
+    for(i = 0; i < n; i++) {
+        min = v[i] < min ? v[i] : min;
+        max = v[i] > max ? v[i] : max;
+    }
+
+    double mean = (s0 + s1 + s2 + s3) / n;
+
+    s0 = s1 = s2 = s3 = 0;
+    for(i = 0; i + 4 <= n; i += 4) {
+        s0 += (v[i] - mean) * (v[i] - mean);
+        s1 += (v[i + 1] - mean) * (v[i + 1] - mean);
+        s2 += (v[i + 2] - mean) * (v[i + 2] - mean);
+        s3 += (v[i + 3] - mean) * (v[i + 3] - mean);
+    }
+    for(; i < n; i++) s0 += (v[i] - mean) * (v[i] - mean);
+
+    double variance = (s0 + s1 + s2 + s3) / n;
+
+    double integral = 0;
+    for(i = 0; i + 1 < n; i++) {
+        integral += 0.5 * (v[i] + v[i + 1]) * (t[i + 1] - t[i]);
+    }
+
+    stats->n_samples = n;
+    stats->min       = min;
+    stats->max       = max;
+    stats->mean      = mean;
+    stats->std       = sqrt(variance);
+    stats->integral  = integral;
+
+    for(i = 0; i < n; i++) {
+        if(v[i] == min) {
+            stats->min_time = t[i];
+            break;
+        }
+    }
+
+    for(i = 0; i < n; i++) {
+        if(v[i] == max) {
+            stats->max_time = t[i];
+            break;
+        }
+    }
+}
+
+// Returns an stb array with the (linearly interpolated) times where the column crosses the threshold
+struct crossing *find_crossings(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, double threshold) {
+
+    const double *time   = get_run_column(columns, 0);
+    const double *values = get_run_column(columns, col);
+
+    struct crossing *crossings = NULL;
+
+    for(uint64_t i = begin; i + 1 < end; i++) {
+
+        double a = values[i] - threshold;
+        double b = values[i + 1] - threshold;
+
+        bool upward   = a < 0 && b >= 0;
+        bool downward = a >= 0 && b < 0;
+
+        if(upward || downward) {
+            struct crossing c;
+            c.time   = time[i] + (time[i + 1] - time[i]) * (-a / (b - a));
+            c.upward = upward;
+            arrput(crossings, c);
+        }
+    }
+
+    return crossings;
+}
+
+// Returns an stb array with the rows of the local maxima greater or equal than the threshold
+uint64_t *find_peaks(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, double threshold) {
+
+    const double *values = get_run_column(columns, col);
+
+    uint64_t *peaks = NULL;
+
+    if(begin == 0) begin = 1;
+
+    for(uint64_t i = begin; i + 1 < end; i++) {
+        if(values[i] > values[i - 1] && values[i] >= values[i + 1] && values[i] >= threshold) {
+            arrput(peaks, i);
+        }
+    }
+
+    return peaks;
+}
+
+// Compares the column of run a with the column of run b (linearly interpolated in the times of run a) in the common time range
+bool compute_run_diff(const struct run_columns *a, uint32_t col_a, const struct run_columns *b, uint32_t col_b, struct run_diff *diff) {
+
+    memset(diff, 0, sizeof(struct run_diff));
+
+    if(a->n_rows == 0 || b->n_rows < 2) return false;
+
+    const double *time_a   = get_run_column(a, 0);
+    const double *values_a = get_run_column(a, col_a);
+    const double *time_b   = get_run_column(b, 0);
+    const double *values_b = get_run_column(b, col_b);
+
+    uint64_t j = 0;
+    double sum = 0, sum_sq = 0;
+
+    for(uint64_t i = 0; i < a->n_rows; i++) {
+
+        double t = time_a[i];
+
+        if(t < time_b[0]) continue;
+        if(t > time_b[b->n_rows - 1]) break;
+
+        while(j + 2 < b->n_rows && time_b[j + 1] < t) j++;
+
+        double dt = time_b[j + 1] - time_b[j];
+        double w  = dt > 0 ? (t - time_b[j]) / dt : 0;
+
+        if(w > 1) w = 1;
+
+        double value_b = values_b[j] + w * (values_b[j + 1] - values_b[j]);
+        double d       = values_a[i] - value_b;
+
+        sum += d;
+        sum_sq += d * d;
+
+        if(fabs(d) > diff->max_abs_diff || diff->n_samples == 0) {
+            diff->max_abs_diff      = fabs(d);
+            diff->max_abs_diff_time = t;
+        }
+
+        diff->n_samples++;
+    }
+
+    if(diff->n_samples == 0) return false;
+
+    diff->mean_diff = sum / diff->n_samples;
+    diff->rms_diff  = sqrt(sum_sq / diff->n_samples);
+
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef __RUN_QUERY_H
+#define __RUN_QUERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Column-major binary copy of a run output, built on demand from the text output and memory-mapped.
+// Layout: magic[8], uint32 version, uint32 n_cols, uint64 n_rows, uint64 source_size, int64 source_mtime_sec,
+// int64 source_mtime_nsec, then n_cols columns of n_rows doubles. The copy is rebuilt when the size or the modification
+// time of the output changes.
+// Column 0 is the time, so it is sorted and is used as the time index of the run.
+#define RUN_COLUMNS_FILE_SUFFIX "_cols"
+#define RUN_COLUMNS_MAGIC "ODECOLS"
+#define RUN_COLUMNS_VERSION 2
+#define RUN_COLUMNS_HEADER_SIZE 48
+
+struct run_columns {
+    void *map;
+    size_t map_size;
+    uint32_t n_cols;
+    uint64_t n_rows;
+    const double *data;
+};
+
+struct window_stats {
+    uint64_t n_samples;
+    double min;
+    double min_time;
+    double max;
+    double max_time;
+    double mean;
+    double std;
+    double integral;
+};
+
+struct crossing {
+    double time;
+    bool upward;
+};
+
+struct run_diff {
+    uint64_t n_samples;
+    double max_abs_diff;
+    double max_abs_diff_time;
+    double mean_diff;
+    double rms_diff;
+};
+
+struct run_columns *open_run_columns(const char *output_file);
+void close_run_columns(struct run_columns *columns);
+
+static inline const double *get_run_column(const struct run_columns *columns, uint32_t col) {
+    return columns->data + (size_t) col * columns->n_rows;
+}
+
+void get_time_window(const struct run_columns *columns, double t0, double t1, uint64_t *begin, uint64_t *end);
+
+void compute_window_stats(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, struct window_stats *stats);
+struct crossing *find_crossings(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, double threshold);
+uint64_t *find_peaks(const struct run_columns *columns, uint32_t col, uint64_t begin, uint64_t end, double threshold);
+bool compute_run_diff(const struct run_columns *a, uint32_t col_a, const struct run_columns *b, uint32_t col_b, struct run_diff *diff);
+
+#endif /* __RUN_QUERY_H */
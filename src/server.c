@@ -0,0 +1,310 @@
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "commands.h"
+#include "pipe_utils.h"
+#include "stb/stb_ds.h"
+#include "string/sds.h"
+#include "string_utils.h"
+
+#define SERVER_POLL_INTERVAL_MS 500
+
+struct client_thread_args {
+    struct shell_variables *shell_state;
+    struct shell_client *client;
+};
+
+static volatile sig_atomic_t stop_server = 0;
+
+static pthread_mutex_t solve_slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t solve_slots_cond  = PTHREAD_COND_INITIALIZER;
+static int free_solve_slots             = 0;
+
+static void stop_server_handler(__attribute__((unused)) int sig) {
+    stop_server = 1;
+}
+
+static void acquire_solve_slot(void) {
+    pthread_mutex_lock(&solve_slots_lock);
+    while(free_solve_slots == 0) {
+        pthread_cond_wait(&solve_slots_cond, &solve_slots_lock);
+    }
+    free_solve_slots--;
+    pthread_mutex_unlock(&solve_slots_lock);
+}
+
+static void release_solve_slot(void) {
+    pthread_mutex_lock(&solve_slots_lock);
+    free_solve_slots++;
+    pthread_cond_signal(&solve_slots_cond);
+    pthread_mutex_unlock(&solve_slots_lock);
+}
+
+static bool write_to_client(int fd, const char *buf, size_t len) {
+
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+
+        buf += n;
+        len -= (size_t) n;
+    }
+
+    return true;
+}
+
+// "solve ... &" is a background job of the shell and does not take a slot
+static bool is_foreground_solve(const char *command) {
+
+    int argc;
+    sds *args  = sdssplitargs(command, &argc);
+    bool solve = args && argc > 1 && STR_EQUALS(args[0], "solve") && args[argc - 1][sdslen(args[argc - 1]) - 1] != '&';
+
+    if(args) sdsfreesplitres(args, argc);
+
+    return solve;
+}
+
+static bool is_loaded_model(struct shell_variables *shell_state, struct model_config *model_config) {
+
+    for(int i = 0; i < shlen(shell_state->loaded_models); i++) {
+        if(shell_state->loaded_models[i].value == model_config) return true;
+    }
+
+    return false;
+}
+
+// Runs a command with the current model of the client. The current model of the shell, used by the clients that did
+// not choose one, is kept unless the command unloaded it
+static bool run_client_command(struct shell_variables *shell_state, struct shell_client *client, sds command) {
+
+    pthread_mutex_lock(&shell_state->lock);
+
+    struct model_config *shell_model = shell_state->current_model;
+
+    if(client->current_model_name) {
+        struct model_config *model_config = shget(shell_state->loaded_models, client->current_model_name);
+        if(model_config) shell_state->current_model = model_config;
+    }
+
+    //the commands print to stdout and stderr, which point to the client while its command runs
+    int saved[2];
+    redirect_output(client->fd, saved);
+
+    shell_state->detach_solves   = true;
+    shell_state->non_interactive = true;
+    bool quit                    = parse_and_execute_command(command, shell_state);
+    shell_state->detach_solves   = false;
+    shell_state->non_interactive = false;
+
+    client->job               = shell_state->detached_job;
+    shell_state->detached_job = NULL;
+
+    restore_output(saved);
+
+    free(client->current_model_name);
+    client->current_model_name = shell_state->current_model ? strdup(shell_state->current_model->model_name) : NULL;
+
+    if(is_loaded_model(shell_state, shell_model)) {
+        shell_state->current_model = shell_model;
+    }
+
+    pthread_mutex_unlock(&shell_state->lock);
+
+    return quit;
+}
+
+static void wait_for_client_job(struct shell_variables *shell_state, struct shell_client *client) {
+
+    struct solve_job *job = client->job;
+    client->job           = NULL;
+
+    join_solve_job(job);
+
+    pthread_mutex_lock(&shell_state->lock);
+
+    int saved[2];
+    redirect_output(client->fd, saved);
+    report_detached_job(job);
+    restore_output(saved);
+
+    pthread_mutex_unlock(&shell_state->lock);
+}
+
+static bool run_client_line(struct shell_variables *shell_state, struct shell_client *client, char *line) {
+
+    int cmd_count = 0;
+    sds *commands = sdssplit(line, ";", &cmd_count);
+    bool quit     = false;
+
+    //executing multiple commands per line separated by ";"
+    for(int i = 0; i < cmd_count && !quit; i++) {
+
+        if(!*commands[i]) continue;
+
+        bool solve = is_foreground_solve(commands[i]);
+
+        if(solve) acquire_solve_slot();
+
+        quit = run_client_command(shell_state, client, commands[i]);
+
+        if(client->job) {
+            wait_for_client_job(shell_state, client);
+        }
+
+        if(solve) release_solve_slot();
+    }
+
+    sdsfreesplitres(commands, cmd_count);
+
+    return quit;
+}
+
+static void *serve_client(void *arg) {
+
+    struct client_thread_args *args     = (struct client_thread_args *) arg;
+    struct shell_variables *shell_state = args->shell_state;
+    struct shell_client *client         = args->client;
+    free(args);
+
+    //the signals that stop the server are handled by the other threads
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    FILE *in      = fdopen(client->fd, "r");
+    char *line    = NULL;
+    size_t cap    = 0;
+    bool quit     = false;
+    bool writable = write_to_client(client->fd, PROMPT, strlen(PROMPT));
+
+    while(writable && !quit && getline(&line, &cap, in) != -1) {
+
+        line[strcspn(line, "\r\n")] = '\0';
+
+        //do not execute commented lines
+        if(line[0] && line[0] != '#') {
+            quit = run_client_line(shell_state, client, line);
+        }
+
+        if(!quit) {
+            writable = write_to_client(client->fd, PROMPT, strlen(PROMPT));
+        }
+    }
+
+    free(line);
+    fclose(in);
+    free(client->current_model_name);
+    free(client);
+
+    return NULL;
+}
+
+// A socket file left by a server that was not stopped is replaced
+static int listen_on_socket(const char *socket_path) {
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family         = AF_UNIX;
+
+    if(strlen(socket_path) >= sizeof(addr.sun_path)) {
+        printf("Error: the socket path %s is too long\n", socket_path);
+        return -1;
+    }
+
+    strcpy(addr.sun_path, socket_path);
+
+    struct stat st;
+    if(stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(fd == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1 || bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+        printf("Error listening on %s: %s\n", socket_path, strerror(errno));
+        if(fd != -1) close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Serves clients until SIGINT or SIGTERM. Returns false if the socket could not be created
+bool run_server(struct shell_variables *shell_state, const char *socket_path) {
+
+    int server_fd = listen_on_socket(socket_path);
+
+    if(server_fd == -1) {
+        return false;
+    }
+
+    int *cpus        = get_usable_cpus();
+    free_solve_slots = arrlen(cpus);
+    arrfree(cpus);
+
+    struct sigaction s = {0};
+    s.sa_handler       = stop_server_handler;
+    sigemptyset(&s.sa_mask);
+    sigaction(SIGINT, &s, NULL);
+    sigaction(SIGTERM, &s, NULL);
+
+    //a client that disconnects in the middle of a reply is not an error of the server
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    struct pollfd listener = {.fd = server_fd, .events = POLLIN};
+
+    while(!stop_server) {
+
+        if(poll(&listener, 1, SERVER_POLL_INTERVAL_MS) <= 0) continue;
+
+        int client_fd = accept(server_fd, NULL, NULL);
+
+        if(client_fd == -1) continue;
+
+        fcntl(client_fd, F_SETFD, FD_CLOEXEC);
+
+        struct shell_client *client = calloc(1, sizeof(struct shell_client));
+        client->fd                  = client_fd;
+
+        struct client_thread_args *args = malloc(sizeof(struct client_thread_args));
+        args->shell_state               = shell_state;
+        args->client                    = client;
+
+        pthread_t thread;
+        if(pthread_create(&thread, NULL, serve_client, args) != 0) {
+            close(client_fd);
+            free(client);
+            free(args);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    close(server_fd);
+    unlink(socket_path);
+
+    printf("Server stopped\n");
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include "ode_shell.h"
+
+// In server mode the shell listens on a Unix domain socket instead of reading the terminal. Each client sends command
+// lines in the language of the shell and gets their output followed by PROMPT. The loaded models, the jobs and the
+// caches are shared by all the clients, but each client has its own current model. Commands run one at a time, as in
+// the shell. The solves of the clients run as jobs, at most one per core, and are waited for without the shell lock, so
+// a client waiting for a solve does not block the others.
+struct shell_client {
+    int fd;
+    char *current_model_name;
+    struct solve_job *job; //solve started by the last command of the client
+};
+
+bool run_server(struct shell_variables *shell_state, const char *socket_path);
+
+#endif /* __SERVER_H */
@@ -0,0 +1,601 @@
+#include "session.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "code_converter.h"
+#include "compiler/module.h"
+#include "file_utils/file_utils.h"
+#include "ode_shell.h"
+#include "run_query.h"
+#include "stb/stb_ds.h"
+#include "string/sds.h"
+
+#define NULL_STRING_LENGTH UINT32_MAX
+
+// Writing
+
+static sds put_u8(sds buf, uint8_t v) {
+    return sdscatlen(buf, &v, sizeof(v));
+}
+
+static sds put_u32(sds buf, uint32_t v) {
+    return sdscatlen(buf, &v, sizeof(v));
+}
+
+static sds put_u64(sds buf, uint64_t v) {
+    return sdscatlen(buf, &v, sizeof(v));
+}
+
+static sds put_double(sds buf, double v) {
+    return sdscatlen(buf, &v, sizeof(v));
+}
+
+static sds put_string(sds buf, const char *s) {
+
+    if(s == NULL) {
+        return put_u32(buf, NULL_STRING_LENGTH);
+    }
+
+    size_t len = strlen(s);
+    buf        = put_u32(buf, (uint32_t) len);
+    return sdscatlen(buf, s, len);
+}
+
+static sds put_run(sds buf, const struct run_info *run_info, uint32_t n_stats) {
+
+    buf = put_string(buf, run_info->filename);
+    buf = put_u8(buf, run_info->saved);
+    buf = put_double(buf, run_info->time);
+    buf = put_u32(buf, run_info->cache_status);
+    buf = put_u64(buf, run_info->num_samples);
+
+    //the statistics are not there when the solver did not write them
+    buf = put_u32(buf, run_info->vars_stats ? n_stats : 0);
+
+    for(uint32_t i = 0; run_info->vars_stats && i < n_stats; i++) {
+        const struct var_stats *s = &run_info->vars_stats[i];
+        buf = put_double(buf, s->min);
+        buf = put_double(buf, s->min_time);
+        buf = put_double(buf, s->max);
+        buf = put_double(buf, s->max_time);
+        buf = put_double(buf, s->mean);
+        buf = put_double(buf, s->variance);
+        buf = put_double(buf, s->integral);
+    }
+
+    const struct solver_stats *solver_stats = run_info->solver_stats;
+    buf                                     = put_u8(buf, solver_stats != NULL);
+
+    if(solver_stats) {
+        buf = put_u32(buf, solver_stats->solver_type);
+        buf = put_u64(buf, solver_stats->rhs_evals);
+        buf = put_u64(buf, solver_stats->accepted_steps);
+        buf = put_u64(buf, solver_stats->rejected_steps);
+        buf = put_u64(buf, solver_stats->lin_solv_setups);
+        buf = put_u64(buf, solver_stats->time_samples);
+        buf = put_double(buf, solver_stats->min_dt);
+        buf = put_double(buf, solver_stats->mean_dt);
+        buf = put_double(buf, solver_stats->max_dt);
+        buf = put_double(buf, solver_stats->rhs_time);
+        buf = put_double(buf, solver_stats->output_time);
+        buf = put_double(buf, solver_stats->total_time);
+    }
+
+    int n_params = arrlen(run_info->params);
+    buf          = put_u32(buf, n_params);
+
+    for(int i = 0; i < n_params; i++) {
+        buf = put_string(buf, run_info->params[i].name);
+        buf = put_double(buf, run_info->params[i].value);
+    }
+
+    return buf;
+}
+
+static sds put_model(sds buf, const struct model_config *model_config) {
+
+    buf = put_string(buf, model_config->model_name);
+    buf = put_string(buf, model_config->model_file);
+    buf = put_u32(buf, model_config->version);
+    buf = put_u8(buf, model_config->is_derived);
+    buf = put_u8(buf, model_config->should_reload);
+    buf = put_u8(buf, model_config->auto_reload);
+    buf = sdscatlen(buf, model_config->hash, sizeof(model_config->hash));
+    buf = sdscatlen(buf, model_config->build_key, sizeof(model_config->build_key));
+    buf = put_u8(buf, model_config->has_build_key);
+
+    buf = put_string(buf, model_config->plot_config.xlabel);
+    buf = put_string(buf, model_config->plot_config.ylabel);
+    buf = put_string(buf, model_config->plot_config.title);
+    buf = put_u32(buf, (uint32_t) model_config->plot_config.xindex);
+    buf = put_u32(buf, (uint32_t) model_config->plot_config.yindex);
+
+    int n_recorded = arrlen(model_config->recorded_vars);
+    buf            = put_u32(buf, n_recorded);
+
+    for(int i = 0; i < n_recorded; i++) {
+        buf = put_string(buf, model_config->recorded_vars[i]);
+    }
+
+    int n_vars = shlen(model_config->var_indexes);
+    buf        = put_u32(buf, n_vars);
+
+    for(int i = 0; i < n_vars; i++) {
+        buf = put_string(buf, model_config->var_indexes[i].key);
+        buf = put_u32(buf, (uint32_t) model_config->var_indexes[i].value);
+    }
+
+    sds encoded = encode_program(sdsempty(), model_config->program);
+    buf         = put_u64(buf, sdslen(encoded));
+    buf         = sdscatsds(buf, encoded);
+    sdsfree(encoded);
+
+    buf = put_u32(buf, model_config->num_runs);
+
+    for(unsigned int r = 0; r < model_config->num_runs; r++) {
+        buf = put_run(buf, &model_config->runs[r], n_vars - 1);
+    }
+
+    return buf;
+}
+
+// Hard links are free, so the outputs are only copied when the session is in another file system
+static bool link_or_copy(const char *from, const char *to) {
+
+    unlink(to);
+
+    if(link(from, to) == 0) {
+        return true;
+    }
+
+    return cp_file(to, from, true) == 0;
+}
+
+static sds get_run_file_in_dir(const char *dir, const char *run_file) {
+    char *file_name = get_file_from_path(run_file);
+    sds path        = sdscatfmt(sdsempty(), "%s/%s", dir, file_name);
+    free(file_name);
+    return path;
+}
+
+// Links the output, statistics and columns of each run from or to dir. Files that do not exist are skipped
+static bool transfer_run_files(struct model_config *model_config, const char *dir, bool to_dir) {
+
+    static const char *suffixes[] = {"", RUN_STATS_FILE_SUFFIX, RUN_COLUMNS_FILE_SUFFIX};
+
+    bool ok = true;
+
+    for(unsigned int r = 1; r <= model_config->num_runs && ok; r++) {
+
+        sds output_file = get_model_output_file(model_config, r);
+
+        for(size_t s = 0; s < sizeof(suffixes) / sizeof(suffixes[0]) && ok; s++) {
+
+            sds run_file    = sdscat(sdsdup(output_file), suffixes[s]);
+            sds in_dir      = get_run_file_in_dir(dir, run_file);
+            const char *src = to_dir ? run_file : in_dir;
+            const char *dst = to_dir ? in_dir : run_file;
+
+            if(file_exists(src)) {
+                ok = link_or_copy(src, dst);
+
+                if(!ok) {
+                    printf("Error copying %s to %s\n", src, dst);
+                }
+            }
+
+            sdsfree(in_dir);
+            sdsfree(run_file);
+        }
+
+        sdsfree(output_file);
+    }
+
+    return ok;
+}
+
+// The outputs of a previous save of the session are removed, so the directory only has the runs of this one
+static bool create_runs_dir(const char *dir) {
+
+    if(mkdir(dir, 0755) != 0 && !file_exists(dir)) {
+        printf("Error creating directory %s\n", dir);
+        return false;
+    }
+
+    DIR *d = opendir(dir);
+
+    if(d == NULL) {
+        printf("Error opening directory %s\n", dir);
+        return false;
+    }
+
+    struct dirent *entry;
+
+    while((entry = readdir(d)) != NULL) {
+        if(entry->d_name[0] == '.') continue;
+
+        sds path = sdscatfmt(sdsempty(), "%s/%s", dir, entry->d_name);
+        unlink(path);
+        sdsfree(path);
+    }
+
+    closedir(d);
+
+    return true;
+}
+
+// The session is written to a temporary file and renamed, so a previous session is only replaced by a complete one
+bool save_session(const char *session_file, struct model_config **models, int n_models, const char *current_model_name) {
+
+    sds runs_dir = sdscat(sdsnew(session_file), SESSION_RUNS_DIR_SUFFIX);
+    bool ok      = create_runs_dir(runs_dir);
+
+    for(int i = 0; i < n_models && ok; i++) {
+        ok = transfer_run_files(models[i], runs_dir, true);
+    }
+
+    sdsfree(runs_dir);
+
+    if(!ok) {
+        return false;
+    }
+
+    sds body = sdsempty();
+    body     = put_string(body, current_model_name);
+    body     = put_u32(body, n_models);
+
+    for(int i = 0; i < n_models; i++) {
+        body = put_model(body, models[i]);
+    }
+
+    sds buf = sdsnewlen(SESSION_MAGIC, 4);
+    buf     = put_u32(buf, SESSION_VERSION);
+    buf     = put_u64(buf, stbds_hash_bytes(body, sdslen(body), 0));
+    buf     = sdscatsds(buf, body);
+
+    sds tmp_file = sdscatprintf(sdsempty(), "%s.%d.tmp", session_file, (int) getpid());
+    FILE *f      = fopen(tmp_file, "wb");
+    ok           = f != NULL;
+
+    if(ok) {
+        ok = fwrite(buf, 1, sdslen(buf), f) == sdslen(buf);
+        ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmp_file, session_file) == 0;
+
+        if(!ok) {
+            unlink(tmp_file);
+        }
+    }
+
+    if(!ok) {
+        printf("Error writing session file %s\n", session_file);
+    }
+
+    sdsfree(tmp_file);
+    sdsfree(buf);
+    sdsfree(body);
+
+    return ok;
+}
+
+// Reading
+
+struct session_reader {
+    const char *pos;
+    const char *end;
+    bool error;
+};
+
+static void get_bytes(struct session_reader *r, void *dst, size_t n) {
+
+    if(r->error || (size_t) (r->end - r->pos) < n) {
+        r->error = true;
+        memset(dst, 0, n);
+        return;
+    }
+
+    memcpy(dst, r->pos, n);
+    r->pos += n;
+}
+
+static uint8_t get_u8(struct session_reader *r) {
+    uint8_t v;
+    get_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+static uint32_t get_u32(struct session_reader *r) {
+    uint32_t v;
+    get_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+static uint64_t get_u64(struct session_reader *r) {
+    uint64_t v;
+    get_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+static double get_double(struct session_reader *r) {
+    double v;
+    get_bytes(r, &v, sizeof(v));
+    return v;
+}
+
+static char *get_string(struct session_reader *r) {
+
+    uint32_t len = get_u32(r);
+
+    if(r->error || len == NULL_STRING_LENGTH) {
+        return NULL;
+    }
+
+    if((size_t) (r->end - r->pos) < len) {
+        r->error = true;
+        return NULL;
+    }
+
+    char *s = strndup(r->pos, len);
+    r->pos += len;
+
+    return s;
+}
+
+// Counts are checked against the remaining bytes before allocating, each element takes at least min_size bytes
+static uint32_t get_count(struct session_reader *r, size_t min_size) {
+
+    uint32_t n = get_u32(r);
+
+    if(!r->error && (uint64_t) n * min_size > (uint64_t) (r->end - r->pos)) {
+        r->error = true;
+    }
+
+    return r->error ? 0 : n;
+}
+
+// The statistics are indexed by variable (see getruninfo), so a run has the statistics of all the variables but t or none
+static void get_run(struct session_reader *r, struct run_info *run_info, uint32_t n_vars_stats) {
+
+    run_info->filename     = get_string(r);
+    run_info->saved        = get_u8(r);
+    run_info->time         = get_double(r);
+    run_info->cache_status = (enum run_cache_status) get_u32(r);
+    run_info->num_samples  = get_u64(r);
+
+    uint32_t n_stats = get_count(r, 7 * sizeof(double));
+
+    if(n_stats > 0 && n_stats != n_vars_stats) {
+        r->error = true;
+        return;
+    }
+
+    if(n_stats > 0) {
+        run_info->vars_stats = (struct var_stats *) malloc(sizeof(struct var_stats) * n_stats);
+
+        for(uint32_t i = 0; i < n_stats; i++) {
+            struct var_stats *s = &run_info->vars_stats[i];
+            s->min              = get_double(r);
+            s->min_time         = get_double(r);
+            s->max              = get_double(r);
+            s->max_time         = get_double(r);
+            s->mean             = get_double(r);
+            s->variance         = get_double(r);
+            s->integral         = get_double(r);
+        }
+    }
+
+    if(get_u8(r) && !r->error) {
+        struct solver_stats *s = (struct solver_stats *) malloc(sizeof(struct solver_stats));
+        s->solver_type         = get_u32(r);
+        s->rhs_evals           = get_u64(r);
+        s->accepted_steps      = get_u64(r);
+        s->rejected_steps      = get_u64(r);
+        s->lin_solv_setups     = get_u64(r);
+        s->time_samples        = get_u64(r);
+        s->min_dt              = get_double(r);
+        s->mean_dt             = get_double(r);
+        s->max_dt              = get_double(r);
+        s->rhs_time            = get_double(r);
+        s->output_time         = get_double(r);
+        s->total_time          = get_double(r);
+        run_info->solver_stats = s;
+    }
+
+    uint32_t n_params = get_count(r, sizeof(uint32_t) + sizeof(double));
+
+    for(uint32_t i = 0; i < n_params && !r->error; i++) {
+        struct run_param param = {0};
+        param.name             = get_string(r);
+        param.value            = get_double(r);
+        arrput(run_info->params, param);
+    }
+}
+
+static struct model_config *get_model(struct session_reader *r) {
+
+    struct model_config *model_config = new_model_config();
+
+    model_config->model_name    = get_string(r);
+    model_config->model_file    = get_string(r);
+    model_config->version       = get_u32(r);
+    model_config->is_derived    = get_u8(r);
+    model_config->should_reload = get_u8(r);
+    model_config->auto_reload   = get_u8(r);
+    get_bytes(r, model_config->hash, sizeof(model_config->hash));
+    get_bytes(r, model_config->build_key, sizeof(model_config->build_key));
+    model_config->has_build_key = get_u8(r);
+
+    model_config->plot_config.xlabel = get_string(r);
+    model_config->plot_config.ylabel = get_string(r);
+    model_config->plot_config.title  = get_string(r);
+    model_config->plot_config.xindex = (int) get_u32(r);
+    model_config->plot_config.yindex = (int) get_u32(r);
+
+    uint32_t n_recorded = get_count(r, sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < n_recorded && !r->error; i++) {
+        arrput(model_config->recorded_vars, get_string(r));
+    }
+
+    sh_new_arena(model_config->var_indexes);
+    shdefault(model_config->var_indexes, -1);
+
+    uint32_t n_vars = get_count(r, 2 * sizeof(uint32_t));
+
+    for(uint32_t i = 0; i < n_vars && !r->error; i++) {
+        char *var_name = get_string(r);
+        uint32_t index = get_u32(r);
+
+        //t is 1 and the variables are 2..n_vars, as their statistics are indexed from them
+        if(index < 1 || index > n_vars) {
+            r->error = true;
+        }
+
+        if(var_name && !r->error) {
+            shput(model_config->var_indexes, var_name, (int) index);
+        }
+
+        free(var_name);
+    }
+
+    uint64_t program_size = get_u64(r);
+
+    if(!r->error && program_size <= (uint64_t) (r->end - r->pos)) {
+        r->error = !decode_program(r->pos, program_size, model_config->model_file, &model_config->program);
+        r->pos += program_size;
+
+        if(!r->error) index_model_symbols(model_config);
+    } else {
+        r->error = true;
+    }
+
+    uint32_t n_runs = get_count(r, 1);
+
+    for(uint32_t i = 0; i < n_runs && !r->error; i++) {
+        struct run_info run_info = {0};
+        get_run(r, &run_info, n_vars > 0 ? n_vars - 1 : 0);
+        arrput(model_config->runs, run_info);
+        model_config->num_runs++;
+    }
+
+    if(model_config->model_name == NULL || model_config->model_file == NULL) {
+        r->error = true;
+    }
+
+    return model_config;
+}
+
+// Used before the outputs of the runs are in place, as their files can belong to another model with the same name
+static void free_runs_keeping_files(struct model_config *model_config) {
+
+    for(unsigned int r = 0; r < model_config->num_runs; r++) {
+        struct run_info *run_info = &model_config->runs[r];
+
+        free(run_info->filename);
+        free(run_info->vars_stats);
+        free(run_info->solver_stats);
+
+        for(int p = 0; p < arrlen(run_info->params); p++) {
+            free(run_info->params[p].name);
+        }
+        arrfree(run_info->params);
+    }
+
+    arrfree(model_config->runs);
+    model_config->num_runs = 0;
+}
+
+// Returns the models of the session, with their executables and the outputs of their runs in place, or NULL on errors
+// or if a model of the session is in loaded_models. The name of the model that was the current one is returned in
+// current_model_name
+struct model_config **load_session(const char *session_file, struct model_hash_entry *loaded_models, char **current_model_name) {
+
+    *current_model_name = NULL;
+
+    size_t size = 0;
+    char *data  = read_entire_file_with_mmap(session_file, &size);
+
+    if(data == NULL || data == MAP_FAILED) {
+        printf("Error: file %s does not exist!\n", session_file);
+        return NULL;
+    }
+
+    struct session_reader r = {.pos = data, .end = data + size};
+
+    char magic[4];
+    get_bytes(&r, magic, sizeof(magic));
+    uint32_t version  = get_u32(&r);
+    uint64_t checksum = get_u64(&r);
+
+    if(r.error || memcmp(magic, SESSION_MAGIC, 4) != 0 || version != SESSION_VERSION ||
+       checksum != stbds_hash_bytes((void *) r.pos, r.end - r.pos, 0)) {
+        printf("Error loading session %s. Invalid or corrupted session file\n", session_file);
+        munmap(data, size);
+        return NULL;
+    }
+
+    struct model_config **models = NULL;
+
+    *current_model_name = get_string(&r);
+    uint32_t n_models   = get_count(&r, 1);
+
+    for(uint32_t i = 0; i < n_models && !r.error; i++) {
+        arrput(models, get_model(&r));
+    }
+
+    munmap(data, size);
+
+    bool restore = false;
+
+    if(r.error || r.pos != r.end) {
+        printf("Error loading session %s. Invalid or corrupted session file\n", session_file);
+    } else {
+        restore = true;
+
+        for(int i = 0; i < arrlen(models) && restore; i++) {
+            if(shgeti(loaded_models, models[i]->model_name) != -1) {
+                printf("Error loading session %s. Model %s is already loaded\n", session_file, models[i]->model_name);
+                restore = false;
+            }
+        }
+    }
+
+    if(!restore) {
+        for(int i = 0; i < arrlen(models); i++) {
+            free_runs_keeping_files(models[i]);
+        }
+    } else {
+        sds runs_dir = sdscat(sdsnew(session_file), SESSION_RUNS_DIR_SUFFIX);
+        bool ok      = true;
+
+        for(int i = 0; i < arrlen(models) && ok; i++) {
+            ok = !restore_model_executable(models[i]) && transfer_run_files(models[i], runs_dir, false);
+
+            if(!ok) {
+                printf("Error restoring model %s\n", models[i]->model_name);
+            }
+        }
+
+        sdsfree(runs_dir);
+
+        if(ok) {
+            return models;
+        }
+    }
+
+    for(int i = 0; i < arrlen(models); i++) {
+        free_model_config(models[i]);
+    }
+
+    arrfree(models);
+    free(*current_model_name);
+    *current_model_name = NULL;
+
+    return NULL;
+}
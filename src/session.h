@@ -0,0 +1,23 @@
+#ifndef __SESSION_H
+#define __SESSION_H
+
+#include "model_config.h"
+
+// A session file has what is needed to bring the loaded models back without parsing, compiling or solving them again:
+// the program (encoded as in the modules, see encode_program), variable indexes, recorded variables, plot settings,
+// version and runs of each model. The outputs of the runs are kept in the SESSION_RUNS_DIR_SUFFIX directory next to
+// the file and are linked back (or copied across file systems) when the session is loaded. The executables are taken
+// from the build cache. The format is:
+//
+//   header: magic "ODS\0", version and the hash of the rest of the file (fixed size, native byte order)
+//   body:   name of the current model and number of models, followed by the models
+#define SESSION_MAGIC "ODS"
+#define SESSION_VERSION 2
+#define SESSION_RUNS_DIR_SUFFIX ".runs"
+
+struct model_hash_entry;
+
+bool save_session(const char *session_file, struct model_config **models, int n_models, const char *current_model_name);
+struct model_config **load_session(const char *session_file, struct model_hash_entry *loaded_models, char **current_model_name);
+
+#endif /* __SESSION_H */
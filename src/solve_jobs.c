@@ -0,0 +1,311 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include "solve_jobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "code_converter.h"
+#include "run_query.h"
+#include "stb/stb_ds.h"
+
+#define MAX_LINE_SIZE 4096
+
+static volatile sig_atomic_t foreground_job_pid  = 0;
+static volatile sig_atomic_t waiting_for_jobs    = 0;
+static volatile sig_atomic_t job_wait_interrupted = 0;
+
+// extra_args (e.g., parameter values) are passed after the output file. When cpu is not negative the child is pinned to it
+struct solve_job *start_solve_job(const char *model_command, double final_time, const char *output_file, char **extra_args, int cpu, bool report_io,
+                                  bool background) {
+
+    int fds[2];
+
+    if(pipe(fds) == -1) {
+        printf("Error creating a pipe to run %s\n", model_command);
+        return NULL;
+    }
+
+    //only the child's copy of the write end should stay open in the processes created later (gnuplot, other jobs)
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    bool show_progress = background || isatty(STDOUT_FILENO);
+
+    char final_time_str[64];
+    snprintf(final_time_str, sizeof(final_time_str), "%lf", final_time);
+
+    char **argv = NULL;
+    arrput(argv, (char *) model_command);
+    arrput(argv, final_time_str);
+    arrput(argv, (char *) output_file);
+    for(int i = 0; i < arrlen(extra_args); i++) {
+        arrput(argv, extra_args[i]);
+    }
+    if(report_io) {
+        arrput(argv, REPORT_IO_FLAG);
+        arrput(argv, SAMPLE_REGIONS_FLAG);
+    }
+    if(show_progress) arrput(argv, PROGRESS_FLAG);
+    arrput(argv, NULL);
+
+    //the outputs can be hard links to the ones of a saved session, so they are replaced instead of overwritten
+    //the columns built from the previous output would be read as the ones of the new run
+    sds stats_file = sdscat(sdsnew(output_file), RUN_STATS_FILE_SUFFIX);
+    sds cols_file  = sdscat(sdsnew(output_file), RUN_COLUMNS_FILE_SUFFIX);
+    unlink(output_file);
+    unlink(stats_file);
+    unlink(cols_file);
+    sdsfree(stats_file);
+    sdsfree(cols_file);
+
+    fflush(stdout);
+
+    pid_t pid = fork();
+
+    if(pid == -1) {
+        printf("Error creating a process to run %s\n", model_command);
+        close(fds[0]);
+        close(fds[1]);
+        arrfree(argv);
+        return NULL;
+    }
+
+    if(pid == 0) {
+        //own process group: Ctrl+C in the terminal reaches the shell, which decides which job to stop
+        setpgid(0, 0);
+#ifdef __linux__
+        if(cpu >= 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+        }
+#else
+        (void) cpu;
+#endif
+        dup2(fds[1], STDOUT_FILENO);
+        execv(model_command, argv);
+        _exit(127);
+    }
+
+    arrfree(argv);
+
+    setpgid(pid, pid);
+    close(fds[1]);
+
+    struct solve_job *job = calloc(1, sizeof(struct solve_job));
+
+    job->pid           = pid;
+    job->from_child    = fds[0];
+    job->background    = background;
+    job->show_progress = show_progress && !background;
+    job->status        = JOB_RUNNING;
+    job->output        = sdsempty();
+    job->final_time    = final_time;
+    job->start_time    = get_wall_time();
+
+    pthread_mutex_init(&job->lock, NULL);
+
+    return job;
+}
+
+static void update_progress(struct solve_job *job, const char *line) {
+
+    double time, final_time;
+    unsigned long long steps;
+
+    if(sscanf(line + strlen(PROGRESS_PREFIX), "%lf %lf %llu", &time, &final_time, &steps) != 3) {
+        return;
+    }
+
+    double now = get_wall_time();
+
+    pthread_mutex_lock(&job->lock);
+    double elapsed = now - job->start_time;
+    if(elapsed > 0) {
+        job->steps_per_second = (double) steps / elapsed;
+    }
+    job->current_time = time;
+    job->steps        = steps;
+    job->elapsed_time = elapsed;
+    pthread_mutex_unlock(&job->lock);
+
+    if(job->show_progress) {
+        printf("\r\033[KSolving: t = %lf of %lf (%.1lf%%), %.0lf steps/s", time, final_time, final_time > 0 ? 100.0 * time / final_time : 0.0,
+               job->steps_per_second);
+        fflush(stdout);
+    }
+}
+
+static void handle_output_line(struct solve_job *job, const char *line) {
+
+    if(strncmp(line, PROGRESS_PREFIX, strlen(PROGRESS_PREFIX)) == 0) {
+        update_progress(job, line);
+        return;
+    }
+
+    if(job->background) {
+        pthread_mutex_lock(&job->lock);
+        job->output = sdscat(job->output, line);
+        pthread_mutex_unlock(&job->lock);
+    } else {
+        if(job->show_progress) printf("\r\033[K");
+        printf("%s", line);
+    }
+}
+
+// Reads the child's output until it exits and sets the final status of the job
+static void *read_solve_job_output(void *arg) {
+
+    struct solve_job *job = (struct solve_job *) arg;
+
+    FILE *fp = fdopen(job->from_child, "r");
+    char line[MAX_LINE_SIZE];
+
+    while(fgets(line, MAX_LINE_SIZE, fp) != NULL) {
+        handle_output_line(job, line);
+    }
+
+    fclose(fp);
+
+    if(job->show_progress) {
+        printf("\r\033[K");
+        fflush(stdout);
+    }
+
+    int st;
+    while(waitpid(job->pid, &st, 0) == -1 && errno == EINTR)
+        ;
+
+    pthread_mutex_lock(&job->lock);
+
+    if(WIFEXITED(st) && WEXITSTATUS(st) == 0) {
+        job->status = JOB_DONE;
+    } else if(WIFEXITED(st) && WEXITSTATUS(st) == SOLVER_INTERRUPTED_EXIT_CODE) {
+        job->status = JOB_CANCELLED;
+    } else {
+        job->status = JOB_FAILED;
+    }
+
+    job->elapsed_time = get_wall_time() - job->start_time;
+    job->finished     = true;
+
+    pthread_mutex_unlock(&job->lock);
+
+    return NULL;
+}
+
+void run_solve_job(struct solve_job *job) {
+
+    if(job->background) {
+        pthread_create(&job->reader, NULL, read_solve_job_output, job);
+        return;
+    }
+
+    foreground_job_pid = job->pid;
+    read_solve_job_output(job);
+    foreground_job_pid = 0;
+}
+
+bool is_solve_job_finished(struct solve_job *job) {
+    pthread_mutex_lock(&job->lock);
+    bool finished = job->finished;
+    pthread_mutex_unlock(&job->lock);
+    return finished;
+}
+
+// The solver stops at the next output point and keeps what was computed so far
+void cancel_solve_job(struct solve_job *job) {
+    if(!is_solve_job_finished(job)) {
+        job->cancel_requested = true;
+        kill(job->pid, SIGINT);
+    }
+}
+
+void join_solve_job(struct solve_job *job) {
+    if(job->background) {
+        pthread_join(job->reader, NULL);
+    }
+}
+
+void free_solve_job(struct solve_job *job) {
+    pthread_mutex_destroy(&job->lock);
+    sdsfree(job->output);
+    free(job);
+}
+
+int *get_usable_cpus(void) {
+
+    int *cpus = NULL;
+
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+
+    if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE && arrlen(cpus) < CPU_COUNT(&cpu_set); cpu++) {
+            if(CPU_ISSET(cpu, &cpu_set)) arrput(cpus, cpu);
+        }
+    }
+#endif
+
+    //without the mask, all the online CPUs
+    if(arrlen(cpus) == 0) {
+        long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for(int cpu = 0; cpu < (n_cpus > 0 ? n_cpus : 1); cpu++) {
+            arrput(cpus, cpu);
+        }
+    }
+
+    return cpus;
+}
+
+const char *get_solve_job_status_name(enum solve_job_status status) {
+    switch(status) {
+        case JOB_RUNNING:
+            return "Running";
+        case JOB_DONE:
+            return "Done";
+        case JOB_CANCELLED:
+            return "Cancelled";
+        case JOB_FAILED:
+            return "Failed";
+    }
+    return "";
+}
+
+// Called from the shell's SIGINT handler. Returns true when the signal was for a job and the shell should carry on
+bool forward_sigint_to_jobs(void) {
+
+    if(foreground_job_pid > 0) {
+        kill(foreground_job_pid, SIGINT);
+        return true;
+    }
+
+    if(waiting_for_jobs) {
+        job_wait_interrupted = 1;
+        return true;
+    }
+
+    return false;
+}
+
+void set_waiting_for_jobs(bool waiting) {
+    job_wait_interrupted = 0;
+    waiting_for_jobs     = waiting;
+}
+
+bool was_job_wait_interrupted(void) {
+    return job_wait_interrupted;
+}
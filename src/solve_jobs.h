@@ -0,0 +1,67 @@
+#ifndef __SOLVE_JOBS_H
+#define __SOLVE_JOBS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "string/sds.h"
+#include "timing.h"
+
+struct model_config;
+
+enum solve_job_status {
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_CANCELLED,
+    JOB_FAILED
+};
+
+// A model executable running as a child process. Its stdout is read line by line: progress lines update the job and
+// everything else is printed (foreground jobs) or kept in output until the job is reported (background jobs)
+struct solve_job {
+    int id;
+    pid_t pid;
+    int from_child;
+    bool background;
+    bool show_progress;
+    bool cancel_requested;
+
+    struct model_config *model_config;
+    unsigned int run_number;
+    bool store_result; //the output is added to the result cache when the job finishes
+    uint8_t result_key[16];
+
+    pthread_t reader;
+    pthread_mutex_t lock;
+    enum solve_job_status status;
+    bool finished;
+    sds output;
+
+    double final_time;
+    double current_time;
+    uint64_t steps;
+    double steps_per_second;
+    double start_time;
+    double elapsed_time;
+};
+
+struct solve_job *start_solve_job(const char *model_command, double final_time, const char *output_file, char **extra_args, int cpu, bool report_io,
+                                  bool background);
+void run_solve_job(struct solve_job *job);
+bool is_solve_job_finished(struct solve_job *job);
+void cancel_solve_job(struct solve_job *job);
+void join_solve_job(struct solve_job *job);
+void free_solve_job(struct solve_job *job);
+const char *get_solve_job_status_name(enum solve_job_status status);
+
+// Returns an stb array with the CPUs the process is allowed to run on (e.g., restricted by taskset or the cpuset of a
+// container), used to size the pools of workers and to pin them
+int *get_usable_cpus(void);
+
+bool forward_sigint_to_jobs(void);
+void set_waiting_for_jobs(bool waiting);
+bool was_job_wait_interrupted(void);
+
+#endif /* __SOLVE_JOBS_H */
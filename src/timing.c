@@ -0,0 +1,195 @@
+#include "timing.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stb/stb_ds.h"
+
+struct trace_event {
+    char *name;
+    double start;
+    double end;
+    int thread;
+};
+
+static volatile bool timing_enabled = false;
+
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct stage_times stage_times;
+
+static char *trace_file_name = NULL;
+static struct trace_event *trace_events;
+static double trace_start;
+
+static int last_thread_number = 0;
+static _Thread_local int thread_number = 0;
+
+static const char *stage_names[N_TIMING_STAGES] = {"parse", "convert to C", "compile", "solve", "plot data", "gnuplot"};
+
+double get_wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+const char *get_timing_stage_name(enum timing_stage stage) {
+    return stage_names[stage];
+}
+
+void set_timing_enabled(bool enabled) {
+    timing_enabled = enabled;
+}
+
+bool is_timing_enabled(void) {
+    return timing_enabled;
+}
+
+double begin_stage(void) {
+    return timing_enabled ? get_wall_time() : 0;
+}
+
+// Threads are numbered in the order they add their first event, so the trace shows the loads and jobs in separate rows
+static int get_thread_number(void) {
+    if(thread_number == 0) {
+        thread_number = __atomic_add_fetch(&last_thread_number, 1, __ATOMIC_RELAXED);
+    }
+    return thread_number;
+}
+
+static void add_trace_event_locked(const char *name, double start, double end) {
+    struct trace_event event = {strdup(name), start, end, get_thread_number()};
+    arrput(trace_events, event);
+}
+
+void add_stage_time(enum timing_stage stage, double start, double end) {
+
+    if(!timing_enabled) return;
+
+    pthread_mutex_lock(&timing_lock);
+
+    stage_times.time[stage] += end - start;
+    stage_times.calls[stage]++;
+
+    if(trace_file_name) {
+        add_trace_event_locked(stage_names[stage], start, end);
+    }
+
+    pthread_mutex_unlock(&timing_lock);
+}
+
+void end_stage(enum timing_stage stage, double start) {
+    if(timing_enabled) {
+        add_stage_time(stage, start, get_wall_time());
+    }
+}
+
+void add_trace_event(const char *name, double start, double end) {
+
+    pthread_mutex_lock(&timing_lock);
+
+    if(trace_file_name) {
+        add_trace_event_locked(name, start, end);
+    }
+
+    pthread_mutex_unlock(&timing_lock);
+}
+
+void take_stage_times(struct stage_times *times) {
+
+    pthread_mutex_lock(&timing_lock);
+
+    *times = stage_times;
+    memset(&stage_times, 0, sizeof(stage_times));
+
+    pthread_mutex_unlock(&timing_lock);
+}
+
+// The events are kept in memory and written by close_trace
+bool open_trace(const char *trace_file) {
+
+    FILE *f = fopen(trace_file, "w");
+
+    if(!f) {
+        return false;
+    }
+
+    fclose(f);
+
+    pthread_mutex_lock(&timing_lock);
+
+    free(trace_file_name);
+    trace_file_name = strdup(trace_file);
+    trace_start     = get_wall_time();
+
+    pthread_mutex_unlock(&timing_lock);
+
+    return true;
+}
+
+// Returns NULL when no trace is open
+const char *get_trace_file(void) {
+    return trace_file_name;
+}
+
+static void write_json_string(FILE *f, const char *s) {
+
+    fputc('"', f);
+
+    for(; *s; s++) {
+        if(*s == '"' || *s == '\\') {
+            fprintf(f, "\\%c", *s);
+        } else if((unsigned char) *s < 0x20) {
+            fprintf(f, "\\u%04x", *s);
+        } else {
+            fputc(*s, f);
+        }
+    }
+
+    fputc('"', f);
+}
+
+// Writes the events as complete ("X") events, with the times in microseconds since the trace was opened
+bool close_trace(void) {
+
+    pthread_mutex_lock(&timing_lock);
+
+    if(!trace_file_name) {
+        pthread_mutex_unlock(&timing_lock);
+        return false;
+    }
+
+    FILE *f   = fopen(trace_file_name, "w");
+    bool done = f != NULL;
+
+    if(f) {
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+        for(int i = 0; i < arrlen(trace_events); i++) {
+            struct trace_event *event = &trace_events[i];
+
+            fprintf(f, "  {\"name\": ");
+            write_json_string(f, event->name);
+            fprintf(f, ", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3lf, \"dur\": %.3lf}%s\n", (int) getpid(), event->thread,
+                    (event->start - trace_start) * 1e6, (event->end - event->start) * 1e6, i < arrlen(trace_events) - 1 ? "," : "");
+        }
+
+        fprintf(f, "]}\n");
+        done = fclose(f) == 0;
+    }
+
+    for(int i = 0; i < arrlen(trace_events); i++) {
+        free(trace_events[i].name);
+    }
+
+    arrfree(trace_events);
+    free(trace_file_name);
+    trace_file_name = NULL;
+
+    pthread_mutex_unlock(&timing_lock);
+
+    return done;
+}
@@ -0,0 +1,43 @@
+#ifndef __TIMING_H
+#define __TIMING_H
+
+#include <stdbool.h>
+
+// Stages of the pipeline, from the model file to the plot. When timing is enabled, the hooks in the shell (and in odec
+// with --time-passes) add the time spent in each stage, measured with a monotonic clock. When a trace is open, each
+// stage (and each command of the shell) is also kept as an event of a Chrome trace (chrome://tracing or Perfetto)
+enum timing_stage {
+    STAGE_PARSE,
+    STAGE_CONVERT,
+    STAGE_COMPILE,
+    STAGE_SOLVE,
+    STAGE_PLOT_DATA,
+    STAGE_GNUPLOT,
+    N_TIMING_STAGES
+};
+
+struct stage_times {
+    double time[N_TIMING_STAGES];
+    unsigned int calls[N_TIMING_STAGES];
+};
+
+double get_wall_time(void);
+const char *get_timing_stage_name(enum timing_stage stage);
+
+void set_timing_enabled(bool enabled);
+bool is_timing_enabled(void);
+
+// Returns the start of a stage, to be given to end_stage
+double begin_stage(void);
+void end_stage(enum timing_stage stage, double start);
+void add_stage_time(enum timing_stage stage, double start, double end);
+void add_trace_event(const char *name, double start, double end);
+
+// Copies the times added since the last call and starts over
+void take_stage_times(struct stage_times *times);
+
+bool open_trace(const char *trace_file);
+const char *get_trace_file(void);
+bool close_trace(void);
+
+#endif /* __TIMING_H */
@@ -5,9 +5,15 @@
 #include <stdlib.h>
 #include <float.h>
 #include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <time.h>
  
 
 #define NEQ 43
+#define NREC 0
+#define NSTATS (NEQ + NREC)
 typedef double real;
 //------------------ Support functions and data ---------------
 
@@ -101,6 +107,325 @@ int ode_get_num_iterations() {
     return __ode_last_iteration__;
 }
 
+#define __OUT_ROW_SIZE__ (NSTATS + 1)
+#define __OUT_BUFFER_ROWS__ (1048576 / (sizeof(real) * __OUT_ROW_SIZE__) + 1)
+
+typedef struct __output_writer__t {
+    FILE *file;
+    real *buffers[2];
+    int n_rows[2];
+    int filling;
+    int pending;
+    bool done;
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t rows_written;
+    uint64_t buffers_written;
+    uint64_t times_blocked;
+    double blocked_time;
+    double write_time;
+    double start_time;
+} __output_writer__;
+
+static __output_writer__ __writer__;
+
+static double __wall_time__(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void __write_rows__(FILE *f, const real *rows, int n_rows) {
+    for(int r = 0; r < n_rows; r++) {
+        const real *row = rows + r * __OUT_ROW_SIZE__;
+        for(int i = 0; i < __OUT_ROW_SIZE__; i++) {
+            fprintf(f, "%lf ", row[i]);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+static void *__output_writer_thread__(void *arg) {
+    __output_writer__ *w = (__output_writer__ *) arg;
+    pthread_mutex_lock(&w->lock);
+    while(1) {
+        while(w->pending == -1 && !w->done) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if(w->pending == -1) break;
+        int b = w->pending;
+        pthread_mutex_unlock(&w->lock);
+        double start = __wall_time__();
+        __write_rows__(w->file, w->buffers[b], w->n_rows[b]);
+        pthread_mutex_lock(&w->lock);
+        w->write_time += __wall_time__() - start;
+        w->n_rows[b] = 0;
+        w->pending = -1;
+        pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void __output_writer_start__(FILE *f) {
+    __output_writer__ *w = &__writer__;
+    memset(w, 0, sizeof(__output_writer__));
+    w->file = f;
+    w->pending = -1;
+    w->buffers[0] = (real *) malloc(sizeof(real) * __OUT_ROW_SIZE__ * __OUT_BUFFER_ROWS__);
+    w->buffers[1] = (real *) malloc(sizeof(real) * __OUT_ROW_SIZE__ * __OUT_BUFFER_ROWS__);
+    w->start_time = __wall_time__();
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    //the regions of the solver are sampled in its own thread (see __start_solver_stats__)
+    sigset_t alarm_set, old_set;
+    sigemptyset(&alarm_set);
+    sigaddset(&alarm_set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alarm_set, &old_set);
+    //if the thread can't be created the rows are written by the solver
+    w->threaded = pthread_create(&w->thread, NULL, __output_writer_thread__, w) == 0;
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+static void __output_flush__(void) {
+    __output_writer__ *w = &__writer__;
+    int b = w->filling;
+    if(w->n_rows[b] == 0) return;
+    w->rows_written += w->n_rows[b];
+    w->buffers_written++;
+    if(!w->threaded) {
+        double start = __wall_time__();
+        __write_rows__(w->file, w->buffers[b], w->n_rows[b]);
+        w->blocked_time += __wall_time__() - start;
+        w->write_time = w->blocked_time;
+        w->n_rows[b] = 0;
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    if(w->pending != -1) {
+        double start = __wall_time__();
+        while(w->pending != -1) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        w->blocked_time += __wall_time__() - start;
+        w->times_blocked++;
+    }
+    w->pending = b;
+    w->filling = 1 - b;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void __output_push_row__(real time, const real *values, const real *recorded) {
+    __output_writer__ *w = &__writer__;
+    real *row = w->buffers[w->filling] + w->n_rows[w->filling] * __OUT_ROW_SIZE__;
+    row[0] = time;
+    for(int i = 0; i < NEQ; i++) {
+        row[i + 1] = values[i];
+    }
+    for(int i = 0; i < NREC; i++) {
+        row[NEQ + 1 + i] = recorded[i];
+    }
+    if(++w->n_rows[w->filling] == (int) __OUT_BUFFER_ROWS__) {
+        __output_flush__();
+    }
+}
+
+static void __output_writer_finish__(bool report_io) {
+    __output_writer__ *w = &__writer__;
+    __output_flush__();
+    if(w->threaded) {
+        pthread_mutex_lock(&w->lock);
+        w->done = true;
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->thread, NULL);
+    }
+    fflush(w->file);
+    if(report_io) {
+        double total_time = __wall_time__() - w->start_time;
+        printf("I/O report: %llu rows in %llu buffers of %d rows (%s writer).\n", (unsigned long long) w->rows_written,
+               (unsigned long long) w->buffers_written, (int) __OUT_BUFFER_ROWS__, w->threaded ? "threaded" : "inline");
+        printf("I/O report: solver blocked on output %llu times for %lf s (%.1lf%% of %lf s). Writer busy for %lf s.\n",
+               (unsigned long long) w->times_blocked, w->blocked_time, total_time > 0 ? 100.0 * w->blocked_time / total_time : 0.0,
+               total_time, w->write_time);
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w->buffers[0]);
+    free(w->buffers[1]);
+}
+
+#define __REGION_SOLVER__ 0
+#define __REGION_RHS__ 1
+#define __REGION_OUTPUT__ 2
+
+typedef struct __solver_stats__t {
+    uint64_t rhs_evals;
+    uint64_t accepted_steps;
+    uint64_t rejected_steps;
+    uint64_t lin_solv_setups;
+    real min_dt;
+    real max_dt;
+    real sum_dt;
+    double start_time;
+    uint64_t samples[3];
+} __solver_stats__;
+
+static __solver_stats__ __solver_stats_values__ = {.min_dt = DBL_MAX};
+static volatile sig_atomic_t __solver_region__ = __REGION_SOLVER__;
+static bool __sample_regions__ = false;
+
+static void __sample_solver_region__(int sig) {
+    (void) sig;
+    __solver_stats_values__.samples[__solver_region__]++;
+}
+
+static void __start_solver_stats__(void) {
+    __solver_stats_values__.start_time = __wall_time__();
+    if(!__sample_regions__) return;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = __sample_solver_region__;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGALRM, &sa, NULL);
+    struct itimerval timer = {{0, 1000}, {0, 1000}};
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+static inline void __count_step_size__(real dt) {
+    if(dt < __solver_stats_values__.min_dt) __solver_stats_values__.min_dt = dt;
+    if(dt > __solver_stats_values__.max_dt) __solver_stats_values__.max_dt = dt;
+}
+
+static void __write_solver_stats__(FILE *stats_file) {
+    if(__sample_regions__) {
+        struct itimerval timer = {{0, 0}, {0, 0}};
+        setitimer(ITIMER_REAL, &timer, NULL);
+    }
+    __solver_stats__ *s = &__solver_stats_values__;
+    double total_time = __wall_time__() - s->start_time;
+    uint64_t n_samples = s->samples[__REGION_SOLVER__] + s->samples[__REGION_RHS__] + s->samples[__REGION_OUTPUT__];
+    double time_per_sample = n_samples > 0 ? total_time / n_samples : 0.0;
+    uint32_t solver_type = 1;
+    double record[11] = {s->rhs_evals, s->accepted_steps, s->rejected_steps,
+                         s->accepted_steps > 0 ? s->min_dt : 0.0, s->accepted_steps > 0 ? s->sum_dt / s->accepted_steps : 0.0, s->max_dt,
+                         s->samples[__REGION_RHS__] * time_per_sample, s->samples[__REGION_OUTPUT__] * time_per_sample, total_time,
+                         s->lin_solv_setups, n_samples};
+    fwrite(&solver_type, sizeof(uint32_t), 1, stats_file);
+    fwrite(record, sizeof(double), 11, stats_file);
+}
+
+//Streaming statistics of each variable. They are written to <output_file>_stats
+typedef struct __run_stats__t {
+    real min;
+    real min_time;
+    real max;
+    real max_time;
+    real mean;
+    real m2;
+    real integral;
+} __run_stats__;
+
+static __run_stats__ __run_stats_values__[NSTATS];
+static real __run_stats_last_values__[NSTATS];
+static real __run_stats_last_time__ = 0.0;
+static uint64_t __run_stats_samples__ = 0;
+
+static void __update_run_stats__(real time, const real *values, const real *recorded) {
+    __run_stats_samples__++;
+    for(int i = 0; i < NSTATS; i++) {
+        __run_stats__ *s = &__run_stats_values__[i];
+        real v = i < NEQ ? values[i] : recorded[i - NEQ];
+        if(__run_stats_samples__ == 1) {
+            s->min = s->max = v;
+            s->min_time = s->max_time = time;
+        } else {
+            if(v < s->min) { s->min = v; s->min_time = time; }
+            if(v > s->max) { s->max = v; s->max_time = time; }
+            s->integral += 0.5 * (v + __run_stats_last_values__[i]) * (time - __run_stats_last_time__);
+        }
+        //Welford's online mean and variance
+        real delta = v - s->mean;
+        s->mean += delta / __run_stats_samples__;
+        s->m2 += delta * (v - s->mean);
+        __run_stats_last_values__[i] = v;
+    }
+    __run_stats_last_time__ = time;
+}
+
+static void __write_run_stats__(const char *file_name) {
+    char *stats_file_name = malloc(strlen(file_name) + strlen("_stats") + 1);
+    sprintf(stats_file_name, "%s_stats", file_name);
+    FILE *stats_file = fopen(stats_file_name, "wb");
+    free(stats_file_name);
+    if(stats_file == NULL) {
+        fprintf(stderr, "Error writing the statistics for %s\n", file_name);
+        return;
+    }
+    uint32_t version = 2;
+    uint32_t n_vars = NSTATS;
+    double final_time = __run_stats_last_time__;
+    fwrite("ODESTATS", 1, 8, stats_file);
+    fwrite(&version, sizeof(uint32_t), 1, stats_file);
+    fwrite(&n_vars, sizeof(uint32_t), 1, stats_file);
+    fwrite(&__run_stats_samples__, sizeof(uint64_t), 1, stats_file);
+    fwrite(&final_time, sizeof(double), 1, stats_file);
+    for(int i = 0; i < NSTATS; i++) {
+        __run_stats__ *s = &__run_stats_values__[i];
+        double record[7] = {s->min, s->min_time, s->max, s->max_time, s->mean,
+                             __run_stats_samples__ > 0 ? s->m2 / __run_stats_samples__ : 0.0, s->integral};
+        fwrite(record, sizeof(double), 7, stats_file);
+    }
+    __write_solver_stats__(stats_file);
+    fclose(stats_file);
+}
+
+static volatile sig_atomic_t __stop_requested__ = 0;
+static bool __progress_enabled__ = false;
+static real __progress_final_time__ = 0.0;
+static double __progress_last_report__ = 0.0;
+
+static void __stop_handler__(int sig) {
+    (void) sig;
+    __stop_requested__ = 1;
+}
+
+static void __report_progress__(real time) {
+    double now = __wall_time__();
+    if(now - __progress_last_report__ >= 0.2) {
+        __progress_last_report__ = now;
+        printf("__progress__ %lf %lf %d\n", time, __progress_final_time__, __ode_last_iteration__);
+        fflush(stdout);
+    }
+}
+
+static void __parse_solver_options__(int argc, char **argv, bool *report_io) {
+    __progress_final_time__ = strtod(argv[1], NULL);
+    for(int i = 3; i < argc; i++) {
+        if(strcmp(argv[i], "--report-io") == 0) {
+            *report_io = true;
+        } else if(strcmp(argv[i], "--progress") == 0) {
+            __progress_enabled__ = true;
+        } else if(strcmp(argv[i], "--sample-regions") == 0) {
+            __sample_regions__ = true;
+        }
+    }
+    signal(SIGINT, __stop_handler__);
+    signal(SIGTERM, __stop_handler__);
+}
+
+static int __solver_exit_code__(real time) {
+    if(__stop_requested__) {
+        printf("Solver interrupted at t = %lf\n", time);
+        return 3;
+    }
+    return 0;
+}
+
 
 real stim(real t, real i_Stim_Start, real i_Stim_End, real i_Stim_Amplitude, real i_Stim_Period, real i_Stim_PulseDuration) {
     if(((t>=i_Stim_Start)&&(t<=i_Stim_End))&&(((t-i_Stim_Start)-(floor(((t-i_Stim_Start)/i_Stim_Period))*i_Stim_Period))<=i_Stim_PulseDuration)) {
@@ -378,7 +703,14 @@ void set_initial_conditions(real *x0, real *values) {
 
 }
 
-static int solve_model(real time, real *sv, real *rDY) {
+static int solve_model(real time, real *sv, real *rDY, real *__rec__) {
+
+    //the evaluations that record the intermediate variables (__rec__ != NULL) are part of the output
+    int __previous_region__ = __solver_region__;
+    if(__rec__ == NULL) {
+        __solver_region__ = __REGION_RHS__;
+        __solver_stats_values__.rhs_evals++;
+    }
 
     //State variables
     const real v =  sv[0];
@@ -856,6 +1188,7 @@ static int solve_model(real time, real *sv, real *rDY) {
     rDY[40] = ((xs2ss-xs2)/txs2);
     rDY[41] = ((Jrel_inf-Jrel_np)/tau_rel);
     rDY[42] = ((Jrel_infp-Jrel_p)/tau_relp);
+    __solver_region__ = __previous_region__;
 
     return 0;  
 
@@ -888,22 +1221,14 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
        dt = final_time - time_new;
     }
 
-    solve_model(time_new, sv, rDY);
+    solve_model(time_new, sv, rDY, NULL);
     time_new += dt;
 
     for(int i = 0; i < NEQ; i++){
         _k1__[i] = rDY[i];
     }
 
-    real min[NEQ];
-    real max[NEQ];
-
-    for(int i = 0; i < NEQ; i++) {
-       min[i] = DBL_MAX;
-       max[i] = DBL_MIN;
-    }
-
-    while(1) {
+    while(!__stop_requested__) {
 
         for(int i = 0; i < NEQ; i++) {
             //stores the old variables in a vector
@@ -915,7 +1240,7 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
         }
 
         time_new += dt;
-        solve_model(time_new, sv, rDY);
+        solve_model(time_new, sv, rDY, NULL);
         time_new -= dt;//step back
 
         double greatestError = 0.0, auxError = 0.0;
@@ -942,6 +1267,7 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
 
         //it doesn't accept the solution
         if ((greatestError >= 1.0f) && dt > 0.00000001) {
+            __solver_stats_values__.rejected_steps++;
             //restore the old values to do it again
             for(int i = 0;  i < NEQ; i++) {
                 sv[i] = edos_old_aux_[i];
@@ -961,11 +1287,11 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
             for(int i = 0; i < NEQ; i++){
                 sv[i] = edos_new_euler_[i];
             }
-            fprintf(f, "%lf ", time_new);
+            __solver_stats_values__.accepted_steps++;
+            __solver_stats_values__.sum_dt += previous_dt;
+            __count_step_size__(previous_dt);
+            __solver_region__ = __REGION_OUTPUT__;
             for(int i = 0; i < NEQ; i++) {
-                fprintf(f, "%lf ", sv[i]);
-                if(sv[i] < min[i]) min[i] = sv[i];
-                if(sv[i] > max[i]) max[i] = sv[i];
                 __exposed_ode_value__ tmp;
                 tmp.time = time_new;
                 tmp.value = sv[i];
@@ -974,7 +1300,10 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
             }
 
             __ode_last_iteration__ += 1;
-            fprintf(f, "\n");
+            __output_push_row__(time_new, sv, NULL);
+            __update_run_stats__(time_new, sv, NULL);
+            if(__progress_enabled__) __report_progress__(time_new);
+            __solver_region__ = __REGION_SOLVER__;
 
             if(time_new + previous_dt >= final_time) {
                 if(final_time == time_new) {
@@ -991,21 +1320,16 @@ void solve_ode(real *sv, float final_time, FILE *f, char *file_name) {
         }
     }
 
-    char *min_max = malloc(strlen(file_name) + 9);
-    sprintf(min_max, "%s_min_max", file_name);
-    FILE* min_max_file = fopen(min_max, "w");
-    for(int i = 0; i < NEQ; i++) {
-        fprintf(min_max_file, "%e;%e\n", min[i], max[i]);
-    }
-    fclose(min_max_file);
-    free(min_max);
-    
+    __write_run_stats__(file_name);
+
     free(_k1__);
     free(_k2__);
 }
 
 
 int main(int argc, char **argv) {
+    bool report_io = false;
+    __parse_solver_options__(argc, argv, &report_io);
 
     real *x0 = (real*) malloc(sizeof(real)*NEQ);
 
@@ -1071,10 +1395,15 @@ int main(int argc, char **argv) {
         fprintf(f, "%lf ", x0[i]);
     }
     fprintf(f, "\n");
+    __update_run_stats__(0.0, x0, NULL);
 
 
+    __output_writer_start__(f);
+    __start_solver_stats__();
     solve_ode(x0, strtod(argv[1], NULL), f, argv[2]);
+    __output_writer_finish__(report_io);
+    fclose(f);
     free(x0);
     
-    return (0);
+    return __solver_exit_code__(__run_stats_last_time__);
 }
\ No newline at end of file
@@ -3,12 +3,15 @@
 ////
 #include "../src/code_converter.h"
 #include "../src/compiler/lexer.h"
+#include "../src/compiler/module.h"
 #include "../src/compiler/parser.h"
 #include "../src/file_utils/file_utils.h"
 #include "../src/stb/stb_ds.h"
 #include <criterion/criterion.h>
 #include <criterion/internal/assert.h>
+#include <pthread.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 program create_parse_program(char *input, bool check_error) {
     lexer *l     = new_lexer(input, "test");
@@ -101,6 +104,135 @@ Test(compiler, ToRORd) {
     munmap(converted, size_converted);
 }
 
+static void *convert_ToRORd(void *arg) {
+
+    size_t file_size;
+    char *source = read_entire_file_with_mmap("ToRORd.ode", &file_size);
+
+    lexer *l        = new_lexer(source, "ToRORd.ode");
+    parser *p       = new_parser(l);
+    program program = parse_program_without_exiting_on_error(p, true, true, NULL);
+
+    char **converted = (char **) arg;
+    size_t converted_size;
+    FILE *outfile = open_memstream(converted, &converted_size);
+
+    if(program) {
+        convert_to_c(program, outfile, EULER_ADPT_SOLVER);
+    }
+
+    fclose(outfile);
+
+    free_lexer(l);
+    free_parser(p);
+    free_program(program);
+    munmap(source, file_size);
+
+    return NULL;
+}
+
+Test(compiler, parallel_conversions) {
+
+    pthread_t threads[4];
+    char *converted[4] = {NULL};
+
+    for(int i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, convert_ToRORd, &converted[i]);
+    }
+
+    for(int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    size_t size_expected;
+    char *expected = read_entire_file_with_mmap("ToRORd.c", &size_expected);
+
+    for(int i = 0; i < 4; i++) {
+        cr_assert_eq(strlen(converted[i]), size_expected);
+        cr_assert_eq(memcmp(converted[i], expected, size_expected), 0);
+        free(converted[i]);
+    }
+
+    munmap(expected, size_expected);
+}
+
+Test(compiler, recorded_vars) {
+
+    char *input  = "a = 2\n"
+                   "flux = a*x\n"
+                   "initial x = 1\n"
+                   "ode x' = -flux\n";
+
+    program prog = create_parse_program(input, true);
+
+    solver_config config = {0};
+    config.solver_type   = EULER_ADPT_SOLVER;
+    arrput(config.recorded_vars, "flux");
+
+    char *code;
+    size_t code_size;
+    FILE *outfile = open_memstream(&code, &code_size);
+    bool error    = convert_to_c_with_config(prog, outfile, &config);
+    fclose(outfile);
+
+    cr_assert(!error);
+    cr_assert(strstr(code, "#define NREC 1") != NULL);
+    cr_assert(strstr(code, "\"#t, x, flux\\n\"") != NULL);
+    cr_assert(strstr(code, "__rec__[0] = flux;") != NULL);
+    free(code);
+
+    config.recorded_vars[0] = "x";
+    outfile = open_memstream(&code, &code_size);
+    error   = convert_to_c_with_config(prog, outfile, &config);
+    fclose(outfile);
+
+    cr_assert(error);
+    free(code);
+
+    arrfree(config.recorded_vars);
+    free_program(prog);
+}
+
+Test(compiler, profile_statements) {
+
+    char *input  = "a = 2\n"
+                   "flux = a*x\n"
+                   "initial x = 1\n"
+                   "ode x' = -flux\n";
+
+    program prog = create_parse_program(input, true);
+
+    solver_config config      = {0};
+    config.solver_type        = EULER_ADPT_SOLVER;
+    config.profile_statements = true;
+
+    char *code;
+    size_t code_size;
+    FILE *outfile = open_memstream(&code, &code_size);
+    bool error    = convert_to_c_with_config(prog, outfile, &config);
+    fclose(outfile);
+
+    cr_assert(!error);
+    cr_assert(strstr(code, "#define __N_PROFILE_STMTS__ 3") != NULL);
+    cr_assert(strstr(code, "__profile_stmt_names__[__N_PROFILE_STMTS__] = {\"a\", \"flux\", \"x'\"};") != NULL);
+    cr_assert(strstr(code, "__profile_stmt__ = 2;") != NULL);
+    cr_assert(strstr(code, "__write_profile__(file_name);") != NULL);
+    free(code);
+
+    //regular builds only have the counters of the solver
+    config.profile_statements = false;
+    outfile = open_memstream(&code, &code_size);
+    error   = convert_to_c_with_config(prog, outfile, &config);
+    fclose(outfile);
+
+    cr_assert(!error);
+    cr_assert(strstr(code, "__profile_stmt__") == NULL);
+    cr_assert(strstr(code, "__write_solver_stats__(stats_file);") != NULL);
+    free(code);
+
+    free_program(prog);
+}
+
 Test(parser, assignment_statement) {
     char *input  = "foo = 1 $kg bar = 2";
 
@@ -347,3 +479,381 @@ Test(parser, call_expression_no_arguments) {
 
     free_program(prog);
 }
+
+Test(program, shared_statements_copy_on_write) {
+    char *input  = "a = 1\nb = 2";
+
+    program prog   = create_parse_program(input, false);
+    program shared = share_program(prog);
+
+    cr_assert_eq(arrlen(shared), 2);
+    cr_assert_eq(shared[0], prog[0]);
+    cr_assert_eq(prog[0]->ref_count, 2);
+
+    ast *a = make_stmt_writable(shared, 0);
+    a->assignment_stmt.value->num_literal.value = 10;
+
+    cr_assert_neq(shared[0], prog[0]);
+    cr_assert_eq(shared[1], prog[1]);
+    cr_assert_eq(prog[0]->ref_count, 1);
+    cr_assert_eq(prog[0]->assignment_stmt.value->num_literal.value, 1);
+    cr_assert_eq(shared[0]->assignment_stmt.value->num_literal.value, 10);
+
+    free_program(prog);
+    cr_assert_eq(shared[1]->ref_count, 1);
+    cr_assert_str_eq(shared[1]->assignment_stmt.name->identifier.value, "b");
+
+    free_program(shared);
+}
+
+Test(program, memory_accounting) {
+    char *input  = "b = 2\na = 1 + b\nfn f(x) { return x * 2 }";
+
+    struct ast_memory_stats before, parsed, copied, freed;
+    get_ast_memory_stats(&before);
+
+    program prog = create_parse_program(input, true);
+    get_ast_memory_stats(&parsed);
+
+    size_t n_nodes = 0, n_bytes = 0;
+    for(int i = 0; i < arrlen(prog); i++) {
+        add_ast_memory(prog[i], &n_nodes, &n_bytes);
+    }
+
+    cr_assert(n_nodes > 0);
+    cr_assert(n_bytes >= n_nodes * sizeof(ast));
+    cr_assert_eq(parsed.heap_nodes, before.heap_nodes);
+    cr_assert(parsed.arena_nodes >= before.arena_nodes + n_nodes);
+
+    program copy = copy_program(prog);
+    get_ast_memory_stats(&copied);
+    cr_assert_eq(copied.heap_nodes, parsed.heap_nodes + n_nodes);
+
+    free_program(copy);
+    get_ast_memory_stats(&freed);
+    cr_assert_eq(freed.heap_nodes, parsed.heap_nodes);
+
+    free_program(prog);
+}
+
+Test(program, statements_outlive_their_parser) {
+    char *input = "fn f(x) {\n    return x*2;\n}\nb = f(3)";
+
+    lexer *l         = new_lexer(input, "test");
+    parser *p        = new_parser(l);
+    program prog     = parse_program(p, false, false, NULL);
+    ast_arena *arena = p->arena;
+
+    free_parser(p);
+    free_lexer(l);
+
+    cr_assert_eq(arrlen(prog), 2);
+    cr_assert_eq(prog[0]->arena, arena);
+    cr_assert_eq(arena->ref_count, 2);
+
+    ast *fn = prog[0];
+    cr_assert_eq(arrlen(fn->function_stmt.parameters), 1);
+    test_identifier(fn->function_stmt.parameters[0], "x");
+    cr_assert_eq(arrlen(fn->function_stmt.body), 1);
+    cr_assert_str_eq(prog[1]->assignment_stmt.name->identifier.value, "b");
+
+    free_program(prog);
+}
+
+Test(lexer, interned_identifiers) {
+    char *input = "ode x' = -y\node y' = x\nz = x + y";
+
+    lexer *l     = new_lexer(input, "test");
+    parser *p    = new_parser(l);
+    program prog = parse_program(p, false, false, NULL);
+
+    free_parser(p);
+    free_lexer(l);
+
+    cr_assert_eq(arrlen(prog), 3);
+
+    ast *x_ode = prog[0]->assignment_stmt.name;
+    ast *y_ode = prog[1]->assignment_stmt.name;
+    ast *x_use = prog[2]->assignment_stmt.value->infix_expr.left;
+
+    cr_assert_neq(x_ode->identifier.symbol, NO_SYMBOL);
+    cr_assert_eq(x_use->identifier.symbol, prog[1]->assignment_stmt.value->identifier.symbol);
+    cr_assert_eq(x_use->identifier.value, symbol_name(x_use->identifier.symbol));
+    cr_assert_eq(get_ode_base_symbol(x_ode->identifier.symbol), x_use->identifier.symbol);
+    cr_assert_neq(x_ode->identifier.symbol, y_ode->identifier.symbol);
+    cr_assert_eq(find_symbol("x'", 2), x_ode->identifier.symbol);
+    cr_assert_eq(find_symbol("not_used_anywhere", 17), NO_SYMBOL);
+
+    free_program(prog);
+}
+
+static program parse_source(const char *source) {
+    lexer *l     = new_lexer(source, "test");
+    parser *p    = new_parser(l);
+    program prog = parse_program_without_exiting_on_error(p, true, true, NULL);
+    free_parser(p);
+    free_lexer(l);
+    return prog;
+}
+
+Test(parser, cached_imports) {
+
+    char import_file[] = "/tmp/odec_import_XXXXXX.ode";
+    int fd             = mkstemps(import_file, 4);
+    FILE *f            = fdopen(fd, "w");
+    fprintf(f, "fn twice(x) {\n    return 2*x\n}\nglobal g = 3\n");
+    fclose(f);
+
+    sds source    = sdscatprintf(sdsempty(), "import \"%s\"\node x' = twice(g)\ninitial x = 1\n", import_file);
+    program prog1 = parse_source(source);
+    program prog2 = parse_source(source);
+
+    cr_assert_not_null(prog1);
+    cr_assert_not_null(prog2);
+    cr_assert_eq(arrlen(prog1), 5);
+    cr_assert_eq(arrlen(prog2), 5);
+
+    //the imported statements are shared between the programs
+    cr_assert_eq(prog1[3]->tag, ast_function_statement);
+    cr_assert_eq(prog1[3], prog2[3]);
+    cr_assert_eq(prog1[4], prog2[4]);
+
+    free_program(prog1);
+    free_program(prog2);
+
+    //a file that changed is parsed again
+    f = fopen(import_file, "a");
+    fprintf(f, "fn thrice(x) {\n    return 3*x\n}\n");
+    fclose(f);
+
+    prog1 = parse_source(source);
+    cr_assert_not_null(prog1);
+    cr_assert_eq(arrlen(prog1), 6);
+    free_program(prog1);
+
+    unlink(import_file);
+    sdsfree(source);
+
+    cr_assert_null(parse_source("import \"/nonexistent/file.ode\"\node x' = 1\ninitial x = 1\n"));
+}
+
+Test(parser, program_diff) {
+
+    char *old_source = "a = 1\n"
+                       "b = 2 * a\n"
+                       "c = 3\n"
+                       "ode x' = b + x\n"
+                       "ode y' = c\n"
+                       "initial x = 0\n"
+                       "initial y = 0\n";
+
+    //a comment and a blank line do not change any statement
+    char *same_source = "# parameters\n"
+                        "a = 1\n"
+                        "b = 2 * a\n"
+                        "\n"
+                        "c = 3\n"
+                        "ode x' = b + x\n"
+                        "ode y' = c\n"
+                        "initial x = 0\n"
+                        "initial y = 0\n";
+
+    char *new_source = "a = 5\n"
+                       "b = 2 * a\n"
+                       "c = 3\n"
+                       "ode x' = b + x\n"
+                       "ode y' = c\n"
+                       "initial x = 0\n"
+                       "initial y = 0\n";
+
+    program old_prog  = parse_source(old_source);
+    program same_prog = parse_source(same_source);
+    program new_prog  = parse_source(new_source);
+
+    struct program_diff diff;
+
+    diff_programs(old_prog, same_prog, &diff);
+    cr_assert_eq(diff.n_changed, 0);
+    cr_assert_eq(diff.n_removed, 0);
+    cr_assert_eq(diff.n_affected, 0);
+    free_program_diff(&diff);
+
+    //a changes, b and x' use it and initial x sets x
+    diff_programs(old_prog, new_prog, &diff);
+    cr_assert_eq(diff.first_changed, 0);
+    cr_assert_eq(diff.n_changed, 1);
+    cr_assert_eq(diff.n_removed, 1);
+    cr_assert_eq(diff.first_line, 1);
+    cr_assert_eq(diff.n_affected, 4);
+    cr_assert(diff.affected[0] && diff.affected[1] && diff.affected[3] && diff.affected[5]);
+    cr_assert(!diff.affected[2] && !diff.affected[4] && !diff.affected[6]);
+    free_program_diff(&diff);
+
+    free_program(old_prog);
+    free_program(same_prog);
+    free_program(new_prog);
+}
+
+Test(parser, precompiled_modules) {
+
+    char import_file[] = "/tmp/odec_module_XXXXXX.ode";
+    int fd             = mkstemps(import_file, 4);
+    FILE *f            = fdopen(fd, "w");
+    fprintf(f, "global g = 3 $mV\n"
+               "fn f(x, y) {\n"
+               "    while(x < y) {\n"
+               "        x = x + 0.5\n"
+               "    }\n"
+               "    if(x > 10 and true) {\n"
+               "        return -x, y\n"
+               "    } elif(x == 0) {\n"
+               "        return 1, 2\n"
+               "    } else {\n"
+               "        return exp(x), g\n"
+               "    }\n"
+               "}\n");
+    fclose(f);
+
+    sds source = sdscatprintf(sdsempty(), "import \"%s\"\n[c, d] = f(1, g)\node x' = c\ninitial x = 1\n", import_file);
+
+    lexer *l         = new_lexer(source, "test");
+    parser *p        = new_parser(l);
+    p->write_modules = true;
+    program prog     = parse_program_without_exiting_on_error(p, true, true, NULL);
+    free_parser(p);
+    free_lexer(l);
+
+    cr_assert_not_null(prog);
+
+    char *path         = realpath(import_file, NULL);
+    sds module_path    = get_module_path(path);
+    size_t source_size = 0;
+    char *lib_source   = read_entire_file_with_mmap(path, &source_size);
+    uint64_t hash      = stbds_hash_bytes(lib_source, source_size, 0);
+
+    cr_assert(file_exists(module_path));
+
+    struct import_entry *entry = read_module(module_path, path, hash, source_size, import_file);
+    cr_assert_not_null(entry);
+    cr_assert_eq(arrlen(entry->statements), 2);
+    cr_assert_eq(arrlen(entry->functions), 1);
+    cr_assert_eq(arrlen(entry->globals), 1);
+    cr_assert_eq(entry->functions[0].value.n_args, 2);
+    cr_assert_eq(entry->functions[0].value.n_returns, 2);
+
+    //the module has the same statements as the source
+    sds *expected = program_to_string(prog);
+    sds *loaded   = program_to_string(entry->statements);
+
+    cr_assert_str_eq(loaded[0], expected[4]);
+    cr_assert_str_eq(loaded[1], expected[5]);
+    cr_assert_eq(entry->statements[1]->function_stmt.name->identifier.symbol, prog[5]->function_stmt.name->identifier.symbol);
+
+    //a module compiled from other contents is not used
+    cr_assert_null(read_module(module_path, path, hash + 1, source_size, import_file));
+
+    //nor a module whose statements do not have the shape of parsed statements
+    ast *fn_name = entry->statements[1]->function_stmt.name;
+    entry->statements[1]->function_stmt.name = NULL;
+    cr_assert(write_module(module_path, entry, source_size));
+    cr_assert_null(read_module(module_path, path, hash, source_size, import_file));
+    entry->statements[1]->function_stmt.name = fn_name;
+
+    ast *global_name = entry->statements[0]->assignment_stmt.name;
+    entry->statements[0]->assignment_stmt.name = entry->statements[0]->assignment_stmt.value;
+    cr_assert(write_module(module_path, entry, source_size));
+    cr_assert_null(read_module(module_path, path, hash, source_size, import_file));
+    entry->statements[0]->assignment_stmt.name = global_name;
+
+    //or that has other statements than the functions and globals of its tables
+    entry->statements[0]->tag = ast_ode_stmt;
+    cr_assert(write_module(module_path, entry, source_size));
+    cr_assert_null(read_module(module_path, path, hash, source_size, import_file));
+    entry->statements[0]->tag = ast_global_stmt;
+
+    for(int i = 0; i < arrlen(expected); i++) sdsfree(expected[i]);
+    for(int i = 0; i < arrlen(loaded); i++) sdsfree(loaded[i]);
+    arrfree(expected);
+    arrfree(loaded);
+
+    release_import_entry(entry);
+    free_program(prog);
+    munmap(lib_source, source_size);
+    unlink(module_path);
+    unlink(import_file);
+    sdsfree(module_path);
+    sdsfree(source);
+    free(path);
+}
+
+Test(parser, encoded_programs) {
+
+    const char *source = "fn f(x) {\n"
+                         "    if(x > 1) {\n"
+                         "        return x*2\n"
+                         "    }\n"
+                         "    return -x\n"
+                         "}\n"
+                         "global g = 2.5\n"
+                         "a = f(g) $mV\n"
+                         "ode y' = a - y\n"
+                         "initial y = 0.125\n";
+
+    lexer *l     = new_lexer(source, "test");
+    parser *p    = new_parser(l);
+    program prog = parse_program_without_exiting_on_error(p, true, true, NULL);
+    free_parser(p);
+    free_lexer(l);
+
+    cr_assert_not_null(prog);
+
+    sds encoded = encode_program(sdsempty(), prog);
+
+    program decoded = NULL;
+    cr_assert(decode_program(encoded, sdslen(encoded), "test", &decoded));
+    cr_assert_eq(arrlen(decoded), arrlen(prog));
+
+    sds *expected = program_to_string(prog);
+    sds *loaded   = program_to_string(decoded);
+
+    for(int i = 0; i < arrlen(expected); i++) {
+        cr_assert_str_eq(loaded[i], expected[i]);
+        cr_assert_eq(decoded[i]->token.line_number, prog[i]->token.line_number);
+    }
+
+    //a truncated program is not decoded
+    program truncated = NULL;
+    cr_assert_not(decode_program(encoded, sdslen(encoded) - 1, "test", &truncated));
+    cr_assert_null(truncated);
+
+    //counts whose sum wraps (2^64-1 strings and 1 statement) are rejected before reading the strings
+    const char wrapping[] = {'\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\xff', '\x01', '\x01', 'a', 'b', 'c'};
+    cr_assert_not(decode_program(wrapping, sizeof(wrapping), "test", &truncated));
+    cr_assert_null(truncated);
+
+    //nor a program whose statements do not have the shape of parsed statements
+    ast *name = prog[2]->assignment_stmt.name;
+    prog[2]->assignment_stmt.name = NULL;
+    sds invalid = encode_program(sdsempty(), prog);
+    prog[2]->assignment_stmt.name = name;
+    cr_assert_not(decode_program(invalid, sdslen(invalid), "test", &truncated));
+    cr_assert_null(truncated);
+    sdsfree(invalid);
+
+    program bare_call = NULL;
+    arrput(bare_call, prog[2]->assignment_stmt.value);
+    invalid = encode_program(sdsempty(), bare_call);
+    cr_assert_not(decode_program(invalid, sdslen(invalid), "test", &truncated));
+    cr_assert_null(truncated);
+    sdsfree(invalid);
+    arrfree(bare_call);
+
+    for(int i = 0; i < arrlen(expected); i++) sdsfree(expected[i]);
+    for(int i = 0; i < arrlen(loaded); i++) sdsfree(loaded[i]);
+    arrfree(expected);
+    arrfree(loaded);
+
+    free_program(decoded);
+    free_program(prog);
+    sdsfree(encoded);
+}